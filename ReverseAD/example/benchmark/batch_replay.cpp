@@ -0,0 +1,81 @@
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <iostream>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+// Function values at many points: one CompiledTrace::evaluate per point
+// against BatchReplay evaluating blocks of points together, with one and
+// with several threads.
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::CompiledTrace;
+using ReverseAD::BatchReplay;
+using ReverseAD::get_timing;
+
+std::shared_ptr<TrivialTrace<double>> foo(size_t n, double* x) {
+  adouble* ax = new adouble[n];
+  adouble ay = 0;
+  double y;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    ax[i] <<= x[i];
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    ay += 100 * (ax[i + 1] - ax[i] * ax[i]) * (ax[i + 1] - ax[i] * ax[i])
+          + (ax[i] - 1) * (ax[i] - 1);
+    ay += ax[i] * ax[i + 1] / (ax[i] * ax[i] + 1.0);
+  }
+  ay >>= y;
+  delete[] ax;
+  return ReverseAD::trace_off<double>();
+}
+
+int main(int argc, char* argv[]) {
+  size_t n = (argc > 1 ? atoi(argv[1]) : 1000);
+  size_t num_points = (argc > 2 ? atoi(argv[2]) : 2000);
+  size_t num_threads = (argc > 3 ? atoi(argv[3]) : 4);
+  std::vector<double> x(num_points * n);
+  for (size_t p = 0; p < num_points; p++) {
+    for (size_t i = 0; i < n; i++) {
+      x[p * n + i] = cos(i + 0.01 * p);
+    }
+  }
+  std::shared_ptr<TrivialTrace<double>> trace = foo(n, &x[0]);
+  std::vector<double> y_single(num_points);
+  std::vector<double> y_batch(num_points);
+
+  CompiledTrace<double> compiled(trace);
+  get_timing();
+  for (size_t p = 0; p < num_points; p++) {
+    compiled.evaluate(&x[p * n], &y_single[p]);
+  }
+  double t_single = get_timing();
+
+  BatchReplay<double> batch(trace);
+  get_timing();
+  batch.evaluate(&x[0], n, &y_batch[0], 1, num_points);
+  double t_batch = get_timing();
+
+  batch.set_num_threads(num_threads);
+  get_timing();
+  batch.evaluate(&x[0], n, &y_batch[0], 1, num_points);
+  double t_threads = get_timing();
+
+  double diff = 0.0;
+  for (size_t p = 0; p < num_points; p++) {
+    diff = std::max(diff, fabs(y_single[p] - y_batch[p]));
+  }
+  std::cout << "n = " << n << ", " << num_points << " points" << std::endl;
+  std::cout << "CompiledTrace::evaluate per point : " << t_single << " s"
+            << std::endl;
+  std::cout << "BatchReplay                       : " << t_batch << " s"
+            << std::endl;
+  std::cout << "BatchReplay, " << num_threads << " threads            : "
+            << t_threads << " s" << std::endl;
+  std::cout << "max difference                    : " << diff << std::endl;
+  return 0;
+}
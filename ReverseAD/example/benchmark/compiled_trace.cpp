@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <iostream>
+
+#include "reversead/reversead.hpp"
+
+// Repeated gradient evaluations: replay the trace at a new point and run
+// BaseReverseAdjoint, against forward() and reverse() on a CompiledTrace.
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::CompiledTrace;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::get_timing;
+
+std::shared_ptr<TrivialTrace<double>> foo(size_t n, double* x) {
+  adouble* ax = new adouble[n];
+  adouble ay = 0;
+  double y;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    ax[i] <<= x[i];
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    ay += 100 * (ax[i + 1] - ax[i] * ax[i]) * (ax[i + 1] - ax[i] * ax[i])
+          + (ax[i] - 1) * (ax[i] - 1);
+    ay += sin(ax[i]) * cos(ax[i + 1]) + exp(ax[i] / n);
+  }
+  ay >>= y;
+  delete[] ax;
+  return ReverseAD::trace_off<double>();
+}
+
+int main(int argc, char* argv[]) {
+  size_t n = (argc > 1 ? atoi(argv[1]) : 1000);
+  size_t rounds = (argc > 2 ? atoi(argv[2]) : 20);
+  double* x = new double[n];
+  double* g = new double[n];
+  double* cg = new double[n];
+  for (size_t i = 0; i < n; i++) {
+    x[i] = cos(i);
+  }
+  std::shared_ptr<TrivialTrace<double>> trace = foo(n, x);
+
+  get_timing();
+  double y;
+  for (size_t k = 0; k < rounds; k++) {
+    x[k % n] += 0.01;
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        BaseFunctionReplay::replay_ind<double>(trace, &y, 1, x, n);
+    BaseReverseAdjoint<double> adjoint(new_trace);
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+        adjoint.compute(n, 1);
+    size_t size;
+    size_t** tind;
+    double* values;
+    tensor->get_internal_coordinate_list(0, 1, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      g[tind[l][0]] = values[l];
+    }
+  }
+  double t_trace = get_timing();
+
+  CompiledTrace<double> compiled(trace);
+  double t_compile = get_timing();
+
+  double cy;
+  double w = 1.0;
+  for (size_t k = 0; k < rounds; k++) {
+    x[k % n] -= 0.01;
+  }
+  for (size_t k = 0; k < rounds; k++) {
+    x[k % n] += 0.01;
+    compiled.forward(x, &cy);
+    compiled.reverse(&w, cg);
+  }
+  double t_compiled = get_timing();
+
+  double error = fabs(y - cy);
+  for (size_t i = 0; i < n; i++) {
+    error = std::max(error, fabs(g[i] - cg[i]));
+  }
+  std::cout << "n = " << n << ", " << rounds << " gradients, "
+            << compiled.get_size() << " instructions" << std::endl;
+  std::cout << "replay + BaseReverseAdjoint : " << t_trace << " s"
+            << std::endl;
+  std::cout << "CompiledTrace compile       : " << t_compile << " s"
+            << std::endl;
+  std::cout << "CompiledTrace sweeps        : " << t_compiled << " s"
+            << std::endl;
+  std::cout << "max difference              : " << error << std::endl;
+
+  delete[] x;
+  delete[] g;
+  delete[] cg;
+  return 0;
+}
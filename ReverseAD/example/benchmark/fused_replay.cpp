@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <iostream>
+
+#include "reversead/reversead.hpp"
+
+// Hessians at a sequence of points: replay_ind into a new trace followed by
+// BaseReverseHessian on it, against the fused compute(x, ...) that keeps
+// the values in the slots of a CompiledTrace.
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::CompiledTrace;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::get_timing;
+
+std::shared_ptr<TrivialTrace<double>> foo(size_t n, double* x) {
+  adouble* ax = new adouble[n];
+  adouble ay = 0;
+  double y;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    ax[i] <<= x[i];
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    ay += 100 * (ax[i + 1] - ax[i] * ax[i]) * (ax[i + 1] - ax[i] * ax[i])
+          + (ax[i] - 1) * (ax[i] - 1);
+    ay += sin(ax[i]) * cos(ax[i + 1]);
+  }
+  ay >>= y;
+  delete[] ax;
+  return ReverseAD::trace_off<double>();
+}
+
+double sum_hessian(std::shared_ptr<DerivativeTensor<size_t, double>> tensor) {
+  size_t size;
+  size_t** tind;
+  double* values;
+  tensor->get_internal_coordinate_list(0, 2, &size, &tind, &values);
+  double ret = 0.0;
+  for (size_t l = 0; l < size; l++) {
+    ret += values[l];
+  }
+  return ret;
+}
+
+int main(int argc, char* argv[]) {
+  size_t n = (argc > 1 ? atoi(argv[1]) : 1000);
+  size_t rounds = (argc > 2 ? atoi(argv[2]) : 20);
+  double* x = new double[n];
+  for (size_t i = 0; i < n; i++) {
+    x[i] = cos(i);
+  }
+  std::shared_ptr<TrivialTrace<double>> trace = foo(n, x);
+
+  get_timing();
+  double y;
+  double s_replay = 0.0;
+  for (size_t k = 0; k < rounds; k++) {
+    x[k % n] += 0.01;
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        BaseFunctionReplay::replay_ind<double>(trace, &y, 1, x, n);
+    BaseReverseHessian<double> hessian(new_trace);
+    s_replay += sum_hessian(hessian.compute(n, 1));
+  }
+  double t_replay = get_timing();
+
+  for (size_t k = 0; k < rounds; k++) {
+    x[k % n] -= 0.01;
+  }
+  get_timing();
+  double s_fused = 0.0;
+  BaseReverseHessian<double> hessian(trace);
+  for (size_t k = 0; k < rounds; k++) {
+    x[k % n] += 0.01;
+    s_fused += sum_hessian(hessian.compute(x, n, 1));
+  }
+  double t_fused = get_timing();
+
+  std::cout << "n = " << n << ", " << rounds << " hessians" << std::endl;
+  std::cout << "replay_ind + BaseReverseHessian : " << t_replay << " s"
+            << std::endl;
+  std::cout << "fused compute(x, ...)           : " << t_fused << " s"
+            << std::endl;
+  std::cout << "difference                      : "
+            << fabs(s_replay - s_fused) << std::endl;
+
+  // what each point costs in memory : replay_ind writes a trace that the
+  // sweep reads back, the fused sweep reads the instructions and slots
+  std::cout << "replay_ind per point            : ";
+  BaseFunctionReplay::replay_ind<double>(trace, &y, 1, x, n)->dump_trace_info();
+  CompiledTrace<double> compiled(trace);
+  std::cout << "fused per point                 : "
+            << compiled.get_size() << " instructions, "
+            << compiled.get_num_slot() + 1 << " slots ("
+            << compiled.get_size()
+               * sizeof(CompiledTrace<double>::Instruction)
+               + (compiled.get_num_slot() + 1) * sizeof(double)
+            << " bytes)" << std::endl;
+
+  delete[] x;
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <iostream>
+
+#include "reversead/reversead.hpp"
+
+// Hessian-vector products for a truncated Newton step: K products by
+// forming the sparse Hessian (BaseReverseHessian) and multiplying, against
+// K single direction passes and one MultiForward<K> pass.
+
+#define K 8
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::get_timing;
+
+// chained Rosenbrock with a coupling term
+std::shared_ptr<TrivialTrace<double>> foo(size_t n, double* x) {
+  adouble* ax = new adouble[n];
+  adouble ay = 0;
+  adouble s = 0;
+  double y;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    ax[i] <<= x[i];
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    ay += 100 * (ax[i + 1] - ax[i] * ax[i]) * (ax[i + 1] - ax[i] * ax[i])
+          + (ax[i] - 1) * (ax[i] - 1);
+    s += sin(ax[i]);
+  }
+  ay += s * s / n;
+  ay >>= y;
+  delete[] ax;
+  return ReverseAD::trace_off<double>();
+}
+
+int main(int argc, char* argv[]) {
+  size_t n = (argc > 1 ? atoi(argv[1]) : 200);
+  double* x = new double[n];
+  double** v = new double*[n];
+  double** hv = new double*[1];
+  double*** hv_k = new double**[1];
+  hv[0] = new double[n];
+  hv_k[0] = new double*[n];
+  for (size_t i = 0; i < n; i++) {
+    x[i] = cos(i);
+    v[i] = new double[K];
+    hv_k[0][i] = new double[K];
+    for (size_t k = 0; k < K; k++) {
+      v[i][k] = sin(i + k);
+    }
+  }
+  std::shared_ptr<TrivialTrace<double>> trace = foo(n, x);
+
+  get_timing();
+  BaseReverseHessian<double> hessian(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      hessian.compute(n, 1);
+  size_t size;
+  size_t** tind;
+  double* values;
+  tensor->get_internal_coordinate_list(0, 2, &size, &tind, &values);
+  double* full = new double[n * K];
+  for (size_t i = 0; i < n * K; i++) {full[i] = 0.0;}
+  for (size_t l = 0; l < size; l++) {
+    size_t i = tind[l][0];
+    size_t j = tind[l][1];
+    for (size_t k = 0; k < K; k++) {
+      full[i * K + k] += values[l] * v[j][k];
+      if (i != j) {
+        full[j * K + k] += values[l] * v[i][k];
+      }
+    }
+  }
+  double t_full = get_timing();
+
+  double* direction = new double[n];
+  double error = 0.0;
+  for (size_t k = 0; k < K; k++) {
+    for (size_t i = 0; i < n; i++) {direction[i] = v[i][k];}
+    ReverseAD::forward_over_reverse(trace, n, 1, x, direction, hv);
+    for (size_t i = 0; i < n; i++) {
+      error = std::max(error, fabs(hv[0][i] - full[i * K + k]));
+    }
+  }
+  double t_single = get_timing();
+
+  ReverseAD::forward_over_reverse<K>(trace, n, 1, x, v, hv_k);
+  for (size_t i = 0; i < n; i++) {
+    for (size_t k = 0; k < K; k++) {
+      error = std::max(error, fabs(hv_k[0][i][k] - full[i * K + k]));
+    }
+  }
+  double t_multi = get_timing();
+
+  std::cout << "n = " << n << ", " << K << " directions, "
+            << "hessian nnz = " << size << std::endl;
+  std::cout << "full hessian + product  : " << t_full << " s" << std::endl;
+  std::cout << "SingleForward x " << K << "      : " << t_single << " s"
+            << std::endl;
+  std::cout << "MultiForward<" << K << ">        : " << t_multi << " s"
+            << std::endl;
+  std::cout << "max difference          : " << error << std::endl;
+
+  for (size_t i = 0; i < n; i++) {
+    delete[] v[i];
+    delete[] hv_k[0][i];
+  }
+  delete[] hv[0];
+  delete[] hv_k[0];
+  delete[] hv;
+  delete[] hv_k;
+  delete[] v;
+  delete[] x;
+  delete[] full;
+  delete[] direction;
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <iostream>
+
+#include "reversead/reversead.hpp"
+
+// Time of BaseReverseGeneric as the number of variables doubles. The trace
+// length and the number of nonzeros both grow linearly in n, so the time
+// per variable should stay flat; it grew linearly when every slice of the
+// adjoint scanned all stored derivatives.
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseGeneric;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::get_timing;
+
+std::shared_ptr<TrivialTrace<double>> foo(size_t n) {
+  adouble* x = new adouble[n];
+  adouble y = 0;
+  double vy;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    x[i] <<= 0.5 + 0.5 * cos(i);
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    y += exp(0.1 * x[i] * x[i + 1]) + sin(x[i]) / (x[i + 1] + 2.0);
+  }
+  y >>= vy;
+  delete[] x;
+  return ReverseAD::trace_off<double>();
+}
+
+int main(int argc, char* argv[]) {
+  size_t order = (argc > 1 ? atoi(argv[1]) : 4);
+  size_t max_n = (argc > 2 ? atoi(argv[2]) : 3200);
+  std::cout << "order = " << order << std::endl;
+  for (size_t n = 100; n <= max_n; n *= 2) {
+    std::shared_ptr<TrivialTrace<double>> trace = foo(n);
+    BaseReverseGeneric<double> generic(trace, order);
+    get_timing();
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+        generic.compute(n, 1);
+    double t = get_timing();
+    std::cout << "n = " << n << " : " << t << " s, "
+              << t / n * 1e6 << " us per variable" << std::endl;
+  }
+  return 0;
+}
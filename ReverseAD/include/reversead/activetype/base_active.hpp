@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include "reversead/common/reversead_core.hpp"
 #include "reversead/common/opcodes.hpp"
 
@@ -13,6 +14,13 @@
 namespace ReverseAD {
 
 class CheckpointTrace;
+class IterativeFuncBase;
+template <typename Base, typename Region> class CheckpointRegion;
+template <typename Base> class BaseActive;
+template <typename Base> class ExternalFunction;
+template <typename Base>
+void call_external(const std::shared_ptr<ExternalFunction<Base>>& func,
+                   BaseActive<Base>* x, BaseActive<Base>* y);
 
 template <typename Base>
 class BaseActive {
@@ -56,6 +64,11 @@ class BaseActive {
   locint loc;
 
   friend class CheckpointTrace;
+  friend class IterativeFuncBase;
+  template <typename B, typename R> friend class CheckpointRegion;
+  template <typename B> friend void call_external(
+      const std::shared_ptr<ExternalFunction<B>>& func,
+      BaseActive<B>* x, BaseActive<B>* y);
 
   friend std::ostream& operator << (std::ostream& os, BaseActive& obj) {
     os << obj.val;
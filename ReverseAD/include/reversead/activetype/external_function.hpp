@@ -0,0 +1,109 @@
+#ifndef REVERSEAD_EXTERNAL_FUNCTION_H_
+#define REVERSEAD_EXTERNAL_FUNCTION_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "reversead/activetype/base_active.hpp"
+#include "reversead/common/reversead_core.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// y = f(x) with a fixed number of inputs and outputs, evaluated and
+// differentiated by user code (e.g. a linear solve) instead of being traced
+// SAC by SAC. The reverse engines call
+//   adjoint : x_adj = J^T * y_adj
+//   hessian : hess = sum_j w[j] * (d^2 y[j] / d x^2), x_num * x_num, dense
+// at the input values recorded on the trace.
+template <typename Base>
+class ExternalFunction {
+ public:
+  typedef std::function<void(const Base* x, size_t x_num,
+                             Base* y, size_t y_num)> Primal;
+  typedef std::function<void(const Base* x, size_t x_num,
+                             const Base* y_adj, size_t y_num,
+                             Base* x_adj)> Adjoint;
+  typedef std::function<void(const Base* x, size_t x_num,
+                             const Base* w, size_t y_num,
+                             Base* hess)> Hessian;
+
+  ExternalFunction(size_t x_num, size_t y_num,
+                   const Primal& primal,
+                   const Adjoint& adjoint,
+                   const Hessian& hessian = nullptr)
+      : x_num(x_num), y_num(y_num),
+        primal(primal), adjoint(adjoint), hessian(hessian) {}
+
+  size_t get_x_num() const {return x_num;}
+  size_t get_y_num() const {return y_num;}
+  bool has_hessian() const {return (bool)hessian;}
+
+  void eval_primal(const Base* x, Base* y) const {
+    primal(x, x_num, y, y_num);
+  }
+  void eval_adjoint(const Base* x, const Base* y_adj, Base* x_adj) const {
+    adjoint(x, x_num, y_adj, y_num, x_adj);
+  }
+  void eval_hessian(const Base* x, const Base* w, Base* hess) const {
+    hessian(x, x_num, w, y_num, hess);
+  }
+
+ private:
+  size_t x_num;
+  size_t y_num;
+  Primal primal;
+  Adjoint adjoint;
+  Hessian hessian;
+};
+
+// One call of an ExternalFunction read back from a trace.
+template <typename Base>
+struct ExternalCall {
+  const ExternalFunction<Base>* func;
+  std::vector<locint> x;
+  std::vector<locint> y;
+  std::vector<Base> vx;
+};
+
+// y = func(x), y gets new locations. Only an ext_func op, the locations and
+// the input values are put on the trace:
+//   loc : id, x[0 .. x_num), y[0 .. y_num), id    val : vx[0 .. x_num)
+template <typename Base>
+void call_external(const std::shared_ptr<ExternalFunction<Base>>& func,
+                   BaseActive<Base>* x, BaseActive<Base>* y) {
+  size_t x_num = func->get_x_num();
+  size_t y_num = func->get_y_num();
+  std::vector<Base> vx(x_num);
+  std::vector<Base> vy(y_num, Base(0.0));
+  for (size_t i = 0; i < x_num; i++) {
+    vx[i] = x[i].val;
+  }
+  func->eval_primal(vx.data(), vy.data());
+  for (size_t j = 0; j < y_num; j++) {
+    y[j].val = vy[j];
+    y[j].loc = get_next_loc();
+  }
+  TrivialTrace<Base>* trace = (TrivialTrace<Base>*)global_trace;
+  if (trace == nullptr) {
+    return;
+  }
+  locint id = trace->add_ext_func(func);
+  trace->put_op(ext_func);
+  trace->put_loc(id);
+  for (size_t i = 0; i < x_num; i++) {
+    trace->put_loc(x[i].loc);
+    trace->put_val(vx[i]);
+  }
+  for (size_t j = 0; j < y_num; j++) {
+    trace->put_loc(y[j].loc);
+  }
+  trace->put_loc(id);
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_EXTERNAL_FUNCTION_H_
@@ -8,6 +8,7 @@
 
 #define REVERSEAD_MAX_GENERIC_ORDER 10
 #define REVERSEAD_MAX_TENSOR_ORDER 6
+#define REVERSEAD_PREACC_BLOCK_SIZE 1024
 
 namespace ReverseAD {
 
@@ -0,0 +1,290 @@
+#ifndef REVERSEAD_BASE_COMPRESSED_DERIVATIVE_H_
+#define REVERSEAD_BASE_COMPRESSED_DERIVATIVE_H_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/forwardtype/multi_forward.hpp"
+#include "reversead/algorithm/base_function_replay.hpp"
+#include "reversead/algorithm/base_reverse_adjoint.hpp"
+#include "reversead/algorithm/base_sparsity_pattern.hpp"
+#include "reversead/algorithm/derivative_tensor.hpp"
+#include "reversead/algorithm/graph_coloring.hpp"
+#include "reversead/algorithm/sparsity_pattern.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// Sparse Jacobian and Hessian by compression. The columns are colored
+// (distance-2 for the Jacobian, star coloring for the Hessian) and every
+// color becomes one direction of MultiForward<DIM>, so each replay of the
+// trace carries DIM colors. The Jacobian is forward mode, the Hessian is
+// forward over reverse (BaseReverseAdjoint<MultiForward<DIM>>).
+// Patterns and colorings are computed once and reused for every point.
+// A trace that can not be replayed in MultiForward (external functions)
+// gives nullptr.
+template <size_t DIM>
+class BaseCompressedDerivative {
+ public:
+  BaseCompressedDerivative(const std::shared_ptr<TrivialTrace<double>>& trace)
+      : trace(trace) {}
+
+  // order 1 tensor
+  std::shared_ptr<DerivativeTensor<size_t, double>> compute_jacobian(
+      const double* const ind_val, size_t ind_num, size_t dep_num);
+
+  // order 2 tensor, the gradient of each dependent is stored as order 1
+  std::shared_ptr<DerivativeTensor<size_t, double>> compute_hessian(
+      const double* const ind_val, size_t ind_num, size_t dep_num);
+
+  size_t get_jacobian_colors() const {return jacobian_colors;}
+  size_t get_hessian_colors() const {return hessian_colors;}
+
+ private:
+  typedef MultiForward<DIM> SeedType;
+
+  void init_jacobian(size_t ind_num, size_t dep_num);
+  void init_hessian(size_t ind_num, size_t dep_num);
+
+  // replays the trace with the colors [base, base + DIM) seeded
+  std::shared_ptr<TrivialTrace<SeedType>> replay_batch(
+      const double* const ind_val, size_t ind_num,
+      const std::vector<size_t>& color, size_t base,
+      std::vector<SeedType>& dep_val) const;
+
+  std::shared_ptr<TrivialTrace<double>> trace;
+
+  std::shared_ptr<SparsityPattern> jacobian;
+  std::vector<size_t> jacobian_color;
+  size_t jacobian_colors = 0;
+
+  // hessian entry (row, col) is read from row src of the compressed
+  // Hessian in the direction color
+  struct Recovery {
+    size_t row, col, src, color;
+  };
+  std::shared_ptr<SparsityPattern> hessian;
+  // the Hessian pattern is ind_num x ind_num, it is the union over the
+  // dependents so their number is kept with it
+  size_t hessian_dep_num = 0;
+  std::vector<size_t> hessian_color;
+  size_t hessian_colors = 0;
+  std::vector<Recovery> recovery;
+};
+
+template <size_t DIM>
+void BaseCompressedDerivative<DIM>::init_jacobian(size_t ind_num,
+                                                  size_t dep_num) {
+  if (jacobian != nullptr && jacobian->get_row_size() == dep_num &&
+      jacobian->get_col_size() == ind_num) {
+    return;
+  }
+  BaseSparsityPattern<double> pattern(trace);
+  jacobian = pattern.jacobian_pattern(ind_num, dep_num);
+  jacobian_colors = jacobian_column_coloring(*jacobian, jacobian_color);
+}
+
+template <size_t DIM>
+void BaseCompressedDerivative<DIM>::init_hessian(size_t ind_num,
+                                                 size_t dep_num) {
+  if (hessian != nullptr && hessian->get_row_size() == ind_num &&
+      hessian_dep_num == dep_num) {
+    return;
+  }
+  BaseSparsityPattern<double> pattern(trace);
+  hessian = pattern.hessian_pattern(ind_num, dep_num);
+  hessian_dep_num = dep_num;
+  std::vector<std::vector<size_t>> adjacency;
+  hessian_adjacency(*hessian, adjacency);
+  hessian_colors = hessian_star_coloring(adjacency, hessian_color);
+
+  // number of neighbors of v colored c
+  auto color_count = [&](size_t v, size_t c) {
+    size_t count = 0;
+    for (const size_t& w : adjacency[v]) {
+      if (hessian_color[w] == c) {
+        count++;
+      }
+    }
+    return count;
+  };
+  recovery.clear();
+  for (size_t i = 0; i < ind_num; i++) {
+    for (const size_t& j : hessian->get_row(i)) {
+      if (i == j) {
+        recovery.push_back({i, j, i, hessian_color[i]});
+      } else if (color_count(i, hessian_color[j]) == 1) {
+        recovery.push_back({i, j, i, hessian_color[j]});
+      } else if (color_count(j, hessian_color[i]) == 1) {
+        recovery.push_back({i, j, j, hessian_color[i]});
+      } else {
+        warning_CompressionConflict(i, j);
+      }
+    }
+  }
+  std::stable_sort(recovery.begin(), recovery.end(),
+                   [](const Recovery& a, const Recovery& b) {
+                     return a.color / DIM < b.color / DIM;
+                   });
+}
+
+template <size_t DIM>
+std::shared_ptr<TrivialTrace<MultiForward<DIM>>>
+    BaseCompressedDerivative<DIM>::replay_batch(
+        const double* const ind_val, size_t ind_num,
+        const std::vector<size_t>& color, size_t base,
+        std::vector<SeedType>& dep_val) const {
+  std::vector<SeedType> x;
+  x.reserve(ind_num);
+  double der[DIM];
+  for (size_t i = 0; i < ind_num; i++) {
+    std::fill(der, der + DIM, 0.0);
+    if (color[i] >= base && color[i] < base + DIM) {
+      der[color[i] - base] = 1.0;
+    }
+    x.push_back(SeedType(ind_val[i], der));
+  }
+  return BaseFunctionReplay::replay_forward<double, SeedType>(
+      trace, dep_val.data(), dep_val.size(), x.data(), ind_num);
+}
+
+template <size_t DIM>
+std::shared_ptr<DerivativeTensor<size_t, double>>
+    BaseCompressedDerivative<DIM>::compute_jacobian(
+        const double* const ind_val, size_t ind_num, size_t dep_num) {
+  init_jacobian(ind_num, dep_num);
+  std::vector<std::vector<double>> values(dep_num);
+  for (size_t i = 0; i < dep_num; i++) {
+    values[i].resize(jacobian->get_row(i).size());
+  }
+  std::vector<SeedType> dep_val(dep_num);
+  // at least one pass for the dependent values
+  size_t base = 0;
+  do {
+    if (!replay_batch(ind_val, ind_num, jacobian_color, base, dep_val)) {
+      return nullptr;
+    }
+    for (size_t i = 0; i < dep_num; i++) {
+      const std::vector<size_t>& row = jacobian->get_row(i);
+      for (size_t l = 0; l < row.size(); l++) {
+        size_t c = jacobian_color[row[l]];
+        if (c >= base && c < base + DIM) {
+          values[i][l] = dep_val[i].getDer(c - base);
+        }
+      }
+    }
+    base += DIM;
+  } while (base < jacobian_colors);
+
+  std::shared_ptr<DerivativeTensor<size_t, double>> ret =
+      std::make_shared<DerivativeTensor<size_t, double>>(dep_num, ind_num, 1);
+  size_t x[1];
+  for (size_t i = 0; i < dep_num; i++) {
+    ret->put_dep_value(i, dep_val[i].getVal());
+    const std::vector<size_t>& row = jacobian->get_row(i);
+    size_t size = 0;
+    for (const double& v : values[i]) {
+      if (!IsZero(v)) {size++;}
+    }
+    ret->init_single_tensor(i, 1, size);
+    size_t l = 0;
+    for (size_t k = 0; k < row.size(); k++) {
+      if (!IsZero(values[i][k])) {
+        x[0] = row[k];
+        ret->put_value(i, 1, l++, x, values[i][k]);
+      }
+    }
+  }
+  return ret;
+}
+
+template <size_t DIM>
+std::shared_ptr<DerivativeTensor<size_t, double>>
+    BaseCompressedDerivative<DIM>::compute_hessian(
+        const double* const ind_val, size_t ind_num, size_t dep_num) {
+  init_hessian(ind_num, dep_num);
+  std::vector<SeedType> dep_val(dep_num);
+  std::vector<std::vector<double>> gradient(
+      dep_num, std::vector<double>(ind_num, 0.0));
+  std::vector<std::vector<double>> values(
+      dep_num, std::vector<double>(recovery.size(), 0.0));
+  // one dense block of the compressed Hessian: ind_num x DIM
+  std::vector<double> block(ind_num * DIM);
+  size_t next = 0;
+  size_t base = 0;
+  do {
+    std::shared_ptr<TrivialTrace<SeedType>> new_trace =
+        replay_batch(ind_val, ind_num, hessian_color, base, dep_val);
+    if (!new_trace) {
+      return nullptr;
+    }
+    BaseReverseAdjoint<SeedType> adjoint(new_trace);
+    std::shared_ptr<DerivativeTensor<size_t, SeedType>> tensor =
+        adjoint.compute(ind_num, dep_num);
+    size_t last = next;
+    while (last < recovery.size() && recovery[last].color < base + DIM) {
+      last++;
+    }
+    for (size_t i = 0; i < dep_num; i++) {
+      size_t size = 0;
+      size_t** tind = nullptr;
+      SeedType* adj = nullptr;
+      tensor->get_internal_coordinate_list(i, 1, &size, &tind, &adj);
+      std::fill(block.begin(), block.end(), 0.0);
+      for (size_t l = 0; l < size; l++) {
+        if (base == 0) {
+          gradient[i][tind[l][0]] = adj[l].getVal();
+        }
+        for (size_t k = 0; k < DIM; k++) {
+          block[tind[l][0] * DIM + k] = adj[l].getDer(k);
+        }
+      }
+      for (size_t l = next; l < last; l++) {
+        values[i][l] =
+            block[recovery[l].src * DIM + recovery[l].color - base];
+      }
+    }
+    next = last;
+    base += DIM;
+  } while (base < hessian_colors);
+
+  std::shared_ptr<DerivativeTensor<size_t, double>> ret =
+      std::make_shared<DerivativeTensor<size_t, double>>(dep_num, ind_num, 2);
+  size_t x[2];
+  for (size_t i = 0; i < dep_num; i++) {
+    ret->put_dep_value(i, dep_val[i].getVal());
+    size_t size = 0;
+    for (const double& v : gradient[i]) {
+      if (!IsZero(v)) {size++;}
+    }
+    ret->init_single_tensor(i, 1, size);
+    size_t l = 0;
+    for (size_t k = 0; k < ind_num; k++) {
+      if (!IsZero(gradient[i][k])) {
+        x[0] = k;
+        ret->put_value(i, 1, l++, x, gradient[i][k]);
+      }
+    }
+    size = 0;
+    for (const double& v : values[i]) {
+      if (!IsZero(v)) {size++;}
+    }
+    ret->init_single_tensor(i, 2, size);
+    l = 0;
+    for (size_t k = 0; k < recovery.size(); k++) {
+      if (!IsZero(values[i][k])) {
+        x[0] = recovery[k].row;
+        x[1] = recovery[k].col;
+        ret->put_value(i, 2, l++, x, values[i][k]);
+      }
+    }
+  }
+  return ret;
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_BASE_COMPRESSED_DERIVATIVE_H_
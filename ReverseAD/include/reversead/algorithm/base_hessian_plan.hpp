@@ -0,0 +1,617 @@
+#ifndef REVERSEAD_BASE_HESSIAN_PLAN_H_
+#define REVERSEAD_BASE_HESSIAN_PLAN_H_
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/algorithm/algorithm_common.hpp"
+#include "reversead/algorithm/base_reverse_mode.hpp"
+#include "reversead/algorithm/derivative_info.hpp"
+#include "reversead/algorithm/derivative_tensor.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// Same derivatives as BaseReverseAdjoint (order 1) / BaseReverseHessian
+// (order 2), split into a symbolic and a numeric phase.
+// The first compute() follows the live set algorithm once, structurally,
+// over the slots of a CompiledTrace and records every update as (kind, src,
+// dst) on slots of a flat value array, a slot is recycled once its entry
+// leaves the live set. Later compute() calls (e.g. after reset_trace() with
+// a trace from BaseFunctionReplay::replay_ind) evaluate the CompiledTrace
+// at the independents of the new trace (or at the given point) and only
+// execute the recorded updates, no live sets and no maps. The tensor holds
+// every entry of the plan (also those that are zero at the point) and is
+// filled in place when the last one returned is no longer referenced.
+// Dependent weights (set_dep_weight) may change between calls, but must
+// already be set before the plan is built.
+template <typename Base>
+class BaseHessianPlan : public BaseReverseMode<Base> {
+ public:
+  using BaseReverseMode<Base>::trace;
+  using BaseReverseMode<Base>::reverse_live;
+  using BaseReverseMode<Base>::indep_index_map;
+
+  BaseHessianPlan() = default;
+  BaseHessianPlan(const std::shared_ptr<TrivialTrace<Base>>& trace,
+                  size_t order = 2)
+      : BaseReverseMode<Base>(trace), order(order) {
+    if (order != 1 && order != 2) {
+      warning_UnsupportedOrder("BaseHessianPlan", order);
+      this->order = 2;
+    }
+  }
+
+  // keeps the plan, only the per compute() states are cleared
+  void clear() override;
+
+  // drops the plan, the next compute() builds a new one
+  void reset_plan();
+
+  bool is_built() const {return built;}
+  size_t get_plan_size() const {return ops.size();}
+  size_t get_num_slots() const {return values.size();}
+
+ protected:
+  void init_dep_deriv(locint dep) override;
+
+  void process_sac(const DerivativeInfo<locint, Base>& info) override;
+
+  void reverse_local_computation(size_t ind_num, size_t dep_num) override;
+  void reverse_compiled_computation(size_t ind_num, size_t dep_num) override;
+
+  std::shared_ptr<DerivativeTensor<size_t, Base>> get_tensor() const override;
+
+ private:
+  enum {
+    kDx = 0,
+    kDy,
+    kTwoDx,
+    kTwoDy,
+    kDxDx,
+    kDxDy,
+    kDyDy,
+    kPxx,
+    kPxy,
+    kPyy,
+    kNumKinds
+  };
+
+  enum {
+    kNonlinearXX = 1,
+    kNonlinearXY = 2,
+    kNonlinearYY = 4
+  };
+
+  struct PlanOp {
+    int kind;
+    size_t src;
+    size_t dst;
+  };
+
+  // the num-th entry of keys[key] (at ind) is values[slot]
+  struct OutputEntry {
+    size_t key;
+    size_t num;
+    size_t ind[2];
+    size_t slot;
+  };
+
+  // symbolic phase
+  void build_sac(const DerivativeInfo<locint, Base>& info);
+  void emit(int kind, size_t src, size_t dst);
+  size_t new_slot();
+  void free_slot(size_t slot);
+  size_t adjoint_slot(locint key, locint x);
+  size_t hessian_slot(locint key, locint x, locint y);
+  void finish_plan();
+  static int nonlinear_kind(const DerivativeInfo<locint, Base>& info);
+
+  // numeric phase
+  void numeric_computation(const CompiledTrace<Base>& code,
+                           size_t ind_num, size_t dep_num);
+  // the ops of the k-th SAC, then its freed slots are zeroed
+  void run_sac(size_t k, const DerivativeInfo<locint, Base>& info);
+
+  size_t order = 2;
+  bool built = false;
+
+  std::vector<PlanOp> ops;
+  // ops of the k-th process_sac call are [sac_begin[k], sac_begin[k+1]),
+  // the slots it frees [clear_begin[k], clear_begin[k+1]) of clears
+  std::vector<size_t> sac_begin;
+  std::vector<size_t> clears;
+  std::vector<size_t> clear_begin;
+  // the k-th init_dep_deriv call adds the weight of dependent init_dep[k]
+  // to init_slot[k] before the init_sac[k]-th SAC
+  std::vector<size_t> init_slot;
+  std::vector<size_t> init_sac;
+  std::vector<size_t> init_dep;
+  std::vector<OutputEntry> adjoint_output;
+  std::vector<OutputEntry> hessian_output;
+  std::vector<locint> keys;
+  // dependent index of keys[k], entry_size[k * order + t - 1] entries of
+  // order t
+  std::vector<size_t> key_dep;
+  std::vector<size_t> entry_size;
+  size_t ind_size = 0;
+  // the trace the plan was built on, evaluated again for every compute()
+  std::shared_ptr<CompiledTrace<Base>> plan_code;
+
+  // numeric phase
+  std::vector<Base> values;
+  std::vector<Base> dep_val;
+  std::vector<Base> ind_buf;
+  std::vector<Base> param_buf;
+  // the last tensor returned and its value arrays, by key and order
+  mutable std::shared_ptr<DerivativeTensor<size_t, Base>> tensor;
+  mutable std::vector<Base*> tensor_values;
+  size_t sac_count = 0;
+
+  // only alive while building
+  std::map<locint, std::map<locint, size_t>> adjoint_slots;
+  std::map<locint, std::map<locint, std::map<locint, size_t>>> hessian_slots;
+  std::vector<size_t> free_slots;
+};
+
+template <typename Base>
+void BaseHessianPlan<Base>::clear() {
+  BaseReverseMode<Base>::clear();
+  std::fill(values.begin(), values.end(), Base(0.0));
+  sac_count = 0;
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::reset_plan() {
+  clear();
+  built = false;
+  ops.clear();
+  sac_begin.clear();
+  clears.clear();
+  clear_begin.clear();
+  init_slot.clear();
+  init_sac.clear();
+  init_dep.clear();
+  adjoint_output.clear();
+  hessian_output.clear();
+  keys.clear();
+  key_dep.clear();
+  entry_size.clear();
+  ind_size = 0;
+  plan_code.reset();
+  values.clear();
+  dep_val.clear();
+  tensor.reset();
+  tensor_values.clear();
+  adjoint_slots.clear();
+  hessian_slots.clear();
+  free_slots.clear();
+}
+
+template <typename Base>
+size_t BaseHessianPlan<Base>::new_slot() {
+  if (!free_slots.empty()) {
+    size_t slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+  }
+  values.push_back(Base(0.0));
+  return values.size() - 1;
+}
+
+// the slot is zeroed and reused after the ops of the current SAC
+template <typename Base>
+void BaseHessianPlan<Base>::free_slot(size_t slot) {
+  clears.push_back(slot);
+}
+
+template <typename Base>
+size_t BaseHessianPlan<Base>::adjoint_slot(locint key, locint x) {
+  std::map<locint, size_t>& slots = adjoint_slots[key];
+  typename std::map<locint, size_t>::iterator iter = slots.find(x);
+  if (iter == slots.end()) {
+    iter = slots.insert(std::make_pair(x, new_slot())).first;
+  }
+  return iter->second;
+}
+
+template <typename Base>
+size_t BaseHessianPlan<Base>::hessian_slot(locint key, locint x, locint y) {
+  if (x < y) {
+    std::swap(x, y);
+  }
+  std::map<locint, size_t>& slots = hessian_slots[key][x];
+  typename std::map<locint, size_t>::iterator iter = slots.find(y);
+  if (iter == slots.end()) {
+    iter = slots.insert(std::make_pair(y, new_slot())).first;
+  }
+  return iter->second;
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::emit(int kind, size_t src, size_t dst) {
+  ops.push_back({kind, src, dst});
+}
+
+template <typename Base>
+int BaseHessianPlan<Base>::nonlinear_kind(
+    const DerivativeInfo<locint, Base>& info) {
+  switch (info.opcode) {
+    case eq_mult_a:
+    case mult_a_a:
+      return (info.y != NULL_LOC ? kNonlinearXY : kNonlinearXX);
+    case eq_div_a:
+    case div_a_a:
+      return (info.y != NULL_LOC ? kNonlinearXY | kNonlinearYY : kNonlinearXX);
+    case pow_a_a:
+      return (info.y != NULL_LOC ?
+              kNonlinearXX | kNonlinearXY | kNonlinearYY : kNonlinearXX);
+    case div_d_a:
+    case sin_a:
+    case cos_a:
+    case asin_a:
+    case acos_a:
+    case atan_a:
+    case sqrt_a:
+    case exp_a:
+    case log_a:
+    case pow_a_d:
+    case pow_d_a:
+    case erf_a:
+      return kNonlinearXX;
+    default:
+      return 0;
+  }
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::init_dep_deriv(locint dep) {
+  locint key = this->get_dep_key(dep);
+  if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+    keys.push_back(key);
+  }
+  size_t slot = adjoint_slot(key, dep);
+  init_slot.push_back(slot);
+  init_sac.push_back(sac_count);
+  init_dep.push_back(this->dep_index_map.find(dep)->second);
+  values[slot] += this->get_dep_weight(dep);
+  reverse_live[dep].insert(key);
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::process_sac(
+    const DerivativeInfo<locint, Base>& info) {
+  if (built) {
+    warning_PlanInconsistent(sac_count);
+    return;
+  }
+  sac_begin.push_back(ops.size());
+  clear_begin.push_back(clears.size());
+  build_sac(info);
+  run_sac(sac_count, info);
+  // reusable from the next SAC on
+  free_slots.insert(free_slots.end(), clears.begin() + clear_begin.back(),
+                    clears.end());
+  sac_count++;
+  if (info.opcode == start_of_tape) {
+    finish_plan();
+  }
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::run_sac(
+    size_t k, const DerivativeInfo<locint, Base>& info) {
+  size_t begin = sac_begin[k];
+  size_t end = (k + 1 < sac_begin.size() ? sac_begin[k + 1] : ops.size());
+  if (begin != end) {
+    Base c[kNumKinds];
+    c[kDx] = info.dx;
+    c[kDy] = info.dy;
+    c[kTwoDx] = 2.0 * info.dx;
+    c[kTwoDy] = 2.0 * info.dy;
+    c[kDxDx] = info.dx * info.dx;
+    c[kDxDy] = info.dx * info.dy;
+    c[kDyDy] = info.dy * info.dy;
+    c[kPxx] = info.pxx;
+    c[kPxy] = info.pxy;
+    c[kPyy] = info.pyy;
+    for (size_t l = begin; l < end; l++) {
+      const PlanOp& op = ops[l];
+      values[op.dst] += c[op.kind] * values[op.src];
+    }
+  }
+  end = (k + 1 < clear_begin.size() ? clear_begin[k + 1] : clears.size());
+  for (size_t l = clear_begin[k]; l < end; l++) {
+    values[clears[l]] = 0.0;
+  }
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::build_sac(
+    const DerivativeInfo<locint, Base>& info) {
+  if (info.r == NULL_LOC) {
+    return;
+  }
+  std::set<locint> dep_set = std::move(reverse_live[info.r]);
+  reverse_live.erase(info.r);
+  int nonlinear = nonlinear_kind(info);
+  for (const locint& key : dep_set) {
+    // w = adjoint(r), erased
+    bool has_w = false;
+    size_t w = 0;
+    std::map<locint, size_t>& a_slots = adjoint_slots[key];
+    typename std::map<locint, size_t>::iterator a_iter = a_slots.find(info.r);
+    if (a_iter != a_slots.end()) {
+      has_w = true;
+      w = a_iter->second;
+      a_slots.erase(a_iter);
+      free_slot(w);
+    }
+    // row of r in the hessian, erased
+    std::map<locint, size_t> row;
+    if (order > 1) {
+      std::map<locint, std::map<locint, size_t>>& h_slots = hessian_slots[key];
+      typename std::map<locint, std::map<locint, size_t>>::iterator h_iter =
+          h_slots.find(info.r);
+      if (h_iter != h_slots.end()) {
+        row = std::move(h_iter->second);
+        h_slots.erase(h_iter);
+        for (const auto& kv : row) {
+          free_slot(kv.second);
+        }
+      }
+    }
+    if (has_w) {
+      if (info.x != NULL_LOC) {
+        emit(kDx, w, adjoint_slot(key, info.x));
+      }
+      if (info.y != NULL_LOC) {
+        emit(kDy, w, adjoint_slot(key, info.y));
+      }
+    }
+    for (const auto& kv : row) {
+      locint p = kv.first;
+      size_t pw = kv.second;
+      if (info.y != NULL_LOC) {
+        if (p != info.r) {
+          if (p == info.x) {
+            emit(kTwoDx, pw, hessian_slot(key, p, p));
+          } else {
+            emit(kDx, pw, hessian_slot(key, info.x, p));
+          }
+          if (p == info.y) {
+            emit(kTwoDy, pw, hessian_slot(key, p, p));
+          } else {
+            emit(kDy, pw, hessian_slot(key, info.y, p));
+          }
+        } else {
+          emit(kDxDx, pw, hessian_slot(key, info.x, info.x));
+          emit(kDxDy, pw, hessian_slot(key, info.x, info.y));
+          emit(kDyDy, pw, hessian_slot(key, info.y, info.y));
+        }
+      } else if (info.x != NULL_LOC) {
+        if (p != info.r) {
+          if (p == info.x) {
+            emit(kTwoDx, pw, hessian_slot(key, p, p));
+          } else {
+            emit(kDx, pw, hessian_slot(key, info.x, p));
+          }
+        } else {
+          emit(kDxDx, pw, hessian_slot(key, info.x, info.x));
+        }
+      }
+    }
+    if (has_w && order > 1) {
+      if (nonlinear & kNonlinearXX) {
+        emit(kPxx, w, hessian_slot(key, info.x, info.x));
+      }
+      if (nonlinear & kNonlinearYY) {
+        emit(kPyy, w, hessian_slot(key, info.y, info.y));
+      }
+      if (nonlinear & kNonlinearXY) {
+        emit(kPxy, w, hessian_slot(key, info.x, info.y));
+      }
+    }
+    if (info.x != NULL_LOC) {
+      reverse_live[info.x].insert(key);
+    }
+    if (info.y != NULL_LOC) {
+      reverse_live[info.y].insert(key);
+    }
+  }
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::finish_plan() {
+  // the k-th call runs [sac_begin[k], sac_begin[k+1])
+  sac_begin.push_back(ops.size());
+  clear_begin.push_back(clears.size());
+  plan_code = this->compiled;
+  ind_size = indep_index_map.size();
+  key_dep.resize(keys.size());
+  entry_size.assign(keys.size() * order, 0);
+  for (size_t k = 0; k < keys.size(); k++) {
+    locint key = keys[k];
+    key_dep[k] = this->get_dep_index(key);
+    for (const auto& kv : adjoint_slots[key]) {
+      typename std::map<locint, size_t>::const_iterator x =
+          indep_index_map.find(kv.first);
+      if (x != indep_index_map.end()) {
+        adjoint_output.push_back(
+            {k, entry_size[k * order]++, {x->second, 0}, kv.second});
+      }
+    }
+    if (order < 2) {
+      continue;
+    }
+    for (const auto& row : hessian_slots[key]) {
+      typename std::map<locint, size_t>::const_iterator x =
+          indep_index_map.find(row.first);
+      if (x == indep_index_map.end()) {
+        continue;
+      }
+      for (const auto& kv : row.second) {
+        typename std::map<locint, size_t>::const_iterator y =
+            indep_index_map.find(kv.first);
+        if (y != indep_index_map.end()) {
+          hessian_output.push_back({k, entry_size[k * order + 1]++,
+                                    {x->second, y->second}, kv.second});
+        }
+      }
+    }
+  }
+  const std::vector<Base>& value = plan_code->get_value();
+  const std::vector<locint>& dep_slot = plan_code->get_dep_slot();
+  dep_val.resize(dep_slot.size());
+  for (size_t d = 0; d < dep_slot.size(); d++) {
+    dep_val[d] = value[dep_slot[d]];
+  }
+  adjoint_slots.clear();
+  hessian_slots.clear();
+  free_slots.clear();
+  reverse_live.clear();
+  built = true;
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::reverse_local_computation(size_t ind_num,
+                                                      size_t dep_num) {
+  if (!trace) {
+    warning_NoTraceSet();
+    return;
+  }
+  if (built) {
+    plan_code->read_inputs(trace, ind_buf, param_buf);
+    plan_code->evaluate(ind_buf.data(), param_buf.data(), nullptr);
+    numeric_computation(*plan_code, ind_num, dep_num);
+    return;
+  }
+  // the plan is built over the slots of the trace at its recorded values
+  this->compiled = std::make_shared<CompiledTrace<Base>>(trace);
+  this->compiled->evaluate(this->compiled->get_ind_value().data(), nullptr);
+  BaseReverseMode<Base>::reverse_compiled_computation(ind_num, dep_num);
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::reverse_compiled_computation(size_t ind_num,
+                                                         size_t dep_num) {
+  if (built) {
+    numeric_computation(*this->compiled, ind_num, dep_num);
+    return;
+  }
+  BaseReverseMode<Base>::reverse_compiled_computation(ind_num, dep_num);
+}
+
+template <typename Base>
+void BaseHessianPlan<Base>::numeric_computation(
+    const CompiledTrace<Base>& code, size_t ind_num, size_t dep_num) {
+  if (ind_num != code.get_num_ind()) {
+    warning_NumberInconsistent("independent", ind_num, code.get_num_ind());
+  }
+  if (dep_num != code.get_num_dep()) {
+    warning_NumberInconsistent("dependent", dep_num, code.get_num_dep());
+  }
+  const std::vector<typename CompiledTrace<Base>::Instruction>& ins =
+      code.get_instructions();
+  // end_of_tape, every instruction but the external calls, start_of_tape
+  size_t num_sac = ins.size() - code.get_ext_calls().size() + 2;
+  if (num_sac + 1 != sac_begin.size() ||
+      code.get_num_dep() != dep_val.size()) {
+    warning_PlanInconsistent(0);
+    return;
+  }
+  const std::vector<Base>& value = code.get_value();
+  const std::vector<locint>& dep_slot = code.get_dep_slot();
+  this->weighted_value = 0.0;
+  for (size_t d = 0; d < dep_slot.size(); d++) {
+    dep_val[d] = value[dep_slot[d]];
+    if (this->dep_weighted && d < this->dep_weight.size()) {
+      this->weighted_value += this->dep_weight[d] * dep_val[d];
+    }
+  }
+  DerivativeInfo<locint, Base> info;
+  size_t next_init = 0;
+  size_t k = 0;
+  for (size_t i = ins.size() + 1; i-- > 0;) {
+    // i == ins.size() stands for end_of_tape
+    if (i < ins.size() && ins[i].op == ext_func) {
+      continue;
+    }
+    for (; next_init < init_sac.size() && init_sac[next_init] == k;
+         next_init++) {
+      size_t dep = init_dep[next_init];
+      values[init_slot[next_init]] +=
+          (!this->dep_weighted ? Base(1.0) :
+           dep < this->dep_weight.size() ? this->dep_weight[dep] : Base(0.0));
+    }
+    if (i < ins.size() && sac_begin[k] != sac_begin[k + 1]) {
+      info.clear();
+      info.opcode = ins[i].op;
+      info.r = ins[i].r;
+      info.x = ins[i].x;
+      info.y = ins[i].y;
+      info.vx = value[ins[i].x];
+      info.vy = value[ins[i].y];
+      info.coval = ins[i].coval;
+      this->local_partials(info);
+    }
+    run_sac(k++, info);
+  }
+  // start_of_tape has no updates
+  run_sac(k, info);
+}
+
+template <typename Base>
+std::shared_ptr<DerivativeTensor<size_t, Base>>
+    BaseHessianPlan<Base>::get_tensor() const {
+  size_t dep_size = keys.size();
+  const std::vector<OutputEntry>* outputs[2] = {&adjoint_output,
+                                                &hessian_output};
+  if (!tensor || tensor.use_count() > 1) {
+    // the structure is only written into a new tensor
+    tensor = std::make_shared<DerivativeTensor<size_t, Base>>(
+        dep_size, ind_size, order);
+    tensor_values.assign(dep_size * order, nullptr);
+    for (size_t k = 0; k < dep_size; k++) {
+      for (size_t t_order = 1; t_order <= order; t_order++) {
+        tensor->init_single_tensor(key_dep[k], t_order,
+                                   entry_size[k * order + t_order - 1]);
+      }
+    }
+    for (size_t t_order = 1; t_order <= order; t_order++) {
+      for (const OutputEntry& entry : *outputs[t_order - 1]) {
+        tensor->put_value(key_dep[entry.key], t_order, entry.num, entry.ind,
+                          Base(0.0));
+      }
+      for (size_t k = 0; k < dep_size; k++) {
+        size_t size;
+        size_t** tind;
+        tensor->get_internal_coordinate_list(
+            key_dep[k], t_order, &size, &tind,
+            &tensor_values[k * order + t_order - 1]);
+      }
+    }
+  }
+  for (size_t k = 0; k < dep_size; k++) {
+    tensor->put_dep_value(key_dep[k], this->dep_weighted ?
+                                      this->weighted_value :
+                                      dep_val[key_dep[k]]);
+  }
+  for (size_t t_order = 1; t_order <= order; t_order++) {
+    for (const OutputEntry& entry : *outputs[t_order - 1]) {
+      tensor_values[entry.key * order + t_order - 1][entry.num] =
+          values[entry.slot];
+    }
+  }
+  return tensor;
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_BASE_HESSIAN_PLAN_H_
@@ -1,9 +1,14 @@
 #ifndef REVERSEAD_BASE_REVERSE_ADJOINT_H_
 #define REVERSEAD_BASE_REVERSE_ADJOINT_H_
 
+#include <algorithm>
+#include <condition_variable>
 #include <set>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "reversead/common/reversead_type.hpp"
 #include "reversead/common/opcodes.hpp"
@@ -29,20 +34,31 @@ class BaseReverseAdjoint : public BaseReverseMode<Base> {
 
   BaseReverseAdjoint() = default;
   BaseReverseAdjoint(const std::shared_ptr<TrivialTrace<Base>>& trace)
-      : BaseReverseMode<Base>(trace), preacc_enabled(false) {}
+      : BaseReverseMode<Base>(trace), preacc_enabled(false),
+        temp_local_dep(NULL_LOC), preacc_threads(1), preacc_block_size(REVERSEAD_PREACC_BLOCK_SIZE),
+        preacc_round(0), preacc_pending(0), preacc_stop(false) {}
 
-  ~BaseReverseAdjoint() = default;
+  ~BaseReverseAdjoint() {stop_preacc_workers();}
 
   void enable_preacc();
 
+  // Statement local derivatives are computed on num_threads worker threads,
+  // block_size statements at a time, while the global fold stays serial.
+  void enable_parallel_preacc(size_t num_threads,
+                              size_t block_size = REVERSEAD_PREACC_BLOCK_SIZE);
+
  protected:
   // From BaseReverseMode 
   void init_dep_deriv(locint dep) override final;
 
   void process_sac(const DerivativeInfo<locint, Base>& info) override final;
 
+  void process_ext(const ExternalCall<Base>& call) override;
+
   std::shared_ptr<DerivativeTensor<size_t, Base>> get_tensor() const override;
 
+  void emit(DerivativeSink<Base>& sink) override;
+
   // Originate BaseReverseAdjoint
   virtual void accumulate_sac(const DerivativeInfo<locint, Base>& info, SingleDeriv& deriv);
 
@@ -50,8 +66,18 @@ class BaseReverseAdjoint : public BaseReverseMode<Base> {
                                 SingleDeriv& local_deriv,
                                 SingleDeriv& deriv);
 
+  virtual void accumulate_ext(const ExternalCall<Base>& call,
+                              SingleDeriv& deriv);
+
   void transcript_adjoint(std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const;
 
+  // streams the derivatives of every dependent up to order, each
+  // dependent is erased from dep_deriv once it is passed
+  void emit_derivs(DerivativeSink<Base>& sink, size_t order);
+  // passes (and frees) the derivatives of one dependent
+  virtual void emit_deriv(size_t dep, SingleDeriv& deriv,
+                          DerivativeSink<Base>& sink);
+
   void accumulate_adjoint_sac(const DerivativeInfo<locint, Base>& info,
                            type_adjoint& adjoint_vals,
                            const Base& w);
@@ -62,11 +88,50 @@ class BaseReverseAdjoint : public BaseReverseMode<Base> {
 
  // preaccumulation stuff
  private:
+  struct PreaccStatement {
+    locint local_dep;
+    std::vector<DerivativeInfo<locint, Base>> sacs;
+    SingleDeriv local_deriv;
+    std::set<locint> local_live;
+  };
+
   bool preacc_enabled;
   locint temp_local_dep;
   SingleDeriv temp_local_deriv;
   std::set<locint> temp_local_live;
   void process_preacc(const DerivativeInfo<locint, Base>& info);
+  // folds every pending statement into the global derivatives
+  void flush_preacc();
+
+  // parallel preaccumulation, the trace is decoded into blocks of statements,
+  // one block is folded while the next one is computed by the workers.
+  // The workers are started with the first block and live until the engine
+  // is destroyed, each new block is one more round for them.
+  size_t preacc_threads;
+  size_t preacc_block_size;
+  std::vector<PreaccStatement> preacc_block;
+  std::vector<PreaccStatement> preacc_computing;
+  std::vector<std::thread> preacc_workers;
+  std::mutex preacc_mutex;
+  std::condition_variable preacc_start;
+  std::condition_variable preacc_done;
+  size_t preacc_round;
+  size_t preacc_pending;
+  bool preacc_stop;
+  void process_parallel_preacc(const DerivativeInfo<locint, Base>& info);
+  void rotate_preacc_block();
+  void launch_preacc_workers();
+  void wait_preacc_workers();
+  void stop_preacc_workers();
+  void run_preacc_worker(size_t t);
+
+  static bool is_statement_boundary(opbyte op);
+  void accumulate_local_sac(const DerivativeInfo<locint, Base>& info,
+                            SingleDeriv& local_deriv,
+                            std::set<locint>& local_live);
+  void fold_local_deriv(locint local_dep,
+                        SingleDeriv& local_deriv,
+                        const std::set<locint>& local_live);
 };
 
 template <typename Base>
@@ -74,6 +139,15 @@ void BaseReverseAdjoint<Base>::enable_preacc() {
   preacc_enabled = true;
 }
 
+template <typename Base>
+void BaseReverseAdjoint<Base>::enable_parallel_preacc(size_t num_threads,
+                                                      size_t block_size) {
+  preacc_enabled = true;
+  stop_preacc_workers();
+  preacc_threads = (num_threads > 0 ? num_threads : 1);
+  preacc_block_size = (block_size > 0 ? block_size : 1);
+}
+
 template <typename Base>
 std::shared_ptr<DerivativeTensor<size_t, Base>>
     BaseReverseAdjoint<Base>::get_tensor() const {
@@ -91,7 +165,7 @@ template <typename Base>
 void BaseReverseAdjoint<Base>::transcript_adjoint(
     std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const{
   for (auto& kv : dep_deriv) {
-    size_t dep = dep_index_map.find(kv.first)->second;
+    size_t dep = this->get_dep_index(kv.first);
     size_t size = kv.second.adjoint_vals->get_size();
     tensor->init_single_tensor(dep, 1, size);
     locint t[1];
@@ -109,10 +183,45 @@ void BaseReverseAdjoint<Base>::transcript_adjoint(
   }
 }
 
+template <typename Base>
+void BaseReverseAdjoint<Base>::emit(DerivativeSink<Base>& sink) {
+  emit_derivs(sink, 1);
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::emit_derivs(DerivativeSink<Base>& sink,
+                                           size_t order) {
+  sink.begin(dep_deriv.size(), indep_index_map.size(), order);
+  BaseReverseMode<Base>::emit_dep_value(sink);
+  auto iter = dep_deriv.begin();
+  while (iter != dep_deriv.end()) {
+    emit_deriv(this->get_dep_index(iter->first), iter->second, sink);
+    iter = dep_deriv.erase(iter);
+  }
+  sink.end();
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::emit_deriv(size_t dep, SingleDeriv& deriv,
+                                          DerivativeSink<Base>& sink) {
+  locint t;
+  size_t x[1];
+  Base w;
+  typename type_adjoint::enumerator a_enum = deriv.adjoint_vals->get_enumerator();
+  bool has_next = a_enum.has_next();
+  while (has_next) {
+    has_next = a_enum.get_next(t, w);
+    x[0] = indep_index_map.find(t)->second;
+    sink.put_value(dep, 1, x, w);
+  }
+  deriv.adjoint_vals->clear();
+}
+
 template <typename Base>
 void BaseReverseAdjoint<Base>::init_dep_deriv(locint dep) {
-  dep_deriv[dep].adjoint_vals->increase(dep, 1.0);
-  reverse_live[dep].insert(dep); 
+  locint key = this->get_dep_key(dep);
+  dep_deriv[key].adjoint_vals->increase(dep, this->get_dep_weight(dep));
+  reverse_live[dep].insert(key);
 }
 
 template <typename Base>
@@ -164,11 +273,53 @@ void BaseReverseAdjoint<Base>::accumulate_adjoint_deriv(
   }
 }
 
+template <typename Base>
+void BaseReverseAdjoint<Base>::accumulate_ext(const ExternalCall<Base>& call,
+                                              SingleDeriv& deriv) {
+  std::vector<Base> w(call.y.size());
+  bool nonzero = false;
+  for (size_t j = 0; j < call.y.size(); j++) {
+    w[j] = deriv.adjoint_vals->get_and_erase(call.y[j]);
+    nonzero = nonzero || !IsZero(w[j]);
+  }
+  if (!nonzero) {
+    return;
+  }
+  std::vector<Base> x_adj(call.x.size(), Base(0.0));
+  call.func->eval_adjoint(call.vx.data(), w.data(), x_adj.data());
+  for (size_t i = 0; i < call.x.size(); i++) {
+    deriv.adjoint_vals->increase(call.x[i], x_adj[i]);
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::process_ext(const ExternalCall<Base>& call) {
+  if (preacc_enabled) {
+    flush_preacc();
+  }
+  std::set<locint> dep_set;
+  for (const locint& y : call.y) {
+    std::set<locint> y_set = std::move(reverse_live[y]);
+    reverse_live.erase(y);
+    dep_set.insert(y_set.begin(), y_set.end());
+  }
+  for (const locint& dep : dep_set) {
+    accumulate_ext(call, dep_deriv[dep]);
+    for (const locint& x : call.x) {
+      reverse_live[x].insert(dep);
+    }
+  }
+}
+
 // here we can do something to enable preaccumulation
 template <typename Base>
 void BaseReverseAdjoint<Base>::process_sac(const DerivativeInfo<locint, Base>& info) {
   if (preacc_enabled) {
-    process_preacc(info);
+    if (preacc_threads > 1) {
+      process_parallel_preacc(info);
+    } else {
+      process_preacc(info);
+    }
     return;
   }
   if (info.r != NULL_LOC) {
@@ -187,9 +338,8 @@ void BaseReverseAdjoint<Base>::process_sac(const DerivativeInfo<locint, Base>& i
 }
 
 template <typename Base>
-void BaseReverseAdjoint<Base>::process_preacc(
-    const DerivativeInfo<locint, Base>& info) {
-  switch (info.opcode) {
+bool BaseReverseAdjoint<Base>::is_statement_boundary(opbyte op) {
+  switch (op) {
     case start_of_tape:
     case assign_a:
     case assign_d:
@@ -200,29 +350,172 @@ void BaseReverseAdjoint<Base>::process_preacc(
     case eq_mult_a:
     case eq_mult_d:
     case eq_div_a:
-      std::set<locint> dep_set = std::move(reverse_live[temp_local_dep]);
-      reverse_live.erase(temp_local_dep);
-      for (const locint& dep : dep_set) {
-        accumulate_deriv(temp_local_dep, temp_local_deriv, dep_deriv[dep]);
-        for (const locint& p : temp_local_live) {
-          reverse_live[p].insert(dep);
-        }
-      }
-      temp_local_dep = info.r;
-      temp_local_live.clear();
-      temp_local_live.insert(info.r);
-      temp_local_deriv.clear();
-      temp_local_deriv.adjoint_vals->increase(info.r, 1.0);
-      break;
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::accumulate_local_sac(
+    const DerivativeInfo<locint, Base>& info,
+    SingleDeriv& local_deriv,
+    std::set<locint>& local_live) {
+  accumulate_sac(info, local_deriv);
+  local_live.erase(info.r);
+  if (info.x != NULL_LOC) {
+    local_live.insert(info.x);
+  }
+  if (info.y != NULL_LOC) {
+    local_live.insert(info.y);
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::fold_local_deriv(
+    locint local_dep,
+    SingleDeriv& local_deriv,
+    const std::set<locint>& local_live) {
+  std::set<locint> dep_set = std::move(reverse_live[local_dep]);
+  reverse_live.erase(local_dep);
+  for (const locint& dep : dep_set) {
+    accumulate_deriv(local_dep, local_deriv, dep_deriv[dep]);
+    for (const locint& p : local_live) {
+      reverse_live[p].insert(dep);
+    }
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::process_preacc(
+    const DerivativeInfo<locint, Base>& info) {
+  if (is_statement_boundary(info.opcode)) {
+    fold_local_deriv(temp_local_dep, temp_local_deriv, temp_local_live);
+    temp_local_dep = info.r;
+    temp_local_live.clear();
+    temp_local_live.insert(info.r);
+    temp_local_deriv.clear();
+    temp_local_deriv.adjoint_vals->increase(info.r, 1.0);
   }
   if (info.r != NULL_LOC) {
-    accumulate_sac(info, temp_local_deriv);
-    temp_local_live.erase(info.r);
-    if (info.x != NULL_LOC) {
-      temp_local_live.insert(info.x);
+    accumulate_local_sac(info, temp_local_deriv, temp_local_live);
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::process_parallel_preacc(
+    const DerivativeInfo<locint, Base>& info) {
+  if (info.opcode == start_of_tape) {
+    flush_preacc();
+    return;
+  }
+  if (is_statement_boundary(info.opcode)) {
+    if (preacc_block.size() >= preacc_block_size) {
+      rotate_preacc_block();
+    }
+    preacc_block.emplace_back();
+    preacc_block.back().local_dep = info.r;
+  }
+  // SACs before the first statement do not contribute, same as serial mode.
+  if (info.r != NULL_LOC && !preacc_block.empty()) {
+    preacc_block.back().sacs.push_back(info);
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::flush_preacc() {
+  if (preacc_threads > 1) {
+    rotate_preacc_block();
+    wait_preacc_workers();
+    for (PreaccStatement& stmt : preacc_computing) {
+      fold_local_deriv(stmt.local_dep, stmt.local_deriv, stmt.local_live);
+    }
+    preacc_computing.clear();
+  } else {
+    fold_local_deriv(temp_local_dep, temp_local_deriv, temp_local_live);
+    temp_local_dep = NULL_LOC;
+    temp_local_live.clear();
+    temp_local_deriv.clear();
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::rotate_preacc_block() {
+  wait_preacc_workers();
+  std::vector<PreaccStatement> ready = std::move(preacc_computing);
+  preacc_computing = std::move(preacc_block);
+  preacc_block.clear();
+  launch_preacc_workers();
+  // the fold of the previous block overlaps with the workers
+  for (PreaccStatement& stmt : ready) {
+    fold_local_deriv(stmt.local_dep, stmt.local_deriv, stmt.local_live);
+  }
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::launch_preacc_workers() {
+  if (preacc_workers.empty()) {
+    preacc_stop = false;
+    for (size_t t = 0; t < preacc_threads; t++) {
+      preacc_workers.emplace_back(
+          &BaseReverseAdjoint<Base>::run_preacc_worker, this, t);
+    }
+  }
+  std::lock_guard<std::mutex> lock(preacc_mutex);
+  preacc_pending = preacc_workers.size();
+  preacc_round++;
+  preacc_start.notify_all();
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::wait_preacc_workers() {
+  std::unique_lock<std::mutex> lock(preacc_mutex);
+  preacc_done.wait(lock, [this]() {return preacc_pending == 0;});
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::stop_preacc_workers() {
+  if (preacc_workers.empty()) {
+    return;
+  }
+  wait_preacc_workers();
+  {
+    std::lock_guard<std::mutex> lock(preacc_mutex);
+    preacc_stop = true;
+    preacc_start.notify_all();
+  }
+  for (std::thread& worker : preacc_workers) {
+    worker.join();
+  }
+  preacc_workers.clear();
+}
+
+template <typename Base>
+void BaseReverseAdjoint<Base>::run_preacc_worker(size_t t) {
+  size_t round = 0;
+  std::unique_lock<std::mutex> lock(preacc_mutex);
+  while (true) {
+    preacc_start.wait(lock, [this, round]() {
+      return preacc_stop || preacc_round != round;
+    });
+    if (preacc_stop) {
+      return;
+    }
+    round = preacc_round;
+    lock.unlock();
+    size_t num_stmt = preacc_computing.size();
+    for (size_t i = t; i < num_stmt; i += preacc_threads) {
+      PreaccStatement& stmt = preacc_computing[i];
+      stmt.local_live.insert(stmt.local_dep);
+      stmt.local_deriv.adjoint_vals->increase(stmt.local_dep, 1.0);
+      for (const DerivativeInfo<locint, Base>& sac : stmt.sacs) {
+        accumulate_local_sac(sac, stmt.local_deriv, stmt.local_live);
+      }
+      std::vector<DerivativeInfo<locint, Base>>().swap(stmt.sacs);
     }
-    if (info.y != NULL_LOC) {
-      temp_local_live.insert(info.y);
+    lock.lock();
+    if (--preacc_pending == 0) {
+      preacc_done.notify_one();
     }
   }
 }
@@ -1,9 +1,11 @@
 #ifndef REVERSEAD_BASE_REVERSE_GENERIC_H_
 #define REVERSEAD_BASE_REVERSE_GENERIC_H_
 
+#include <algorithm>
 #include <cmath>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "reversead/common/reversead_core.hpp"
 #include "reversead/common/reversead_type.hpp"
@@ -143,8 +145,11 @@ class BaseReverseGeneric : public BaseReverseMode<Base> {
             if (!IsZero(ssw[i*(order+1)+j])) {
               global_deriv.increase(ss_set, ssw[i*(order+1)+j]);
             }
+            // longer terms have no derivative, stop before overflowing
+            if (ss_set.size() == order) {break;}
             ss_set.insert(info.y);
           }
+          if (s_set.size() == order) {break;}
           s_set.insert(info.x);
         }
       } else if (info.x != NULL_LOC){
@@ -154,6 +159,7 @@ class BaseReverseGeneric : public BaseReverseMode<Base> {
                               sw,
                               local_deriv.get_enumerator()); // initial enum
         for (size_t i = 1; i <= order; i++) {
+          if (s_set.size() == order) {break;}
           s_set.insert(info.x);
           if (!IsZero(ssw[i])) {
             global_deriv.increase(s_set, ssw[i]);
@@ -176,12 +182,16 @@ class BaseReverseGeneric : public BaseReverseMode<Base> {
     locint* t = new locint[order];
     size_t* x = new size_t[order];
     for (auto& kv : dep_deriv) {
-      size_t dep = dep_index_map.find(kv.first)->second;
+      size_t dep = this->get_dep_index(kv.first);
       for (size_t i = 0; i < order; i++) {
         size[i] = kv.second.get_size(i);
         ret->init_single_tensor(dep, i+1, size[i]);
         curr_l[i] = 0;
       }
+      // GenericDeriv is unordered, sort to report the terms by order and
+      // then lexicographically
+      std::vector<std::pair<GenericMultiset<locint>, Base>> terms;
+      terms.reserve(kv.second.get_size());
       GenericMultiset<locint> s_set;
       Base sw;
       typename GenericDeriv<locint, Base>::enumerator g_enum =
@@ -189,14 +199,22 @@ class BaseReverseGeneric : public BaseReverseMode<Base> {
       while (g_enum.has_next()) {
         g_enum.get_curr_pair(s_set, sw);
         g_enum.move_to_next();
-        size_t t_order = s_set.size();
-        s_set.to_array(t);
+        terms.emplace_back(s_set, sw);
+      }
+      std::sort(terms.begin(), terms.end(),
+                [](const std::pair<GenericMultiset<locint>, Base>& l,
+                   const std::pair<GenericMultiset<locint>, Base>& r) {
+        return l.first < r.first;
+      });
+      for (const auto& term : terms) {
+        size_t t_order = term.first.size();
+        term.first.to_array(t);
         // The iterator of multiset puts small number fist
         // reverse the order so it gives lower half
         for (size_t i = 0; i < t_order; i++) {
           x[t_order - 1 - i] = indep_index_map.find(t[i])->second;
         }
-        ret->put_value(dep, t_order, curr_l[t_order-1], x, sw);
+        ret->put_value(dep, t_order, curr_l[t_order-1], x, term.second);
         curr_l[t_order - 1]++;
       }
     }
@@ -217,13 +235,15 @@ class BaseReverseGeneric : public BaseReverseMode<Base> {
   
   template <typename Base>
   void BaseReverseGeneric<Base>::init_dep_deriv(locint dep) {
-    GenericDeriv<locint, Base> d_deriv(order);
+    locint key = this->get_dep_key(dep);
+    if (dep_deriv.find(key) == dep_deriv.end()) {
+      GenericDeriv<locint, Base> d_deriv(order);
+      dep_deriv.insert(std::pair<locint, GenericDeriv<locint, Base>>(key, d_deriv));
+    }
     GenericMultiset<locint> d_set;
     d_set.insert(dep);
-    d_deriv.increase(d_set, 1.0);
-    dep_deriv.insert(std::pair<locint, GenericDeriv<locint, Base>>(dep, d_deriv));
-    //d_deriv.debug();
-    reverse_live[dep].insert(dep);
+    dep_deriv.find(key)->second.increase(d_set, this->get_dep_weight(dep));
+    reverse_live[dep].insert(key);
   }
   
   template <typename Base>
@@ -1,9 +1,11 @@
 #ifndef REVERSEAD_BASE_REVERSE_HESSIAN_H_
 #define REVERSEAD_BASE_REVERSE_HESSIAN_H_
 
+#include <algorithm>
 #include <set>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "reversead/common/reversead_type.hpp"
 #include "reversead/trace/trivial_trace.hpp"
@@ -40,6 +42,12 @@ class BaseReverseHessian : public virtual BaseReverseAdjoint<Base> {
  protected:
   std::shared_ptr<DerivativeTensor<size_t, Base>> get_tensor() const override;
 
+  void emit(DerivativeSink<Base>& sink) override;
+
+  // the adjoints, then the Hessian one row at a time
+  void emit_deriv(size_t dep, SingleDeriv& deriv,
+                  DerivativeSink<Base>& sink) override;
+
   void accumulate_sac(
       const DerivativeInfo<locint, Base>& info, SingleDeriv& deriv) override;
 
@@ -47,6 +55,12 @@ class BaseReverseHessian : public virtual BaseReverseAdjoint<Base> {
                         SingleDeriv& local_deriv,
                         SingleDeriv& deriv) override;
 
+  // edge pushing through y = f(x) : the rows of y are pushed to x with the
+  // Jacobian (from y_num adjoint calls), J^T * H_yy * J and the hessian
+  // callback weighted by the adjoints of y are added to H_xx
+  void accumulate_ext(const ExternalCall<Base>& call,
+                      SingleDeriv& deriv) override;
+
   void transcript_hessian(
       std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const;
 
@@ -73,6 +87,102 @@ void BaseReverseHessian<Base>::accumulate_sac(const DerivativeInfo<locint, Base>
   accumulate_hessian_sac(info, *(deriv.hessian_vals), w, r);
 }
 
+template <typename Base>
+void BaseReverseHessian<Base>::accumulate_ext(const ExternalCall<Base>& call,
+                                              SingleDeriv& deriv) {
+  size_t x_num = call.x.size();
+  size_t y_num = call.y.size();
+  std::vector<Base> w(y_num);
+  std::vector<type_adjoint> rows(y_num);
+  bool nonzero = false;
+  for (size_t j = 0; j < y_num; j++) {
+    w[j] = deriv.adjoint_vals->get_and_erase(call.y[j]);
+    rows[j] = deriv.hessian_vals->get_and_erase(call.y[j]);
+    nonzero = nonzero || !IsZero(w[j]);
+  }
+  // jac[j * x_num + i] = d y[j] / d x[i]
+  std::vector<Base> jac(y_num * x_num, Base(0.0));
+  std::vector<Base> e(y_num, Base(0.0));
+  for (size_t j = 0; j < y_num; j++) {
+    e[j] = 1.0;
+    call.func->eval_adjoint(call.vx.data(), e.data(), &jac[j * x_num]);
+    e[j] = 0.0;
+  }
+  for (size_t i = 0; i < x_num; i++) {
+    Base a = 0.0;
+    for (size_t j = 0; j < y_num; j++) {
+      a += w[j] * jac[j * x_num + i];
+    }
+    deriv.adjoint_vals->increase(call.x[i], a);
+  }
+  // pushing : H(y, p) to H(x, p), H_yy is kept for the creating part
+  std::vector<Base> hyy(y_num * y_num, Base(0.0));
+  locint p;
+  Base pw;
+  for (size_t j = 0; j < y_num; j++) {
+    typename type_adjoint::enumerator r_enum = rows[j].get_enumerator();
+    bool has_next = r_enum.has_next();
+    while (has_next) {
+      has_next = r_enum.get_next(p, pw);
+      size_t k = std::find(call.y.begin(), call.y.end(), p) - call.y.begin();
+      if (k < y_num) {
+        hyy[j * y_num + k] = pw;
+        hyy[k * y_num + j] = pw;
+        continue;
+      }
+      for (size_t i = 0; i < x_num; i++) {
+        Base d = jac[j * x_num + i];
+        if (p == call.x[i]) {
+          deriv.hessian_vals->increase(p, p, 2.0 * d * pw);
+        } else {
+          deriv.hessian_vals->increase(call.x[i], p, d * pw);
+        }
+      }
+    }
+  }
+  // creating : hess = sum_j w[j] * f_j'' + J^T * H_yy * J
+  std::vector<Base> hess(x_num * x_num, Base(0.0));
+  if (nonzero) {
+    if (call.func->has_hessian()) {
+      call.func->eval_hessian(call.vx.data(), w.data(), hess.data());
+    } else {
+      warning_ExtFuncNoHessian();
+    }
+  }
+  std::vector<Base> hj(y_num * x_num, Base(0.0));
+  for (size_t j = 0; j < y_num; j++) {
+    for (size_t k = 0; k < y_num; k++) {
+      Base h = hyy[j * y_num + k];
+      if (IsZero(h)) {continue;}
+      for (size_t i = 0; i < x_num; i++) {
+        hj[j * x_num + i] += h * jac[k * x_num + i];
+      }
+    }
+  }
+  for (size_t j = 0; j < y_num; j++) {
+    for (size_t i = 0; i < x_num; i++) {
+      Base d = jac[j * x_num + i];
+      if (IsZero(d)) {continue;}
+      for (size_t l = 0; l < x_num; l++) {
+        hess[i * x_num + l] += d * hj[j * x_num + l];
+      }
+    }
+  }
+  for (size_t i = 0; i < x_num; i++) {
+    deriv.hessian_vals->increase(call.x[i], call.x[i], hess[i * x_num + i]);
+    for (size_t l = i + 1; l < x_num; l++) {
+      if (call.x[i] == call.x[l]) {
+        // the same location passed twice
+        deriv.hessian_vals->increase(call.x[i], call.x[i],
+                                     2.0 * hess[i * x_num + l]);
+      } else {
+        deriv.hessian_vals->increase(call.x[i], call.x[l],
+                                     hess[i * x_num + l]);
+      }
+    }
+  }
+}
+
 template <typename Base>
 std::shared_ptr<DerivativeTensor<size_t, Base>>
     BaseReverseHessian<Base>::get_tensor() const {
@@ -91,7 +201,7 @@ template <typename Base>
 void BaseReverseHessian<Base>::transcript_hessian(
     std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const {
   for (auto& kv : dep_deriv) {
-    locint dep = dep_index_map.find(kv.first)->second;
+    size_t dep = this->get_dep_index(kv.first);
     size_t size = kv.second.hessian_vals->get_size();
     tensor->init_single_tensor(dep, 2, size);
     locint t[2];
@@ -110,6 +220,31 @@ void BaseReverseHessian<Base>::transcript_hessian(
   }
 }
 
+template <typename Base>
+void BaseReverseHessian<Base>::emit(DerivativeSink<Base>& sink) {
+  this->emit_derivs(sink, 2);
+}
+
+template <typename Base>
+void BaseReverseHessian<Base>::emit_deriv(size_t dep, SingleDeriv& deriv,
+                                          DerivativeSink<Base>& sink) {
+  BaseReverseAdjoint<Base>::emit_deriv(dep, deriv, sink);
+  size_t x[2];
+  locint t;
+  Base w;
+  for (const locint& row : deriv.hessian_vals->get_row_keys()) {
+    type_adjoint r = deriv.hessian_vals->get_and_erase(row);
+    x[0] = indep_index_map.find(row)->second;
+    typename type_adjoint::enumerator r_enum = r.get_enumerator();
+    bool has_next = r_enum.has_next();
+    while (has_next) {
+      has_next = r_enum.get_next(t, w);
+      x[1] = indep_index_map.find(t)->second;
+      sink.put_value(dep, 2, x, w);
+    }
+  }
+}
+
 template <typename Base>
 void BaseReverseHessian<Base>::accumulate_deriv(locint local_dep,
                                                 SingleDeriv& local_deriv,
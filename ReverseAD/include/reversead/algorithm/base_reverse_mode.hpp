@@ -5,14 +5,18 @@
 #include <set>
 #include <map>
 #include <memory>
+#include <vector>
 
+#include "reversead/activetype/external_function.hpp"
 #include "reversead/common/opcodes.hpp"
 #include "reversead/common/reversead_const.hpp"
 #include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
 #include "reversead/algorithm/algorithm_common.hpp"
 #include "reversead/algorithm/derivative_info.hpp"
 #include "reversead/algorithm/trivial_deriv.hpp"
 #include "reversead/algorithm/derivative_tensor.hpp"
+#include "reversead/algorithm/derivative_sink.hpp"
 #include "reversead/util/error_info.hpp"
 
 #define COMBINE_D_1 info.dx += info.dy; info.dy = 0;
@@ -45,28 +49,76 @@ class BaseReverseMode {
 
   std::shared_ptr<DerivativeTensor<size_t, Base>> compute(size_t ind_num, size_t dep_num);
 
+  // Evaluates the trace at ind_val and differentiates in the same call.
+  // The values only live in the slots of a CompiledTrace (built at the
+  // first call and kept until reset_trace), no new trace is recorded.
+  std::shared_ptr<DerivativeTensor<size_t, Base>> compute(
+      const Base* const ind_val, size_t ind_num, size_t dep_num);
+
+  // The same derivatives, passed to sink instead of being returned. Engines
+  // that read out their results row by row stream them and free each row
+  // after it is passed, the others go through a DerivativeTensor first.
+  void compute(size_t ind_num, size_t dep_num, DerivativeSink<Base>& sink);
+  void compute(const Base* const ind_val, size_t ind_num, size_t dep_num,
+               DerivativeSink<Base>& sink);
+
   void reset_trace(std::shared_ptr<TrivialTrace<Base>> _trace);
 
+  // Only the weighted sum of the dependents (e.g. a Lagrangian) is
+  // differentiated, all dependents share one derivative structure and the
+  // tensor has a single dependent. The weights are kept across compute(),
+  // call again to update them without retracing.
+  void set_dep_weight(const Base* const weight, size_t dep_num);
+  void clear_dep_weight();
+
   virtual void clear();
 
  protected:
   virtual void init_dep_deriv(locint dep) = 0;
 
   virtual void process_sac(const DerivativeInfo<locint, Base>& info) = 0;
+  // an ExternalFunction call, engines without support warn and skip it
+  virtual void process_ext(const ExternalCall<Base>& call);
   
-  void reverse_local_computation(size_t, size_t);
+  // the reverse sweep of compute(ind_num, dep_num), an engine with a
+  // recorded sweep (BaseHessianPlan) replaces it
+  virtual void reverse_local_computation(size_t, size_t);
+  // the SACs of trace in reverse order, a checkpoint region is retraced and
+  // swept in place of its ckp_region op
+  void reverse_sweep(size_t& ind_count, size_t& dep_count);
+  // the same sweep over the values of the last evaluate() of compiled
+  virtual void reverse_compiled_computation(size_t, size_t);
+
+  // partials of a SAC from opcode, vx, vy and coval
+  static void local_partials(DerivativeInfo<locint, Base>& info);
 
   void transcript_dep_value(std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const;
 
   virtual std::shared_ptr<DerivativeTensor<size_t, Base>> get_tensor() const = 0;
 
+  // hands the results to sink, by default through get_tensor()
+  virtual void emit(DerivativeSink<Base>& sink);
+  void emit_dep_value(DerivativeSink<Base>& sink) const;
+
+  // the key in dep_deriv (and reverse_live) of a dependent
+  locint get_dep_key(locint dep);
+  Base get_dep_weight(locint dep) const;
+  // the dependent index in the tensor of a key in dep_deriv
+  size_t get_dep_index(locint key) const;
+
   std::shared_ptr<TrivialTrace<Base>> trace;
+  std::shared_ptr<CompiledTrace<Base>> compiled;
   std::map<locint, std::set<locint> > reverse_live;
   std::map<locint, SingleDeriv> dep_deriv;
   std::map<locint, size_t> indep_index_map;
   std::map<locint, size_t> dep_index_map;
   std::map<locint, Base> dep_value;
 
+  bool dep_weighted = false;
+  std::vector<Base> dep_weight;
+  locint weighted_key = NULL_LOC;
+  Base weighted_value = 0.0;
+
  private:
   void reset_trace_no_clear(std::shared_ptr<TrivialTrace<Base>> _trace);
   void compute_iterative();
@@ -81,15 +133,141 @@ std::shared_ptr<DerivativeTensor<size_t, Base>> BaseReverseMode<Base>::compute(s
   return tensor;
 }
 
+template <typename Base>
+std::shared_ptr<DerivativeTensor<size_t, Base>> BaseReverseMode<Base>::compute(
+    const Base* const ind_val, size_t ind_num, size_t dep_num) {
+  if (!compiled) {
+    if (!trace) {
+      warning_NoTraceSet();
+    }
+    compiled = std::make_shared<CompiledTrace<Base>>(trace);
+  }
+  compiled->evaluate(ind_val, nullptr);
+  reverse_compiled_computation(ind_num, dep_num);
+  std::shared_ptr<DerivativeTensor<size_t, Base>> tensor = get_tensor();
+  this->clear();
+  return tensor;
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::compute(size_t ind_num, size_t dep_num,
+                                    DerivativeSink<Base>& sink) {
+  reverse_local_computation(ind_num, dep_num);
+  emit(sink);
+  this->clear();
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::compute(const Base* const ind_val,
+                                    size_t ind_num, size_t dep_num,
+                                    DerivativeSink<Base>& sink) {
+  if (!compiled) {
+    if (!trace) {
+      warning_NoTraceSet();
+    }
+    compiled = std::make_shared<CompiledTrace<Base>>(trace);
+  }
+  compiled->evaluate(ind_val, nullptr);
+  reverse_compiled_computation(ind_num, dep_num);
+  emit(sink);
+  this->clear();
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::set_dep_weight(const Base* const weight,
+                                           size_t dep_num) {
+  if (trace && dep_num != trace->get_num_dep()) {
+    warning_NumberInconsistent("dependent", dep_num, trace->get_num_dep());
+  }
+  dep_weighted = true;
+  dep_weight.assign(weight, weight + dep_num);
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::clear_dep_weight() {
+  dep_weighted = false;
+  dep_weight.clear();
+}
+
+template <typename Base>
+locint BaseReverseMode<Base>::get_dep_key(locint dep) {
+  if (!dep_weighted) {
+    return dep;
+  }
+  if (weighted_key == NULL_LOC) {
+    weighted_key = dep;
+  }
+  return weighted_key;
+}
+
+template <typename Base>
+Base BaseReverseMode<Base>::get_dep_weight(locint dep) const {
+  if (!dep_weighted) {
+    return 1.0;
+  }
+  size_t index = dep_index_map.find(dep)->second;
+  if (index < dep_weight.size()) {
+    return dep_weight[index];
+  }
+  return 0.0;
+}
+
+template <typename Base>
+size_t BaseReverseMode<Base>::get_dep_index(locint key) const {
+  if (dep_weighted) {
+    return 0;
+  }
+  return dep_index_map.find(key)->second;
+}
+
 template <typename Base>
 void BaseReverseMode<Base>::transcript_dep_value(
     std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const {
+  if (dep_weighted) {
+    if (!dep_deriv.empty()) {
+      tensor->put_dep_value(0, weighted_value);
+    }
+    return;
+  }
   for (auto& kv: dep_deriv) {
     size_t dep = dep_index_map.find(kv.first)->second;
     tensor->put_dep_value(dep, dep_value.find(kv.first)->second);
   }
 }
 
+template <typename Base>
+void BaseReverseMode<Base>::emit(DerivativeSink<Base>& sink) {
+  std::shared_ptr<DerivativeTensor<size_t, Base>> tensor = get_tensor();
+  sink.begin(tensor->_dep_size, tensor->_ind_size, tensor->_order);
+  for (size_t dep = 0; dep < tensor->_dep_size; dep++) {
+    sink.put_dep_value(dep, tensor->_dep_value[dep]);
+    for (size_t order = 1; order <= tensor->_order; order++) {
+      size_t size;
+      size_t** tind;
+      Base* values;
+      tensor->get_internal_coordinate_list(dep, order, &size, &tind, &values);
+      for (size_t i = 0; i < size; i++) {
+        sink.put_value(dep, order, tind[i], values[i]);
+      }
+    }
+  }
+  sink.end();
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::emit_dep_value(DerivativeSink<Base>& sink) const {
+  if (dep_weighted) {
+    if (!dep_deriv.empty()) {
+      sink.put_dep_value(0, weighted_value);
+    }
+    return;
+  }
+  for (auto& kv: dep_deriv) {
+    size_t dep = dep_index_map.find(kv.first)->second;
+    sink.put_dep_value(dep, dep_value.find(kv.first)->second);
+  }
+}
+
 template <typename Base>
 void BaseReverseMode<Base>::compute_iterative() {
   reverse_local_computation(trace->get_num_ind(), trace->get_num_dep());
@@ -100,12 +278,14 @@ void BaseReverseMode<Base>::reset_trace(
     std::shared_ptr<TrivialTrace<Base>> _trace) {
   this->clear();
   this->trace = _trace;
+  this->compiled.reset();
 }
 
 template <typename Base>
 void BaseReverseMode<Base>::reset_trace_no_clear(
     std::shared_ptr<TrivialTrace<Base>> _trace) {
   this->trace = _trace;
+  this->compiled.reset();
 }
 
 template <typename Base>
@@ -115,18 +295,12 @@ void BaseReverseMode<Base>::clear() {
   this->indep_index_map.clear();
   this->dep_index_map.clear();
   this->dep_value.clear();
+  this->weighted_key = NULL_LOC;
+  this->weighted_value = 0.0;
 }
 
 template <typename Base>
 void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep_num) {
-  using std::sin;
-  using std::cos;
-  using std::acos;
-  using std::sqrt;
-  using std::pow;
-  using std::log;
-  using std::exp;
-
     DerivativeInfo<locint, Base> info;
     if (!trace) {
       warning_NoTraceSet();
@@ -140,9 +314,21 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
     size_t ind_count = trace->get_num_ind();
     size_t dep_count = trace->get_num_dep();
     
-    locint res;
-    double coval;
     trace->init_reverse();
+    reverse_sweep(ind_count, dep_count);
+    // this is only for preaccumulation
+    info.clear();
+    info.opcode = start_of_tape;
+    process_sac(info);
+    trace->end_reverse();
+    return;
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::reverse_sweep(size_t& ind_count,
+                                          size_t& dep_count) {
+    DerivativeInfo<locint, Base> info;
+    locint res;
     opbyte op = trace->get_next_op_r();
     
     while (op != start_of_tape) {
@@ -164,12 +350,15 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
             case assign_dep:
                 res = trace->get_next_loc_r();
                 dep_value[res] = trace->get_next_val_r();
-                init_dep_deriv(res);
                 if (dep_count == 0) {
                   // TODO(warning)
                 }
                 dep_count--;
                 dep_index_map[res] = dep_count;
+                if (dep_weighted) {
+                  weighted_value += get_dep_weight(res) * dep_value[res];
+                }
+                init_dep_deriv(res);
                 break;
             case assign_param:
                 info.r = trace->get_next_loc_r();
@@ -182,7 +371,6 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
             case assign_a:
                 info.r = trace->get_next_loc_r();
                 info.x = trace->get_next_loc_r();
-                info.dx = 1.0;
                 break;
             case comp_eq:
             case comp_lt:
@@ -192,42 +380,203 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 break;
             case eq_plus_a:
             case plus_a_a:
+            case eq_minus_a:
+            case minus_a_a:
+                info.r = trace->get_next_loc_r();
+                info.y = trace->get_next_loc_r();
+                info.x = trace->get_next_loc_r();
+                break;
+            case eq_plus_d:
+            case plus_d_a:
+            case minus_d_a:
+            case eq_mult_d:
+            case mult_d_a:
+                info.r = trace->get_next_loc_r();
+                info.x = trace->get_next_loc_r();
+                info.coval = trace->get_next_coval_r();
+                break;
+            case eq_mult_a:
+            case mult_a_a:
+            case eq_div_a:
+            case div_a_a:
+            case pow_a_a:
                 info.r = trace->get_next_loc_r();
                 info.y = trace->get_next_loc_r();
                 info.x = trace->get_next_loc_r();
+                info.vy = trace->get_next_val_r();
+                info.vx = trace->get_next_val_r();
+                break;
+            case div_d_a:
+            case pow_a_d:
+            case pow_d_a:
+                info.r = trace->get_next_loc_r();
+                info.x = trace->get_next_loc_r();
+                info.vx = trace->get_next_val_r();
+                info.coval = trace->get_next_coval_r();
+                break;
+            case sin_a:
+            case cos_a:
+            case asin_a:
+            case acos_a:
+            case atan_a:
+            case sqrt_a:
+            case exp_a:
+            case log_a:
+            case erf_a:
+            case fabs_a:
+                info.r = trace->get_next_loc_r();
+                info.x = trace->get_next_loc_r();
+                info.vx = trace->get_next_val_r();
+                break;
+            case rmpi_send:
+            case rmpi_recv:
+                break;
+            case ckp_region:
+            {
+                std::shared_ptr<TrivialTrace<Base>> outer = trace;
+                trace = outer->retrace_region(trace->get_next_loc_r());
+                if (trace) {
+                  trace->init_reverse();
+                  reverse_sweep(ind_count, dep_count);
+                  trace->end_reverse();
+                }
+                trace = outer;
+                op = trace->get_next_op_r();
+                continue;
+            }
+            case ext_func:
+            {
+                ExternalCall<Base> call;
+                call.func = trace->get_ext_func(trace->get_next_loc_r());
+                if (call.func) {
+                  call.y.resize(call.func->get_y_num());
+                  call.x.resize(call.func->get_x_num());
+                  call.vx.resize(call.func->get_x_num());
+                  for (size_t j = call.y.size(); j-- > 0;) {
+                    call.y[j] = trace->get_next_loc_r();
+                  }
+                  for (size_t i = call.x.size(); i-- > 0;) {
+                    call.x[i] = trace->get_next_loc_r();
+                    call.vx[i] = trace->get_next_val_r();
+                  }
+                  process_ext(call);
+                }
+                trace->get_next_loc_r();
+                op = trace->get_next_op_r();
+                continue;
+            }
+            default:
+                warning_UnrecognizedOpcode((int)op);
+        }
+        local_partials(info);
+        // call to inherited virtual functions
+        process_sac(info);
+        
+        op = trace->get_next_op_r();
+    }
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::process_ext(
+    const ExternalCall<Base>& /*call*/) {
+  warning_ExtFuncUnsupported("This reverse mode");
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::reverse_compiled_computation(size_t ind_num, size_t dep_num) {
+  const std::vector<Base>& value = compiled->get_value();
+  size_t ind_count = compiled->get_num_ind();
+  size_t dep_count = compiled->get_num_dep();
+  if (ind_num != ind_count) {
+    warning_NumberInconsistent("independent", ind_num, ind_count);
+  }
+  if (dep_num != dep_count) {
+    warning_NumberInconsistent("dependent", dep_num, dep_count);
+  }
+  DerivativeInfo<locint, Base> info;
+  info.opcode = end_of_tape;
+  process_sac(info);
+  const std::vector<typename CompiledTrace<Base>::Instruction>& code =
+      compiled->get_instructions();
+  const std::vector<ExternalCall<Base>>& ext_calls = compiled->get_ext_calls();
+  size_t ext_count = ext_calls.size();
+  locint res;
+  for (size_t i = code.size(); i-- > 0;) {
+    info.clear();
+    info.opcode = code[i].op;
+    switch (code[i].op) {
+      case ext_func:
+        // in slots, with the inputs of the last evaluate()
+        process_ext(ext_calls[--ext_count]);
+        continue;
+      case assign_ind:
+        ind_count--;
+        indep_index_map[code[i].x] = ind_count;
+        break;
+      case assign_dep:
+        res = code[i].x;
+        dep_value[res] = value[res];
+        dep_count--;
+        dep_index_map[res] = dep_count;
+        if (dep_weighted) {
+          weighted_value += get_dep_weight(res) * dep_value[res];
+        }
+        init_dep_deriv(res);
+        break;
+      case comp_eq:
+      case comp_lt:
+        break;
+      default:
+        info.r = code[i].r;
+        info.x = code[i].x;
+        info.y = code[i].y;
+        info.vx = value[code[i].x];
+        info.vy = value[code[i].y];
+        info.coval = code[i].coval;
+        local_partials(info);
+    }
+    process_sac(info);
+  }
+  info.clear();
+  info.opcode = start_of_tape;
+  process_sac(info);
+}
+
+template <typename Base>
+void BaseReverseMode<Base>::local_partials(DerivativeInfo<locint, Base>& info) {
+  using std::sin;
+  using std::cos;
+  using std::acos;
+  using std::sqrt;
+  using std::pow;
+  using std::log;
+  using std::exp;
+
+    switch (info.opcode) {
+            case assign_a:
+                info.dx = 1.0;
+                break;
+            case eq_plus_a:
+            case plus_a_a:
                 info.dx = 1.0;
                 info.dy = 1.0;
                 PSEUDO_BINARY
                 break;
             case eq_plus_d:
             case plus_d_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                trace->get_next_coval_r();
                 info.dx = 1.0;
                 break;
             case eq_minus_a:
             case minus_a_a:
-                info.r = trace->get_next_loc_r();
-                info.y = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
                 info.dx = 1.0;
                 info.dy = -1.0;
                 PSEUDO_BINARY
                 break;
             case minus_d_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                trace->get_next_coval_r();
                 info.dx = -1.0;
                 break;
             case eq_mult_a:
             case mult_a_a:
-                info.r = trace->get_next_loc_r();
-                info.y = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vy = trace->get_next_val_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = info.vy;
                 info.dy = info.vx;
                 info.pxy = 1.0;
@@ -235,17 +584,10 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 break;
             case eq_mult_d:
             case mult_d_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.dx = trace->get_next_coval_r();
+                info.dx = info.coval;
                 break;
             case eq_div_a:
             case div_a_a:
-                info.r = trace->get_next_loc_r();
-                info.y = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vy = trace->get_next_val_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = 1.0 / info.vy;
                 info.dy = -info.vx / (info.vy*info.vy);
                 info.pxy = -1.0 / (info.vy*info.vy);
@@ -255,34 +597,24 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 PSEUDO_BINARY
                 break;
             case div_d_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
-                coval = trace->get_next_coval_r();
+            {
+                double coval = info.coval;
                 info.dx = -coval / (info.vx*info.vx);
                 info.pxx = 2.0 * coval / (info.vx*info.vx*info.vx);
                 info.pxxx = -6.0 * coval / (info.vx*info.vx*info.vx*info.vx);
+            }
                 break;
             case sin_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = cos(info.vx);
                 info.pxx = -sin(info.vx);
                 info.pxxx = -cos(info.vx);
                 break;
             case cos_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = -sin(info.vx);
                 info.pxx = -cos(info.vx);
                 info.pxxx = sin(info.vx);
                 break;
             case asin_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
             {
                 Base t = sqrt(1.0 - info.vx * info.vx);
                 info.dx = 1.0 / t;
@@ -291,9 +623,6 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
             }
                 break;
             case acos_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
             {
                 Base t = -sqrt(1.0 - info.vx * info.vx);
                 info.dx = 1.0 / t;
@@ -302,9 +631,6 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
             }
                 break;
             case atan_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 {
                     Base t = 1.0 + info.vx * info.vx;
                     info.dx = 1.0 / t;
@@ -313,9 +639,6 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 }
                 break;
             case sqrt_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 if (info.vx != 0.0) {
                     info.dx = 0.5/sqrt(info.vx);
                     info.pxx = -0.5 * info.dx / info.vx;
@@ -323,27 +646,16 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 }
                 break;
             case exp_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = exp(info.vx);
                 info.pxx = info.dx;
                 info.pxxx = info.dx;
                 break;
             case log_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = 1.0 / info.vx;
                 info.pxx = - info.dx * info.dx;
                 info.pxxx = -2.0 * info.pxx / info.vx;
                 break;
             case pow_a_a:
-                info.r = trace->get_next_loc_r();
-                info.y = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vy = trace->get_next_val_r();
-                info.vx = trace->get_next_val_r();
             {
                 Base t = pow(info.vx, info.vy);
                 info.dx = info.vy * t / info.vx;
@@ -359,12 +671,8 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 PSEUDO_BINARY
                 break;
             case pow_a_d:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
-                coval = trace->get_next_coval_r();
-                info.coval = coval;
             {
+                double coval = info.coval;
                 Base t = pow(info.vx, coval);
                 info.dx = coval * t / info.vx;
                 info.pxx = (coval - 1) * info.dx / info.vx;
@@ -372,12 +680,8 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
             }
                 break;
             case pow_d_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
-                coval = trace->get_next_coval_r();
-                info.coval = coval;
                 {
+                  double coval = info.coval;
                   Base t = pow(coval, info.vx);
                   info.dx = log(coval) * t;
                   info.pxx = log(coval) * info.dx;
@@ -385,17 +689,11 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                 }
                 break;
             case erf_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 info.dx = 2.0/sqrt(PI)*exp(-info.vx*info.vx);
                 info.pxx = info.dx * (-2.0 * info.vx);
                 info.pxxx = info.dx * (4.0 * info.vx * info.vx - 2);
                 break;
             case fabs_a:
-                info.r = trace->get_next_loc_r();
-                info.x = trace->get_next_loc_r();
-                info.vx = trace->get_next_val_r();
                 if (info.vx > 0) {
                   info.dx = 1.0;
                 } else if (info.vx < 0) {
@@ -404,23 +702,9 @@ void BaseReverseMode<Base>::reverse_local_computation(size_t ind_num, size_t dep
                   // TODO(muwang) : warning message
                 }
                 break;
-            case rmpi_send:
-            case rmpi_recv:
-                break;
             default:
-                warning_UnrecognizedOpcode((int)op);
-        }
-        // call to inherited virtual functions
-        process_sac(info);
-        
-        op = trace->get_next_op_r();
+                break;
     }
-    // this is only for preaccumulation
-    info.clear();
-    info.opcode = op;
-    process_sac(info);
-    trace->end_reverse();
-    return;
 }
 
 } // namespace ReverseAD
@@ -127,12 +127,15 @@ void BaseReverseTensor<Base>::clear() {
 
 template <typename Base>
 void BaseReverseTensor<Base>::init_dep_deriv(locint dep) {
-  TensorDeriv<locint, Base> d_deriv(order);
+  locint key = this->get_dep_key(dep);
+  if (dep_deriv.find(key) == dep_deriv.end()) {
+    TensorDeriv<locint, Base> d_deriv(order);
+    dep_deriv.insert(std::pair<locint, TensorDeriv<locint, Base>>(key, d_deriv));
+  }
   TensorIndex<locint> t_index;
   t_index.insert(dep);
-  d_deriv.increase(t_index, 1.0);
-  dep_deriv.insert(std::pair<locint, TensorDeriv<locint, Base>>(dep, d_deriv));
-  reverse_live[dep].insert(dep);
+  dep_deriv.find(key)->second.increase(t_index, this->get_dep_weight(dep));
+  reverse_live[dep].insert(key);
 }
 
 template <typename Base>
@@ -145,7 +148,7 @@ std::shared_ptr<DerivativeTensor<size_t, Base>>
       std::make_shared<DerivativeTensor<size_t, Base>>(dep_size, ind_size, order);
   BaseReverseMode<Base>::transcript_dep_value(ret);
   for (auto& kv : dep_deriv) {
-    locint dep = dep_index_map.find(kv.first)->second;
+    size_t dep = this->get_dep_index(kv.first);
     for (size_t d = 1; d <= order; d++) {
       size = kv.second.tensor[d]->size();
       ret->init_single_tensor(dep, d, size);
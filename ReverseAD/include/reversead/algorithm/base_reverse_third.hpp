@@ -42,11 +42,22 @@ class BaseReverseThird : public virtual BaseReverseHessian<Base> {
  protected:
   std::shared_ptr<DerivativeTensor<size_t, Base>> get_tensor() const override;
 
+  void emit(DerivativeSink<Base>& sink) override;
+
+  // up to the Hessian, then the third order one block at a time
+  void emit_deriv(size_t dep, SingleDeriv& deriv,
+                  DerivativeSink<Base>& sink) override;
+
   void accumulate_sac(const DerivativeInfo<locint, Base>& info, SingleDeriv& deriv) override;
 
   void accumulate_deriv(locint local_dep,
                         SingleDeriv& local_deriv,
                         SingleDeriv& deriv) override;
+
+  // no third order callback on ExternalFunction
+  void process_ext(const ExternalCall<Base>& /*call*/) override {
+    warning_ExtFuncUnsupported("BaseReverseThird");
+  }
     
   void transcript_third(std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const;
 
@@ -98,7 +109,7 @@ template <typename Base>
 void BaseReverseThird<Base>::transcript_third(
     std::shared_ptr<DerivativeTensor<size_t, Base>> tensor) const {
   for (auto& kv : dep_deriv) {
-    locint dep = dep_index_map.find(kv.first)->second;
+    size_t dep = this->get_dep_index(kv.first);
     size_t size = kv.second.third_vals->get_size();
     tensor->init_single_tensor(dep, 3, size);
     locint t[3];
@@ -118,6 +129,33 @@ void BaseReverseThird<Base>::transcript_third(
   }
 }
 
+template <typename Base>
+void BaseReverseThird<Base>::emit(DerivativeSink<Base>& sink) {
+  this->emit_derivs(sink, 3);
+}
+
+template <typename Base>
+void BaseReverseThird<Base>::emit_deriv(size_t dep, SingleDeriv& deriv,
+                                        DerivativeSink<Base>& sink) {
+  BaseReverseHessian<Base>::emit_deriv(dep, deriv, sink);
+  size_t x[3];
+  locint t[2];
+  Base w;
+  for (const locint& row : deriv.third_vals->get_row_keys()) {
+    type_hessian h = deriv.third_vals->get_and_erase(row);
+    x[0] = indep_index_map.find(row)->second;
+    typename type_hessian::enumerator h_enum = h.get_enumerator();
+    bool has_next = h_enum.has_next();
+    while (has_next) {
+      has_next = h_enum.get_next(t[0], t[1], w);
+      x[1] = indep_index_map.find(t[0])->second;
+      x[2] = indep_index_map.find(t[1])->second;
+      sink.put_value(dep, 3, x, w);
+    }
+  }
+  deriv.third_vals->clear();
+}
+
 template <typename Base>
 void BaseReverseThird<Base>::accumulate_deriv(locint local_dep,
                                                   SingleDeriv& local_deriv,
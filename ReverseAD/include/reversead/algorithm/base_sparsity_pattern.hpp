@@ -0,0 +1,515 @@
+#ifndef REVERSEAD_BASE_SPARSITY_PATTERN_H_
+#define REVERSEAD_BASE_SPARSITY_PATTERN_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "reversead/activetype/external_function.hpp"
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/algorithm/sparsity_pattern.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// Structural (no floating point) Jacobian and Hessian patterns of a trace.
+// The Jacobian pattern is found by forward propagation of index domains,
+// the Hessian pattern by the nonlinear interaction domains of each SAC,
+// it covers the Hessian of every dependent.
+template <typename Base>
+class BaseSparsityPattern {
+ public:
+  BaseSparsityPattern(const std::shared_ptr<TrivialTrace<Base>>& trace)
+      : trace(trace), num_threads(1), decoded(false), num_slots(0) {}
+
+  void set_num_threads(size_t num_threads);
+
+  std::shared_ptr<SparsityPattern> jacobian_pattern(size_t ind_num,
+                                                    size_t dep_num);
+
+  std::shared_ptr<SparsityPattern> hessian_pattern(size_t ind_num,
+                                                   size_t dep_num);
+
+ private:
+  typedef std::shared_ptr<const std::vector<size_t>> IndexSet;
+
+  enum {
+    kLinear = 0,
+    kNonlinearXX = 1,
+    kNonlinearXY = 2,
+    kNonlinearYY = 4
+  };
+
+  struct PatternOp {
+    size_t r, x, y;
+    int nonlinear;
+  };
+
+  struct Interaction {
+    int nonlinear;
+    IndexSet x;
+    IndexSet y;
+  };
+
+  static const size_t kNoSlot = static_cast<size_t>(-1);
+
+  void decode_trace(size_t ind_num, size_t dep_num);
+  // appends the ops of trace, checkpoint regions are retraced and inlined
+  void decode_ops(const std::shared_ptr<TrivialTrace<Base>>& trace,
+                  std::unordered_map<locint, size_t>& slot_map);
+
+  // index domains restricted to independents in [lo, hi)
+  void propagate_index_domain(size_t lo, size_t hi,
+                              std::vector<IndexSet>& domain,
+                              const std::vector<bool>* active,
+                              std::vector<Interaction>* interactions) const;
+
+  // job(t, lo, hi) is called for the t-th part of [0, size)
+  void run_threads(size_t size,
+                   const std::function<void(size_t, size_t, size_t)>& job) const;
+
+  static IndexSet merge_index_set(const IndexSet& a, const IndexSet& b);
+
+  static void add_lower_half(const IndexSet& cols, size_t row,
+                             std::vector<size_t>& dest);
+
+  std::shared_ptr<TrivialTrace<Base>> trace;
+  size_t num_threads;
+
+  bool decoded;
+  size_t num_slots;
+  std::vector<PatternOp> ops;
+  std::vector<size_t> ind_slot;
+  std::vector<size_t> dep_slot;
+  std::vector<size_t> last_use;
+};
+
+template <typename Base>
+const size_t BaseSparsityPattern<Base>::kNoSlot;
+
+template <typename Base>
+void BaseSparsityPattern<Base>::set_num_threads(size_t num_threads) {
+  this->num_threads = (num_threads > 0 ? num_threads : 1);
+}
+
+template <typename Base>
+typename BaseSparsityPattern<Base>::IndexSet
+    BaseSparsityPattern<Base>::merge_index_set(const IndexSet& a,
+                                               const IndexSet& b) {
+  if (!a || a == b) {return b;}
+  if (!b) {return a;}
+  std::vector<size_t> c;
+  c.reserve(a->size() + b->size());
+  std::set_union(a->begin(), a->end(), b->begin(), b->end(),
+                 std::back_inserter(c));
+  // share the storage whenever one side already covers the union
+  if (c.size() == a->size()) {return a;}
+  if (c.size() == b->size()) {return b;}
+  return std::make_shared<const std::vector<size_t>>(std::move(c));
+}
+
+template <typename Base>
+void BaseSparsityPattern<Base>::add_lower_half(const IndexSet& cols,
+                                               size_t row,
+                                               std::vector<size_t>& dest) {
+  std::vector<size_t>::const_iterator last =
+      std::upper_bound(cols->begin(), cols->end(), row);
+  if (last == cols->begin()) {return;}
+  if (dest.empty()) {
+    dest.assign(cols->begin(), last);
+    return;
+  }
+  std::vector<size_t> merged;
+  merged.reserve(dest.size() + (last - cols->begin()));
+  std::set_union(dest.begin(), dest.end(), cols->begin(), last,
+                 std::back_inserter(merged));
+  dest.swap(merged);
+}
+
+template <typename Base>
+void BaseSparsityPattern<Base>::run_threads(
+    size_t size,
+    const std::function<void(size_t, size_t, size_t)>& job) const {
+  size_t num_workers = std::max<size_t>(1, std::min(num_threads, size));
+  if (num_workers == 1) {
+    job(0, 0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < num_workers; t++) {
+    workers.emplace_back(job, t, size * t / num_workers,
+                         size * (t + 1) / num_workers);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+template <typename Base>
+std::shared_ptr<SparsityPattern> BaseSparsityPattern<Base>::jacobian_pattern(
+    size_t ind_num, size_t dep_num) {
+  decode_trace(ind_num, dep_num);
+  size_t ind_size = ind_slot.size();
+  size_t dep_size = dep_slot.size();
+  size_t num_workers = std::max<size_t>(1, std::min(num_threads, ind_size));
+  std::vector<std::vector<IndexSet>> dep_domain(num_workers);
+  // each worker tracks its own range of independents
+  run_threads(ind_size, [&](size_t t, size_t lo, size_t hi) {
+    std::vector<IndexSet> domain;
+    propagate_index_domain(lo, hi, domain, nullptr, nullptr);
+    std::vector<IndexSet>& dest = dep_domain[t];
+    for (size_t i = 0; i < dep_size; i++) {
+      dest.push_back(domain[dep_slot[i]]);
+    }
+  });
+  std::shared_ptr<SparsityPattern> pattern =
+      std::make_shared<SparsityPattern>(dep_size, ind_size);
+  for (size_t i = 0; i < dep_size; i++) {
+    std::vector<size_t>& row = pattern->get_mutable_row(i);
+    for (const std::vector<IndexSet>& part : dep_domain) {
+      if (!part.empty() && part[i]) {
+        row.insert(row.end(), part[i]->begin(), part[i]->end());
+      }
+    }
+  }
+  return pattern;
+}
+
+template <typename Base>
+std::shared_ptr<SparsityPattern> BaseSparsityPattern<Base>::hessian_pattern(
+    size_t ind_num, size_t dep_num) {
+  decode_trace(ind_num, dep_num);
+  size_t ind_size = ind_slot.size();
+  // only SACs that reach some dependent contribute
+  std::vector<bool> active(num_slots, false);
+  for (const size_t& slot : dep_slot) {
+    active[slot] = true;
+  }
+  for (auto iter = ops.rbegin(); iter != ops.rend(); ++iter) {
+    if (active[iter->r]) {
+      if (iter->x != kNoSlot) {active[iter->x] = true;}
+      if (iter->y != kNoSlot) {active[iter->y] = true;}
+    }
+  }
+  std::vector<IndexSet> domain;
+  std::vector<Interaction> interactions;
+  propagate_index_domain(0, ind_size, domain, &active, &interactions);
+  domain.clear();
+
+  std::shared_ptr<SparsityPattern> pattern =
+      std::make_shared<SparsityPattern>(ind_size, ind_size);
+  // each worker owns a range of rows
+  run_threads(ind_size, [&](size_t /*t*/, size_t lo, size_t hi) {
+    for (const Interaction& inter : interactions) {
+      for (int side = 0; side < 2; side++) {
+        const IndexSet& rows = (side == 0 ? inter.x : inter.y);
+        if (!rows) {continue;}
+        std::vector<IndexSet> cols;
+        if (side == 0) {
+          if (inter.nonlinear & kNonlinearXX) {cols.push_back(inter.x);}
+          if ((inter.nonlinear & kNonlinearXY) && inter.y) {
+            cols.push_back(inter.y);
+          }
+        } else {
+          if ((inter.nonlinear & kNonlinearXY) && inter.x) {
+            cols.push_back(inter.x);
+          }
+          if (inter.nonlinear & kNonlinearYY) {cols.push_back(inter.y);}
+        }
+        if (cols.empty()) {continue;}
+        std::vector<size_t>::const_iterator iter =
+            std::lower_bound(rows->begin(), rows->end(), lo);
+        for (; iter != rows->end() && *iter < hi; ++iter) {
+          for (const IndexSet& c : cols) {
+            add_lower_half(c, *iter, pattern->get_mutable_row(*iter));
+          }
+        }
+      }
+    }
+  });
+  return pattern;
+}
+
+template <typename Base>
+void BaseSparsityPattern<Base>::propagate_index_domain(
+    size_t lo, size_t hi,
+    std::vector<IndexSet>& domain,
+    const std::vector<bool>* active,
+    std::vector<Interaction>* interactions) const {
+  std::set<std::tuple<const void*, const void*, int>> seen;
+  domain.assign(num_slots, IndexSet());
+  for (size_t k = lo; k < hi; k++) {
+    domain[ind_slot[k]] = std::make_shared<const std::vector<size_t>>(1, k);
+  }
+  size_t op_size = ops.size();
+  for (size_t i = 0; i < op_size; i++) {
+    const PatternOp& op = ops[i];
+    IndexSet r;
+    if (op.x != kNoSlot) {
+      r = domain[op.x];
+    }
+    if (op.y != kNoSlot) {
+      r = merge_index_set(r, domain[op.y]);
+    }
+    if (interactions != nullptr && op.nonlinear != kLinear && r &&
+        (*active)[op.r]) {
+      Interaction inter;
+      inter.nonlinear = op.nonlinear;
+      inter.x = (op.x != kNoSlot ? domain[op.x] : IndexSet());
+      inter.y = (op.y != kNoSlot ? domain[op.y] : IndexSet());
+      // unary chains share the same domain, record them only once
+      if (seen.insert(std::make_tuple((const void*)inter.x.get(),
+                                      (const void*)inter.y.get(),
+                                      inter.nonlinear)).second) {
+        interactions->push_back(std::move(inter));
+      }
+    }
+    if (op.x != kNoSlot && last_use[op.x] == i) {
+      domain[op.x].reset();
+    }
+    if (op.y != kNoSlot && last_use[op.y] == i) {
+      domain[op.y].reset();
+    }
+    domain[op.r] = std::move(r);
+  }
+}
+
+template <typename Base>
+void BaseSparsityPattern<Base>::decode_trace(size_t ind_num, size_t dep_num) {
+  if (!trace) {
+    warning_NoTraceSet();
+  }
+  if (ind_num != trace->get_num_ind()) {
+    warning_NumberInconsistent("independent", ind_num, trace->get_num_ind());
+  }
+  if (dep_num != trace->get_num_dep()) {
+    warning_NumberInconsistent("dependent", dep_num, trace->get_num_dep());
+  }
+  if (decoded) {
+    return;
+  }
+  std::unordered_map<locint, size_t> slot_map;
+  decode_ops(trace, slot_map);
+
+  last_use.assign(num_slots, kNoSlot);
+  for (size_t i = 0; i < ops.size(); i++) {
+    if (ops[i].x != kNoSlot) {last_use[ops[i].x] = i;}
+    if (ops[i].y != kNoSlot) {last_use[ops[i].y] = i;}
+  }
+  for (const size_t& slot : dep_slot) {
+    last_use[slot] = ops.size();
+  }
+  decoded = true;
+}
+
+template <typename Base>
+void BaseSparsityPattern<Base>::decode_ops(
+    const std::shared_ptr<TrivialTrace<Base>>& trace,
+    std::unordered_map<locint, size_t>& slot_map) {
+  auto new_slot = [&](locint loc) -> size_t {
+    slot_map[loc] = num_slots;
+    return num_slots++;
+  };
+  auto find_slot = [&](locint loc) -> size_t {
+    auto iter = slot_map.find(loc);
+    if (iter == slot_map.end()) {
+      // defined outside of this trace
+      return new_slot(loc);
+    }
+    return iter->second;
+  };
+
+  locint res;
+  locint arg1;
+  locint arg2;
+  trace->init_forward();
+  opbyte op = trace->get_next_op_f();
+  while (op != end_of_tape) {
+    PatternOp pop;
+    pop.r = kNoSlot;
+    pop.x = kNoSlot;
+    pop.y = kNoSlot;
+    pop.nonlinear = kLinear;
+    switch (op) {
+      case start_of_tape:
+      case rmpi_send:
+      case rmpi_recv:
+        break;
+      case ckp_region:
+      {
+        std::shared_ptr<TrivialTrace<Base>> region =
+            trace->retrace_region(trace->get_next_loc_f());
+        if (region) {
+          decode_ops(region, slot_map);
+        }
+      }
+        break;
+      case ext_func:
+      {
+        // no structure is known : a chain of nonlinear ops over all the
+        // inputs, every output is a copy of its end
+        const ExternalFunction<Base>* func =
+            trace->get_ext_func(trace->get_next_loc_f());
+        if (func == nullptr) {
+          break;
+        }
+        size_t chain = kNoSlot;
+        for (size_t i = 0; i < func->get_x_num(); i++) {
+          arg1 = trace->get_next_loc_f();
+          trace->get_next_val_f();
+          PatternOp link;
+          link.x = find_slot(arg1);
+          link.y = kNoSlot;
+          link.nonlinear = kNonlinearXX;
+          if (chain != kNoSlot) {
+            link.y = link.x;
+            link.x = chain;
+            link.nonlinear = kNonlinearXX | kNonlinearXY | kNonlinearYY;
+          }
+          link.r = num_slots++;
+          ops.push_back(link);
+          chain = link.r;
+        }
+        for (size_t j = 0; j < func->get_y_num(); j++) {
+          res = trace->get_next_loc_f();
+          PatternOp copy;
+          copy.x = chain;
+          copy.y = kNoSlot;
+          copy.nonlinear = kLinear;
+          copy.r = new_slot(res);
+          ops.push_back(copy);
+        }
+        trace->get_next_loc_f();
+      }
+        break;
+      case assign_ind:
+        res = trace->get_next_loc_f();
+        trace->get_next_val_f();
+        ind_slot.push_back(new_slot(res));
+        break;
+      case assign_dep:
+        res = trace->get_next_loc_f();
+        trace->get_next_val_f();
+        dep_slot.push_back(find_slot(res));
+        break;
+      case assign_param:
+        res = trace->get_next_loc_f();
+        trace->get_next_param_f();
+        pop.r = new_slot(res);
+        break;
+      case assign_d:
+        res = trace->get_next_loc_f();
+        trace->get_next_coval_f();
+        pop.r = new_slot(res);
+        break;
+      case comp_eq:
+      case comp_lt:
+        trace->get_next_loc_f();
+        trace->get_next_loc_f();
+        trace->get_next_coval_f();
+        break;
+      case assign_a:
+      case fabs_a:
+        arg1 = trace->get_next_loc_f();
+        res = trace->get_next_loc_f();
+        if (op == fabs_a) {
+          trace->get_next_val_f();
+        }
+        pop.x = find_slot(arg1);
+        pop.r = new_slot(res);
+        break;
+      case eq_plus_a:
+      case plus_a_a:
+      case eq_minus_a:
+      case minus_a_a:
+        arg1 = trace->get_next_loc_f();
+        arg2 = trace->get_next_loc_f();
+        res = trace->get_next_loc_f();
+        pop.x = find_slot(arg1);
+        pop.y = find_slot(arg2);
+        pop.r = new_slot(res);
+        break;
+      case eq_plus_d:
+      case plus_d_a:
+      case minus_d_a:
+      case eq_mult_d:
+      case mult_d_a:
+        arg1 = trace->get_next_loc_f();
+        trace->get_next_coval_f();
+        res = trace->get_next_loc_f();
+        pop.x = find_slot(arg1);
+        pop.r = new_slot(res);
+        break;
+      case eq_mult_a:
+      case mult_a_a:
+      case eq_div_a:
+      case div_a_a:
+      case pow_a_a:
+        arg1 = trace->get_next_loc_f();
+        arg2 = trace->get_next_loc_f();
+        res = trace->get_next_loc_f();
+        trace->get_next_val_f();
+        trace->get_next_val_f();
+        pop.x = find_slot(arg1);
+        pop.y = find_slot(arg2);
+        pop.r = new_slot(res);
+        if (op == eq_mult_a || op == mult_a_a) {
+          pop.nonlinear = kNonlinearXY;
+        } else if (op == pow_a_a) {
+          pop.nonlinear = kNonlinearXX | kNonlinearXY | kNonlinearYY;
+        } else {
+          pop.nonlinear = kNonlinearXY | kNonlinearYY;
+        }
+        if (pop.x == pop.y) {
+          pop.nonlinear = kNonlinearXX;
+          pop.y = kNoSlot;
+        }
+        break;
+      case div_d_a:
+      case pow_a_d:
+      case pow_d_a:
+        arg1 = trace->get_next_loc_f();
+        trace->get_next_val_f();
+        trace->get_next_coval_f();
+        res = trace->get_next_loc_f();
+        pop.x = find_slot(arg1);
+        pop.r = new_slot(res);
+        pop.nonlinear = kNonlinearXX;
+        break;
+      case sin_a:
+      case cos_a:
+      case asin_a:
+      case acos_a:
+      case atan_a:
+      case sqrt_a:
+      case exp_a:
+      case log_a:
+      case erf_a:
+        arg1 = trace->get_next_loc_f();
+        res = trace->get_next_loc_f();
+        trace->get_next_val_f();
+        pop.x = find_slot(arg1);
+        pop.r = new_slot(res);
+        pop.nonlinear = kNonlinearXX;
+        break;
+      default:
+        warning_UnrecognizedOpcode((int)op);
+    }
+    if (pop.r != kNoSlot) {
+      ops.push_back(pop);
+    }
+    op = trace->get_next_op_f();
+  }
+  trace->end_forward();
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_BASE_SPARSITY_PATTERN_H_
@@ -0,0 +1,592 @@
+#ifndef REVERSEAD_BASE_TAYLOR_TENSOR_H_
+#define REVERSEAD_BASE_TAYLOR_TENSOR_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/common/reversead_const.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
+#include "reversead/algorithm/algorithm_common.hpp"
+#include "reversead/algorithm/derivative_tensor.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// Derivative tensors up to a given order by forward propagation of
+// univariate Taylor polynomials (Griewank, Utke and Walther).
+// For order k the trace is replayed along every integer direction i with
+// |i| = k, keeping k + 1 Taylor coefficients per slot; the k-th coefficient
+// of y(x + t * i) is the homogeneous polynomial sum_{|j| = k} F_j * i^j,
+// F_j = (d^j y) / j!. A derivative whose indices use the variables S only
+// depends on the directions supported on S, so it is interpolated from
+// those, with the closed form weights of Griewank, Utke and Walther
+//   d^j y = sum_{|i| = k} gamma_ij * y_k(i),
+//   gamma_ij = sum_{0 < q <= j} (-1)^{k - |q|} binom(j, q)
+//              * binom(k * q / |q|, i) * (|q| / k)^k.
+// The weights only depend on the sorted exponents of j, they are worked
+// out for those and permuted for the others.
+// The directions are independent and are shared out to set_num_threads()
+// workers. The tensors are dense, every index of every order is reported.
+// External functions have no Taylor arithmetic, such traces are refused.
+template <typename Base>
+class BaseTaylorTensor {
+ public:
+  BaseTaylorTensor(const std::shared_ptr<TrivialTrace<Base>>& trace,
+                   size_t order)
+      : compiled(std::make_shared<CompiledTrace<Base>>(trace)),
+        order(order), num_threads(1) {}
+  BaseTaylorTensor(const std::shared_ptr<CompiledTrace<Base>>& compiled,
+                   size_t order)
+      : compiled(compiled), order(order), num_threads(1) {}
+
+  void set_num_threads(size_t num_threads) {
+    this->num_threads = (num_threads > 0 ? num_threads : 1);
+  }
+
+  // derivatives at the point recorded on the trace
+  std::shared_ptr<DerivativeTensor<size_t, Base>> compute(size_t ind_num,
+                                                          size_t dep_num);
+
+ private:
+  // interpolation of the derivatives of order k using s variables
+  struct Interpolation {
+    // the local directions, k nondecreasing variables in [0, s) each,
+    // in rank order
+    std::vector<std::vector<size_t>> dirs;
+    // weight[a][b] : contribution of direction b to d^j y, j the direction
+    // a, only for the directions a using all s variables
+    std::vector<std::vector<double>> weight;
+  };
+
+  // number of multisets of size k drawn from n variables
+  size_t num_multiset(size_t n, size_t k) const {
+    return binomial[n + k - 1][k];
+  }
+  // position of the nondecreasing tuple a[0..k) among all of them
+  size_t rank(const size_t* a, size_t k) const {
+    size_t ret = 0;
+    for (size_t m = 0; m < k; m++) {
+      ret += binomial[a[m] + m][m + 1];
+    }
+    return ret;
+  }
+  // the nondecreasing tuple over n variables following a, false at the end
+  static bool next_multiset(size_t* a, size_t k, size_t n);
+  // the same for increasing tuples
+  static bool next_subset(size_t* a, size_t k, size_t n);
+
+  void init_binomial(size_t n);
+  void init_interpolation(size_t s, size_t k, Interpolation& interp) const;
+
+  // Taylor coefficients of degree k of all dependents along the directions
+  // [lo, hi) of order k, written to coef[dir * dep_num + dep]
+  void sweep(size_t k, size_t lo, size_t hi, const std::vector<Base>& value,
+             Base* coef, std::vector<Base>& series) const;
+
+  // job(t, lo, hi) is called for the t-th part of [0, size)
+  void run_threads(size_t size,
+                   const std::function<void(size_t, size_t, size_t)>& job) const;
+
+  std::shared_ptr<CompiledTrace<Base>> compiled;
+  size_t order;
+  size_t num_threads;
+  size_t num_ind;
+  std::vector<std::vector<size_t>> binomial;
+  // interp[k][s], only depends on k and s so it is kept between computes
+  std::vector<std::vector<Interpolation>> interp;
+};
+
+template <typename Base>
+void BaseTaylorTensor<Base>::run_threads(
+    size_t size,
+    const std::function<void(size_t, size_t, size_t)>& job) const {
+  size_t num_workers = std::max<size_t>(1, std::min(num_threads, size));
+  if (num_workers == 1) {
+    job(0, 0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < num_workers; t++) {
+    workers.emplace_back(job, t, size * t / num_workers,
+                         size * (t + 1) / num_workers);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+template <typename Base>
+bool BaseTaylorTensor<Base>::next_multiset(size_t* a, size_t k, size_t n) {
+  for (size_t m = 0; m < k; m++) {
+    if ((m + 1 < k && a[m] < a[m + 1]) || (m + 1 == k && a[m] + 1 < n)) {
+      a[m]++;
+      for (size_t l = 0; l < m; l++) {a[l] = 0;}
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Base>
+bool BaseTaylorTensor<Base>::next_subset(size_t* a, size_t k, size_t n) {
+  for (size_t m = 0; m < k; m++) {
+    if ((m + 1 < k && a[m] + 1 < a[m + 1]) || (m + 1 == k && a[m] + 1 < n)) {
+      a[m]++;
+      for (size_t l = 0; l < m; l++) {a[l] = l;}
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Base>
+void BaseTaylorTensor<Base>::init_binomial(size_t n) {
+  binomial.assign(n + order + 1, std::vector<size_t>(order + 2, 0));
+  for (size_t i = 0; i < binomial.size(); i++) {
+    binomial[i][0] = 1;
+    for (size_t j = 1; j <= std::min(i, order + 1); j++) {
+      binomial[i][j] = binomial[i - 1][j - 1] +
+                       (j <= i - 1 ? binomial[i - 1][j] : 0);
+    }
+  }
+}
+
+template <typename Base>
+void BaseTaylorTensor<Base>::init_interpolation(
+    size_t s, size_t k, Interpolation& interp) const {
+  std::vector<size_t> a(k, 0);
+  do {
+    interp.dirs.push_back(a);
+  } while (next_multiset(&a[0], k, s));
+  const size_t m = interp.dirs.size();
+  // the exponents of each direction, only the positive ones, and the
+  // variables they use as a bit mask (s <= k is small)
+  std::vector<std::vector<std::pair<size_t, size_t>>> expo(m);
+  std::vector<size_t> support(m, 0);
+  for (size_t b = 0; b < m; b++) {
+    const std::vector<size_t>& dir = interp.dirs[b];
+    for (size_t e = 0; e < k; e++) {
+      if (e == 0 || dir[e] != dir[e - 1]) {
+        expo[b].push_back(std::make_pair(dir[e], 0));
+      }
+      expo[b].back().second++;
+      support[b] |= (size_t)1 << dir[e];
+    }
+  }
+  // gen[v][e] = binom(k * q_v / |q|, e), a generalized binomial
+  std::vector<std::vector<long double>> gen(s,
+                                            std::vector<long double>(k + 1));
+  // the rows for nonincreasing exponents, by those exponents
+  std::map<std::vector<size_t>, std::vector<long double>> sorted_row;
+  std::vector<size_t> q(s);
+  for (size_t a = 0; a < m; a++) {
+    // the rows j with nonincreasing positive exponents
+    if (expo[a].size() != s) {continue;}
+    std::vector<size_t> j(s);
+    bool sorted = true;
+    for (size_t v = 0; v < s; v++) {
+      j[v] = expo[a][v].second;
+      sorted = sorted && (v == 0 || j[v] <= j[v - 1]);
+    }
+    if (!sorted) {continue;}
+    std::vector<long double>& row = sorted_row[j];
+    row.assign(m, 0.0);
+    std::fill(q.begin(), q.end(), 0);
+    while (true) {
+      // the next 0 < q <= j
+      size_t v = 0;
+      while (v < s && q[v] == j[v]) {q[v++] = 0;}
+      if (v == s) {break;}
+      q[v]++;
+      size_t q_sum = 0;
+      size_t q_support = 0;
+      for (size_t u = 0; u < s; u++) {
+        q_sum += q[u];
+        q_support |= (q[u] > 0 ? (size_t)1 << u : 0);
+      }
+      long double c = ((k - q_sum) % 2 == 0 ? 1.0 : -1.0);
+      for (size_t u = 0; u < s; u++) {
+        c *= binomial[j[u]][q[u]];
+        long double x = (long double)(k * q[u]) / q_sum;
+        gen[u][0] = 1.0;
+        for (size_t e = 1; e <= k; e++) {
+          gen[u][e] = gen[u][e - 1] * (x - (e - 1)) / e;
+        }
+      }
+      for (size_t e = 0; e < k; e++) {c *= (long double)q_sum / k;}
+      for (size_t b = 0; b < m; b++) {
+        // zero if b uses a variable q does not
+        if ((support[b] & ~q_support) != 0) {continue;}
+        long double w = c;
+        for (const std::pair<size_t, size_t>& ve : expo[b]) {
+          w *= gen[ve.first][ve.second];
+        }
+        row[b] += w;
+      }
+    }
+  }
+  // the other rows : with the variables sorted by decreasing exponent,
+  // direction b of j is the direction of the sorted exponents
+  interp.weight.resize(m);
+  std::vector<size_t> j(s), perm(s), to_sorted(s), dir(k);
+  for (size_t a = 0; a < m; a++) {
+    if (expo[a].size() != s) {continue;}
+    for (size_t v = 0; v < s; v++) {perm[v] = v;}
+    std::stable_sort(perm.begin(), perm.end(), [&expo, a](size_t u, size_t v) {
+      return expo[a][u].second > expo[a][v].second;
+    });
+    for (size_t v = 0; v < s; v++) {
+      j[v] = expo[a][perm[v]].second;
+      to_sorted[perm[v]] = v;
+    }
+    const std::vector<long double>& row = sorted_row[j];
+    std::vector<double>& weight = interp.weight[a];
+    weight.resize(m);
+    for (size_t b = 0; b < m; b++) {
+      for (size_t e = 0; e < k; e++) {
+        dir[e] = to_sorted[interp.dirs[b][e]];
+      }
+      std::sort(dir.begin(), dir.end());
+      weight[b] = (double)row[rank(&dir[0], k)];
+    }
+  }
+}
+
+template <typename Base>
+std::shared_ptr<DerivativeTensor<size_t, Base>> BaseTaylorTensor<Base>::compute(
+    size_t ind_num, size_t dep_num) {
+  if (ind_num != compiled->get_num_ind()) {
+    warning_NumberInconsistent("independent", ind_num,
+                               compiled->get_num_ind());
+    return nullptr;
+  }
+  if (dep_num != compiled->get_num_dep()) {
+    warning_NumberInconsistent("dependent", dep_num,
+                               compiled->get_num_dep());
+    return nullptr;
+  }
+  if (order < 1 || order > REVERSEAD_MAX_GENERIC_ORDER) {
+    warning_UnsupportedOrder("BaseTaylorTensor", order);
+    return nullptr;
+  }
+  if (!compiled->get_ext_calls().empty()) {
+    warning_ExtFuncRefused("BaseTaylorTensor");
+    return nullptr;
+  }
+  num_ind = ind_num;
+  init_binomial(num_ind);
+  std::shared_ptr<DerivativeTensor<size_t, Base>> ret =
+      std::make_shared<DerivativeTensor<size_t, Base>>(dep_num, num_ind, order);
+  std::vector<Base> dep_val(dep_num);
+  compiled->evaluate(compiled->get_ind_value().data(), dep_val.data());
+  // the trace is in SSA form, so these are the values of every SAC
+  const std::vector<Base> value = compiled->get_value();
+  for (size_t dep = 0; dep < dep_num; dep++) {
+    ret->put_dep_value(dep, dep_val[dep]);
+  }
+
+  std::vector<Base> coef;
+  std::vector<size_t> x(order), s_var(order), global(order), dir_rank;
+  std::vector<Base> deriv(dep_num);
+  for (size_t k = 1; k <= order; k++) {
+    if (num_ind == 0) {break;}
+    size_t num_dir = num_multiset(num_ind, k);
+    coef.assign(num_dir * dep_num, Base(0.0));
+    run_threads(num_dir, [&](size_t /*t*/, size_t lo, size_t hi) {
+      std::vector<Base> series;
+      sweep(k, lo, hi, value, coef.data(), series);
+    });
+    if (interp.size() <= k) {interp.resize(k + 1);}
+    if (interp[k].size() <= std::min(k, num_ind)) {
+      interp[k].resize(std::min(k, num_ind) + 1);
+      for (size_t s = 1; s <= std::min(k, num_ind); s++) {
+        if (interp[k][s].dirs.empty()) {
+          init_interpolation(s, k, interp[k][s]);
+        }
+      }
+    }
+    for (size_t dep = 0; dep < dep_num; dep++) {
+      ret->init_single_tensor(dep, k, num_dir);
+    }
+    // The derivatives by their support S : the directions on S are ranked
+    // once for all the derivatives using every variable of S. The rank of
+    // a derivative among all of them is the one of the same direction.
+    for (size_t s = 1; s <= std::min(k, num_ind); s++) {
+      const Interpolation& in = interp[k][s];
+      dir_rank.resize(in.dirs.size());
+      for (size_t v = 0; v < s; v++) {s_var[v] = v;}
+      do {
+        for (size_t b = 0; b < in.dirs.size(); b++) {
+          for (size_t m = 0; m < k; m++) {global[m] = s_var[in.dirs[b][m]];}
+          dir_rank[b] = rank(&global[0], k);
+        }
+        for (size_t a = 0; a < in.dirs.size(); a++) {
+          const std::vector<double>& w = in.weight[a];
+          if (w.empty()) {continue;}
+          std::fill(deriv.begin(), deriv.end(), Base(0.0));
+          for (size_t b = 0; b < in.dirs.size(); b++) {
+            const Base* c = &coef[dir_rank[b] * dep_num];
+            for (size_t dep = 0; dep < dep_num; dep++) {
+              deriv[dep] += w[b] * c[dep];
+            }
+          }
+          for (size_t m = 0; m < k; m++) {
+            x[m] = s_var[in.dirs[a][k - 1 - m]];
+          }
+          for (size_t dep = 0; dep < dep_num; dep++) {
+            ret->put_value(dep, k, dir_rank[a], &x[0], deriv[dep]);
+          }
+        }
+      } while (next_subset(&s_var[0], s, num_ind));
+    }
+  }
+  return ret;
+}
+
+template <typename Base>
+void BaseTaylorTensor<Base>::sweep(size_t k, size_t lo, size_t hi,
+                                   const std::vector<Base>& value,
+                                   Base* coef,
+                                   std::vector<Base>& series) const {
+  using std::sin;
+  using std::cos;
+  using std::sqrt;
+  using std::log;
+  using std::exp;
+
+  const size_t K = k + 1;
+  const size_t dep_num = compiled->get_num_dep();
+  // slot s at s * K, then temporaries
+  series.assign((compiled->get_num_slot() + 1 + 3) * K, Base(0.0));
+  Base* t1 = &series[(compiled->get_num_slot() + 1) * K];
+  Base* t2 = t1 + K;
+  Base* t3 = t2 + K;
+  std::vector<size_t> dir(k, 0);
+  std::vector<size_t> count(num_ind, 0);
+  // series of exp(P) into R, R[0] given
+  auto exp_series = [k](const Base* P, Base* R) {
+    for (size_t m = 1; m <= k; m++) {
+      Base sum = 0.0;
+      for (size_t j = 1; j <= m; j++) {sum += j * P[j] * R[m - j];}
+      R[m] = sum / m;
+    }
+  };
+  // R' * Q = s * X', R[0] given
+  auto quot_series = [k](const Base* X, const Base* Q, Base s, Base* R) {
+    for (size_t m = 1; m <= k; m++) {
+      Base sum = s * m * X[m];
+      for (size_t j = 1; j < m; j++) {sum -= j * R[j] * Q[m - j];}
+      R[m] = sum / (m * Q[0]);
+    }
+  };
+  // R = X * Y
+  auto mult_series = [k](const Base* X, const Base* Y, Base* R) {
+    for (size_t m = 0; m <= k; m++) {
+      Base sum = 0.0;
+      for (size_t j = 0; j <= m; j++) {sum += X[j] * Y[m - j];}
+      R[m] = sum;
+    }
+  };
+
+  // the directions of order k from lo on
+  for (size_t d = 0; d < lo; d++) {
+    next_multiset(&dir[0], k, num_ind);
+  }
+
+  for (size_t d = lo; d < hi; d++, next_multiset(&dir[0], k, num_ind)) {
+    std::fill(count.begin(), count.end(), 0);
+    for (size_t v : dir) {count[v]++;}
+    size_t ind_count = 0;
+    size_t dep_count = 0;
+    for (const typename CompiledTrace<Base>::Instruction& ins :
+             compiled->get_instructions()) {
+      Base* R = &series[ins.r * K];
+      const Base* X = &series[ins.x * K];
+      const Base* Y = &series[ins.y * K];
+      const Base c = ins.coval;
+      switch (ins.op) {
+        case assign_ind:
+        {
+          Base* I = &series[ins.x * K];
+          I[0] = value[ins.x];
+          I[1] = (Base)count[ind_count++];
+          for (size_t m = 2; m <= k; m++) {I[m] = 0.0;}
+        }
+          continue;
+        case assign_dep:
+          coef[d * dep_num + dep_count++] = X[k];
+          continue;
+        case comp_eq:
+        case comp_lt:
+          continue;
+        default:
+          break;
+      }
+      R[0] = value[ins.r];
+      switch (ins.op) {
+        case assign_d:
+        case assign_param:
+          for (size_t m = 1; m <= k; m++) {R[m] = 0.0;}
+          break;
+        case assign_a:
+        case eq_plus_d:
+        case plus_d_a:
+          for (size_t m = 1; m <= k; m++) {R[m] = X[m];}
+          break;
+        case minus_d_a:
+          for (size_t m = 1; m <= k; m++) {R[m] = -X[m];}
+          break;
+        case eq_plus_a:
+        case plus_a_a:
+          for (size_t m = 1; m <= k; m++) {R[m] = X[m] + Y[m];}
+          break;
+        case eq_minus_a:
+        case minus_a_a:
+          for (size_t m = 1; m <= k; m++) {R[m] = X[m] - Y[m];}
+          break;
+        case eq_mult_d:
+        case mult_d_a:
+          for (size_t m = 1; m <= k; m++) {R[m] = c * X[m];}
+          break;
+        case eq_mult_a:
+        case mult_a_a:
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = 0.0;
+            for (size_t j = 0; j <= m; j++) {sum += X[j] * Y[m - j];}
+            R[m] = sum;
+          }
+          break;
+        case eq_div_a:
+        case div_a_a:
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = X[m];
+            for (size_t j = 1; j <= m; j++) {sum -= Y[j] * R[m - j];}
+            R[m] = sum / Y[0];
+          }
+          break;
+        case div_d_a:
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = 0.0;
+            for (size_t j = 1; j <= m; j++) {sum -= X[j] * R[m - j];}
+            R[m] = sum / X[0];
+          }
+          break;
+        case sin_a:
+        case cos_a:
+        {
+          // t1 = sin(x), t2 = cos(x)
+          t1[0] = sin(X[0]);
+          t2[0] = cos(X[0]);
+          for (size_t m = 1; m <= k; m++) {
+            Base s = 0.0;
+            Base co = 0.0;
+            for (size_t j = 1; j <= m; j++) {
+              s += j * X[j] * t2[m - j];
+              co -= j * X[j] * t1[m - j];
+            }
+            t1[m] = s / m;
+            t2[m] = co / m;
+          }
+          const Base* S = (ins.op == sin_a ? t1 : t2);
+          for (size_t m = 1; m <= k; m++) {R[m] = S[m];}
+        }
+          break;
+        case asin_a:
+        case acos_a:
+          // t2 = sqrt(1 - x * x)
+          mult_series(X, X, t1);
+          for (size_t m = 0; m <= k; m++) {t1[m] = -t1[m];}
+          t1[0] += 1.0;
+          t2[0] = sqrt(t1[0]);
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = t1[m];
+            for (size_t j = 1; j < m; j++) {sum -= t2[j] * t2[m - j];}
+            t2[m] = sum / (2.0 * t2[0]);
+          }
+          quot_series(X, t2, (ins.op == asin_a ? 1.0 : -1.0), R);
+          break;
+        case atan_a:
+          mult_series(X, X, t1);
+          t1[0] += 1.0;
+          quot_series(X, t1, 1.0, R);
+          break;
+        case sqrt_a:
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = X[m];
+            for (size_t j = 1; j < m; j++) {sum -= R[j] * R[m - j];}
+            R[m] = sum / (2.0 * R[0]);
+          }
+          break;
+        case exp_a:
+          exp_series(X, R);
+          break;
+        case log_a:
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = 0.0;
+            for (size_t j = 1; j < m; j++) {sum += j * R[j] * X[m - j];}
+            R[m] = (X[m] - sum / m) / X[0];
+          }
+          break;
+        case pow_a_d:
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = 0.0;
+            for (size_t j = 1; j <= m; j++) {
+              sum += (c * j - (m - j)) * X[j] * R[m - j];
+            }
+            R[m] = sum / (m * X[0]);
+          }
+          break;
+        case pow_d_a:
+          for (size_t m = 0; m <= k; m++) {t1[m] = log(c) * X[m];}
+          exp_series(t1, R);
+          break;
+        case pow_a_a:
+          // exp(y * log(x))
+          t1[0] = log(X[0]);
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = 0.0;
+            for (size_t j = 1; j < m; j++) {sum += j * t1[j] * X[m - j];}
+            t1[m] = (X[m] - sum / m) / X[0];
+          }
+          mult_series(Y, t1, t3);
+          exp_series(t3, R);
+          break;
+        case erf_a:
+        {
+          // t2 = exp(-x * x)
+          mult_series(X, X, t1);
+          for (size_t m = 0; m <= k; m++) {t1[m] = -t1[m];}
+          t2[0] = exp(t1[0]);
+          exp_series(t1, t2);
+          const Base w = 2.0 / sqrt(PI);
+          for (size_t m = 1; m <= k; m++) {
+            Base sum = 0.0;
+            for (size_t j = 1; j <= m; j++) {sum += j * X[j] * t2[m - j];}
+            R[m] = w * sum / m;
+          }
+        }
+          break;
+        case fabs_a:
+        {
+          Base s = (X[0] < 0.0 ? -1.0 : 1.0);
+          for (size_t m = 1; m <= k; m++) {R[m] = s * X[m];}
+        }
+          break;
+        default:
+          warning_UnrecognizedOpcode((int)ins.op);
+      }
+    }
+  }
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_BASE_TAYLOR_TENSOR_H_
@@ -0,0 +1,315 @@
+#ifndef REVERSEAD_BATCH_REPLAY_H_
+#define REVERSEAD_BATCH_REPLAY_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
+#include "reversead/algorithm/dense_replay.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// Evaluates one trace at many points in one pass over its instructions.
+// Points are taken kLanes at a time and the values are stored structure of
+// arrays (kLanes consecutive values per slot), so every SAC is a fixed
+// length loop over the points that the compiler vectorizes. Blocks of points
+// are shared out to set_num_threads() workers (one by default), each with
+// its own value buffer. External functions are called once per point (from
+// several threads at a time with more than one worker).
+//
+// ind_val is num_points x ind_num and dep_val num_points x dep_num, both row
+// major. Parameters keep their traced values.
+template <typename Base>
+class BatchReplay {
+ public:
+  static const size_t kLanes = 8;
+
+  BatchReplay(const std::shared_ptr<TrivialTrace<Base>>& trace)
+      : trace(trace),
+        compiled(std::make_shared<CompiledTrace<Base>>(trace)),
+        num_threads(1) {}
+  BatchReplay(const std::shared_ptr<TrivialTrace<Base>>& trace,
+              const std::shared_ptr<CompiledTrace<Base>>& compiled)
+      : trace(trace), compiled(compiled), num_threads(1) {}
+
+  void set_num_threads(size_t num_threads) {
+    this->num_threads = (num_threads > 0 ? num_threads : 1);
+  }
+
+  // dependent values only
+  void evaluate(const Base* const ind_val, size_t ind_num,
+                Base* dep_val, size_t dep_num, size_t num_points);
+
+  // dependent values and a new trace for every point
+  std::vector<std::shared_ptr<TrivialTrace<Base>>> replay(
+      const Base* const ind_val, size_t ind_num,
+      Base* dep_val, size_t dep_num, size_t num_points);
+
+ private:
+  bool check_number(size_t ind_num, size_t dep_num) const;
+
+  // evaluates the points [lo, hi), hi - lo <= kLanes
+  void sweep_block(const Base* const ind_val, Base* dep_val,
+                   size_t lo, size_t hi, std::vector<Base>& value) const;
+
+  // job(lo, hi) is called for each of the num_threads parts of [0, size),
+  // a worker keeps its own buffers
+  void run_threads(size_t size,
+                   const std::function<void(size_t, size_t)>& job) const;
+
+  std::shared_ptr<TrivialTrace<Base>> trace;
+  std::shared_ptr<CompiledTrace<Base>> compiled;
+  size_t num_threads;
+};
+
+template <typename Base>
+const size_t BatchReplay<Base>::kLanes;
+
+template <typename Base>
+bool BatchReplay<Base>::check_number(size_t ind_num, size_t dep_num) const {
+  if (ind_num != compiled->get_num_ind()) {
+    warning_NumberInconsistent("independent", ind_num,
+                               compiled->get_num_ind());
+    return false;
+  }
+  if (dep_num != compiled->get_num_dep()) {
+    warning_NumberInconsistent("dependent", dep_num,
+                               compiled->get_num_dep());
+    return false;
+  }
+  return true;
+}
+
+template <typename Base>
+void BatchReplay<Base>::run_threads(
+    size_t size,
+    const std::function<void(size_t, size_t)>& job) const {
+  size_t num_workers = std::max<size_t>(1, std::min(num_threads, size));
+  if (num_workers == 1) {
+    job(0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < num_workers; t++) {
+    workers.emplace_back(job, size * t / num_workers,
+                         size * (t + 1) / num_workers);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+template <typename Base>
+void BatchReplay<Base>::evaluate(const Base* const ind_val, size_t ind_num,
+                                 Base* dep_val, size_t dep_num,
+                                 size_t num_points) {
+  if (!check_number(ind_num, dep_num)) {return;}
+  size_t num_blocks = (num_points + kLanes - 1) / kLanes;
+  run_threads(num_blocks, [&](size_t lo, size_t hi) {
+    std::vector<Base> value;
+    for (size_t b = lo; b < hi; b++) {
+      sweep_block(ind_val, dep_val, b * kLanes,
+                  std::min(num_points, (b + 1) * kLanes), value);
+    }
+  });
+}
+
+template <typename Base>
+std::vector<std::shared_ptr<TrivialTrace<Base>>> BatchReplay<Base>::replay(
+    const Base* const ind_val, size_t ind_num,
+    Base* dep_val, size_t dep_num, size_t num_points) {
+  std::vector<std::shared_ptr<TrivialTrace<Base>>> ret(num_points);
+  if (!check_number(ind_num, dep_num)) {return ret;}
+  run_threads(num_points, [&](size_t lo, size_t hi) {
+    DenseReplay<Base> dense(trace, compiled);
+    for (size_t p = lo; p < hi; p++) {
+      ret[p] = dense.replay_ind(&dep_val[p * dep_num], dep_num,
+                                &ind_val[p * ind_num], ind_num);
+    }
+  });
+  return ret;
+}
+
+template <typename Base>
+void BatchReplay<Base>::sweep_block(const Base* const ind_val, Base* dep_val,
+                                    size_t lo, size_t hi,
+                                    std::vector<Base>& value) const {
+  using std::sin;
+  using std::cos;
+  using std::asin;
+  using std::acos;
+  using std::atan;
+  using std::sqrt;
+  using std::pow;
+  using std::log;
+  using std::exp;
+  using std::fabs;
+  using std::erf;
+
+  const size_t L = kLanes;
+  const size_t ind_num = compiled->get_num_ind();
+  const size_t dep_num = compiled->get_num_dep();
+  const std::vector<Base>& param_value = compiled->get_param_value();
+  // slot s of lane l at s * L + l, slot 0 stays zero
+  if (value.size() != (compiled->get_num_slot() + 1) * L) {
+    value.assign((compiled->get_num_slot() + 1) * L, Base(0.0));
+  }
+  Base* v = value.data();
+  size_t ind_count = 0;
+  size_t dep_count = 0;
+  size_t param_count = 0;
+  size_t ext_count = 0;
+  std::vector<Base> ext_value;
+  for (const typename CompiledTrace<Base>::Instruction& ins :
+           compiled->get_instructions()) {
+    Base* vr = v + ins.r * L;
+    const Base* vx = v + ins.x * L;
+    const Base* vy = v + ins.y * L;
+    const Base c = ins.coval;
+    switch (ins.op) {
+      case assign_ind:
+        // the lanes past hi repeat the last point
+        for (size_t l = 0; l < L; l++) {
+          size_t p = std::min(lo + l, hi - 1);
+          v[ins.x * L + l] = ind_val[p * ind_num + ind_count];
+        }
+        ind_count++;
+        break;
+      case assign_dep:
+        for (size_t p = lo; p < hi; p++) {
+          dep_val[p * dep_num + dep_count] = vx[p - lo];
+        }
+        dep_count++;
+        break;
+      case assign_param:
+        for (size_t l = 0; l < L; l++) {vr[l] = param_value[param_count];}
+        param_count++;
+        break;
+      case assign_d:
+        for (size_t l = 0; l < L; l++) {vr[l] = c;}
+        break;
+      case assign_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l];}
+        break;
+      case comp_eq:
+        for (size_t l = 0; l < hi - lo; l++) {
+          bool flag = (vx[l] == vy[l]);
+          if ((!flag && c == 1.0) || (flag && c != 1.0)) {
+            warning_BranchInconsistent<Base>(vx[l], "==", vy[l]);
+            break;
+          }
+        }
+        break;
+      case comp_lt:
+        for (size_t l = 0; l < hi - lo; l++) {
+          bool flag = (vx[l] < vy[l]);
+          if ((!flag && c == 1.0) || (flag && c != 1.0)) {
+            warning_BranchInconsistent<Base>(vx[l], "<", vy[l]);
+            break;
+          }
+        }
+        break;
+      case eq_plus_a:
+      case plus_a_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l] + vy[l];}
+        break;
+      case eq_plus_d:
+      case plus_d_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l] + c;}
+        break;
+      case eq_minus_a:
+      case minus_a_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l] - vy[l];}
+        break;
+      case minus_d_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = c - vx[l];}
+        break;
+      case eq_mult_a:
+      case mult_a_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l] * vy[l];}
+        break;
+      case eq_mult_d:
+      case mult_d_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l] * c;}
+        break;
+      case eq_div_a:
+      case div_a_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = vx[l] / vy[l];}
+        break;
+      case div_d_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = c / vx[l];}
+        break;
+      case sin_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = sin(vx[l]);}
+        break;
+      case cos_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = cos(vx[l]);}
+        break;
+      case asin_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = asin(vx[l]);}
+        break;
+      case acos_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = acos(vx[l]);}
+        break;
+      case atan_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = atan(vx[l]);}
+        break;
+      case sqrt_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = sqrt(vx[l]);}
+        break;
+      case exp_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = exp(vx[l]);}
+        break;
+      case log_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = log(vx[l]);}
+        break;
+      case pow_a_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = pow(vx[l], vy[l]);}
+        break;
+      case pow_a_d:
+        for (size_t l = 0; l < L; l++) {vr[l] = pow(vx[l], c);}
+        break;
+      case pow_d_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = pow(c, vx[l]);}
+        break;
+      case erf_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = erf(vx[l]);}
+        break;
+      case fabs_a:
+        for (size_t l = 0; l < L; l++) {vr[l] = fabs(vx[l]);}
+        break;
+      case ext_func:
+      {
+        const ExternalCall<Base>& call =
+            compiled->get_ext_calls()[ext_count++];
+        ext_value.resize(call.x.size() + call.y.size());
+        Base* ex = ext_value.data();
+        Base* ey = ex + call.x.size();
+        for (size_t l = 0; l < hi - lo; l++) {
+          for (size_t i = 0; i < call.x.size(); i++) {
+            ex[i] = v[call.x[i] * L + l];
+          }
+          call.func->eval_primal(ex, ey);
+          for (size_t j = 0; j < call.y.size(); j++) {
+            v[call.y[j] * L + l] = ey[j];
+          }
+        }
+      }
+        break;
+      default:
+        warning_UnrecognizedOpcode((int)ins.op);
+    }
+  }
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_BATCH_REPLAY_H_
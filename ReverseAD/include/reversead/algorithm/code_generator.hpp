@@ -0,0 +1,54 @@
+#ifndef REVERSEAD_CODE_GENERATOR_H_
+#define REVERSEAD_CODE_GENERATOR_H_
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
+
+namespace ReverseAD {
+
+// Emits standalone straight-line C++ (no ReverseAD headers needed) for a
+// trace, one local variable per value of a slot of the CompiledTrace:
+//   void <name>_function(const double* x, double* y);
+//   void <name>_gradient(const double* x, const double* w,
+//                        double* y, double* g);            // g = w^T f'(x)
+//   void <name>_hessian_vector(const double* x, const double* w,
+//                              const double* v, double* y, double* g,
+//                              double* hv);     // hv = (sum_j w_j f_j'') v
+// The reverse sweep is unrolled with the partials of every SAC inlined,
+// the Hessian-vector product is forward over reverse along v.
+// Parameters are fixed to the values on the trace and the branches taken
+// while tracing are assumed (comparisons are not emitted). External
+// functions can not be emitted, nothing is generated for a trace that calls
+// them.
+class CodeGenerator {
+ public:
+  CodeGenerator(const std::shared_ptr<TrivialTrace<double>>& trace,
+                const std::string& name = "reversead")
+      : trace(trace), compiled(trace), name(name) {}
+
+  void generate(std::ostream& os, bool hessian_vector = true);
+
+  // A main() that includes source_file (the output of generate) and checks
+  // the generated functions at the point on the trace against
+  // BaseReverseHessian. The program returns 0 on success.
+  void generate_harness(std::ostream& os, const std::string& source_file,
+                        bool hessian_vector = true);
+
+ private:
+  // function bodies, tangent adds the forward derivative along v
+  void generate_forward(std::ostream& os, bool tangent);
+  void generate_reverse(std::ostream& os, bool tangent);
+
+  std::shared_ptr<TrivialTrace<double>> trace;
+  CompiledTrace<double> compiled;
+  std::string name;
+};
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_CODE_GENERATOR_H_
@@ -0,0 +1,354 @@
+#ifndef REVERSEAD_COMPACT_THIRD_H_
+#define REVERSEAD_COMPACT_THIRD_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/algorithm/algorithm_common.hpp"
+#include "reversead/algorithm/trivial_hessian.hpp"
+
+namespace ReverseAD {
+
+// Sparse symmetric third order tensor, a drop-in for TrivialThird.
+// Every entry is kept once with sorted indices x >= y >= z. The entries of
+// one x form a block: a flat open addressing table of (y, z, w) slots, so
+// an update is one row lookup and a probe in contiguous memory, and
+// get_and_erase(x) reads and drops a single block. The slot arrays of
+// erased blocks are pooled and reused by new ones.
+template <typename LocType, typename Base>
+class CompactThird {
+ public:
+  CompactThird() : live(0), last_x(NULL_LOC), last_row(nullptr) {}
+  CompactThird(const CompactThird<LocType, Base>& other)
+      : rows(other.rows), live(other.live),
+        last_x(NULL_LOC), last_row(nullptr) {}
+  CompactThird(CompactThird<LocType, Base>&& other)
+      : rows(std::move(other.rows)), pool(std::move(other.pool)),
+        live(other.live), last_x(NULL_LOC), last_row(nullptr) {
+    other.clear();
+  }
+  CompactThird<LocType, Base>& operator=(const CompactThird<LocType, Base>& other) {
+    rows = other.rows;
+    live = other.live;
+    last_row = nullptr;
+    return *this;
+  }
+  CompactThird<LocType, Base>& operator=(CompactThird<LocType, Base>&& other) {
+    rows = std::move(other.rows);
+    pool = std::move(other.pool);
+    live = other.live;
+    last_row = nullptr;
+    other.clear();
+    return *this;
+  }
+  ~CompactThird() = default;
+
+  TrivialHessian<LocType, Base> get_and_erase(const LocType& x);
+
+  void increase(const LocType& x, const LocType& y, const LocType& z,
+                const Base& w) {
+    if (IsZero(w)) {return;}
+    LocType a = x, b = y, c = z;
+    if (a < b) {std::swap(a, b);}
+    if (b < c) {std::swap(b, c);}
+    if (a < b) {std::swap(a, b);}
+    add(get_row(a), b, c, w);
+  }
+
+  void clear() {
+    rows.clear();
+    pool.clear();
+    live = 0;
+    last_row = nullptr;
+  }
+
+  // the x of all blocks, increasing
+  std::vector<LocType> get_row_keys() const {
+    std::vector<LocType> ret;
+    for (const auto& kv : rows) {
+      ret.push_back(kv.first);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  }
+
+  // serializable, same layout as TrivialThird
+  CompactThird(char* buf);
+  size_t get_size() const {return live;}
+  size_t byte_size() const;
+  void write_to_byte(char*) const;
+  void debug() const;
+
+ private:
+  struct Slot {
+    // y == NULL_LOC marks an empty slot
+    LocType y, z;
+    Base w;
+  };
+
+  struct Row {
+    std::vector<Slot> slots;
+    size_t size;
+  };
+
+ public:
+  // visits the entries in increasing (x, y, z), sorting one block at a time
+  class enumerator {
+   public:
+    bool has_next() {
+      return _pos < _slots.size();
+    }
+    bool get_next(LocType& x, LocType& y, LocType& z, Base& w) {
+      x = _rows[_row_pos].first;
+      y = _slots[_pos]->y;
+      z = _slots[_pos]->z;
+      w = _slots[_pos]->w;
+      if (++_pos == _slots.size()) {
+        ++_row_pos;
+        find_next();
+      }
+      return has_next();
+    }
+
+   private:
+    enumerator(const CompactThird<LocType, Base>* const third)
+        : _row_pos(0), _pos(0) {
+      for (const auto& kv : third->rows) {
+        _rows.emplace_back(kv.first, &(kv.second));
+      }
+      std::sort(_rows.begin(), _rows.end(),
+                [](const std::pair<LocType, const Row*>& l,
+                   const std::pair<LocType, const Row*>& r) {
+        return l.first < r.first;
+      });
+      find_next();
+    }
+    // loads the first nonempty block from _row_pos on
+    void find_next() {
+      _slots.clear();
+      _pos = 0;
+      for (; _row_pos < _rows.size(); ++_row_pos) {
+        for (const Slot& slot : _rows[_row_pos].second->slots) {
+          if (slot.y != NULL_LOC) {_slots.push_back(&slot);}
+        }
+        if (!_slots.empty()) {break;}
+      }
+      std::sort(_slots.begin(), _slots.end(),
+                [](const Slot* l, const Slot* r) {
+        return (l->y != r->y ? l->y < r->y : l->z < r->z);
+      });
+    }
+    std::vector<std::pair<LocType, const Row*>> _rows;
+    std::vector<const Slot*> _slots;
+    size_t _row_pos;
+    size_t _pos;
+
+    friend class CompactThird<LocType, Base>;
+  };
+  enumerator get_enumerator() const;
+
+ private:
+  static const size_t kInitSlots = 8;
+  // only small slot arrays are pooled, large ones go back to the allocator
+  static const size_t kMaxPool = 64;
+  static const size_t kMaxPoolSlots = 1024;
+
+  static size_t hash(const LocType& y, const LocType& z) {
+    uint64_t h = (uint64_t)y * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)z * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+    return (size_t)(h ^ (h >> 32));
+  }
+
+  Row& get_row(const LocType& x);
+  void add(Row& row, const LocType& y, const LocType& z, const Base& w);
+  // doubles the slots of row and reinserts its entries
+  void grow(Row& row);
+  // a slot array of the given size, from the pool if possible
+  void take_slots(std::vector<Slot>& slots, size_t size);
+  void put_slots(std::vector<Slot>& slots);
+
+  std::unordered_map<LocType, Row> rows;
+  std::vector<std::vector<Slot>> pool;
+  size_t live;
+  // the row of the last update, consecutive updates often share x
+  LocType last_x;
+  Row* last_row;
+};
+
+template <typename LocType, typename Base>
+const size_t CompactThird<LocType, Base>::kInitSlots;
+
+template <typename LocType, typename Base>
+const size_t CompactThird<LocType, Base>::kMaxPool;
+
+template <typename LocType, typename Base>
+const size_t CompactThird<LocType, Base>::kMaxPoolSlots;
+
+template <typename LocType, typename Base>
+typename CompactThird<LocType, Base>::enumerator
+    CompactThird<LocType, Base>::get_enumerator() const {
+  typename CompactThird<LocType, Base>::enumerator ret(this);
+  return ret;
+}
+
+template <typename LocType, typename Base>
+void CompactThird<LocType, Base>::take_slots(std::vector<Slot>& slots,
+                                             size_t size) {
+  Slot empty;
+  empty.y = NULL_LOC;
+  empty.z = NULL_LOC;
+  empty.w = Base(0.0);
+  if (!pool.empty()) {
+    slots.swap(pool.back());
+    pool.pop_back();
+  }
+  slots.assign(size, empty);
+}
+
+template <typename LocType, typename Base>
+void CompactThird<LocType, Base>::put_slots(std::vector<Slot>& slots) {
+  if (pool.size() < kMaxPool && slots.capacity() <= kMaxPoolSlots) {
+    pool.push_back(std::move(slots));
+  }
+}
+
+template <typename LocType, typename Base>
+typename CompactThird<LocType, Base>::Row&
+    CompactThird<LocType, Base>::get_row(const LocType& x) {
+  if (last_row != nullptr && last_x == x) {return *last_row;}
+  typename std::unordered_map<LocType, Row>::iterator iter = rows.find(x);
+  if (iter == rows.end()) {
+    iter = rows.emplace(x, Row()).first;
+    take_slots(iter->second.slots, kInitSlots);
+    iter->second.size = 0;
+  }
+  last_x = x;
+  last_row = &(iter->second);
+  return iter->second;
+}
+
+template <typename LocType, typename Base>
+void CompactThird<LocType, Base>::add(Row& row, const LocType& y,
+                                      const LocType& z, const Base& w) {
+  if ((row.size + 1) * 8 > row.slots.size() * 7) {
+    grow(row);
+  }
+  size_t mask = row.slots.size() - 1;
+  size_t i = hash(y, z) & mask;
+  Slot* slots = row.slots.data();
+  while (slots[i].y != NULL_LOC) {
+    if (slots[i].y == y && slots[i].z == z) {
+      slots[i].w += w;
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  slots[i].y = y;
+  slots[i].z = z;
+  slots[i].w = w;
+  row.size++;
+  live++;
+}
+
+template <typename LocType, typename Base>
+void CompactThird<LocType, Base>::grow(Row& row) {
+  std::vector<Slot> old;
+  old.swap(row.slots);
+  take_slots(row.slots, old.size() * 2);
+  size_t mask = row.slots.size() - 1;
+  for (const Slot& slot : old) {
+    if (slot.y == NULL_LOC) {continue;}
+    size_t i = hash(slot.y, slot.z) & mask;
+    while (row.slots[i].y != NULL_LOC) {i = (i + 1) & mask;}
+    row.slots[i] = slot;
+  }
+  put_slots(old);
+}
+
+template <typename LocType, typename Base>
+TrivialHessian<LocType, Base> CompactThird<LocType, Base>::get_and_erase(
+    const LocType& x) {
+  TrivialHessian<LocType, Base> ret;
+  typename std::unordered_map<LocType, Row>::iterator iter = rows.find(x);
+  if (iter == rows.end()) {return ret;}
+  for (const Slot& slot : iter->second.slots) {
+    if (slot.y != NULL_LOC) {
+      ret[slot.y][slot.z] = slot.w;
+    }
+  }
+  live -= iter->second.size;
+  put_slots(iter->second.slots);
+  rows.erase(iter);
+  last_row = nullptr;
+  return ret;
+}
+
+template <typename LocType, typename Base>
+void CompactThird<LocType, Base>::debug() const {
+  typename CompactThird<LocType, Base>::enumerator d_enum =
+      this->get_enumerator();
+  LocType x, y, z;
+  Base w;
+  while (d_enum.has_next()) {
+    d_enum.get_next(x, y, z, w);
+    std::cout << "T[" << x << ", " << y << ", " << z << "] = "
+              << w << std::endl;
+  }
+}
+
+template <typename LocType, typename Base>
+size_t CompactThird<LocType, Base>::byte_size() const {
+  return get_size() * (sizeof(double) + sizeof(LocType) * 3) + sizeof(size_t);
+}
+
+template <typename LocType, typename Base>
+void CompactThird<LocType, Base>::write_to_byte(char* buf) const {
+  char* p = buf;
+  *((size_t*)p) = get_size();
+  p += sizeof(size_t);
+
+  typename CompactThird<LocType, Base>::enumerator d_enum =
+      this->get_enumerator();
+  LocType x, y, z;
+  Base w;
+  while (d_enum.has_next()) {
+    d_enum.get_next(x, y, z, w);
+    *((LocType*)p) = x;
+    p += sizeof(LocType);
+    *((LocType*)p) = y;
+    p += sizeof(LocType);
+    *((LocType*)p) = z;
+    p += sizeof(LocType);
+    *((Base*)p) = w;
+    p += sizeof(Base);
+  }
+}
+
+template <typename LocType, typename Base>
+CompactThird<LocType, Base>::CompactThird(char* buf)
+    : live(0), last_x(NULL_LOC), last_row(nullptr) {
+  char* p = buf;
+  size_t size = *((size_t*)p);
+  p += sizeof(size_t);
+  LocType x, y, z;
+  Base w;
+  for (size_t i = 0; i < size; i++) {
+    x = *((LocType*)p);
+    p += sizeof(LocType);
+    y = *((LocType*)p);
+    p += sizeof(LocType);
+    z = *((LocType*)p);
+    p += sizeof(LocType);
+    w = *((Base*)p);
+    p += sizeof(Base);
+    increase(x, y, z, w);
+  }
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_COMPACT_THIRD_H_
@@ -0,0 +1,437 @@
+#ifndef REVERSEAD_DENSE_REPLAY_H_
+#define REVERSEAD_DENSE_REPLAY_H_
+
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "reversead/activetype/external_function.hpp"
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// Function replay with the values indexed by the dense slots of a
+// CompiledTrace. The decoded trace and the value buffer are kept by the
+// object, so replaying the same trace again only costs the arithmetic and
+// the new value tape. BaseFunctionReplay uses it for every replay.
+// External functions are evaluated at the new inputs, a trace calling them
+// can only be replayed with NewBase = OldBase (nullptr otherwise).
+// The new trace shares the op and location tapes of the old one, unless it
+// has checkpoint regions: those are inlined (as decoded by CompiledTrace)
+// and the new trace gets its own tapes, with the SACs of every region
+// recorded at the new values.
+template <typename OldBase, typename NewBase = OldBase>
+class DenseReplay {
+ public:
+  DenseReplay(const std::shared_ptr<TrivialTrace<OldBase>>& trace)
+      : trace(trace),
+        compiled(std::make_shared<CompiledTrace<OldBase>>(trace)) {}
+  DenseReplay(const std::shared_ptr<TrivialTrace<OldBase>>& trace,
+              const std::shared_ptr<CompiledTrace<OldBase>>& compiled)
+      : trace(trace), compiled(compiled) {}
+
+  std::shared_ptr<TrivialTrace<NewBase>> replay_ind(
+      const NewBase* const ind_val, int ind_num) {
+    return replay((NewBase*)nullptr, compiled->get_num_dep(),
+                  ind_val, ind_num,
+                  (NewBase*)nullptr, compiled->get_num_param(),
+                  false, true, false);
+  }
+
+  std::shared_ptr<TrivialTrace<NewBase>> replay_ind(
+      NewBase* dep_val, int dep_num,
+      const NewBase* const ind_val, int ind_num) {
+    return replay(dep_val, dep_num,
+                  ind_val, ind_num,
+                  (NewBase*)nullptr, compiled->get_num_param(),
+                  true, true, false);
+  }
+
+  // exchanges the value buffer with buffer, e.g. to keep it between two
+  // DenseReplay objects of the same trace
+  void swap_value(std::vector<NewBase>& buffer) {value.swap(buffer);}
+
+  // Same arguments as the private BaseFunctionReplay::replay, values that
+  // are not reset are taken from the trace.
+  std::shared_ptr<TrivialTrace<NewBase>> replay(
+      NewBase* dep_val, int dep_num,
+      const NewBase* const ind_val, int ind_num,
+      const NewBase* const param_val, int param_num,
+      bool reset_dep, bool reset_ind, bool reset_param);
+
+ private:
+  // ops, locations and constants of the instructions, for a trace with
+  // checkpoint regions
+  std::shared_ptr<TrivialTrace<NewBase>> inline_code() const;
+
+  // only a function of NewBase can be called, other replays are refused
+  static void eval_primal(const ExternalFunction<NewBase>& func,
+                          const NewBase* x, NewBase* y) {
+    func.eval_primal(x, y);
+  }
+  template <typename Base>
+  static void eval_primal(const ExternalFunction<Base>& /*func*/,
+                          const NewBase* /*x*/, NewBase* /*y*/) {}
+  static locint add_ext_func(
+      TrivialTrace<NewBase>& code,
+      const std::shared_ptr<ExternalFunction<NewBase>>& func) {
+    return code.add_ext_func(func);
+  }
+  template <typename Base>
+  static locint add_ext_func(
+      TrivialTrace<NewBase>& /*code*/,
+      const std::shared_ptr<ExternalFunction<Base>>& /*func*/) {
+    return NULL_LOC;
+  }
+
+  std::shared_ptr<TrivialTrace<OldBase>> trace;
+  std::shared_ptr<CompiledTrace<OldBase>> compiled;
+  std::vector<NewBase> value;
+  std::vector<NewBase> ext_value;
+};
+
+template <typename OldBase, typename NewBase>
+std::shared_ptr<TrivialTrace<NewBase>> DenseReplay<OldBase, NewBase>::replay(
+    NewBase* dep_val, int dep_num,
+    const NewBase* const ind_val, int ind_num,
+    const NewBase* const param_val, int param_num,
+    bool reset_dep, bool reset_ind, bool reset_param) {
+  using std::sin;
+  using std::cos;
+  using std::asin;
+  using std::acos;
+  using std::atan;
+  using std::sqrt;
+  using std::pow;
+  using std::log;
+  using std::exp;
+  using std::fabs;
+  using std::erf;
+
+  if (reset_param && param_num != (int)compiled->get_num_param()) {
+    warning_NumberInconsistent("parameter", param_num,
+                               compiled->get_num_param());
+  }
+  if (reset_ind && ind_num != (int)compiled->get_num_ind()) {
+    warning_NumberInconsistent("independent", ind_num,
+                               compiled->get_num_ind());
+  }
+  if (reset_dep && dep_num != (int)compiled->get_num_dep()) {
+    warning_NumberInconsistent("dependent", dep_num,
+                               compiled->get_num_dep());
+  }
+  if (!std::is_same<OldBase, NewBase>::value &&
+      !compiled->get_ext_calls().empty()) {
+    warning_ExtFuncReplay();
+    return nullptr;
+  }
+  std::shared_ptr<VirtualTape<NewBase>> val_tape =
+      std::make_shared<VirtualTape<NewBase>>();
+  val_tape->init_taping();
+  std::shared_ptr<VirtualTape<NewBase>> param_tape =
+      std::make_shared<VirtualTape<NewBase>>();
+  param_tape->init_taping();
+
+  // slots never written (e.g. undefined locations) stay zero
+  if (value.size() != compiled->get_num_slot() + 1) {
+    value.assign(compiled->get_num_slot() + 1, NewBase(0.0));
+  }
+  const std::vector<OldBase>& ind_value = compiled->get_ind_value();
+  const std::vector<OldBase>& param_value = compiled->get_param_value();
+  NewBase* v = value.data();
+  int ind_count = 0;
+  int dep_count = 0;
+  int param_count = 0;
+  size_t ext_count = 0;
+  NewBase val1, val2;
+  for (const typename CompiledTrace<OldBase>::Instruction& ins :
+           compiled->get_instructions()) {
+    switch (ins.op) {
+      case assign_ind:
+        if (reset_ind) {
+          // reset: value from function call
+          v[ins.x] = ind_val[ind_count];
+        } else {
+          // no reset: value from trace
+          v[ins.x] = ind_value[ind_count];
+        }
+        ind_count++;
+        val_tape->put(v[ins.x]);
+        break;
+      case assign_dep:
+        if (reset_dep) {
+          dep_val[dep_count++] = v[ins.x];
+        }
+        val_tape->put(v[ins.x]);
+        break;
+      case assign_param:
+        // the new trace reads every parameter back in its reverse sweep
+        if (reset_param) {
+          v[ins.r] = param_val[param_count];
+        } else {
+          v[ins.r] = param_value[param_count];
+        }
+        param_tape->put(v[ins.r]);
+        param_count++;
+        break;
+      case assign_d:
+        v[ins.r] = ins.coval;
+        break;
+      case assign_a:
+        v[ins.r] = v[ins.x];
+        break;
+      case comp_eq:
+      {
+        bool flag = (v[ins.x] == v[ins.y]);
+        if ((!flag && ins.coval == 1.0) || (flag && ins.coval != 1.0)) {
+          warning_BranchInconsistent<NewBase>(v[ins.x], "==", v[ins.y]);
+        }
+      }
+        break;
+      case comp_lt:
+      {
+        bool flag = (v[ins.x] < v[ins.y]);
+        if ((!flag && ins.coval == 1.0) || (flag && ins.coval != 1.0)) {
+          warning_BranchInconsistent<NewBase>(v[ins.x], "<", v[ins.y]);
+        }
+      }
+        break;
+      case eq_plus_a:
+      case plus_a_a:
+        v[ins.r] = v[ins.x] + v[ins.y];
+        break;
+      case eq_plus_d:
+      case plus_d_a:
+        v[ins.r] = v[ins.x] + ins.coval;
+        break;
+      case eq_minus_a:
+      case minus_a_a:
+        v[ins.r] = v[ins.x] - v[ins.y];
+        break;
+      case minus_d_a:
+        v[ins.r] = ins.coval - v[ins.x];
+        break;
+      case eq_mult_a:
+      case mult_a_a:
+        val1 = v[ins.x];
+        val2 = v[ins.y];
+        v[ins.r] = val1 * val2;
+        val_tape->put(val1);
+        val_tape->put(val2);
+        break;
+      case eq_mult_d:
+      case mult_d_a:
+        v[ins.r] = v[ins.x] * ins.coval;
+        break;
+      case eq_div_a:
+      case div_a_a:
+        val1 = v[ins.x];
+        val2 = v[ins.y];
+        v[ins.r] = val1 / val2;
+        val_tape->put(val1);
+        val_tape->put(val2);
+        break;
+      case div_d_a:
+        val1 = v[ins.x];
+        v[ins.r] = ins.coval / val1;
+        val_tape->put(val1);
+        break;
+      case sin_a:
+        val1 = v[ins.x];
+        v[ins.r] = sin(val1);
+        val_tape->put(val1);
+        break;
+      case cos_a:
+        val1 = v[ins.x];
+        v[ins.r] = cos(val1);
+        val_tape->put(val1);
+        break;
+      case asin_a:
+        val1 = v[ins.x];
+        if (val1 < -1 || val1 > 1) {
+          warning_ParameterOutOfBound<NewBase>(val1, "asin");
+        }
+        v[ins.r] = asin(val1);
+        val_tape->put(val1);
+        break;
+      case acos_a:
+        val1 = v[ins.x];
+        if (val1 < -1 || val1 > 1) {
+          warning_ParameterOutOfBound<NewBase>(val1, "acos");
+        }
+        v[ins.r] = acos(val1);
+        val_tape->put(val1);
+        break;
+      case atan_a:
+        val1 = v[ins.x];
+        v[ins.r] = atan(val1);
+        val_tape->put(val1);
+        break;
+      case sqrt_a:
+        val1 = v[ins.x];
+        v[ins.r] = sqrt(val1);
+        val_tape->put(val1);
+        break;
+      case exp_a:
+        val1 = v[ins.x];
+        v[ins.r] = exp(val1);
+        val_tape->put(val1);
+        break;
+      case log_a:
+        val1 = v[ins.x];
+        if (val1 <= 0) {
+          warning_ParameterOutOfBound<NewBase>(val1, "log");
+        }
+        v[ins.r] = log(val1);
+        val_tape->put(val1);
+        break;
+      case pow_a_a:
+        val1 = v[ins.x];
+        val2 = v[ins.y];
+        v[ins.r] = pow(val1, val2);
+        val_tape->put(val1);
+        val_tape->put(val2);
+        break;
+      case pow_a_d:
+        val1 = v[ins.x];
+        v[ins.r] = pow(val1, ins.coval);
+        val_tape->put(val1);
+        break;
+      case pow_d_a:
+        val1 = v[ins.x];
+        v[ins.r] = pow(ins.coval, val1);
+        val_tape->put(val1);
+        break;
+      case erf_a:
+        val1 = v[ins.x];
+        v[ins.r] = erf(val1);
+        val_tape->put(val1);
+        break;
+      case fabs_a:
+        val1 = v[ins.x];
+        v[ins.r] = fabs(val1);
+        val_tape->put(val1);
+        break;
+      case ext_func:
+      {
+        const ExternalCall<OldBase>& call =
+            compiled->get_ext_calls()[ext_count++];
+        ext_value.resize(call.x.size() + call.y.size());
+        NewBase* vx = ext_value.data();
+        NewBase* vy = vx + call.x.size();
+        for (size_t i = 0; i < call.x.size(); i++) {
+          vx[i] = v[call.x[i]];
+          val_tape->put(vx[i]);
+        }
+        eval_primal(*call.func, vx, vy);
+        for (size_t j = 0; j < call.y.size(); j++) {
+          v[call.y[j]] = vy[j];
+        }
+      }
+        break;
+      default:
+        warning_UnrecognizedOpcode((int)ins.op);
+    }
+  }
+  val_tape->end_taping();
+  param_tape->end_taping();
+  std::shared_ptr<TrivialTrace<NewBase>> ret;
+  if (reset_param || reset_ind) {
+    // a new set of param or ind values
+    if (trace->has_region()) {
+      ret = copy_tape<NewBase, NewBase>(inline_code(), val_tape, param_tape);
+    } else {
+      ret = copy_tape<OldBase, NewBase>(trace, val_tape, param_tape);
+    }
+  }
+  return ret;
+}
+
+template <typename OldBase, typename NewBase>
+std::shared_ptr<TrivialTrace<NewBase>>
+    DenseReplay<OldBase, NewBase>::inline_code() const {
+  std::shared_ptr<TrivialTrace<NewBase>> code =
+      std::make_shared<TrivialTrace<NewBase>>();
+  const std::vector<locint>& loc = compiled->get_slot_loc();
+  size_t ext_count = 0;
+  code->init_tracing();
+  code->put_op(start_of_tape);
+  for (const typename CompiledTrace<OldBase>::Instruction& ins :
+           compiled->get_instructions()) {
+    code->put_op(ins.op);
+    if (ins.op == ext_func) {
+      const ExternalCall<OldBase>& call =
+          compiled->get_ext_calls()[ext_count];
+      locint id = add_ext_func(*code, compiled->get_ext_funcs()[ext_count]);
+      ext_count++;
+      code->put_loc(id);
+      for (locint x : call.x) {code->put_loc(loc[x]);}
+      for (locint y : call.y) {code->put_loc(loc[y]);}
+      code->put_loc(id);
+      continue;
+    }
+    // the locations are x, y, r on the tape, those of the op
+    switch (ins.op) {
+      case assign_param:
+      case assign_d:
+        break;
+      default:
+        code->put_loc(loc[ins.x]);
+    }
+    switch (ins.op) {
+      case comp_eq:
+      case comp_lt:
+      case eq_plus_a:
+      case plus_a_a:
+      case eq_minus_a:
+      case minus_a_a:
+      case eq_mult_a:
+      case mult_a_a:
+      case eq_div_a:
+      case div_a_a:
+      case pow_a_a:
+        code->put_loc(loc[ins.y]);
+        break;
+    }
+    switch (ins.op) {
+      case assign_ind:
+        code->declare_ind();
+        break;
+      case assign_dep:
+        code->declare_dep();
+        break;
+      case comp_eq:
+      case comp_lt:
+        break;
+      default:
+        code->put_loc(loc[ins.r]);
+    }
+    switch (ins.op) {
+      case assign_d:
+      case comp_eq:
+      case comp_lt:
+      case eq_plus_d:
+      case plus_d_a:
+      case minus_d_a:
+      case eq_mult_d:
+      case mult_d_a:
+      case div_d_a:
+      case pow_a_d:
+      case pow_d_a:
+        code->put_coval(ins.coval);
+        break;
+    }
+  }
+  code->put_op(end_of_tape);
+  code->end_tracing();
+  return code;
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_DENSE_REPLAY_H_
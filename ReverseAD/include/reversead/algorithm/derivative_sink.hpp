@@ -0,0 +1,52 @@
+#ifndef REVERSEAD_DERIVATIVE_SINK_H_
+#define REVERSEAD_DERIVATIVE_SINK_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace ReverseAD {
+
+// Receives the derivatives of compute(..., sink) entry by entry, in place of
+// a DerivativeTensor. The entries are those get_internal_coordinate_list()
+// would give (the same indices, order by order for each dependent), but
+// they are passed on while the engine reads out its own structures and the
+// engine drops each part right after, so the derivatives are never held
+// twice.
+template <typename Base>
+class DerivativeSink {
+ public:
+  virtual ~DerivativeSink() = default;
+
+  // before anything else, the sizes of the tensor compute() would return
+  virtual void begin(size_t /*dep_size*/, size_t /*ind_size*/,
+                     size_t /*order*/) {}
+  virtual void put_dep_value(size_t /*dep*/, const Base& /*value*/) {}
+  // ind holds order independent indices
+  virtual void put_value(size_t dep, size_t order, const size_t* ind,
+                         const Base& value) = 0;
+  // after the last entry
+  virtual void end() {}
+};
+
+// Passes every entry to a callback, e.g. a writer or the assembly of a
+// solver matrix.
+template <typename Base>
+class FunctionSink : public DerivativeSink<Base> {
+ public:
+  typedef std::function<void(size_t dep, size_t order, const size_t* ind,
+                             const Base& value)> Callback;
+
+  FunctionSink(const Callback& callback) : callback(callback) {}
+
+  void put_value(size_t dep, size_t order, const size_t* ind,
+                 const Base& value) override {
+    callback(dep, order, ind, value);
+  }
+
+ private:
+  Callback callback;
+};
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_DERIVATIVE_SINK_H_
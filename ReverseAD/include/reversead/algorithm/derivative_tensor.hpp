@@ -1,8 +1,14 @@
 #ifndef REVERSEAD_DERIVATIVE_TENSOR_H_
 #define REVERSEAD_DERIVATIVE_TENSOR_H_
 
+#include <algorithm>
+#include <functional>
+#include <iostream>
 #include <map>
 #include <memory>
+#include <vector>
+
+#include "reversead/util/error_info.hpp"
 
 namespace ReverseAD {
 
@@ -12,6 +18,41 @@ template <typename Base> class BaseReverseHessian;
 template <typename Base> class BaseReverseThird;
 template <typename Base> class BaseReverseGeneric;
 template <typename Base> class BaseReverseTensor;
+template <typename Base> class BaseHessianPlan;
+template <typename Base> class BaseTaylorTensor;
+template <size_t DIM> class BaseCompressedDerivative;
+class SingleForward;
+class IterativeFuncBase;
+
+template <typename LocType, typename Base> class DerivativeTensor;
+
+// Where the entries of a DerivativeTensor went in a compressed export
+// (get_jacobian_csr() and the others below). The caller keeps it between
+// calls, a later tensor with the same entries then only writes the values,
+// without sorting or allocating.
+template <typename LocType>
+class DerivativeLayout {
+ public:
+  bool is_built() const {return built;}
+  void clear() {
+    built = false;
+    count.clear();
+    coords.clear();
+    slot.clear();
+  }
+
+ private:
+  template <typename L, typename B> friend class DerivativeTensor;
+  bool built = false;
+  int kind = 0;
+  size_t dep = 0;
+  size_t order = 0;
+  // entries of each dependent, in the order of the tensor
+  std::vector<size_t> count;
+  // the index tuple (as stored) and the slot in the export of each entry
+  std::vector<LocType> coords;
+  std::vector<size_t> slot;
+};
 
 template <typename LocType, typename Base>
 class DerivativeTensor {
@@ -21,12 +62,16 @@ class DerivativeTensor {
   friend class BaseReverseThird<Base>;
   friend class BaseReverseGeneric<Base>;
   friend class BaseReverseTensor<Base>;
-//  friend std::shared_ptr<DerivativeTensor<size_t, double>> strip_derivative(
-//      const std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor,
-//      size_t t_order, size_t ind_size, size_t dep_size);
+  friend class BaseHessianPlan<Base>;
+  friend class BaseTaylorTensor<Base>;
+  friend class IterativeFuncBase;
+  template <size_t DIM> friend class BaseCompressedDerivative;
+  friend std::shared_ptr<DerivativeTensor<size_t, double>> strip_derivative(
+      const std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor,
+      size_t t_order, size_t ind_size, size_t dep_size);
 
  public:
-  DerivativeTensor(): _dep_size(0), _order(0) {}
+  DerivativeTensor(): _dep_size(0), _ind_size(0), _order(0) {}
 
   DerivativeTensor(size_t dep_size, size_t ind_size, size_t order) {
     this->_dep_size = dep_size;
@@ -64,8 +109,49 @@ class DerivativeTensor {
   }
 
   size_t get_dep_size() const {return _dep_size;}
+  size_t get_ind_size() const {return _ind_size;}
+
+  // the number of entries of order, over all dependents
+  size_t get_nnz(size_t order) const;
+
+  // Exports into caller buffers, the indices are those of the independents
+  // and the dependents. With an empty (or no) layout the structure is
+  // written and kept in layout. With a layout built from an earlier tensor
+  // only the values are written and the structure arrays may be nullptr,
+  // false is returned (and nothing written) if the entries are different.
+
+  // Jacobian in CSR, row_ptr has get_dep_size() + 1 entries, col_ind and
+  // values get_nnz(1). Columns are sorted within a row.
+  bool get_jacobian_csr(size_t* row_ptr, LocType* col_ind, Base* values,
+                        DerivativeLayout<LocType>* layout = nullptr) const;
+  // Jacobian in CSC, col_ptr has get_ind_size() + 1 entries.
+  bool get_jacobian_csc(size_t* col_ptr, LocType* row_ind, Base* values,
+                        DerivativeLayout<LocType>* layout = nullptr) const;
+  // Hessian of dep as the lower triangle (rind >= cind) in coordinates,
+  // sorted by row then column.
+  bool get_hessian_coo(size_t dep, LocType* rind, LocType* cind,
+                       Base* values,
+                       DerivativeLayout<LocType>* layout = nullptr) const;
+  // Any order, tind holds order indices per entry, each tuple sorted
+  // decreasingly and the tuples sorted lexicographically.
+  bool get_sorted_coordinate_list(
+      size_t dep, size_t order, LocType* tind, Base* values,
+      DerivativeLayout<LocType>* layout = nullptr) const;
 
  private:
+  enum {
+    kJacobianCSR = 1,
+    kJacobianCSC = 2,
+    kSorted = 3
+  };
+
+  // The entries of order of dependents [dep_lo, dep_hi) are put in the
+  // order of less(dep_a, tuple_a, dep_b, tuple_b), write(k, dep, tuple) is
+  // called for the k-th of them when the structure is built.
+  template <typename Less, typename Write>
+  bool export_entries(size_t dep_lo, size_t dep_hi, size_t order, int kind,
+                      const Less& less, const Write& write, Base* values,
+                      DerivativeLayout<LocType>* layout) const;
 
   class SingleTensor {
    public:
@@ -109,6 +195,19 @@ class DerivativeTensor {
     Base* values;
   };
 
+  // nullptr if dep has no entries of order
+  const SingleTensor* find_single_tensor(size_t dep, size_t order) const {
+    auto d_iter = _data.find(dep);
+    if (d_iter == _data.end()) {
+      return nullptr;
+    }
+    auto o_iter = d_iter->second.find(order);
+    if (o_iter == d_iter->second.end()) {
+      return nullptr;
+    }
+    return o_iter->second.get();
+  }
+
   void init_single_tensor(size_t dep, size_t order, size_t order_size) {
     _data[dep].insert(std::make_pair(order,
         std::make_shared<SingleTensor>(order, order_size)));
@@ -130,6 +229,194 @@ class DerivativeTensor {
   std::vector<Base> _dep_value;
 };
 
+template <typename LocType, typename Base>
+size_t DerivativeTensor<LocType, Base>::get_nnz(size_t order) const {
+  size_t nnz = 0;
+  for (size_t dep = 0; dep < _dep_size; dep++) {
+    const SingleTensor* single = find_single_tensor(dep, order);
+    if (single != nullptr) {
+      nnz += single->get_size();
+    }
+  }
+  return nnz;
+}
+
+template <typename LocType, typename Base>
+bool DerivativeTensor<LocType, Base>::get_jacobian_csr(
+    size_t* row_ptr, LocType* col_ind, Base* values,
+    DerivativeLayout<LocType>* layout) const {
+  bool structure = (layout == nullptr || !layout->is_built());
+  if (structure && row_ptr != nullptr) {
+    std::fill(row_ptr, row_ptr + _dep_size + 1, 0);
+  }
+  bool ret = export_entries(0, _dep_size, 1, kJacobianCSR,
+      [](size_t da, const LocType* a, size_t db, const LocType* b) {
+        return (da != db ? da < db : a[0] < b[0]);
+      },
+      [row_ptr, col_ind](size_t k, size_t dep, const LocType* t) {
+        if (row_ptr != nullptr) {row_ptr[dep + 1]++;}
+        if (col_ind != nullptr) {col_ind[k] = t[0];}
+      }, values, layout);
+  if (structure && row_ptr != nullptr) {
+    for (size_t i = 0; i < _dep_size; i++) {
+      row_ptr[i + 1] += row_ptr[i];
+    }
+  }
+  return ret;
+}
+
+template <typename LocType, typename Base>
+bool DerivativeTensor<LocType, Base>::get_jacobian_csc(
+    size_t* col_ptr, LocType* row_ind, Base* values,
+    DerivativeLayout<LocType>* layout) const {
+  bool structure = (layout == nullptr || !layout->is_built());
+  if (structure && col_ptr != nullptr) {
+    std::fill(col_ptr, col_ptr + _ind_size + 1, 0);
+  }
+  bool ret = export_entries(0, _dep_size, 1, kJacobianCSC,
+      [](size_t da, const LocType* a, size_t db, const LocType* b) {
+        return (a[0] != b[0] ? a[0] < b[0] : da < db);
+      },
+      [col_ptr, row_ind](size_t k, size_t dep, const LocType* t) {
+        if (col_ptr != nullptr) {col_ptr[t[0] + 1]++;}
+        if (row_ind != nullptr) {row_ind[k] = dep;}
+      }, values, layout);
+  if (structure && col_ptr != nullptr) {
+    for (size_t i = 0; i < _ind_size; i++) {
+      col_ptr[i + 1] += col_ptr[i];
+    }
+  }
+  return ret;
+}
+
+template <typename LocType, typename Base>
+bool DerivativeTensor<LocType, Base>::get_hessian_coo(
+    size_t dep, LocType* rind, LocType* cind, Base* values,
+    DerivativeLayout<LocType>* layout) const {
+  if (dep >= _dep_size || _order < 2) {
+    std::cout << "This derivative tensor does not have information about : "
+              << " dep = "<< dep << " order = " << 2 << std::endl;
+    return false;
+  }
+  return export_entries(dep, dep + 1, 2, kSorted,
+      [](size_t, const LocType* a, size_t, const LocType* b) {
+        return (a[0] != b[0] ? a[0] < b[0] : a[1] < b[1]);
+      },
+      [rind, cind](size_t k, size_t, const LocType* t) {
+        if (rind != nullptr) {rind[k] = t[0];}
+        if (cind != nullptr) {cind[k] = t[1];}
+      }, values, layout);
+}
+
+template <typename LocType, typename Base>
+bool DerivativeTensor<LocType, Base>::get_sorted_coordinate_list(
+    size_t dep, size_t order, LocType* tind, Base* values,
+    DerivativeLayout<LocType>* layout) const {
+  if (dep >= _dep_size || order == 0 || order > _order) {
+    std::cout << "This derivative tensor does not have information about : "
+              << " dep = "<< dep << " order = " << order << std::endl;
+    return false;
+  }
+  return export_entries(dep, dep + 1, order, kSorted,
+      [order](size_t, const LocType* a, size_t, const LocType* b) {
+        return std::lexicographical_compare(a, a + order, b, b + order);
+      },
+      [tind, order](size_t k, size_t, const LocType* t) {
+        if (tind != nullptr) {std::copy(t, t + order, &tind[k * order]);}
+      }, values, layout);
+}
+
+template <typename LocType, typename Base>
+template <typename Less, typename Write>
+bool DerivativeTensor<LocType, Base>::export_entries(
+    size_t dep_lo, size_t dep_hi, size_t order, int kind,
+    const Less& less, const Write& write, Base* values,
+    DerivativeLayout<LocType>* layout) const {
+  if (layout != nullptr && layout->built) {
+    // the entries have to be those the layout was built from
+    bool same = (layout->kind == kind && layout->dep == dep_lo &&
+                 layout->order == order &&
+                 layout->count.size() == dep_hi - dep_lo);
+    size_t n = 0;
+    for (size_t dep = dep_lo; same && dep < dep_hi; dep++) {
+      const SingleTensor* single = find_single_tensor(dep, order);
+      size_t size = (single != nullptr ? single->get_size() : 0);
+      if (size != layout->count[dep - dep_lo]) {
+        same = false;
+        break;
+      }
+      for (size_t i = 0; same && i < size; i++, n++) {
+        same = std::equal(single->tind[i], single->tind[i] + order,
+                          &layout->coords[n * order]);
+      }
+    }
+    if (!same) {
+      warning_LayoutInconsistent();
+      return false;
+    }
+    if (values != nullptr) {
+      n = 0;
+      for (size_t dep = dep_lo; dep < dep_hi; dep++) {
+        const SingleTensor* single = find_single_tensor(dep, order);
+        size_t size = (single != nullptr ? single->get_size() : 0);
+        for (size_t i = 0; i < size; i++, n++) {
+          values[layout->slot[n]] = single->values[i];
+        }
+      }
+    }
+    return true;
+  }
+
+  std::vector<size_t> count;
+  std::vector<size_t> dep_of;
+  std::vector<LocType> raw;
+  std::vector<LocType> sorted;
+  for (size_t dep = dep_lo; dep < dep_hi; dep++) {
+    const SingleTensor* single = find_single_tensor(dep, order);
+    size_t size = (single != nullptr ? single->get_size() : 0);
+    count.push_back(size);
+    for (size_t i = 0; i < size; i++) {
+      dep_of.push_back(dep);
+      raw.insert(raw.end(), single->tind[i], single->tind[i] + order);
+      sorted.insert(sorted.end(), single->tind[i], single->tind[i] + order);
+      std::sort(sorted.end() - order, sorted.end(), std::greater<LocType>());
+    }
+  }
+  size_t total = dep_of.size();
+  std::vector<size_t> perm(total);
+  for (size_t n = 0; n < total; n++) {
+    perm[n] = n;
+  }
+  std::stable_sort(perm.begin(), perm.end(), [&](size_t a, size_t b) {
+    return less(dep_of[a], &sorted[a * order], dep_of[b], &sorted[b * order]);
+  });
+  std::vector<size_t> slot(total);
+  for (size_t k = 0; k < total; k++) {
+    slot[perm[k]] = k;
+    write(k, dep_of[perm[k]], &sorted[perm[k] * order]);
+  }
+  if (values != nullptr) {
+    size_t n = 0;
+    for (size_t dep = dep_lo; dep < dep_hi; dep++) {
+      const SingleTensor* single = find_single_tensor(dep, order);
+      size_t size = (single != nullptr ? single->get_size() : 0);
+      for (size_t i = 0; i < size; i++, n++) {
+        values[slot[n]] = single->values[i];
+      }
+    }
+  }
+  if (layout != nullptr) {
+    layout->built = true;
+    layout->kind = kind;
+    layout->dep = dep_lo;
+    layout->order = order;
+    layout->count = std::move(count);
+    layout->coords = std::move(raw);
+    layout->slot = std::move(slot);
+  }
+  return true;
+}
+
 } // namespace ReverseAD
 
 #endif // REVERSEAD_DERIVATIEV_TENSOR_H_
@@ -2,7 +2,7 @@
 #define REVERSEAD_GENERIC_DERIV_H_
 
 #include <vector>
-#include <map>
+#include <unordered_map>
 
 #include "reversead/algorithm/algorithm_common.hpp"
 #include "reversead/algorithm/generic_multiset.hpp"
@@ -11,12 +11,15 @@ namespace ReverseAD {
 
 template <typename LocType, typename Base>
 class GenericDeriv {
+  typedef std::unordered_map<GenericMultiset<LocType>, Base,
+                             GenericMultisetHash<LocType>> GenericMap;
  public:
   GenericDeriv(): _order(0) {};
   GenericDeriv(size_t order): _order(order) {_data.resize(_order);};
   void clear() {
     _data.clear();
     _data.resize(_order);
+    _index.clear();
   }
   void increase(const GenericMultiset<LocType>& set, Base v) {
     if (IsZero(v)) {
@@ -26,13 +29,25 @@ class GenericDeriv {
     if (check_size_fail(order)) {
       return;
     }
-    _data[order-1][set] += v;
+    std::pair<typename GenericMap::iterator, bool> ret =
+        _data[order-1].emplace(set, v);
+    if (ret.second) {
+      add_to_index(set);
+    } else {
+      ret.first->second += v;
+    }
   }
 
   size_t get_size(size_t order) const {
     return _data[order].size();
   }
 
+  size_t get_size() const {
+    size_t ret = 0;
+    for (const GenericMap& m : _data) {ret += m.size();}
+    return ret;
+  }
+
   Base get(const GenericMultiset<LocType>& set) {
     size_t order = set.size();
     if (check_size_fail(order)) {
@@ -44,8 +59,8 @@ class GenericDeriv {
     return _data[order - 1][set];
   }
   void debug() const {
-    typename std::vector<std::map<GenericMultiset<LocType>, Base> >::const_iterator v_iter;
-    typename std::map<GenericMultiset<LocType>, Base >::const_iterator m_iter;
+    typename std::vector<GenericMap >::const_iterator v_iter;
+    typename GenericMap::const_iterator m_iter;
     v_iter = _data.begin();
     while(v_iter != _data.end()) {
       m_iter = (*v_iter).begin();
@@ -59,23 +74,26 @@ class GenericDeriv {
     }
   }
 
+  // Moves every term containing target into gd. Only the terms listed
+  // under target in the index are visited.
   void get_and_erase(LocType target, GenericDeriv& gd) {
     gd.clear();
-    typename std::vector<std::map<GenericMultiset<LocType>, Base> >::iterator v_iter;
-    typename std::map<GenericMultiset<LocType>, Base>::iterator m_iter;
-    v_iter = _data.begin();
-    while(v_iter != _data.end()) {
-      m_iter = v_iter->begin();
-      while(m_iter != v_iter->end()) {
-        if (m_iter->first.find(target)) {
-          gd.increase(m_iter->first, m_iter->second);
-          m_iter = (*v_iter).erase(m_iter);
-        } else {
-          ++m_iter;
-        }
+    typename std::unordered_map<LocType, std::vector<GenericMultiset<LocType>>>
+        ::iterator i_iter = _index.find(target);
+    if (i_iter == _index.end()) {
+      return;
+    }
+    for (const GenericMultiset<LocType>& set : i_iter->second) {
+      GenericMap& m = _data[set.size() - 1];
+      typename GenericMap::iterator m_iter = m.find(set);
+      // already moved out through another location of the term
+      if (m_iter == m.end()) {
+        continue;
       }
-      ++v_iter;
+      gd.increase(m_iter->first, m_iter->second);
+      m.erase(m_iter);
     }
+    _index.erase(i_iter);
   }
 
   class enumerator {
@@ -114,7 +132,7 @@ class GenericDeriv {
 
    private:
 
-    enumerator(const typename std::vector<std::map<GenericMultiset<LocType>, Base> > * const p_data) {
+    enumerator(const typename std::vector<GenericMap > * const p_data) {
       this->_p_data = p_data;
       this->v_iter = _p_data->begin();
       while (v_iter != _p_data->end()) {
@@ -126,9 +144,9 @@ class GenericDeriv {
       }
     }
 
-    const std::vector<std::map<GenericMultiset<LocType>, Base> > * _p_data;
-    mutable typename std::vector<std::map<GenericMultiset<LocType>, Base> >::const_iterator v_iter;
-    mutable typename std::map<GenericMultiset<LocType>, Base>::const_iterator m_iter;
+    const std::vector<GenericMap > * _p_data;
+    mutable typename std::vector<GenericMap >::const_iterator v_iter;
+    mutable typename GenericMap::const_iterator m_iter;
 
    friend class GenericDeriv<LocType, Base>;
   };
@@ -140,8 +158,23 @@ class GenericDeriv {
 
  private:
   size_t _order; // LocTypehe highest order
-  std::vector<std::map<GenericMultiset<LocType>, Base> > _data;
-  
+  std::vector<GenericMap > _data;
+  // location -> terms containing it. A term is listed once per distinct
+  // location when it is created; entries of terms erased through another
+  // location are left behind and skipped by get_and_erase.
+  std::unordered_map<LocType, std::vector<GenericMultiset<LocType>>> _index;
+
+  void add_to_index(const GenericMultiset<LocType>& set) {
+    LocType t[REVERSEAD_MAX_GENERIC_ORDER];
+    size_t len = set.size();
+    set.to_array(t);
+    for (size_t i = 0; i < len; i++) {
+      if (i == 0 || t[i] != t[i-1]) {
+        _index[t[i]].push_back(set);
+      }
+    }
+  }
+
   bool check_size_fail(size_t order) {
     if (order < 1 || order > _order) {
       std::cout << "Max order = " << _order
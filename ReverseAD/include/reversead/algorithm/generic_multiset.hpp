@@ -1,19 +1,22 @@
 #ifndef REVERSEAD_GENERIC_MULTISET_H_
 #define REVERSEAD_GENERIC_MULTISET_H_
 
-#include <set>
+#include <cstdint>
 #include <iostream>
 
+#include "reversead/algorithm/algorithm_common.hpp"
+
 namespace ReverseAD {
 
+// A multiset of at most REVERSEAD_MAX_GENERIC_ORDER elements, kept sorted
+// (smallest first) in an inline array, like TensorIndex for the tensor
+// engine. Copies and comparisons touch no heap memory.
 template <typename T>
 class GenericMultiset {
  public:
-  GenericMultiset();
-  GenericMultiset(const GenericMultiset& rsh);
-  GenericMultiset(const GenericMultiset&& rhs);
-  GenericMultiset& operator = (const GenericMultiset& rhs);
-  GenericMultiset& operator = (const GenericMultiset&& rhs);
+  GenericMultiset() : _len(0) {}
+  GenericMultiset(const GenericMultiset<T>& rhs) = default;
+  GenericMultiset<T>& operator = (const GenericMultiset<T>& rhs) = default;
   inline bool operator == (const GenericMultiset<T>& rhs) const;
   inline bool operator != (const GenericMultiset<T>& rhs) const;
   inline bool operator < (const GenericMultiset<T>& rhs) const;
@@ -21,165 +24,137 @@ class GenericMultiset {
   size_t insert(T element);
   size_t insert(T element, size_t count);
   size_t remove(T element);
-  size_t size() const;
+  size_t size() const {return _len;}
   void debug() const;
   bool find(T target) const;
   size_t count(T target) const;
-  void write_to_byte(char* buf) const;
   void to_array(T*) const;
-  void clear();
+  void clear() {_len = 0;}
+  size_t hash() const;
 
  private:
-  std::multiset<T> _data;
+  T _data[REVERSEAD_MAX_GENERIC_ORDER];
+  size_t _len;
 };
 
 template <typename T>
-GenericMultiset<T>::GenericMultiset() {
-  _data.clear();
-}
-
-template <typename T>
-GenericMultiset<T>::GenericMultiset(const GenericMultiset& rhs) {
-//  std::cout << "GenericMultiset L-ctor" << std::endl;
-  _data = rhs._data;
-}
-
-template <typename T>
-GenericMultiset<T>::GenericMultiset(const GenericMultiset&& rhs) {
-//  std::cout << "GenericMultiset R-ctor" << std::endl;
-  _data = std::move(rhs._data);
-}
-
-template <typename T>
-GenericMultiset<T>& GenericMultiset<T>::operator = (
-    const GenericMultiset<T>& rhs) {
-//  std::cout << "GenericMultiset L-assign" << std::endl;
-  this->_data = rhs._data;
-  return *this;
-}
-
-template <typename T>
-GenericMultiset<T>& GenericMultiset<T>::operator = (
-    const GenericMultiset<T>&& rhs) {
-//  std::cout << "GenericMultiset R-assign" << std::endl;
-  this->_data = std::move(rhs._data);
-  return *this;
-}
+struct GenericMultisetHash {
+  size_t operator () (const GenericMultiset<T>& set) const {
+    return set.hash();
+  }
+};
 
 template <typename T>
 size_t GenericMultiset<T>::insert(T element) {
-  _data.insert(element);
-  return _data.count(element);
+  return insert(element, 1);
 }
 
 template <typename T>
 size_t GenericMultiset<T>::insert(T element, size_t count) {
-  for(size_t i = 0; i < count; i++) {
-    _data.insert(element);
+  if (_len + count > REVERSEAD_MAX_GENERIC_ORDER) {
+    std::cout << "GenericMultiset : more than "
+              << REVERSEAD_MAX_GENERIC_ORDER << " elements" << std::endl;
+    return this->count(element);
+  }
+  size_t l = _len;
+  while (l > 0 && _data[l - 1] > element) {
+    _data[l - 1 + count] = _data[l - 1];
+    l--;
+  }
+  for (size_t i = 0; i < count; i++) {
+    _data[l + i] = element;
   }
-  return _data.count(element);
+  _len += count;
+  return this->count(element);
 }
 
 template <typename T>
 size_t GenericMultiset<T>::remove(T element) {
-  typename std::multiset<T>::iterator hit(_data.find(element));
-  if (hit != _data.end()) {
-    _data.erase(hit);
+  size_t l = 0;
+  while (l < _len && _data[l] < element) {l++;}
+  if (l < _len && _data[l] == element) {
+    for (size_t i = l + 1; i < _len; i++) {
+      _data[i - 1] = _data[i];
+    }
+    _len--;
   }
-  return _data.count(element);
+  return count(element);
 }
 
 template <typename T>
 void GenericMultiset<T>::to_array(T* array) const {
-  typename std::multiset<T>::const_iterator iter = _data.begin();
-  size_t l = 0;
-  while (iter != _data.end()) {
-    array[l++] = *iter;
-    iter++;
+  for (size_t i = 0; i < _len; i++) {
+    array[i] = _data[i];
   }
 }
 
-template <typename T>
-size_t GenericMultiset<T>::size() const {
-  return _data.size();
-}
-
 template <typename T>
 bool GenericMultiset<T>::find(T target) const {
-  if (_data.find(target) != _data.end()) {
-    return true;
+  for (size_t i = 0; i < _len; i++) {
+    if (_data[i] == target) {return true;}
   }
   return false;
 }
 
 template <typename T>
 size_t GenericMultiset<T>::count(T target) const {
-  return _data.count(target);
+  size_t ret = 0;
+  for (size_t i = 0; i < _len; i++) {
+    if (_data[i] == target) {ret++;}
+  }
+  return ret;
 }
 
 template <typename T>
-void GenericMultiset<T>::debug() const {
-  typename std::multiset<T>::iterator iter;
-  std::cout << "{ ";
-  for(iter = _data.begin(); iter != _data.end(); ++iter) {
-    std::cout << (*iter) << " ";
+size_t GenericMultiset<T>::hash() const {
+  uint64_t h = _len;
+  for (size_t i = 0; i < _len; i++) {
+    h = (h ^ (uint64_t)_data[i]) * 0x100000001B3ull;
+    h ^= h >> 29;
   }
-  std::cout << "}";
+  return (size_t)h;
 }
 
 template <typename T>
-void GenericMultiset<T>::clear() {
-  _data.clear();
+void GenericMultiset<T>::debug() const {
+  std::cout << "{ ";
+  for (size_t i = 0; i < _len; i++) {
+    std::cout << _data[i] << " ";
+  }
+  std::cout << "}";
 }
 
-// kind of redundent because we have < operator.
-// But it's more efficient to keep it.
 template <typename T>
 inline bool GenericMultiset<T>::operator == (
     const GenericMultiset<T>& rhs) const {
-  typename std::multiset<T>::iterator iter1;
-  typename std::multiset<T>::iterator iter2;
-  if (this->_data.size() != rhs._data.size()) {
+  if (this->_len != rhs._len) {
     return false;
   }
-  iter1 = this->_data.begin();
-  iter2 = rhs._data.begin();
-  while (iter1 != this->_data.end() && iter2 != rhs._data.end()) {
-    if (*iter1 != *iter2) {
+  for (size_t i = 0; i < _len; i++) {
+    if (this->_data[i] != rhs._data[i]) {
       return false;
     }
-    ++iter1;
-    ++iter2;
   }
   return true;
 }
 
-template <typename T> 
+template <typename T>
 inline bool GenericMultiset<T>::operator != (
     const GenericMultiset<T>& rhs) const{
   return !((*this) == rhs);
 }
 
-template <typename T> 
+// shorter sets first, then lexicographic
+template <typename T>
 inline bool GenericMultiset<T>::operator < (
     const GenericMultiset<T>& rhs) const{
-  typename std::multiset<T>::iterator iter1;
-  typename std::multiset<T>::iterator iter2;
-  if (this->_data.size() < rhs._data.size()) {
-    return true;
-  } else if (this->_data.size() > rhs._data.size()) {
-    return false;
+  if (this->_len != rhs._len) {
+    return this->_len < rhs._len;
   }
-  iter1 = this->_data.begin();
-  iter2 = rhs._data.begin();
-  while (iter1 != this->_data.end() && iter2 != rhs._data.end()) {
-    if (*iter1 < *iter2) {
-      return true;
-    } else if (*iter1 > *iter2) {
-      return false;
+  for (size_t i = 0; i < _len; i++) {
+    if (this->_data[i] != rhs._data[i]) {
+      return this->_data[i] < rhs._data[i];
     }
-    ++iter1;
-    ++iter2;
   }
   return false;
 }
@@ -0,0 +1,27 @@
+#ifndef REVERSEAD_GRAPH_COLORING_H_
+#define REVERSEAD_GRAPH_COLORING_H_
+
+#include <vector>
+
+#include "reversead/algorithm/sparsity_pattern.hpp"
+
+namespace ReverseAD {
+
+// Greedy distance-2 coloring of the columns of a Jacobian pattern, columns
+// sharing a row get different colors. Returns the number of colors.
+size_t jacobian_column_coloring(const SparsityPattern& pattern,
+                                std::vector<size_t>& color);
+
+// Off diagonal neighbors of each vertex of a lower half Hessian pattern.
+void hessian_adjacency(const SparsityPattern& pattern,
+                       std::vector<std::vector<size_t>>& adjacency);
+
+// Greedy star coloring of the adjacency graph of a Hessian pattern
+// (Gebremedhin, Manne and Pothen), every path on four vertices uses at
+// least three colors. Returns the number of colors.
+size_t hessian_star_coloring(const std::vector<std::vector<size_t>>& adjacency,
+                             std::vector<size_t>& color);
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_GRAPH_COLORING_H_
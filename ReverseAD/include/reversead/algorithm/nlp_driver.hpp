@@ -0,0 +1,279 @@
+#ifndef REVERSEAD_NLP_DRIVER_H_
+#define REVERSEAD_NLP_DRIVER_H_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
+#include "reversead/algorithm/base_reverse_adjoint.hpp"
+#include "reversead/algorithm/base_reverse_hessian.hpp"
+#include "reversead/algorithm/base_sparsity_pattern.hpp"
+#include "reversead/algorithm/derivative_sink.hpp"
+#include "reversead/algorithm/sparsity_pattern.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// The callbacks of a (IPOPT style) NLP solver
+//   min f(x)  s.t.  g(x),   x in R^n, g in R^m
+// from a single trace whose dependents are f, g[0], ..., g[m-1].
+// The Jacobian of g and the lower triangle of the Hessian of the Lagrangian
+//   obj_factor * f + sum_i lambda[i] * g[i]
+// are given as triplets with a structure fixed at construction (from
+// BaseSparsityPattern, so it holds at every x). Each eval_* call reuses the
+// engines (and their CompiledTrace) and streams the derivatives into the
+// caller's value arrays through a coordinate to slot map, nothing is
+// retraced and no DerivativeTensor is built.
+template <typename Base>
+class NlpDriver {
+ public:
+  NlpDriver(const std::shared_ptr<TrivialTrace<Base>>& trace);
+
+  size_t get_n() const {return n;}
+  size_t get_m() const {return m;}
+  size_t get_nnz_jac() const {return jac_cind.size();}
+  size_t get_nnz_hess() const {return hess_cind.size();}
+
+  // the triplet structures, get_nnz_jac() / get_nnz_hess() entries
+  template <typename Index>
+  void get_jac_structure(Index* irow, Index* jcol) const;
+  template <typename Index>
+  void get_hess_structure(Index* irow, Index* jcol) const;
+
+  bool eval_f(const Base* x, Base& obj_value);
+  bool eval_g(const Base* x, Base* g);
+  bool eval_grad_f(const Base* x, Base* grad_f);
+  bool eval_jac_g(const Base* x, Base* values);
+  bool eval_h(const Base* x, Base obj_factor, const Base* lambda,
+              Base* values);
+
+ private:
+  // the slot of (row, col) in a row-wise structure, row_start[row] is the
+  // first slot of row and cind holds the sorted columns of each row
+  static bool find_slot(const std::vector<size_t>& row_start,
+                        const std::vector<size_t>& cind,
+                        size_t row, size_t col, size_t& slot);
+
+  // scatters the entries of one engine into gradient / value arrays
+  class SlotSink : public DerivativeSink<Base> {
+   public:
+    SlotSink(const NlpDriver<Base>& driver, size_t order)
+        : driver(driver), order(order) {}
+    void put_value(size_t dep, size_t order, const size_t* ind,
+                   const Base& value) override;
+
+    Base* grad = nullptr;
+    // the Jacobian or the Hessian
+    Base* values = nullptr;
+    bool consistent = true;
+
+   private:
+    const NlpDriver<Base>& driver;
+    size_t order;
+  };
+
+  // evaluates the dependents at x unless x is the last point
+  void evaluate(const Base* x);
+  // One adjoint sweep gives the gradient and the Jacobian, the part that
+  // is not asked for is kept for the other call at the same x.
+  bool sweep_first_order(const Base* x, Base* grad, Base* jac);
+
+  size_t n;
+  size_t m;
+  std::shared_ptr<TrivialTrace<Base>> trace;
+  CompiledTrace<Base> compiled;
+  BaseReverseAdjoint<Base> adjoint;
+  BaseReverseHessian<Base> hessian;
+
+  bool evaluated = false;
+  std::vector<Base> last_x;
+  std::vector<Base> dep_val;
+  std::vector<Base> weight;
+
+  std::vector<Base> first_order_x;
+  std::vector<Base> grad_buf;
+  std::vector<Base> jac_buf;
+  bool has_grad = false;
+  bool has_jac = false;
+
+  // Jacobian of g (the rows of the dependents 1..m) and the lower triangle
+  // of the Hessian, row-wise
+  std::vector<size_t> jac_row_start;
+  std::vector<size_t> jac_cind;
+  std::vector<size_t> hess_row_start;
+  std::vector<size_t> hess_cind;
+};
+
+template <typename Base>
+NlpDriver<Base>::NlpDriver(const std::shared_ptr<TrivialTrace<Base>>& trace)
+    : trace(trace), compiled(trace), adjoint(trace), hessian(trace) {
+  n = trace->get_num_ind();
+  m = trace->get_num_dep() - 1;
+  last_x.resize(n);
+  dep_val.resize(m + 1);
+  weight.resize(m + 1);
+  first_order_x.resize(n);
+  grad_buf.resize(n);
+
+  BaseSparsityPattern<Base> sparsity(trace);
+  std::shared_ptr<SparsityPattern> jac = sparsity.jacobian_pattern(n, m + 1);
+  jac_row_start.push_back(0);
+  for (size_t i = 1; i <= m; i++) {
+    const std::vector<size_t>& row = jac->get_row(i);
+    jac_cind.insert(jac_cind.end(), row.begin(), row.end());
+    jac_row_start.push_back(jac_cind.size());
+  }
+  std::shared_ptr<SparsityPattern> hess = sparsity.hessian_pattern(n, m + 1);
+  hess_row_start.push_back(0);
+  for (size_t i = 0; i < n; i++) {
+    const std::vector<size_t>& row = hess->get_row(i);
+    hess_cind.insert(hess_cind.end(), row.begin(), row.end());
+    hess_row_start.push_back(hess_cind.size());
+  }
+  jac_buf.resize(jac_cind.size());
+}
+
+template <typename Base>
+template <typename Index>
+void NlpDriver<Base>::get_jac_structure(Index* irow, Index* jcol) const {
+  for (size_t i = 0; i < m; i++) {
+    for (size_t k = jac_row_start[i]; k < jac_row_start[i + 1]; k++) {
+      irow[k] = i;
+      jcol[k] = jac_cind[k];
+    }
+  }
+}
+
+template <typename Base>
+template <typename Index>
+void NlpDriver<Base>::get_hess_structure(Index* irow, Index* jcol) const {
+  for (size_t i = 0; i < n; i++) {
+    for (size_t k = hess_row_start[i]; k < hess_row_start[i + 1]; k++) {
+      irow[k] = i;
+      jcol[k] = hess_cind[k];
+    }
+  }
+}
+
+template <typename Base>
+void NlpDriver<Base>::evaluate(const Base* x) {
+  if (evaluated && std::equal(x, x + n, last_x.begin())) {
+    return;
+  }
+  std::copy(x, x + n, last_x.begin());
+  compiled.evaluate(x, dep_val.data());
+  evaluated = true;
+}
+
+template <typename Base>
+bool NlpDriver<Base>::eval_f(const Base* x, Base& obj_value) {
+  evaluate(x);
+  obj_value = dep_val[0];
+  return true;
+}
+
+template <typename Base>
+bool NlpDriver<Base>::eval_g(const Base* x, Base* g) {
+  evaluate(x);
+  std::copy(dep_val.begin() + 1, dep_val.end(), g);
+  return true;
+}
+
+template <typename Base>
+bool NlpDriver<Base>::eval_grad_f(const Base* x, Base* grad_f) {
+  bool ret = true;
+  if (!has_grad || !std::equal(x, x + n, first_order_x.begin())) {
+    ret = sweep_first_order(x, grad_buf.data(), jac_buf.data());
+    has_jac = true;
+  }
+  std::copy(grad_buf.begin(), grad_buf.end(), grad_f);
+  return ret;
+}
+
+template <typename Base>
+bool NlpDriver<Base>::eval_jac_g(const Base* x, Base* values) {
+  if (has_jac && std::equal(x, x + n, first_order_x.begin())) {
+    std::copy(jac_buf.begin(), jac_buf.end(), values);
+    return true;
+  }
+  has_jac = false;
+  return sweep_first_order(x, grad_buf.data(), values);
+}
+
+template <typename Base>
+bool NlpDriver<Base>::sweep_first_order(const Base* x, Base* grad,
+                                        Base* jac) {
+  SlotSink sink(*this, 1);
+  sink.grad = grad;
+  sink.values = jac;
+  std::fill(grad, grad + n, Base(0.0));
+  std::fill(jac, jac + get_nnz_jac(), Base(0.0));
+  adjoint.compute(x, n, m + 1, sink);
+  std::copy(x, x + n, first_order_x.begin());
+  has_grad = true;
+  return sink.consistent;
+}
+
+template <typename Base>
+bool NlpDriver<Base>::eval_h(const Base* x, Base obj_factor,
+                             const Base* lambda, Base* values) {
+  weight[0] = obj_factor;
+  std::copy(lambda, lambda + m, weight.begin() + 1);
+  hessian.set_dep_weight(weight.data(), m + 1);
+  SlotSink sink(*this, 2);
+  sink.values = values;
+  std::fill(values, values + get_nnz_hess(), Base(0.0));
+  hessian.compute(x, n, m + 1, sink);
+  return sink.consistent;
+}
+
+template <typename Base>
+bool NlpDriver<Base>::find_slot(const std::vector<size_t>& row_start,
+                                const std::vector<size_t>& cind,
+                                size_t row, size_t col, size_t& slot) {
+  std::vector<size_t>::const_iterator begin = cind.begin() + row_start[row];
+  std::vector<size_t>::const_iterator end = cind.begin() + row_start[row + 1];
+  std::vector<size_t>::const_iterator iter = std::lower_bound(begin, end, col);
+  if (iter == end || *iter != col) {
+    return false;
+  }
+  slot = iter - cind.begin();
+  return true;
+}
+
+template <typename Base>
+void NlpDriver<Base>::SlotSink::put_value(size_t dep, size_t order,
+                                          const size_t* ind,
+                                          const Base& value) {
+  if (order != this->order) {
+    return;
+  }
+  size_t slot;
+  if (order == 1) {
+    if (dep == 0) {
+      grad[ind[0]] += value;
+      return;
+    }
+    if (find_slot(driver.jac_row_start, driver.jac_cind,
+                  dep - 1, ind[0], slot)) {
+      values[slot] += value;
+      return;
+    }
+    warning_NotInPattern(dep - 1, ind[0]);
+  } else {
+    size_t row = std::max(ind[0], ind[1]);
+    size_t col = std::min(ind[0], ind[1]);
+    if (find_slot(driver.hess_row_start, driver.hess_cind, row, col, slot)) {
+      values[slot] += value;
+      return;
+    }
+    warning_NotInPattern(row, col);
+  }
+  consistent = false;
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_NLP_DRIVER_H_
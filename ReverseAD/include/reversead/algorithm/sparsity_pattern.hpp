@@ -0,0 +1,54 @@
+#ifndef REVERSEAD_SPARSITY_PATTERN_H_
+#define REVERSEAD_SPARSITY_PATTERN_H_
+
+#include <vector>
+
+namespace ReverseAD {
+
+// Row-wise nonzero structure, each row holds sorted column indices.
+// Jacobian patterns have one row per dependent, Hessian patterns one row
+// per independent with only the lower half (col <= row) stored.
+class SparsityPattern {
+ public:
+  SparsityPattern(size_t row_size, size_t col_size)
+      : _col_size(col_size), _rows(row_size) {}
+
+  size_t get_row_size() const {return _rows.size();}
+  size_t get_col_size() const {return _col_size;}
+
+  size_t get_nnz() const {
+    size_t nnz = 0;
+    for (const std::vector<size_t>& row : _rows) {
+      nnz += row.size();
+    }
+    return nnz;
+  }
+
+  const std::vector<size_t>& get_row(size_t row) const {
+    return _rows[row];
+  }
+
+  // rind and cind must hold get_nnz() entries
+  void get_coordinate_list(size_t* rind, size_t* cind) const {
+    size_t l = 0;
+    for (size_t i = 0; i < _rows.size(); i++) {
+      for (const size_t& j : _rows[i]) {
+        rind[l] = i;
+        cind[l] = j;
+        l++;
+      }
+    }
+  }
+
+  std::vector<size_t>& get_mutable_row(size_t row) {
+    return _rows[row];
+  }
+
+ private:
+  size_t _col_size;
+  std::vector<std::vector<size_t>> _rows;
+};
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_SPARSITY_PATTERN_H_
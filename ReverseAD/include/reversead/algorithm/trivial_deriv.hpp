@@ -6,6 +6,7 @@
 #include "reversead/algorithm/trivial_adjoint.hpp"
 #include "reversead/algorithm/trivial_hessian.hpp"
 #include "reversead/algorithm/trivial_third.hpp"
+#include "reversead/algorithm/compact_third.hpp"
 
 namespace ReverseAD {
 
@@ -15,7 +16,7 @@ class TrivialDeriv {
 
   typedef TrivialAdjoint<locint, Base> type_adjoint;
   typedef TrivialHessian<locint, Base> type_hessian;
-  typedef TrivialThird<locint, Base> type_third;
+  typedef CompactThird<locint, Base> type_third;
 
   TrivialDeriv() {
     adjoint_vals.reset(new type_adjoint());
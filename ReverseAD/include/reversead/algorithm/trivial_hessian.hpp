@@ -2,6 +2,7 @@
 #define TRIVIAL_HESSIAN_H_
 
 #include <map>
+#include <vector>
 
 #include "reversead/algorithm/algorithm_common.hpp"
 #include "reversead/algorithm/trivial_adjoint.hpp"
@@ -35,6 +36,15 @@ class TrivialHessian {
     _data.clear();
   }
 
+  // the x of all rows, increasing, for reading out with get_and_erase(x)
+  std::vector<LocType> get_row_keys() const {
+    std::vector<LocType> ret;
+    for (const auto& kv : _data) {
+      ret.push_back(kv.first);
+    }
+    return ret;
+  }
+
   // serializable
   TrivialHessian(char* buf);
   size_t get_size() const;
@@ -2,6 +2,7 @@
 #define TRIVIAL_THIRD_H_
 
 #include <map>
+#include <vector>
 
 #include "reversead/algorithm/algorithm_common.hpp"
 #include "reversead/algorithm/trivial_hessian.hpp"
@@ -46,6 +47,15 @@ class TrivialThird {
     _data.clear();
   }
 
+  // the x of all blocks, increasing
+  std::vector<LocType> get_row_keys() const {
+    std::vector<LocType> ret;
+    for (const auto& kv : _data) {
+      ret.push_back(kv.first);
+    }
+    return ret;
+  }
+
   // serializable
   TrivialThird(char* buf);
   size_t get_size() const;
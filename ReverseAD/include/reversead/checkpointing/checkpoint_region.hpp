@@ -0,0 +1,93 @@
+#ifndef REVERSEAD_CHECKPOINT_REGION_H_
+#define REVERSEAD_CHECKPOINT_REGION_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "reversead/activetype/base_active.hpp"
+#include "reversead/common/reversead_core.hpp"
+#include "reversead/common/runtime_env.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+
+namespace ReverseAD {
+
+// The inputs (values and locations) and the indexing state at the start of
+// a checkpoint region, enough to trace the region again with the same
+// locations as in the forward run.
+template <typename Base, typename Region>
+class CheckpointRegion {
+ public:
+  CheckpointRegion(const BaseActive<Base>* x, size_t x_num, size_t y_num,
+                   const Region& region, const RuntimeEnv& env)
+      : x_num(x_num), y_num(y_num), region(region), env(env) {
+    for (size_t i = 0; i < x_num; i++) {
+      values.push_back(x[i].getVal());
+      locs.push_back(x[i].getLoc());
+    }
+  }
+
+  std::shared_ptr<TrivialTrace<Base>> retrace() {
+    // the outer trace (if any) is suspended, a nested region is traced
+    // as a ckp_region op of this one
+    void* outer_trace = global_trace;
+    std::shared_ptr<RuntimeEnv> outer_env = runtime_env;
+    global_trace = nullptr;
+    runtime_env_off();
+    BaseActive<Base>* x = new BaseActive<Base>[x_num];
+    BaseActive<Base>* y = new BaseActive<Base>[y_num];
+    for (size_t i = 0; i < x_num; i++) {
+      new(&x[i]) BaseActive<Base>(values[i], locs[i]);
+    }
+    trace_on_runtime_env<Base>(std::make_shared<RuntimeEnv>(env));
+    region(x, x_num, y, y_num);
+    std::shared_ptr<TrivialTrace<Base>> trace = trace_off<Base>();
+    delete[] x;
+    delete[] y;
+    global_trace = outer_trace;
+    runtime_env_on(outer_env);
+    return trace;
+  }
+
+ private:
+  size_t x_num;
+  size_t y_num;
+  Region region;
+  RuntimeEnv env;
+  std::vector<Base> values;
+  std::vector<locint> locs;
+};
+
+// Evaluates region(x, x_num, y, y_num) without recording its SACs, only a
+// ckp_region op is put on the current trace. The reverse sweep (and any
+// forward decoding of the trace) traces the region again from the saved
+// inputs when it reaches that op, so the tape of a large sub-model only
+// exists while it is differentiated. Regions can be nested.
+// The region must be deterministic, all its active inputs must be passed
+// through x and it must not declare independents or dependents. It is
+// copied and kept with the trace, so it should not refer to active
+// variables or locals of the caller by reference.
+template <typename Base, typename Region>
+void checkpoint_region(BaseActive<Base>* x, size_t x_num,
+                       BaseActive<Base>* y, size_t y_num,
+                       Region region) {
+  TrivialTrace<Base>* trace = (TrivialTrace<Base>*)global_trace;
+  if (trace == nullptr || !runtime_env) {
+    region(x, x_num, y, y_num);
+    return;
+  }
+  std::shared_ptr<CheckpointRegion<Base, Region>> ckp =
+      std::make_shared<CheckpointRegion<Base, Region>>(
+          x, x_num, y_num, region, *runtime_env);
+  global_trace = nullptr;
+  region(x, x_num, y, y_num);
+  global_trace = (void*)trace;
+  size_t id = trace->add_region([ckp]() {return ckp->retrace();});
+  trace->put_op(ckp_region);
+  trace->put_loc(id);
+}
+
+} // namespace ReverseAD
+
+#endif // REVERSEAD_CHECKPOINT_REGION_H_
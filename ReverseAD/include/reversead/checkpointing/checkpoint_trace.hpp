@@ -1,6 +1,11 @@
 #ifndef REVERSEAD_CHECKPOINT_TRACE_H_
 #define REVERSEAD_CHECKPOINT_TRACE_H_
 
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "reversead/activetype/base_active.hpp"
 #include "reversead/common/reversead_type.hpp"
 #include "reversead/common/runtime_env.hpp"
@@ -8,10 +13,19 @@
 
 namespace ReverseAD {
 
+// Checkpoints are kept in memory up to a budget of bytes, the others go
+// to a local file. They are read back latest first, so the earliest
+// ones (needed last) are the ones written out, and during the reverse
+// the next ones on file are read ahead on another thread as soon as the
+// budget has room. By default everything stays in memory, or everything
+// goes to file with ENABLE_DISK_TAPE.
 class CheckpointTrace {
  public:
   CheckpointTrace();
-  ~CheckpointTrace() = default;
+  ~CheckpointTrace();
+
+  void set_memory_budget(size_t max_bytes);
+  size_t get_num_spilled() const {return _num_spilled;}
 
   void end_checkpointing();
   void init_reverse();
@@ -25,12 +39,38 @@ class CheckpointTrace {
   size_t get_iteration_num();
   void dump_trace() const;
  private:
+  struct Checkpoint {
+    size_t x_num;
+    std::vector<double> values;
+    std::vector<locint> locs;
+    RuntimeEnv runtime_env;
+    // where the checkpoint is in the file, if spilled
+    std::streamoff offset;
+  };
+
+  size_t checkpoint_bytes(size_t index) const;
+  // writes the earliest checkpoint in memory to the file
+  void spill();
+  void load(size_t index);
+  // starts reading the next checkpoints on file that fit the budget
+  void prefetch();
+
   size_t _checkpoint_num;
-  std::shared_ptr<TrivialTape<size_t>> _tape_x_num;
   std::shared_ptr<TrivialTape<size_t>> _tape_iter_num;
-  std::shared_ptr<VirtualTape<double>> _tape_x_values;
-  std::shared_ptr<VirtualTape<locint>> _tape_x_locint;
-  std::shared_ptr<TrivialTape<RuntimeEnv>> _tape_runtime_env;
+  std::vector<Checkpoint> _checkpoints;
+
+  size_t _max_bytes;
+  size_t _mem_bytes; // in memory, or being read back
+  // checkpoints [_first_in_mem, _checkpoints.size()) are in memory
+  size_t _first_in_mem;
+  size_t _num_spilled;
+  std::string _file_name;
+  std::ofstream _out;
+  std::ifstream _in;
+  // [_prefetch_lo, _prefetch_hi) are read by _prefetch
+  std::thread _prefetch;
+  size_t _prefetch_lo;
+  size_t _prefetch_hi;
 };
 
 } //namespace ReverseAD
@@ -2,12 +2,18 @@
 #define REVERSEAD_ITERATIVE_FUNC_BASE_H_
 
 #include <cstddef>
+#include <memory>
+#include <vector>
 
 #include "reversead/activetype/base_active.hpp"
 #include "reversead/algorithm/derivative_tensor.hpp"
+#include "reversead/common/runtime_env.hpp"
 
 namespace ReverseAD {
 
+template <typename Base> class BaseReverseMode;
+class CheckpointTrace;
+
 // In ideal, IterativeFunc should provide both plain and overloaded
 // function evaluation. But, since C++ does not support template function
 // overload. To do that requires the user to registrate two sets of function
@@ -26,12 +32,76 @@ class IterativeFuncBase {
 
   void run(double*, size_t, double*, size_t);
 
+  // derivatives up to t_order : BaseReverseAdjoint, BaseReverseHessian,
+  // BaseReverseThird for 1-3 and BaseReverseGeneric above
   std::shared_ptr<DerivativeTensor<size_t, double>> compute(
       double*, size_t, size_t);
+  // the same with any reverse engine, for example a BaseReverseTensor or
+  // one with its own set_dep_weight(). The engine is reset before use.
+  std::shared_ptr<DerivativeTensor<size_t, double>> compute(
+      double*, size_t, BaseReverseMode<double>& reverse_mode);
+
+  // Only the weighted sum of the outputs (a Lagrangian) is
+  // differentiated by compute(x, x_num, t_order), see
+  // BaseReverseMode::set_dep_weight.
+  void set_dep_weight(const double* const weight, size_t y_num);
+  void clear_dep_weight();
+
+  // gradient and Hessian times v of the weighted sum of the outputs (all
+  // weights 1 without set_dep_weight), each of size x_num. Forward over
+  // reverse : every segment between the set_min_op_per_cp checkpoints is
+  // traced and replayed with SingleForward values, once forward for the
+  // tangents and once more for the adjoints, so no second order derivative
+  // of the state is formed. The checkpoints are kept in memory.
+  void hessian_vector(double* x_values, size_t x_num, const double* v,
+                      double* gradient, double* hv);
   
   void set_min_op_per_cp(size_t min_op_per_cp);
+  // keeps at most max_bytes of the (greedy) checkpoints in memory and
+  // spills the others to a local file, see CheckpointTrace
+  void set_checkpoint_memory(size_t max_bytes);
+  size_t get_num_spilled_checkpoints() const {return _num_spilled;}
+
+  // Binomial (Revolve) checkpointing : at most max_checkpoints states,
+  // the initial one included, are stored and the other ones recomputed.
+  // When the number of iterations is known (IterativeFuncFixed) the
+  // schedule is optimal, otherwise checkpoints are thinned out online
+  // and each interval between them is reversed optimally.
+  // 0 (default) keeps the greedy placement of set_min_op_per_cp.
+  // The binomial states are always kept in memory and the steps are
+  // retraced on the calling thread, set_checkpoint_memory and
+  // set_num_threads only apply to the greedy checkpoints.
+  void set_max_checkpoints(size_t max_checkpoints);
+  // the same, as a budget of bytes for the stored states
+  void set_max_checkpoint_bytes(size_t max_bytes);
+
+  // With more than one thread, the segments between the (greedy)
+  // checkpoints are retraced on num_threads worker threads ahead of the
+  // reverse sweep, which stays on the calling thread. iteration_step must
+  // then be safe to call concurrently, and up to num_threads + 1 segment
+  // traces are held at once.
+  void set_num_threads(size_t num_threads);
+
+  // Fixed point mode, first order only : for loops converging to a fixed
+  // point t = G(t), the loop runs to convergence untraced and a single
+  // iteration is traced there. The adjoint of that iteration is applied
+  // until the adjoints change by less than tol (at most max_iter times),
+  // so memory and work no longer grow with the number of iterations.
+  void enable_fixed_point(double tol, size_t max_iter);
+  void disable_fixed_point();
+  // adjoint iterations of the last fixed point compute(), all dependents
+  size_t get_num_adjoint_iter() const {return _num_adjoint_iter;}
+
+  // statistics of the last compute() with binomial checkpointing
+  size_t get_num_recomputed_steps() const {return _num_recomputed_steps;}
+  size_t get_peak_checkpoints() const {return _peak_checkpoints;}
 
  protected:
+  // the number of iterations if it is known before running
+  virtual bool get_fixed_num_iter(size_t& /*num_iter*/) const {
+    return false;
+  }
+
   size_t _x_num;
   size_t _t_num;
   size_t _y_num;
@@ -42,6 +112,51 @@ class IterativeFuncBase {
   void (*_initial_step)(adouble*, size_t, adouble* , size_t);
   void (*_iteration_step)(adouble*, size_t);
   void (*_final_step)(adouble*, size_t, adouble*, size_t);
+
+ private:
+  struct Checkpoint {
+    size_t iter;
+    std::vector<double> values;
+    std::vector<locint> locs;
+    RuntimeEnv runtime_env;
+  };
+
+  std::shared_ptr<DerivativeTensor<size_t, double>> compute_binomial(
+      double*, BaseReverseMode<double>& reverse_mode,
+      size_t max_checkpoints);
+  void push_checkpoint(size_t iter, adouble* t,
+                       const std::shared_ptr<RuntimeEnv>& runtime_env);
+  void restore_checkpoint(const Checkpoint& cp, adouble* t,
+                          std::shared_ptr<RuntimeEnv>& runtime_env);
+  // runs num iteration steps without tracing
+  void advance(adouble* t, std::shared_ptr<RuntimeEnv>& runtime_env,
+               size_t num);
+  // reverses the steps [_checkpoints[pos].iter, end) with free more
+  // checkpoints, the ones above pos are already placed on the way
+  void reverse_range(size_t pos, size_t end, size_t free, adouble* t,
+                     std::shared_ptr<RuntimeEnv>& runtime_env,
+                     BaseReverseMode<double>* reverse_mode);
+
+  std::shared_ptr<DerivativeTensor<size_t, double>> compute_fixed_point(
+      double*, size_t t_order);
+
+  // sweeps the segments left on cp_trace, returns the last cp_num
+  size_t reverse_segments_parallel(CheckpointTrace& cp_trace, size_t cp_num,
+                                   BaseReverseMode<double>* reverse_mode);
+
+  std::vector<double> _dep_weight;
+  size_t _num_threads;
+  bool _fixed_point;
+  double _fixed_point_tol;
+  size_t _fixed_point_max_iter;
+  size_t _num_adjoint_iter;
+  size_t _checkpoint_memory;
+  size_t _num_spilled;
+  size_t _max_checkpoints;
+  size_t _max_checkpoint_bytes;
+  std::vector<Checkpoint> _checkpoints;
+  size_t _num_recomputed_steps;
+  size_t _peak_checkpoints;
 };
 
 } // namespace ReverseAD
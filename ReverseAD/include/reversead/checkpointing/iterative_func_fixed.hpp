@@ -19,6 +19,8 @@ class IterativeFuncFixed : public IterativeFuncBase {
 
   void iteration_init() override final;
   bool iteration_done(adouble*, size_t) override final;
+ protected:
+  bool get_fixed_num_iter(size_t& num_iter) const override final;
  private:
   size_t _max_num_iter;
   size_t _curr_iter;
@@ -41,7 +41,11 @@ enum OPCODES {
   comp_eq,
   comp_lt,
   rmpi_send,
-  rmpi_recv
+  rmpi_recv,
+  // a checkpoint_region, its only operand (a loc) is the region index
+  ckp_region,
+  // a call_external, see external_function.hpp for its operands
+  ext_func
 };
 
 } // namespace ReverseAD
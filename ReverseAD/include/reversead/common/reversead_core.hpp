@@ -13,9 +13,10 @@
 
 namespace ReverseAD {
 
-  extern void* global_trace;
+  // per thread, so that several threads can trace at once
+  extern thread_local void* global_trace;
   //extern RuntimeEnv* runtime_env;
-  extern std::shared_ptr<RuntimeEnv> runtime_env;
+  extern thread_local std::shared_ptr<RuntimeEnv> runtime_env;
   
   // declarions for indexing functions
   locint get_next_loc();
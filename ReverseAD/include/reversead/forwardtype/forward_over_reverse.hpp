@@ -2,13 +2,26 @@
 #define REVERSEAD_FORWARD_OVER_REVERSE_H_
 
 #include <memory>
+#include <vector>
 
 #include "reversead/common/reversead_type.hpp"
 #include "reversead/trace/trivial_trace.hpp"
+#include "reversead/forwardtype/single_forward.hpp"
+#include "reversead/forwardtype/multi_forward.hpp"
+#include "reversead/algorithm/base_function_replay.hpp"
+#include "reversead/algorithm/base_reverse_adjoint.hpp"
+#include "reversead/algorithm/base_reverse_hessian.hpp"
 #include "reversead/algorithm/derivative_tensor.hpp"
 
 namespace ReverseAD {
 
+// All functions replay the trace once with the direction adjoint_init_value
+// as tangent of the independents, followed by one reverse sweep on the
+// replayed trace. Results are dense and symmetric, the caller allocates
+// them: hessian_vector[dep][ind], third_vector[dep][ind][ind], ...
+// If the trace can not be replayed (external functions of double) they are
+// not touched, directional_reverse returns nullptr.
+
 void forward_over_reverse(std::shared_ptr<TrivialTrace<double>> trace,
                           size_t ind_num,
                           size_t dep_num,
@@ -30,6 +43,8 @@ void forward_over_third(std::shared_ptr<TrivialTrace<double>> trace,
                         double* adjoint_init_value,
                         double**** fourth_vector);
 
+// derivatives up to order t_order, each contracted once more with the
+// direction (the dependent values hold the directional derivatives)
 std::shared_ptr<DerivativeTensor<size_t, double>> directional_reverse(
     std::shared_ptr<TrivialTrace<double>> trace,
     size_t t_order,
@@ -37,7 +52,117 @@ std::shared_ptr<DerivativeTensor<size_t, double>> directional_reverse(
     size_t dep_num,
     double* ind_init_value,
     double* adjoint_init_value);
- 
+
+// keeps the tangent part of every entry
+std::shared_ptr<DerivativeTensor<size_t, double>> strip_derivative(
+    const std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor,
+    size_t t_order, size_t ind_size, size_t dep_size);
+
+// K directions in one pass, adjoint_init_value[ind][K] and
+// hessian_vector[dep][ind][K]
+template <size_t K>
+void forward_over_reverse(std::shared_ptr<TrivialTrace<double>> trace,
+                          size_t ind_num,
+                          size_t dep_num,
+                          double* ind_init_value,
+                          double** adjoint_init_value,
+                          double*** hessian_vector);
+
+// K directions in one pass, third_vector[dep][ind][ind][K]
+template <size_t K>
+void forward_over_second(std::shared_ptr<TrivialTrace<double>> trace,
+                         size_t ind_num,
+                         size_t dep_num,
+                         double* ind_init_value,
+                         double** adjoint_init_value,
+                         double**** third_vector);
+
+template <size_t K>
+std::shared_ptr<TrivialTrace<MultiForward<K>>> multi_forward_replay(
+    std::shared_ptr<TrivialTrace<double>> trace,
+    size_t ind_num,
+    double* ind_init_value,
+    double** adjoint_init_value) {
+  std::vector<MultiForward<K>> x;
+  x.reserve(ind_num);
+  for (size_t i = 0; i < ind_num; i++) {
+    x.push_back(MultiForward<K>(ind_init_value[i], adjoint_init_value[i]));
+  }
+  return BaseFunctionReplay::replay_forward<double, MultiForward<K>>(
+      trace, x.data(), ind_num);
+}
+
+template <size_t K>
+void forward_over_reverse(std::shared_ptr<TrivialTrace<double>> trace,
+                          size_t ind_num,
+                          size_t dep_num,
+                          double* ind_init_value,
+                          double** adjoint_init_value,
+                          double*** hessian_vector) {
+  std::shared_ptr<TrivialTrace<MultiForward<K>>> new_trace =
+      multi_forward_replay<K>(trace, ind_num, ind_init_value,
+                              adjoint_init_value);
+  if (!new_trace) {
+    return;
+  }
+  BaseReverseAdjoint<MultiForward<K>> adjoint(new_trace);
+  std::shared_ptr<DerivativeTensor<size_t, MultiForward<K>>> tensor =
+      adjoint.compute(ind_num, dep_num);
+  size_t size;
+  size_t** tind;
+  MultiForward<K>* values;
+  for (size_t d = 0; d < dep_num; d++) {
+    for (size_t i = 0; i < ind_num; i++) {
+      for (size_t k = 0; k < K; k++) {
+        hessian_vector[d][i][k] = 0.0;
+      }
+    }
+    tensor->get_internal_coordinate_list(d, 1, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      for (size_t k = 0; k < K; k++) {
+        hessian_vector[d][tind[l][0]][k] = values[l].getDer(k);
+      }
+    }
+  }
+}
+
+template <size_t K>
+void forward_over_second(std::shared_ptr<TrivialTrace<double>> trace,
+                         size_t ind_num,
+                         size_t dep_num,
+                         double* ind_init_value,
+                         double** adjoint_init_value,
+                         double**** third_vector) {
+  std::shared_ptr<TrivialTrace<MultiForward<K>>> new_trace =
+      multi_forward_replay<K>(trace, ind_num, ind_init_value,
+                              adjoint_init_value);
+  if (!new_trace) {
+    return;
+  }
+  BaseReverseHessian<MultiForward<K>> hessian(new_trace);
+  std::shared_ptr<DerivativeTensor<size_t, MultiForward<K>>> tensor =
+      hessian.compute(ind_num, dep_num);
+  size_t size;
+  size_t** tind;
+  MultiForward<K>* values;
+  for (size_t d = 0; d < dep_num; d++) {
+    for (size_t i = 0; i < ind_num; i++) {
+      for (size_t j = 0; j < ind_num; j++) {
+        for (size_t k = 0; k < K; k++) {
+          third_vector[d][i][j][k] = 0.0;
+        }
+      }
+    }
+    tensor->get_internal_coordinate_list(d, 2, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      for (size_t k = 0; k < K; k++) {
+        third_vector[d][tind[l][0]][tind[l][1]][k] = values[l].getDer(k);
+        third_vector[d][tind[l][1]][tind[l][0]][k] = values[l].getDer(k);
+      }
+    }
+  }
+}
+
 } // namespace ReverseAD
 
 #endif // REVERSEAD_FORWARD_OVER_REVERSE_H_
@@ -5,18 +5,29 @@
 #include "reversead/common/reversead_type.hpp"
 #include "reversead/common/reversead_core.hpp"
 #include "reversead/activetype/base_active.hpp"
+#include "reversead/activetype/external_function.hpp"
 #include "reversead/trace/trivial_trace.hpp"
+#include "reversead/trace/compiled_trace.hpp"
 #include "reversead/forwardtype/single_forward.hpp"
 #include "reversead/forwardtype/multi_forward.hpp"
 #include "reversead/forwardtype/forward_over_reverse.hpp"
 #include "reversead/checkpointing/iterative_func_cond.hpp"
 #include "reversead/checkpointing/iterative_func_fixed.hpp"
+#include "reversead/checkpointing/checkpoint_region.hpp"
+#include "reversead/algorithm/dense_replay.hpp"
 #include "reversead/algorithm/base_function_replay.hpp"
+#include "reversead/algorithm/batch_replay.hpp"
 #include "reversead/algorithm/base_reverse_mode.hpp"
 #include "reversead/algorithm/base_reverse_adjoint.hpp"
 #include "reversead/algorithm/base_reverse_hessian.hpp"
 #include "reversead/algorithm/base_reverse_third.hpp"
 #include "reversead/algorithm/base_reverse_generic.hpp"
 #include "reversead/algorithm/base_reverse_tensor.hpp"
+#include "reversead/algorithm/base_taylor_tensor.hpp"
+#include "reversead/algorithm/base_sparsity_pattern.hpp"
+#include "reversead/algorithm/base_compressed_derivative.hpp"
+#include "reversead/algorithm/base_hessian_plan.hpp"
+#include "reversead/algorithm/code_generator.hpp"
+#include "reversead/algorithm/nlp_driver.hpp"
 
 #endif // REVERSE_AD_H_
@@ -1,6 +1,7 @@
 #ifndef REVERSEAD_DISK_TAPE_H_
 #define REVERSEAD_DISK_TAPE_H_
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -16,7 +17,7 @@
 
 namespace ReverseAD {
 
-extern int _disk_tape_id;
+extern std::atomic<int> _disk_tape_id;
 
 template <typename T>
 class DiskTape : public AbstractTape<T> {
@@ -0,0 +1,613 @@
+#ifndef COMPILED_TRACE_H_
+#define COMPILED_TRACE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "reversead/activetype/external_function.hpp"
+#include "reversead/common/reversead_type.hpp"
+#include "reversead/common/reversead_const.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/trace/trivial_trace.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+// A TrivialTrace decoded once into a flat array of fixed-width instructions.
+// Locations are renumbered into dense slots 1..get_num_slot() keeping their
+// order (so the result of a SAC still has the largest slot among its
+// operands), slot 0 is a sink for missing operands. The instructions keep
+// the order of the trace, including assign_ind and assign_dep (slot in x, no
+// result) and assign_param, whose slots are also listed separately.
+// Checkpoint regions are retraced and inlined. An external function call
+// is an ext_func instruction (no slots), the k-th one is get_ext_calls()[k]
+// with its operands in slots and its inputs at the last sweep.
+// forward() evaluates the values and the first order partials of every SAC,
+// reverse() is then an adjoint sweep over the cached partials (branch free
+// but for the external calls) that can be repeated for as many adjoint
+// seeds as needed.
+template <typename Base>
+class CompiledTrace {
+ public:
+  struct Instruction {
+    opbyte op;
+    locint r; // result slot, 0 for comparisons, assign_ind and assign_dep
+    locint x; // first operand slot, 0 for none
+    locint y; // second operand slot, 0 for none
+    double coval;
+  };
+
+  CompiledTrace(const std::shared_ptr<TrivialTrace<Base>>& trace) {
+    compile(trace);
+  }
+
+  // values and partials, parameters are those on the trace
+  void forward(const Base* const ind_val, Base* dep_val) {
+    sweep<true>(ind_val, param_value.data(), dep_val);
+  }
+  void forward(const Base* const ind_val, const Base* const param_val,
+               Base* dep_val) {
+    sweep<true>(ind_val, param_val, dep_val);
+  }
+  // values only
+  void evaluate(const Base* const ind_val, Base* dep_val) {
+    sweep<false>(ind_val, param_value.data(), dep_val);
+  }
+  void evaluate(const Base* const ind_val, const Base* const param_val,
+                Base* dep_val) {
+    sweep<false>(ind_val, param_val, dep_val);
+  }
+
+  // ind_adj[i] = sum_j dep_adj[j] * d dep[j] / d ind[i] at the point of
+  // the last forward()
+  void reverse(const Base* const dep_adj, Base* ind_adj);
+
+  size_t get_num_ind() const {return ind_slot.size();}
+  size_t get_num_dep() const {return dep_slot.size();}
+  size_t get_num_param() const {return param_slot.size();}
+  size_t get_num_slot() const {return value.size() - 1;}
+  size_t get_size() const {return code.size();}
+
+  const std::vector<Instruction>& get_instructions() const {return code;}
+  const std::vector<locint>& get_ind_slot() const {return ind_slot;}
+  const std::vector<locint>& get_dep_slot() const {return dep_slot;}
+  const std::vector<locint>& get_param_slot() const {return param_slot;}
+  const std::vector<ExternalCall<Base>>& get_ext_calls() const {
+    return ext_calls;
+  }
+  // ext_funcs[k] owns ext_calls[k].func
+  const std::vector<std::shared_ptr<ExternalFunction<Base>>>&
+      get_ext_funcs() const {return ext_funcs;}
+  // the location on the trace of every slot
+  const std::vector<locint>& get_slot_loc() const {return slot_loc;}
+  // values recorded on the trace
+  const std::vector<Base>& get_ind_value() const {return ind_value;}
+  const std::vector<Base>& get_param_value() const {return param_value;}
+  // the independent and parameter values recorded on trace, which has the
+  // structure of the compiled one (e.g. a replay of it), without decoding
+  void read_inputs(const std::shared_ptr<TrivialTrace<Base>>& trace,
+                   std::vector<Base>& ind_val,
+                   std::vector<Base>& param_val) const;
+  // values of all slots after the last sweep
+  const std::vector<Base>& get_value() const {return value;}
+
+ private:
+  void compile(const std::shared_ptr<TrivialTrace<Base>>& trace);
+  // appends the instructions of trace, and their locations to locs
+  void decode(const std::shared_ptr<TrivialTrace<Base>>& trace,
+              std::vector<locint>& locs);
+  template <typename SlotOf>
+  void renumber(const SlotOf& slot);
+
+  template <bool partials>
+  void sweep(const Base* const ind_val, const Base* const param_val,
+             Base* dep_val);
+
+  std::vector<Instruction> code;
+  std::vector<locint> ind_slot;
+  std::vector<locint> dep_slot;
+  std::vector<locint> param_slot;
+  std::vector<Base> ind_value;
+  // position of each independent value on the val tape
+  std::vector<size_t> ind_pos;
+  std::vector<Base> param_value;
+  std::vector<ExternalCall<Base>> ext_calls;
+  std::vector<std::shared_ptr<ExternalFunction<Base>>> ext_funcs;
+  std::vector<locint> slot_loc;
+
+  std::vector<Base> value;
+  std::vector<Base> adjoint;
+  // d r / d x and d r / d y of instruction i at 2*i and 2*i+1
+  std::vector<Base> partial;
+};
+
+template <typename Base>
+void CompiledTrace<Base>::compile(
+    const std::shared_ptr<TrivialTrace<Base>>& trace) {
+  std::vector<locint> locs;
+  decode(trace, locs);
+
+  // order preserving renumbering, NULL_LOC is the smallest and maps to 0.
+  // Independents are numbered from 1 and intermediates from BASE_LOC, so
+  // usually both ranges are dense and a table indexed by location does it.
+  locint max_ind = 0;
+  locint max_loc = BASE_LOC;
+  for (locint loc : locs) {
+    if (loc < BASE_LOC) {
+      max_ind = std::max(max_ind, loc);
+    } else {
+      max_loc = std::max(max_loc, loc);
+    }
+  }
+  size_t table_size = (max_ind + 1) + (max_loc - BASE_LOC + 1);
+  size_t num_slot = 0;
+  if (table_size <= 4 * locs.size()) {
+    auto index = [max_ind](locint loc) {
+      return (loc < BASE_LOC ? loc : loc - BASE_LOC + max_ind + 1);
+    };
+    std::vector<locint> table(table_size, 0);
+    for (locint loc : locs) {
+      table[index(loc)] = 1;
+    }
+    table[index(NULL_LOC)] = 0;
+    slot_loc.assign(1, NULL_LOC);
+    for (size_t i = 0; i < table.size(); i++) {
+      if (table[i] != 0) {
+        table[i] = ++num_slot;
+        slot_loc.push_back(i <= max_ind ? i : i - max_ind - 1 + BASE_LOC);
+      }
+    }
+    renumber([&table, &index](locint loc) {return table[index(loc)];});
+  } else {
+    // sparse locations (e.g. dummy independents in MPI mode)
+    locs.push_back(NULL_LOC);
+    std::sort(locs.begin(), locs.end());
+    locs.erase(std::unique(locs.begin(), locs.end()), locs.end());
+    num_slot = locs.size() - 1;
+    slot_loc = locs;
+    renumber([&locs](locint loc) {
+      return (locint)(std::lower_bound(locs.begin(), locs.end(), loc) -
+                      locs.begin());
+    });
+  }
+
+  value.assign(num_slot + 1, Base(0.0));
+  adjoint.assign(num_slot + 1, Base(0.0));
+  partial.assign(2 * code.size(), Base(0.0));
+}
+
+template <typename Base>
+void CompiledTrace<Base>::decode(
+    const std::shared_ptr<TrivialTrace<Base>>& trace,
+    std::vector<locint>& locs) {
+  Instruction ins;
+  // position of the next value on the val tape of trace
+  size_t num_val = 0;
+  auto next_val = [&trace, &num_val]() {
+    num_val++;
+    return trace->get_next_val_f();
+  };
+  trace->init_forward();
+  opbyte op = trace->get_next_op_f();
+  while (op != end_of_tape) {
+    ins.op = op;
+    ins.r = ins.x = ins.y = NULL_LOC;
+    ins.coval = 0.0;
+    switch (op) {
+      case start_of_tape:
+      case rmpi_send:
+      case rmpi_recv:
+        op = trace->get_next_op_f();
+        continue;
+      case ckp_region:
+      {
+        std::shared_ptr<TrivialTrace<Base>> region =
+            trace->retrace_region(trace->get_next_loc_f());
+        if (region) {
+          decode(region, locs);
+        }
+        op = trace->get_next_op_f();
+        continue;
+      }
+      case ext_func:
+      {
+        locint id = trace->get_next_loc_f();
+        ExternalCall<Base> call;
+        call.func = trace->get_ext_func(id);
+        if (call.func) {
+          call.x.resize(call.func->get_x_num());
+          call.vx.resize(call.func->get_x_num());
+          call.y.resize(call.func->get_y_num());
+          for (size_t i = 0; i < call.x.size(); i++) {
+            call.x[i] = trace->get_next_loc_f();
+            call.vx[i] = next_val();
+          }
+          for (size_t j = 0; j < call.y.size(); j++) {
+            call.y[j] = trace->get_next_loc_f();
+          }
+          locs.insert(locs.end(), call.x.begin(), call.x.end());
+          locs.insert(locs.end(), call.y.begin(), call.y.end());
+          ext_calls.push_back(call);
+          ext_funcs.push_back(trace->get_ext_funcs()[id]);
+        }
+        trace->get_next_loc_f();
+        if (!call.func) {
+          op = trace->get_next_op_f();
+          continue;
+        }
+        break;
+      }
+      case assign_ind:
+        ins.x = trace->get_next_loc_f();
+        ind_slot.push_back(ins.x);
+        ind_pos.push_back(num_val);
+        ind_value.push_back(next_val());
+        break;
+      case assign_dep:
+        ins.x = trace->get_next_loc_f();
+        dep_slot.push_back(ins.x);
+        next_val();
+        break;
+      case assign_param:
+        // kept in place, its value is set before the sweep
+        ins.r = trace->get_next_loc_f();
+        param_slot.push_back(ins.r);
+        param_value.push_back(trace->get_next_param_f());
+        break;
+      case assign_d:
+        ins.r = trace->get_next_loc_f();
+        ins.coval = trace->get_next_coval_f();
+        break;
+      case assign_a:
+        ins.x = trace->get_next_loc_f();
+        ins.r = trace->get_next_loc_f();
+        break;
+      case comp_eq:
+      case comp_lt:
+        ins.x = trace->get_next_loc_f();
+        ins.y = trace->get_next_loc_f();
+        ins.coval = trace->get_next_coval_f();
+        break;
+      case eq_plus_a:
+      case plus_a_a:
+      case eq_minus_a:
+      case minus_a_a:
+        ins.x = trace->get_next_loc_f();
+        ins.y = trace->get_next_loc_f();
+        ins.r = trace->get_next_loc_f();
+        break;
+      case eq_plus_d:
+      case plus_d_a:
+      case minus_d_a:
+      case eq_mult_d:
+      case mult_d_a:
+        ins.x = trace->get_next_loc_f();
+        ins.coval = trace->get_next_coval_f();
+        ins.r = trace->get_next_loc_f();
+        break;
+      case eq_mult_a:
+      case mult_a_a:
+      case eq_div_a:
+      case div_a_a:
+      case pow_a_a:
+        ins.x = trace->get_next_loc_f();
+        ins.y = trace->get_next_loc_f();
+        ins.r = trace->get_next_loc_f();
+        next_val();
+        next_val();
+        break;
+      case div_d_a:
+      case pow_a_d:
+      case pow_d_a:
+        ins.x = trace->get_next_loc_f();
+        next_val();
+        ins.coval = trace->get_next_coval_f();
+        ins.r = trace->get_next_loc_f();
+        break;
+      case sin_a:
+      case cos_a:
+      case asin_a:
+      case acos_a:
+      case atan_a:
+      case sqrt_a:
+      case exp_a:
+      case log_a:
+      case erf_a:
+      case fabs_a:
+        ins.x = trace->get_next_loc_f();
+        ins.r = trace->get_next_loc_f();
+        next_val();
+        break;
+      default:
+        warning_UnrecognizedOpcode((int)op);
+        op = trace->get_next_op_f();
+        continue;
+    }
+    locs.push_back(ins.r);
+    locs.push_back(ins.x);
+    locs.push_back(ins.y);
+    code.push_back(ins);
+    op = trace->get_next_op_f();
+  }
+  trace->end_forward();
+}
+
+template <typename Base>
+void CompiledTrace<Base>::read_inputs(
+    const std::shared_ptr<TrivialTrace<Base>>& trace,
+    std::vector<Base>& ind_val, std::vector<Base>& param_val) const {
+  ind_val.resize(ind_pos.size());
+  param_val.resize(param_slot.size());
+  trace->init_forward();
+  size_t pos = 0;
+  for (size_t i = 0; i < ind_pos.size(); i++) {
+    for (; pos < ind_pos[i]; pos++) {
+      trace->get_next_val_f();
+    }
+    ind_val[i] = trace->get_next_val_f();
+    pos++;
+  }
+  for (size_t i = 0; i < param_val.size(); i++) {
+    param_val[i] = trace->get_next_param_f();
+  }
+  trace->end_forward();
+}
+
+template <typename Base>
+template <typename SlotOf>
+void CompiledTrace<Base>::renumber(const SlotOf& slot) {
+  for (Instruction& ins : code) {
+    ins.r = slot(ins.r);
+    ins.x = slot(ins.x);
+    ins.y = slot(ins.y);
+  }
+  for (locint& loc : ind_slot) {loc = slot(loc);}
+  for (locint& loc : dep_slot) {loc = slot(loc);}
+  for (locint& loc : param_slot) {loc = slot(loc);}
+  for (ExternalCall<Base>& call : ext_calls) {
+    for (locint& loc : call.x) {loc = slot(loc);}
+    for (locint& loc : call.y) {loc = slot(loc);}
+  }
+}
+
+template <typename Base>
+template <bool partials>
+void CompiledTrace<Base>::sweep(const Base* const ind_val,
+                                const Base* const param_val,
+                                Base* dep_val) {
+  using std::sin;
+  using std::cos;
+  using std::asin;
+  using std::acos;
+  using std::atan;
+  using std::sqrt;
+  using std::pow;
+  using std::log;
+  using std::exp;
+  using std::fabs;
+  using std::erf;
+
+  Base* v = value.data();
+  Base* d = partial.data();
+  for (size_t i = 0; i < ind_slot.size(); i++) {
+    v[ind_slot[i]] = ind_val[i];
+  }
+  for (size_t i = 0; i < param_slot.size(); i++) {
+    v[param_slot[i]] = param_val[i];
+  }
+  const size_t size = code.size();
+  const Instruction* ins = code.data();
+  ExternalCall<Base>* call = ext_calls.data();
+  std::vector<Base> ext_y;
+  for (size_t i = 0; i < size; i++, ins++, d += 2) {
+    const Base vx = v[ins->x];
+    const Base vy = v[ins->y];
+    switch (ins->op) {
+      case assign_ind:
+      case assign_dep:
+      case assign_param:
+        break;
+      case assign_d:
+        v[ins->r] = ins->coval;
+        break;
+      case assign_a:
+        v[ins->r] = vx;
+        if (partials) {d[0] = 1.0;}
+        break;
+      case comp_eq:
+      {
+        bool flag = (vx == vy);
+        if ((!flag && ins->coval == 1.0) || (flag && ins->coval != 1.0)) {
+          warning_BranchInconsistent<Base>(vx, "==", vy);
+        }
+      }
+        break;
+      case comp_lt:
+      {
+        bool flag = (vx < vy);
+        if ((!flag && ins->coval == 1.0) || (flag && ins->coval != 1.0)) {
+          warning_BranchInconsistent<Base>(vx, "<", vy);
+        }
+      }
+        break;
+      case eq_plus_a:
+      case plus_a_a:
+        if (partials) {d[0] = 1.0; d[1] = 1.0;}
+        v[ins->r] = vx + vy;
+        break;
+      case eq_plus_d:
+      case plus_d_a:
+        if (partials) {d[0] = 1.0;}
+        v[ins->r] = vx + ins->coval;
+        break;
+      case eq_minus_a:
+      case minus_a_a:
+        if (partials) {d[0] = 1.0; d[1] = -1.0;}
+        v[ins->r] = vx - vy;
+        break;
+      case minus_d_a:
+        if (partials) {d[0] = -1.0;}
+        v[ins->r] = ins->coval - vx;
+        break;
+      case eq_mult_a:
+      case mult_a_a:
+        if (partials) {d[0] = vy; d[1] = vx;}
+        v[ins->r] = vx * vy;
+        break;
+      case eq_mult_d:
+      case mult_d_a:
+        if (partials) {d[0] = ins->coval;}
+        v[ins->r] = vx * ins->coval;
+        break;
+      case eq_div_a:
+      case div_a_a:
+        if (partials) {d[0] = 1.0 / vy; d[1] = -vx / (vy * vy);}
+        v[ins->r] = vx / vy;
+        break;
+      case div_d_a:
+        if (partials) {d[0] = -ins->coval / (vx * vx);}
+        v[ins->r] = ins->coval / vx;
+        break;
+      case sin_a:
+        if (partials) {d[0] = cos(vx);}
+        v[ins->r] = sin(vx);
+        break;
+      case cos_a:
+        if (partials) {d[0] = -sin(vx);}
+        v[ins->r] = cos(vx);
+        break;
+      case asin_a:
+        if (vx < -1 || vx > 1) {
+          warning_ParameterOutOfBound<Base>(vx, "asin");
+        }
+        if (partials) {d[0] = 1.0 / sqrt(1.0 - vx * vx);}
+        v[ins->r] = asin(vx);
+        break;
+      case acos_a:
+        if (vx < -1 || vx > 1) {
+          warning_ParameterOutOfBound<Base>(vx, "acos");
+        }
+        if (partials) {d[0] = -1.0 / sqrt(1.0 - vx * vx);}
+        v[ins->r] = acos(vx);
+        break;
+      case atan_a:
+        if (partials) {d[0] = 1.0 / (1.0 + vx * vx);}
+        v[ins->r] = atan(vx);
+        break;
+      case sqrt_a:
+        v[ins->r] = sqrt(vx);
+        if (partials) {d[0] = (vx != 0.0 ? 0.5 / v[ins->r] : Base(0.0));}
+        break;
+      case exp_a:
+        v[ins->r] = exp(vx);
+        if (partials) {d[0] = v[ins->r];}
+        break;
+      case log_a:
+        if (vx <= 0) {
+          warning_ParameterOutOfBound<Base>(vx, "log");
+        }
+        if (partials) {d[0] = 1.0 / vx;}
+        v[ins->r] = log(vx);
+        break;
+      case pow_a_a:
+        if (partials) {
+          Base t = pow(vx, vy);
+          d[0] = vy * t / vx;
+          d[1] = log(vx) * t;
+          v[ins->r] = t;
+        } else {
+          v[ins->r] = pow(vx, vy);
+        }
+        break;
+      case pow_a_d:
+        if (partials) {
+          Base t = pow(vx, ins->coval);
+          d[0] = ins->coval * t / vx;
+          v[ins->r] = t;
+        } else {
+          v[ins->r] = pow(vx, ins->coval);
+        }
+        break;
+      case pow_d_a:
+        v[ins->r] = pow(ins->coval, vx);
+        if (partials) {d[0] = log(ins->coval) * v[ins->r];}
+        break;
+      case erf_a:
+        if (partials) {d[0] = 2.0 / sqrt(PI) * exp(-vx * vx);}
+        v[ins->r] = erf(vx);
+        break;
+      case fabs_a:
+        if (partials) {
+          d[0] = (vx > 0 ? Base(1.0) : (vx < 0 ? Base(-1.0) : Base(0.0)));
+        }
+        v[ins->r] = fabs(vx);
+        break;
+      case ext_func:
+        // the inputs are kept for reverse()
+        for (size_t j = 0; j < call->x.size(); j++) {
+          call->vx[j] = v[call->x[j]];
+        }
+        ext_y.resize(call->y.size());
+        call->func->eval_primal(call->vx.data(), ext_y.data());
+        for (size_t j = 0; j < call->y.size(); j++) {
+          v[call->y[j]] = ext_y[j];
+        }
+        call++;
+        break;
+    }
+  }
+  if (dep_val != nullptr) {
+    for (size_t i = 0; i < dep_slot.size(); i++) {
+      dep_val[i] = v[dep_slot[i]];
+    }
+  }
+}
+
+template <typename Base>
+void CompiledTrace<Base>::reverse(const Base* const dep_adj, Base* ind_adj) {
+  Base* a = adjoint.data();
+  std::fill(adjoint.begin(), adjoint.end(), Base(0.0));
+  for (size_t i = 0; i < dep_slot.size(); i++) {
+    a[dep_slot[i]] += dep_adj[i];
+  }
+  // operands of a SAC always sit in smaller slots than its result, but
+  // the result adjoint is read and reset first so x == r is also fine.
+  // An ext_func instruction has no partials (all its slots are 0), its
+  // adjoint is added when the sweep gets to it.
+  const Instruction* ins = code.data() + code.size();
+  const Base* d = partial.data() + partial.size();
+  const ExternalCall<Base>* call = ext_calls.data() + ext_calls.size();
+  std::vector<Base> y_adj;
+  std::vector<Base> x_adj;
+  while (ins != code.data()) {
+    ins--;
+    d -= 2;
+    if (ins->op == ext_func) {
+      call--;
+      y_adj.resize(call->y.size());
+      x_adj.assign(call->x.size(), Base(0.0));
+      for (size_t j = 0; j < call->y.size(); j++) {
+        y_adj[j] = a[call->y[j]];
+        a[call->y[j]] = 0.0;
+      }
+      call->func->eval_adjoint(call->vx.data(), y_adj.data(), x_adj.data());
+      for (size_t j = 0; j < call->x.size(); j++) {
+        a[call->x[j]] += x_adj[j];
+      }
+      continue;
+    }
+    Base w = a[ins->r];
+    a[ins->r] = 0.0;
+    a[ins->x] += d[0] * w;
+    a[ins->y] += d[1] * w;
+  }
+  for (size_t i = 0; i < ind_slot.size(); i++) {
+    ind_adj[i] = a[ind_slot[i]];
+  }
+}
+
+} // namespace ReverseAD
+
+#endif // COMPILED_TRACE_H_
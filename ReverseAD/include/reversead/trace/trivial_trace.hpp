@@ -1,14 +1,18 @@
 #ifndef TRIVIAL_TRACE_H_
 #define TRIVIAL_TRACE_H_
 
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "reversead/common/reversead_config.h"
 #include "reversead/common/reversead_type.hpp"
 #include "reversead/tape/trivial_tape.hpp"
 #include "reversead/tape/disk_tape.hpp"
 #include "reversead/trace/abstract_trace.hpp"
+#include "reversead/util/error_info.hpp"
 
 namespace ReverseAD {
 
@@ -20,6 +24,9 @@ template <typename T>
 using VirtualTape = TrivialTape<T>;
 #endif
 
+template <typename Base> class ExternalFunction;
+template <typename Base> class CompiledTrace;
+
 template<typename Base>
 class TrivialTrace : public AbstractTrace<Base> {
   using AbstractTrace<Base>::num_ind;
@@ -87,6 +94,54 @@ class TrivialTrace : public AbstractTrace<Base> {
     coval_tape->put(coval);
   }
 
+  // Checkpoint regions : only a ckp_region op is on this trace, the
+  // region is traced again (same locations) when a sweep reaches it.
+  size_t add_region(
+      const std::function<std::shared_ptr<TrivialTrace<Base>>()>& retrace) {
+    regions.push_back(retrace);
+    return regions.size() - 1;
+  }
+  std::shared_ptr<TrivialTrace<Base>> retrace_region(size_t region) const {
+    if (region >= regions.size()) {
+      warning_RegionNotFound(region);
+      return nullptr;
+    }
+    return regions[region]();
+  }
+  bool has_region() const {return !regions.empty();}
+
+  // External functions called on this trace, an ext_func op keeps the index
+  size_t add_ext_func(const std::shared_ptr<ExternalFunction<Base>>& func) {
+    for (size_t i = 0; i < ext_funcs.size(); i++) {
+      if (ext_funcs[i] == func) {
+        return i;
+      }
+    }
+    ext_funcs.push_back(func);
+    return ext_funcs.size() - 1;
+  }
+  const ExternalFunction<Base>* get_ext_func(size_t id) const {
+    if (id >= ext_funcs.size()) {
+      warning_ExtFuncNotFound(id);
+      return nullptr;
+    }
+    return ext_funcs[id].get();
+  }
+  const std::vector<std::shared_ptr<ExternalFunction<Base>>>&
+      get_ext_funcs() const {return ext_funcs;}
+
+  // The decoded form of this trace and the slot values of a replay,
+  // built by the first replay and kept with the trace for the next ones.
+  // BaseFunctionReplay holds get_replay_mutex() while it uses them.
+  const std::shared_ptr<CompiledTrace<Base>>& get_compiled() const {
+    return compiled;
+  }
+  void set_compiled(const std::shared_ptr<CompiledTrace<Base>>& compiled) {
+    this->compiled = compiled;
+  }
+  std::vector<Base>& get_replay_value() {return replay_value;}
+  std::mutex& get_replay_mutex() {return replay_mutex;}
+
   // forward sweep
   inline void init_forward() {
     op_tape->init_forward();
@@ -152,6 +207,16 @@ class TrivialTrace : public AbstractTrace<Base> {
 
   // for debug
   inline void dump_trace_info() {
+    std::cout << "Trace : " << op_tape->size() << " ops, "
+              << loc_tape->size() << " locs, "
+              << val_tape->size() << " vals, "
+              << param_tape->size() << " params, "
+              << coval_tape->size() << " covals ("
+              << op_tape->size() * sizeof(opbyte)
+                 + loc_tape->size() * sizeof(locint)
+                 + (val_tape->size() + param_tape->size()) * sizeof(Base)
+                 + coval_tape->size() * sizeof(double)
+              << " bytes)" << std::endl;
   }
 
   inline void dump_trace() {
@@ -173,8 +238,31 @@ class TrivialTrace : public AbstractTrace<Base> {
   std::shared_ptr<VirtualTape<Base>> val_tape;
   std::shared_ptr<VirtualTape<Base>> param_tape;
   std::shared_ptr<VirtualTape<double>> coval_tape;
+  std::vector<std::function<std::shared_ptr<TrivialTrace<Base>>()>> regions;
+  std::vector<std::shared_ptr<ExternalFunction<Base>>> ext_funcs;
+  std::shared_ptr<CompiledTrace<Base>> compiled;
+  std::vector<Base> replay_value;
+  std::mutex replay_mutex;
 };
 
+// The ext_func ops of a copied tape keep their indices, so the functions are
+// carried over in order. They are only callable with their own Base.
+template <typename Base>
+void copy_ext_funcs(const TrivialTrace<Base>& other, TrivialTrace<Base>& ret) {
+  for (const std::shared_ptr<ExternalFunction<Base>>& func :
+           other.get_ext_funcs()) {
+    ret.add_ext_func(func);
+  }
+}
+
+template <typename OldBase, typename NewBase>
+void copy_ext_funcs(const TrivialTrace<OldBase>& other,
+                    TrivialTrace<NewBase>& /*ret*/) {
+  if (!other.get_ext_funcs().empty()) {
+    warning_ExtFuncReplay();
+  }
+}
+
 template <typename OldBase, typename NewBase>
 std::shared_ptr<TrivialTrace<NewBase>> copy_tape(
       const std::shared_ptr<TrivialTrace<OldBase>>& other,
@@ -189,6 +277,7 @@ std::shared_ptr<TrivialTrace<NewBase>> copy_tape(
     ret->coval_tape = other->coval_tape;
     ret->num_ind = other->num_ind;
     ret->num_dep = other->num_dep;
+    copy_ext_funcs(*other, *ret);
     return ret;
   }
 
@@ -22,6 +22,17 @@ void warning_NumberInconsistent(const char* const info, int input_num, int trace
 
 void warning_UnrecognizedOpcode(int opcode);
 void warning_NoTraceSet();
+void warning_CompressionConflict(size_t row, size_t col);
+void warning_UnsupportedOrder(const char* const name, size_t order);
+void warning_PlanInconsistent(size_t sac_count);
+void warning_RegionNotFound(size_t region);
+void warning_ExtFuncNotFound(size_t id);
+void warning_ExtFuncUnsupported(const char* const name);
+void warning_ExtFuncNoHessian();
+void warning_ExtFuncReplay();
+void warning_ExtFuncRefused(const char* const name);
+void warning_LayoutInconsistent();
+void warning_NotInPattern(size_t row, size_t col);
 
 double get_timing();
 
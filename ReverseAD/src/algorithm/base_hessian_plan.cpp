@@ -0,0 +1,5 @@
+#include "reversead/algorithm/base_hessian_plan.hpp"
+#include "reversead/forwardtype/single_forward.hpp"
+
+template class ReverseAD::BaseHessianPlan<double>;
+template class ReverseAD::BaseHessianPlan<ReverseAD::SingleForward>;
@@ -0,0 +1,5 @@
+#include "reversead/algorithm/base_sparsity_pattern.hpp"
+#include "reversead/forwardtype/single_forward.hpp"
+
+template class ReverseAD::BaseSparsityPattern<double>;
+template class ReverseAD::BaseSparsityPattern<ReverseAD::SingleForward>;
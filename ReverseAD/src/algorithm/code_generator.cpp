@@ -0,0 +1,498 @@
+#include <cmath>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "reversead/common/reversead_const.hpp"
+#include "reversead/common/opcodes.hpp"
+#include "reversead/algorithm/base_reverse_hessian.hpp"
+#include "reversead/algorithm/code_generator.hpp"
+#include "reversead/util/error_info.hpp"
+
+namespace ReverseAD {
+
+namespace {
+
+typedef CompiledTrace<double>::Instruction Instruction;
+
+std::string num(double c) {
+  if (std::isnan(c)) {
+    return "(0.0 / 0.0)";
+  } else if (std::isinf(c)) {
+    return (c > 0 ? "(1.0 / 0.0)" : "(-1.0 / 0.0)");
+  }
+  std::ostringstream os;
+  os << std::setprecision(17) << c;
+  std::string ret = os.str();
+  if (ret.find_first_of(".e") == std::string::npos) {
+    ret += ".0";
+  }
+  return (c < 0 ? "(" + ret + ")" : ret);
+}
+
+std::string var(char prefix, locint slot, size_t version = 0) {
+  std::string ret = prefix + std::to_string(slot);
+  return (version == 0 ? ret : ret + "_" + std::to_string(version));
+}
+
+// The versions of the slots read and written by each instruction. A slot
+// written again (x = x is traced with r == x) gets a new version, v12 then
+// v12_1 ..., so that every value is declared once.
+struct SlotVersions {
+  std::vector<size_t> r, x, y;
+  std::vector<size_t> last;
+};
+
+void number_versions(const CompiledTrace<double>& compiled,
+                     SlotVersions& ver) {
+  const std::vector<Instruction>& code = compiled.get_instructions();
+  std::vector<bool> written(compiled.get_num_slot() + 1, false);
+  for (locint s : compiled.get_ind_slot()) {written[s] = true;}
+  for (locint s : compiled.get_param_slot()) {written[s] = true;}
+  ver.last.assign(compiled.get_num_slot() + 1, 0);
+  ver.r.assign(code.size(), 0);
+  ver.x.assign(code.size(), 0);
+  ver.y.assign(code.size(), 0);
+  for (size_t i = 0; i < code.size(); i++) {
+    const Instruction& ins = code[i];
+    if (ins.r == NULL_LOC || ins.op == assign_param) {
+      continue;
+    }
+    ver.x[i] = ver.last[ins.x];
+    ver.y[i] = ver.last[ins.y];
+    if (written[ins.r]) {
+      ver.last[ins.r]++;
+    }
+    written[ins.r] = true;
+    ver.r[i] = ver.last[ins.r];
+  }
+}
+
+// value and partials of one SAC, an empty string is a zero partial
+struct LocalExpr {
+  std::string value;
+  std::string dx, dy;
+  std::string pxx, pxy, pyy;
+};
+
+void local_expr(const Instruction& ins, const std::string& vx,
+                const std::string& vy, const std::string& vr, LocalExpr& e) {
+  const std::string c = num(ins.coval);
+  e = LocalExpr();
+  switch (ins.op) {
+    case assign_d:
+      e.value = c;
+      break;
+    case assign_a:
+      e.value = vx;
+      e.dx = "1.0";
+      break;
+    case eq_plus_a:
+    case plus_a_a:
+      e.value = vx + " + " + vy;
+      e.dx = e.dy = "1.0";
+      break;
+    case eq_plus_d:
+    case plus_d_a:
+      e.value = vx + " + " + c;
+      e.dx = "1.0";
+      break;
+    case eq_minus_a:
+    case minus_a_a:
+      e.value = vx + " - " + vy;
+      e.dx = "1.0";
+      e.dy = "-1.0";
+      break;
+    case minus_d_a:
+      e.value = c + " - " + vx;
+      e.dx = "-1.0";
+      break;
+    case eq_mult_a:
+    case mult_a_a:
+      e.value = vx + " * " + vy;
+      e.dx = vy;
+      e.dy = vx;
+      e.pxy = "1.0";
+      break;
+    case eq_mult_d:
+    case mult_d_a:
+      e.value = vx + " * " + c;
+      e.dx = c;
+      break;
+    case eq_div_a:
+    case div_a_a:
+      e.value = vx + " / " + vy;
+      e.dx = "(1.0 / " + vy + ")";
+      e.dy = "(-" + vr + " / " + vy + ")";
+      e.pxy = "(-1.0 / (" + vy + " * " + vy + "))";
+      e.pyy = "(2.0 * " + vr + " / (" + vy + " * " + vy + "))";
+      break;
+    case div_d_a:
+      e.value = c + " / " + vx;
+      e.dx = "(-" + vr + " / " + vx + ")";
+      e.pxx = "(2.0 * " + vr + " / (" + vx + " * " + vx + "))";
+      break;
+    case sin_a:
+      e.value = "std::sin(" + vx + ")";
+      e.dx = "std::cos(" + vx + ")";
+      e.pxx = "(-" + vr + ")";
+      break;
+    case cos_a:
+      e.value = "std::cos(" + vx + ")";
+      e.dx = "(-std::sin(" + vx + "))";
+      e.pxx = "(-" + vr + ")";
+      break;
+    case asin_a:
+      e.value = "std::asin(" + vx + ")";
+      e.dx = "(1.0 / std::sqrt(1.0 - " + vx + " * " + vx + "))";
+      e.pxx = "(" + vx + " * std::pow(1.0 - " + vx + " * " + vx +
+              ", -1.5))";
+      break;
+    case acos_a:
+      e.value = "std::acos(" + vx + ")";
+      e.dx = "(-1.0 / std::sqrt(1.0 - " + vx + " * " + vx + "))";
+      e.pxx = "(-" + vx + " * std::pow(1.0 - " + vx + " * " + vx +
+              ", -1.5))";
+      break;
+    case atan_a:
+      e.value = "std::atan(" + vx + ")";
+      e.dx = "(1.0 / (1.0 + " + vx + " * " + vx + "))";
+      e.pxx = "(-2.0 * " + vx + " / ((1.0 + " + vx + " * " + vx +
+              ") * (1.0 + " + vx + " * " + vx + ")))";
+      break;
+    case sqrt_a:
+      e.value = "std::sqrt(" + vx + ")";
+      e.dx = "(" + vx + " != 0.0 ? 0.5 / " + vr + " : 0.0)";
+      e.pxx = "(" + vx + " != 0.0 ? -0.25 / (" + vr + " * " + vx +
+              ") : 0.0)";
+      break;
+    case exp_a:
+      e.value = "std::exp(" + vx + ")";
+      e.dx = e.pxx = vr;
+      break;
+    case log_a:
+      e.value = "std::log(" + vx + ")";
+      e.dx = "(1.0 / " + vx + ")";
+      e.pxx = "(-1.0 / (" + vx + " * " + vx + "))";
+      break;
+    case pow_a_a:
+      e.value = "std::pow(" + vx + ", " + vy + ")";
+      e.dx = "(" + vy + " * " + vr + " / " + vx + ")";
+      e.dy = "(std::log(" + vx + ") * " + vr + ")";
+      e.pxx = "((" + vy + " - 1.0) * " + vy + " * " + vr + " / (" + vx +
+              " * " + vx + "))";
+      e.pxy = "((" + vy + " * std::log(" + vx + ") + 1.0) * " + vr +
+              " / " + vx + ")";
+      e.pyy = "(std::log(" + vx + ") * std::log(" + vx + ") * " + vr + ")";
+      break;
+    case pow_a_d:
+      e.value = "std::pow(" + vx + ", " + c + ")";
+      e.dx = "(" + c + " * " + vr + " / " + vx + ")";
+      e.pxx = "(" + c + " * (" + c + " - 1.0) * " + vr + " / (" + vx +
+              " * " + vx + "))";
+      break;
+    case pow_d_a:
+      e.value = "std::pow(" + c + ", " + vx + ")";
+      e.dx = "(" + num(std::log(ins.coval)) + " * " + vr + ")";
+      e.pxx = "(" + num(std::log(ins.coval) * std::log(ins.coval)) +
+              " * " + vr + ")";
+      break;
+    case erf_a:
+      e.value = "std::erf(" + vx + ")";
+      e.dx = "(" + num(2.0 / std::sqrt(PI)) + " * std::exp(-" + vx +
+             " * " + vx + "))";
+      e.pxx = "(-2.0 * " + vx + " * " + e.dx + ")";
+      break;
+    case fabs_a:
+      e.value = "std::fabs(" + vx + ")";
+      e.dx = "(" + vx + " > 0.0 ? 1.0 : (" + vx + " < 0.0 ? -1.0 : 0.0))";
+      break;
+  }
+}
+
+// "d * a", folding the unit partials
+std::string scale(const std::string& d, const std::string& a) {
+  if (d == "1.0") {return a;}
+  if (d == "-1.0") {return "(-" + a + ")";}
+  return d + " * " + a;
+}
+
+std::string sum(const std::vector<std::string>& terms) {
+  std::string ret;
+  for (const std::string& t : terms) {
+    ret += (ret.empty() ? "" : " + ") + t;
+  }
+  return (ret.empty() ? "0.0" : ret);
+}
+
+void accumulate(std::ostream& os, std::set<std::string>& live,
+                const std::string& a, const std::string& term) {
+  if (live.count(a) > 0) {
+    os << "  " << a << " += " << term << ";\n";
+  } else {
+    os << "  double " << a << " = " << term << ";\n";
+    live.insert(a);
+  }
+}
+
+void write_array(std::ostream& os, const char* name,
+                 const std::vector<double>& v) {
+  os << "  const double " << name << "[" << v.size() << "] = {";
+  for (size_t i = 0; i < v.size(); i++) {
+    os << (i == 0 ? "" : ", ") << (i % 4 == 0 ? "\n      " : "")
+       << num(v[i]);
+  }
+  os << "};\n";
+}
+
+} // namespace
+
+void CodeGenerator::generate_forward(std::ostream& os, bool tangent) {
+  const std::vector<locint>& ind_slot = compiled.get_ind_slot();
+  const std::vector<locint>& param_slot = compiled.get_param_slot();
+  std::vector<bool> defined(compiled.get_num_slot() + 1, false);
+  for (size_t i = 0; i < ind_slot.size(); i++) {
+    os << "  const double " << var('v', ind_slot[i]) << " = x[" << i
+       << "];\n";
+    if (tangent) {
+      os << "  const double " << var('t', ind_slot[i]) << " = v[" << i
+         << "];\n";
+    }
+    defined[ind_slot[i]] = true;
+  }
+  for (size_t i = 0; i < param_slot.size(); i++) {
+    os << "  const double " << var('v', param_slot[i]) << " = "
+       << num(compiled.get_param_value()[i]) << ";\n";
+    if (tangent) {
+      os << "  const double " << var('t', param_slot[i]) << " = 0.0;\n";
+    }
+    defined[param_slot[i]] = true;
+  }
+  for (const Instruction& ins : compiled.get_instructions()) {
+    if (ins.r != NULL_LOC) {
+      defined[ins.r] = true;
+    }
+  }
+  // locations used but not defined on the trace are zero
+  for (size_t s = 1; s < defined.size(); s++) {
+    if (!defined[s]) {
+      os << "  const double " << var('v', s) << " = 0.0;\n";
+      if (tangent) {
+        os << "  const double " << var('t', s) << " = 0.0;\n";
+      }
+    }
+  }
+  SlotVersions ver;
+  number_versions(compiled, ver);
+  const std::vector<Instruction>& code = compiled.get_instructions();
+  LocalExpr e;
+  for (size_t i = 0; i < code.size(); i++) {
+    const Instruction& ins = code[i];
+    if (ins.r == NULL_LOC || ins.op == assign_param) {
+      continue;
+    }
+    local_expr(ins, var('v', ins.x, ver.x[i]), var('v', ins.y, ver.y[i]),
+               var('v', ins.r, ver.r[i]), e);
+    os << "  const double " << var('v', ins.r, ver.r[i]) << " = " << e.value
+       << ";\n";
+    if (tangent) {
+      std::vector<std::string> terms;
+      if (!e.dx.empty()) {
+        terms.push_back(scale(e.dx, var('t', ins.x, ver.x[i])));
+      }
+      if (!e.dy.empty()) {
+        terms.push_back(scale(e.dy, var('t', ins.y, ver.y[i])));
+      }
+      os << "  const double " << var('t', ins.r, ver.r[i]) << " = "
+         << sum(terms) << ";\n";
+    }
+  }
+  const std::vector<locint>& dep_slot = compiled.get_dep_slot();
+  for (size_t i = 0; i < dep_slot.size(); i++) {
+    os << "  y[" << i << "] = "
+       << var('v', dep_slot[i], ver.last[dep_slot[i]]) << ";\n";
+  }
+}
+
+void CodeGenerator::generate_reverse(std::ostream& os, bool tangent) {
+  SlotVersions ver;
+  number_versions(compiled, ver);
+  std::set<std::string> live;
+  // b is the derivative of the adjoint a along v
+  std::set<std::string> live_b;
+  const std::vector<locint>& dep_slot = compiled.get_dep_slot();
+  for (size_t i = 0; i < dep_slot.size(); i++) {
+    accumulate(os, live, var('a', dep_slot[i], ver.last[dep_slot[i]]),
+               "w[" + std::to_string(i) + "]");
+  }
+  const std::vector<Instruction>& code = compiled.get_instructions();
+  LocalExpr e;
+  for (size_t i = code.size(); i-- > 0;) {
+    const Instruction& ins = code[i];
+    if (ins.r == NULL_LOC || ins.op == assign_param) {
+      continue;
+    }
+    const std::string ar = var('a', ins.r, ver.r[i]);
+    const std::string br = var('b', ins.r, ver.r[i]);
+    if (live.count(ar) == 0) {
+      continue;
+    }
+    local_expr(ins, var('v', ins.x, ver.x[i]), var('v', ins.y, ver.y[i]),
+               var('v', ins.r, ver.r[i]), e);
+    const std::string tx = var('t', ins.x, ver.x[i]);
+    const std::string ty = var('t', ins.y, ver.y[i]);
+    const std::string* d[2] = {&e.dx, &e.dy};
+    const std::string a[2] = {var('a', ins.x, ver.x[i]),
+                              var('a', ins.y, ver.y[i])};
+    const std::string b[2] = {var('b', ins.x, ver.x[i]),
+                              var('b', ins.y, ver.y[i])};
+    // second order terms: d/dv of the partials
+    std::vector<std::string> second[2];
+    if (!e.pxx.empty()) {second[0].push_back(scale(e.pxx, tx));}
+    if (!e.pxy.empty()) {
+      second[0].push_back(scale(e.pxy, ty));
+      second[1].push_back(scale(e.pxy, tx));
+    }
+    if (!e.pyy.empty()) {second[1].push_back(scale(e.pyy, ty));}
+    for (size_t k = 0; k < 2; k++) {
+      if (d[k]->empty()) {
+        continue;
+      }
+      accumulate(os, live, a[k], scale(*d[k], ar));
+      if (!tangent) {
+        continue;
+      }
+      std::vector<std::string> terms;
+      if (live_b.count(br) > 0) {
+        terms.push_back(scale(*d[k], br));
+      }
+      if (!second[k].empty()) {
+        terms.push_back("(" + sum(second[k]) + ") * " + ar);
+      }
+      if (terms.empty()) {
+        continue;
+      }
+      accumulate(os, live_b, b[k], sum(terms));
+    }
+  }
+  const std::vector<locint>& ind_slot = compiled.get_ind_slot();
+  for (size_t i = 0; i < ind_slot.size(); i++) {
+    const std::string a = var('a', ind_slot[i]);
+    const std::string b = var('b', ind_slot[i]);
+    os << "  g[" << i << "] = " << (live.count(a) > 0 ? a : "0.0") << ";\n";
+    if (tangent) {
+      os << "  hv[" << i << "] = " << (live_b.count(b) > 0 ? b : "0.0")
+         << ";\n";
+    }
+  }
+}
+
+void CodeGenerator::generate(std::ostream& os, bool hessian_vector) {
+  if (!compiled.get_ext_calls().empty()) {
+    warning_ExtFuncRefused("CodeGenerator");
+    return;
+  }
+  os << "// Generated by ReverseAD: " << compiled.get_num_ind()
+     << " independents, " << compiled.get_num_dep() << " dependents, "
+     << compiled.get_size() << " operations.\n";
+  os << "#include <cmath>\n\n";
+
+  os << "void " << name << "_function(const double* x, double* y) {\n";
+  generate_forward(os, false);
+  os << "}\n\n";
+
+  os << "void " << name << "_gradient(const double* x, const double* w,\n"
+     << "    double* y, double* g) {\n";
+  generate_forward(os, false);
+  generate_reverse(os, false);
+  os << "}\n";
+
+  if (hessian_vector) {
+    os << "\nvoid " << name << "_hessian_vector(const double* x, "
+       << "const double* w,\n"
+       << "    const double* v, double* y, double* g, double* hv) {\n";
+    generate_forward(os, true);
+    generate_reverse(os, true);
+    os << "}\n";
+  }
+}
+
+void CodeGenerator::generate_harness(std::ostream& os,
+                                     const std::string& source_file,
+                                     bool hessian_vector) {
+  if (!compiled.get_ext_calls().empty()) {
+    warning_ExtFuncRefused("CodeGenerator");
+    return;
+  }
+  const size_t n = compiled.get_num_ind();
+  const size_t m = compiled.get_num_dep();
+  std::vector<double> x(compiled.get_ind_value());
+  std::vector<double> w(m), v(n);
+  for (size_t j = 0; j < m; j++) {w[j] = 1.0 / (j + 1);}
+  for (size_t i = 0; i < n; i++) {v[i] = 1.0 - 0.5 * i / n;}
+
+  BaseReverseHessian<double> hessian(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      hessian.compute(n, m);
+  std::vector<double> y(m), g(n, 0.0), hv(n, 0.0);
+  size_t size;
+  size_t** tind;
+  double* values;
+  for (size_t j = 0; j < m; j++) {
+    y[j] = tensor->get_dep_value(j);
+    tensor->get_internal_coordinate_list(j, 1, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      g[tind[l][0]] += w[j] * values[l];
+    }
+    tensor->get_internal_coordinate_list(j, 2, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      hv[tind[l][0]] += w[j] * values[l] * v[tind[l][1]];
+      if (tind[l][0] != tind[l][1]) {
+        hv[tind[l][1]] += w[j] * values[l] * v[tind[l][0]];
+      }
+    }
+  }
+
+  os << "// Checks the functions in " << source_file
+     << " against BaseReverseHessian.\n";
+  os << "#include <cmath>\n#include <cstdio>\n\n";
+  os << "#include \"" << source_file << "\"\n\n";
+  os << "static int check(const char* what, const double* a, "
+     << "const double* b, int n) {\n"
+     << "  int ret = 0;\n"
+     << "  for (int i = 0; i < n; i++) {\n"
+     << "    if (std::fabs(a[i] - b[i]) > 1e-8 * (1.0 + std::fabs(b[i]))) {\n"
+     << "      std::printf(\"%s[%d] : %.17g expected %.17g\\n\", what, i,"
+     << " a[i], b[i]);\n"
+     << "      ret = 1;\n"
+     << "    }\n"
+     << "  }\n"
+     << "  return ret;\n"
+     << "}\n\n";
+  os << "int main() {\n";
+  write_array(os, "x", x);
+  write_array(os, "w", w);
+  write_array(os, "v", v);
+  write_array(os, "ey", y);
+  write_array(os, "eg", g);
+  write_array(os, "ehv", hv);
+  os << "  double y[" << m << "], g[" << n << "], hv[" << n << "];\n"
+     << "  int ret = 0;\n";
+  os << "  " << name << "_function(x, y);\n"
+     << "  ret |= check(\"function y\", y, ey, " << m << ");\n";
+  os << "  " << name << "_gradient(x, w, y, g);\n"
+     << "  ret |= check(\"gradient y\", y, ey, " << m << ");\n"
+     << "  ret |= check(\"gradient g\", g, eg, " << n << ");\n";
+  if (hessian_vector) {
+    os << "  " << name << "_hessian_vector(x, w, v, y, g, hv);\n"
+       << "  ret |= check(\"hessian_vector y\", y, ey, " << m << ");\n"
+       << "  ret |= check(\"hessian_vector g\", g, eg, " << n << ");\n"
+       << "  ret |= check(\"hessian_vector hv\", hv, ehv, " << n << ");\n";
+  }
+  os << "  std::printf(ret == 0 ? \"" << name << " OK!\\n\" : \"" << name
+     << " FAILED!\\n\");\n"
+     << "  return ret;\n"
+     << "}\n";
+}
+
+} // namespace ReverseAD
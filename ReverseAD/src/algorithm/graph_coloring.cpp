@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "reversead/algorithm/graph_coloring.hpp"
+
+namespace ReverseAD {
+
+namespace {
+
+const size_t kNoColor = static_cast<size_t>(-1);
+
+size_t smallest_allowed_color(const std::vector<size_t>& forbidden,
+                              size_t v) {
+  size_t c = 0;
+  while (forbidden[c] == v) {
+    c++;
+  }
+  return c;
+}
+
+} // namespace
+
+size_t jacobian_column_coloring(const SparsityPattern& pattern,
+                                std::vector<size_t>& color) {
+  size_t n = pattern.get_col_size();
+  size_t m = pattern.get_row_size();
+  std::vector<std::vector<size_t>> col_rows(n);
+  for (size_t i = 0; i < m; i++) {
+    for (const size_t& j : pattern.get_row(i)) {
+      col_rows[j].push_back(i);
+    }
+  }
+  size_t num_colors = 0;
+  color.assign(n, kNoColor);
+  std::vector<size_t> forbidden(n + 1, kNoColor);
+  for (size_t j = 0; j < n; j++) {
+    for (const size_t& i : col_rows[j]) {
+      for (const size_t& k : pattern.get_row(i)) {
+        if (color[k] != kNoColor) {
+          forbidden[color[k]] = j;
+        }
+      }
+    }
+    color[j] = smallest_allowed_color(forbidden, j);
+    num_colors = std::max(num_colors, color[j] + 1);
+  }
+  return num_colors;
+}
+
+void hessian_adjacency(const SparsityPattern& pattern,
+                       std::vector<std::vector<size_t>>& adjacency) {
+  size_t n = pattern.get_row_size();
+  adjacency.assign(n, std::vector<size_t>());
+  for (size_t i = 0; i < n; i++) {
+    for (const size_t& j : pattern.get_row(i)) {
+      if (j != i) {
+        adjacency[i].push_back(j);
+        adjacency[j].push_back(i);
+      }
+    }
+  }
+  for (std::vector<size_t>& adj : adjacency) {
+    std::sort(adj.begin(), adj.end());
+  }
+}
+
+size_t hessian_star_coloring(const std::vector<std::vector<size_t>>& adjacency,
+                             std::vector<size_t>& color) {
+  size_t n = adjacency.size();
+  size_t num_colors = 0;
+  color.assign(n, kNoColor);
+  std::vector<size_t> forbidden(n + 1, kNoColor);
+  for (size_t v = 0; v < n; v++) {
+    for (const size_t& w : adjacency[v]) {
+      if (color[w] != kNoColor) {
+        forbidden[color[w]] = v;
+      }
+    }
+    for (const size_t& w : adjacency[v]) {
+      for (const size_t& x : adjacency[w]) {
+        if (x == v || color[x] == kNoColor) {
+          continue;
+        }
+        if (color[w] == kNoColor) {
+          forbidden[color[x]] = v;
+        } else {
+          // v-w-x-y would be a two colored path
+          for (const size_t& y : adjacency[x]) {
+            if (y != w && color[y] == color[w]) {
+              forbidden[color[x]] = v;
+              break;
+            }
+          }
+        }
+      }
+    }
+    color[v] = smallest_allowed_color(forbidden, v);
+    num_colors = std::max(num_colors, color[v] + 1);
+  }
+  return num_colors;
+}
+
+} // namespace ReverseAD
@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <limits>
 #include <memory>
+#include <string>
 
 #include "reversead/checkpointing/checkpoint_trace.hpp"
 #include "reversead/common/reversead_type.hpp"
@@ -10,80 +15,200 @@ namespace ReverseAD {
 
 CheckpointTrace::CheckpointTrace() {
   _checkpoint_num = 0;
-  _tape_x_num = std::make_shared<TrivialTape<size_t>>();
   _tape_iter_num = std::make_shared<TrivialTape<size_t>>();
-  _tape_x_values = std::make_shared<VirtualTape<double>>();
-  _tape_x_locint = std::make_shared<VirtualTape<locint>>();
-  _tape_runtime_env = std::make_shared<TrivialTape<RuntimeEnv>>();
-  _tape_x_num->init_taping();
   _tape_iter_num->init_taping();
-  _tape_x_values->init_taping();
-  _tape_x_locint->init_taping();
-  _tape_runtime_env->init_taping();
+#ifdef ENABLE_DISK_TAPE
+  _max_bytes = 0;
+#else
+  _max_bytes = std::numeric_limits<size_t>::max();
+#endif
+  _mem_bytes = 0;
+  _first_in_mem = 0;
+  _num_spilled = 0;
+  _prefetch_lo = 0;
+  _prefetch_hi = 0;
+}
+
+CheckpointTrace::~CheckpointTrace() {
+  if (_prefetch.joinable()) {
+    _prefetch.join();
+  }
+  if (!_file_name.empty()) {
+    _out.close();
+    _in.close();
+    if (std::remove(_file_name.c_str()) != 0) {
+      std::cerr << "Fail to remove checkpoint file : "
+                << _file_name << std::endl;
+    }
+  }
+}
+
+void CheckpointTrace::set_memory_budget(size_t max_bytes) {
+  _max_bytes = max_bytes;
 }
 
 void CheckpointTrace::end_checkpointing() {
-  _tape_x_num->end_taping();
   _tape_iter_num->end_taping();
-  _tape_x_values->end_taping();
-  _tape_x_locint->end_taping();
-  _tape_runtime_env->end_taping();
+  if (_out.is_open()) {
+    _out.close();
+  }
 }
 void CheckpointTrace::init_reverse() {
-  _tape_x_num->init_reverse();
   _tape_iter_num->init_reverse();
-  _tape_x_values->init_reverse();
-  _tape_x_locint->init_reverse();
-  _tape_runtime_env->init_reverse();
+  if (!_file_name.empty()) {
+    _in.open(_file_name, std::ifstream::in | std::ifstream::binary);
+  }
+  prefetch();
 }
 void CheckpointTrace::end_reverse() {
-  _tape_x_num->end_reverse();
   _tape_iter_num->end_reverse();
-  _tape_x_values->end_reverse();
-  _tape_x_locint->end_reverse();
-  _tape_runtime_env->end_reverse();
+  if (_prefetch.joinable()) {
+    _prefetch.join();
+  }
+}
+
+size_t CheckpointTrace::checkpoint_bytes(size_t index) const {
+  return _checkpoints[index].x_num * (sizeof(double) + sizeof(locint))
+         + sizeof(Checkpoint);
 }
 
 size_t CheckpointTrace::make_checkpoint(
     adouble* x, size_t x_num, std::shared_ptr<RuntimeEnv>& runtime_env) {
   _checkpoint_num++; 
-  _tape_x_num->put(x_num);
+  _checkpoints.emplace_back();
+  Checkpoint& cp = _checkpoints.back();
+  cp.x_num = x_num;
+  cp.values.resize(x_num);
+  cp.locs.resize(x_num);
   for (size_t i = 0; i < x_num; i++) {
-    _tape_x_values->put(x[i].getVal());
-    _tape_x_locint->put(x[i].getLoc());
+    cp.values[i] = x[i].getVal();
+    cp.locs[i] = x[i].getLoc();
+  }
+  cp.runtime_env = *(runtime_env.get());
+  cp.offset = 0;
+  _mem_bytes += checkpoint_bytes(_checkpoints.size() - 1);
+  while (_mem_bytes > _max_bytes && _first_in_mem < _checkpoints.size()) {
+    spill();
   }
-  _tape_runtime_env->put(*(runtime_env.get()));
   return _checkpoint_num;
 }
 
+void CheckpointTrace::spill() {
+  if (_file_name.empty()) {
+    int rank = 0;
+#ifdef ENABLE_REVERSEAD_MPI
+    if (MPI::Is_initialized()) {
+      rank = MPI::COMM_WORLD.Get_rank();
+    }
+#endif
+    _file_name = "./Reverse_Checkpoint_" + std::to_string(rank)
+               + "_" + std::to_string(_disk_tape_id++) + ".cp";
+    _out.open(_file_name,
+              std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+  }
+  Checkpoint& cp = _checkpoints[_first_in_mem];
+  cp.offset = _out.tellp();
+  _out.write((const char*)cp.values.data(), sizeof(double) * cp.x_num);
+  _out.write((const char*)cp.locs.data(), sizeof(locint) * cp.x_num);
+  _out.write((const char*)&cp.runtime_env, sizeof(RuntimeEnv));
+  if (!_out) {
+    std::cerr << "Fail to write checkpoint file : " << _file_name << std::endl;
+  }
+  std::vector<double>().swap(cp.values);
+  std::vector<locint>().swap(cp.locs);
+  _mem_bytes -= checkpoint_bytes(_first_in_mem);
+  _first_in_mem++;
+  _num_spilled++;
+}
+
+void CheckpointTrace::load(size_t index) {
+  Checkpoint& cp = _checkpoints[index];
+  cp.values.resize(cp.x_num);
+  cp.locs.resize(cp.x_num);
+  _in.seekg(cp.offset);
+  _in.read((char*)cp.values.data(), sizeof(double) * cp.x_num);
+  _in.read((char*)cp.locs.data(), sizeof(locint) * cp.x_num);
+  _in.read((char*)&cp.runtime_env, sizeof(RuntimeEnv));
+  if (!_in) {
+    std::cerr << "Fail to read checkpoint file : " << _file_name << std::endl;
+  }
+}
+
+void CheckpointTrace::prefetch() {
+  if (_prefetch.joinable()) {return;}
+  size_t hi = _first_in_mem;
+  size_t lo = hi;
+  while (lo > 0 && _mem_bytes + checkpoint_bytes(lo - 1) <= _max_bytes) {
+    _mem_bytes += checkpoint_bytes(lo - 1);
+    lo--;
+  }
+  if (lo == hi) {return;}
+  _first_in_mem = lo;
+  _prefetch_lo = lo;
+  _prefetch_hi = hi;
+  _prefetch = std::thread([this, lo, hi]() {
+    for (size_t i = hi; i > lo; i--) {
+      load(i - 1);
+    }
+  });
+}
+
 void CheckpointTrace::set_iteration_num(size_t iter_num) {
   _tape_iter_num->put(iter_num);
 }
 size_t CheckpointTrace::get_iteration_num() {
   return _tape_iter_num->get_next_r();
 }
+
 size_t CheckpointTrace::get_checkpoint(
    adouble* x, size_t x_num, std::shared_ptr<RuntimeEnv>& runtime_env) {
-  if (_tape_x_num->get_next_r() != x_num) {
+  size_t index = _checkpoint_num - 1;
+  if (_prefetch.joinable() &&
+      index >= _prefetch_lo && index < _prefetch_hi) {
+    _prefetch.join();
+  }
+  if (index < _first_in_mem) {
+    // not requested in time, read it now
+    if (_prefetch.joinable()) {
+      _prefetch.join();
+    }
+    load(index);
+    _mem_bytes += checkpoint_bytes(index);
+    _first_in_mem = index;
+  }
+  Checkpoint& cp = _checkpoints[index];
+  if (cp.x_num != x_num) {
     std::cerr << "checkpointing x_num mismatch" << std::endl;
   }
 
   // In place construction
   for (size_t i = x_num; i > 0; i--) {
-    new(&x[i-1]) adouble(_tape_x_values->get_next_r(),
-                       _tape_x_locint->get_next_r());
+    new(&x[i-1]) adouble(cp.values[i-1], cp.locs[i-1]);
   }
   // build shared_ptr form a copy constructor
-  runtime_env = std::make_shared<RuntimeEnv>(_tape_runtime_env->get_next_r());
+  runtime_env = std::make_shared<RuntimeEnv>(cp.runtime_env);
+  std::vector<double>().swap(cp.values);
+  std::vector<locint>().swap(cp.locs);
+  _mem_bytes -= checkpoint_bytes(index);
+  _checkpoints.pop_back();
+  _first_in_mem = std::min(_first_in_mem, _checkpoints.size());
+  prefetch();
   return --_checkpoint_num;
 }
 
 void CheckpointTrace::dump_trace() const {
   std::cout << "num of checkpoints : " << _checkpoint_num << std::endl;
-  _tape_x_num->dump_tape();
+  std::cout << "in memory : " << _checkpoints.size() - _first_in_mem
+            << " (" << _mem_bytes << " bytes), on file : " << _first_in_mem
+            << std::endl;
   _tape_iter_num->dump_tape();
-  _tape_x_values->dump_tape();
-  _tape_x_locint->dump_tape();
-  _tape_runtime_env->dump_tape();
+  for (size_t i = _first_in_mem; i < _checkpoints.size(); i++) {
+    const Checkpoint& cp = _checkpoints[i];
+    std::cout << "checkpoint " << i << " :" << cp.runtime_env;
+    for (size_t j = 0; j < cp.x_num; j++) {
+      std::cout << " [" << cp.locs[j] << "] = " << cp.values[j];
+    }
+    std::cout << std::endl;
+  }
 }
 } // namespace ReverseAD
@@ -1,19 +1,134 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <iostream>
 #include <cassert>
+#include <thread>
 
 #include "reversead/activetype/base_active.hpp"
+#include "reversead/algorithm/base_function_replay.hpp"
 #include "reversead/algorithm/base_reverse_adjoint.hpp"
+#include "reversead/algorithm/base_reverse_generic.hpp"
 #include "reversead/algorithm/base_reverse_hessian.hpp"
 #include "reversead/algorithm/base_reverse_third.hpp"
 #include "reversead/common/reversead_core.hpp"
 #include "reversead/common/runtime_env.hpp"
 #include "reversead/checkpointing/iterative_func_base.hpp"
 #include "reversead/checkpointing/checkpoint_trace.hpp"
+#include "reversead/forwardtype/single_forward.hpp"
+#include "reversead/util/error_info.hpp"
 
 namespace ReverseAD {
 
 size_t kMIN_OP_PER_CP = 1000000; // 1M
 
+namespace {
+
+BaseReverseMode<double>* new_reverse_mode(size_t t_order) {
+  std::shared_ptr<TrivialTrace<double>> trace;
+  if (t_order == 1) {
+    return new BaseReverseAdjoint<double>(trace);
+  } else if (t_order == 2) {
+    return new BaseReverseHessian<double>(trace);
+  } else if (t_order == 3) {
+    return new BaseReverseThird<double>(trace);
+  } else if (t_order > 3 && t_order <= REVERSEAD_MAX_GENERIC_ORDER) {
+    return new BaseReverseGeneric<double>(trace, t_order);
+  }
+  warning_UnsupportedOrder("IterativeFunc", t_order);
+  return nullptr;
+}
+
+// C(s + t, s), the most steps that s checkpoints (the starting one
+// included) reverse when no step is advanced more than t times.
+// Saturates to limit + 1.
+size_t binomial_steps(size_t s, size_t t, size_t limit) {
+  size_t ret = 1;
+  for (size_t i = 1; i <= t; i++) {
+    ret = ret * (s + i) / i;
+    if (ret > limit) {return limit + 1;}
+  }
+  return ret;
+}
+
+// How far to advance from the start of `steps` steps before taking the
+// next checkpoint, with `snaps` >= 2 checkpoints including the start.
+// Any split with both parts within their binomial bounds for t - 1
+// gives the minimal number of recomputed steps.
+size_t binomial_split(size_t steps, size_t snaps) {
+  size_t t = 0;
+  while (binomial_steps(snaps, t, steps) < steps) {t++;}
+  size_t left = binomial_steps(snaps, t - 1, steps);
+  size_t right = binomial_steps(snaps - 1, t - 1, steps);
+  size_t ret = std::min(left, (steps > right ? steps - right : 1));
+  return std::max<size_t>(1, std::min(ret, steps - 1));
+}
+
+// the gradient of dependent dep in tensor, as a dense vector
+template <typename Base>
+void get_gradient(std::shared_ptr<DerivativeTensor<size_t, Base>> tensor,
+                  size_t dep, std::vector<Base>& gradient) {
+  size_t size = 0;
+  size_t** tind = nullptr;
+  Base* values = nullptr;
+  std::fill(gradient.begin(), gradient.end(), Base(0.0));
+  tensor->get_internal_coordinate_list(dep, 1, &size, &tind, &values);
+  for (size_t i = 0; i < size; i++) {
+    gradient[tind[i][0]] = values[i];
+  }
+}
+
+// num_steps iterations from t_values, as a function of the state
+std::shared_ptr<TrivialTrace<double>> trace_steps(
+    void (*iteration_step)(adouble*, size_t), adouble* t, size_t t_num,
+    const std::vector<SingleForward>& t_values, size_t num_steps) {
+  double dummy;
+  trace_on<double>();
+  for (size_t i = 0; i < t_num; i++) {
+    t[i] <<= t_values[i].getVal();
+  }
+  for (size_t k = 0; k < num_steps; k++) {
+    (*iteration_step)(t, t_num);
+  }
+  for (size_t i = 0; i < t_num; i++) {
+    t[i] >>= dummy;
+  }
+  return trace_off<double>();
+}
+
+// the outputs of trace, with their tangents, at in
+void replay_tangent(const std::shared_ptr<TrivialTrace<double>>& trace,
+                    const std::vector<SingleForward>& in,
+                    std::vector<SingleForward>& out) {
+  BaseFunctionReplay::replay_forward<double, SingleForward>(
+      trace, out.data(), out.size(), in.data(), in.size());
+}
+
+// w_in = w_out^T F'(in), forward over reverse : the tangent of w_in is
+// the tangent of w_out times F' plus w_out^T F'' times the tangent of in
+void reverse_tangent(const std::shared_ptr<TrivialTrace<double>>& trace,
+                     const std::vector<SingleForward>& in,
+                     const std::vector<SingleForward>& w_out,
+                     std::vector<SingleForward>& w_in) {
+  BaseReverseAdjoint<SingleForward> adjoint(
+      BaseFunctionReplay::replay_forward<double, SingleForward>(
+          trace, in.data(), in.size()));
+  adjoint.set_dep_weight(w_out.data(), w_out.size());
+  get_gradient(adjoint.compute(in.size(), w_out.size()), 0, w_in);
+}
+
+// A segment between two checkpoints, retraced on its own thread
+struct RetraceJob {
+  explicit RetraceJob(size_t t_num) : t(t_num), iter_num(0) {}
+  std::vector<adouble> t;
+  std::shared_ptr<RuntimeEnv> runtime_env;
+  size_t iter_num;
+  std::shared_ptr<TrivialTrace<double>> trace;
+  std::thread worker;
+};
+
+} // namespace
+
 IterativeFuncBase::IterativeFuncBase(
     size_t x_num, size_t t_num, size_t y_num,
     void (*set_up)(),
@@ -31,12 +146,59 @@ IterativeFuncBase::IterativeFuncBase(
   _final_step = final_step;
   // Use default value
   _min_op_per_cp = kMIN_OP_PER_CP;
+  _num_threads = 1;
+  _fixed_point = false;
+  _fixed_point_tol = 0.0;
+  _fixed_point_max_iter = 0;
+  _num_adjoint_iter = 0;
+  _checkpoint_memory = 0;
+  _num_spilled = 0;
+  _max_checkpoints = 0;
+  _max_checkpoint_bytes = 0;
+  _num_recomputed_steps = 0;
+  _peak_checkpoints = 0;
 }
 
 void IterativeFuncBase::set_min_op_per_cp(size_t min_op_per_cp) {
   this->_min_op_per_cp = min_op_per_cp;
 }
 
+void IterativeFuncBase::enable_fixed_point(double tol, size_t max_iter) {
+  this->_fixed_point = true;
+  this->_fixed_point_tol = tol;
+  this->_fixed_point_max_iter = max_iter;
+}
+
+void IterativeFuncBase::disable_fixed_point() {
+  this->_fixed_point = false;
+}
+
+void IterativeFuncBase::set_dep_weight(const double* const weight,
+                                       size_t y_num) {
+  assert(y_num == _y_num);
+  this->_dep_weight.assign(weight, weight + y_num);
+}
+
+void IterativeFuncBase::clear_dep_weight() {
+  this->_dep_weight.clear();
+}
+
+void IterativeFuncBase::set_checkpoint_memory(size_t max_bytes) {
+  this->_checkpoint_memory = max_bytes;
+}
+
+void IterativeFuncBase::set_num_threads(size_t num_threads) {
+  this->_num_threads = (num_threads > 0 ? num_threads : 1);
+}
+
+void IterativeFuncBase::set_max_checkpoints(size_t max_checkpoints) {
+  this->_max_checkpoints = max_checkpoints;
+}
+
+void IterativeFuncBase::set_max_checkpoint_bytes(size_t max_bytes) {
+  this->_max_checkpoint_bytes = max_bytes;
+}
+
 void IterativeFuncBase::run(double* x_values, size_t x_num,
                             double* y_values, size_t y_num) {
   assert(x_num == _x_num);
@@ -68,7 +230,43 @@ std::shared_ptr<DerivativeTensor<size_t, double>> IterativeFuncBase::compute(
     size_t t_order) {
   assert(x_num == _x_num);
 
+  if (_fixed_point) {
+    return compute_fixed_point(x_values, t_order);
+  }
+  BaseReverseMode<double>* reverse_mode = new_reverse_mode(t_order);
+  if (reverse_mode == nullptr) {
+    return nullptr;
+  }
+  if (!_dep_weight.empty()) {
+    reverse_mode->set_dep_weight(_dep_weight.data(), _dep_weight.size());
+  }
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      compute(x_values, x_num, *reverse_mode);
+  delete reverse_mode;
+  return tensor;
+}
+
+std::shared_ptr<DerivativeTensor<size_t, double>> IterativeFuncBase::compute(
+    double* x_values, size_t x_num,
+    BaseReverseMode<double>& reverse_mode) {
+  assert(x_num == _x_num);
+
+  size_t max_checkpoints = _max_checkpoints;
+  if (_max_checkpoint_bytes > 0) {
+    size_t cp_bytes = _t_num * (sizeof(double) + sizeof(locint)) +
+                      sizeof(Checkpoint);
+    size_t by_bytes = std::max<size_t>(1, _max_checkpoint_bytes / cp_bytes);
+    max_checkpoints = (max_checkpoints == 0 ?
+                       by_bytes : std::min(max_checkpoints, by_bytes));
+  }
+  if (max_checkpoints > 0) {
+    return compute_binomial(x_values, reverse_mode, max_checkpoints);
+  }
+
   CheckpointTrace cp_trace;
+  if (_checkpoint_memory > 0) {
+    cp_trace.set_memory_budget(_checkpoint_memory);
+  }
   // first recompute the function, no tracing
   // but record the initial values for each step, and also runtime env.
   adouble* x_adouble = new adouble[_x_num];
@@ -141,18 +339,12 @@ std::shared_ptr<DerivativeTensor<size_t, double>> IterativeFuncBase::compute(
     y_adouble[i] >>= dummy_y;
   }
   std::shared_ptr<TrivialTrace<double>> trace = trace_off<double>();
-  BaseReverseMode<double>* reverse_mode = nullptr;
-  if (t_order == 1) {
-    reverse_mode = new BaseReverseAdjoint<double>(trace);
-  } else if (t_order == 2) {
-    reverse_mode = new BaseReverseHessian<double>(trace);
-  } else if (t_order == 3) {
-    reverse_mode = new BaseReverseThird<double>(trace);
-  } else {
-    std::cerr << "Only (1-3) orders for IterativeFunc." << std::endl;
-  }
-  reverse_mode->compute_iterative();
+  reverse_mode.reset_trace(trace);
+  reverse_mode.compute_iterative();
   // Step 2 : get initial values and runtime for iterative_step
+  if (_num_threads > 1) {
+    cp_num = reverse_segments_parallel(cp_trace, cp_num, &reverse_mode);
+  }
   while (cp_num > 1) {
     cp_num = cp_trace.get_checkpoint(t_adouble, _t_num, runtime_env);
     size_t step_iter_num = cp_trace.get_iteration_num();
@@ -162,8 +354,8 @@ std::shared_ptr<DerivativeTensor<size_t, double>> IterativeFuncBase::compute(
       --step_iter_num;
     }
     trace = trace_off<double>();
-    reverse_mode->reset_trace_no_clear(trace);
-    reverse_mode->compute_iterative();
+    reverse_mode.reset_trace_no_clear(trace);
+    reverse_mode.compute_iterative();
   }
   // Step 3 : get initial values and runtime for set_up
   cp_num = cp_trace.get_checkpoint(t_adouble, _t_num, runtime_env);
@@ -174,13 +366,421 @@ std::shared_ptr<DerivativeTensor<size_t, double>> IterativeFuncBase::compute(
   }
   (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
   trace = trace_off<double>();
-  reverse_mode->reset_trace_no_clear(trace);
+  reverse_mode.reset_trace_no_clear(trace);
   std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
-      reverse_mode->compute(_x_num, 0);
-  delete reverse_mode;
+      reverse_mode.compute(_x_num, 0);
   (*_tear_down)();
   cp_trace.end_reverse();
+  delete[] x_adouble;
+  delete[] y_adouble;
+  delete[] t_adouble;
+  _num_spilled = cp_trace.get_num_spilled();
   return tensor;
 }
 
+void IterativeFuncBase::hessian_vector(double* x_values, size_t x_num,
+                                       const double* v,
+                                       double* gradient, double* hv) {
+  assert(x_num == _x_num);
+  adouble* x_adouble = new adouble[_x_num];
+  adouble* y_adouble = new adouble[_y_num];
+  adouble* t_adouble = new adouble[_t_num];
+  double dummy;
+
+  // run the loop untraced, the state at the start of every segment is kept
+  (*_set_up)();
+  iteration_init();
+  for (size_t i = 0; i < _x_num; i++) {
+    x_adouble[i] = x_values[i];
+  }
+  (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
+  std::shared_ptr<RuntimeEnv> runtime_env = std::make_shared<RuntimeEnv>();
+  runtime_env->init();
+  locint prev_loc = runtime_env->curr_loc;
+  std::vector<std::vector<SingleForward>> states;
+  std::vector<size_t> steps;
+  while (!iteration_done(t_adouble, _t_num)) {
+    if (steps.empty() || runtime_env->curr_loc - prev_loc >= _min_op_per_cp) {
+      states.emplace_back(_t_num);
+      for (size_t i = 0; i < _t_num; i++) {
+        states.back()[i] = SingleForward(t_adouble[i].getVal());
+      }
+      steps.push_back(0);
+      prev_loc = runtime_env->curr_loc;
+    }
+    runtime_env_on(runtime_env);
+    (*_iteration_step)(t_adouble, _t_num);
+    runtime_env_off();
+    steps.back()++;
+  }
+
+  // forward : the tangents along v at the start of every segment
+  std::vector<SingleForward> x_fwd(_x_num);
+  for (size_t i = 0; i < _x_num; i++) {
+    x_fwd[i] = SingleForward(x_values[i], v[i]);
+  }
+  trace_on<double>();
+  for (size_t i = 0; i < _x_num; i++) {
+    x_adouble[i] <<= x_values[i];
+  }
+  (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
+  for (size_t i = 0; i < _t_num; i++) {
+    t_adouble[i] >>= dummy;
+  }
+  std::shared_ptr<TrivialTrace<double>> initial_trace = trace_off<double>();
+  std::vector<SingleForward> t_fwd(_t_num);
+  replay_tangent(initial_trace, x_fwd, t_fwd);
+  for (size_t s = 0; s < states.size(); s++) {
+    for (size_t i = 0; i < _t_num; i++) {
+      states[s][i] = SingleForward(states[s][i].getVal(), t_fwd[i].getDer());
+    }
+    replay_tangent(trace_steps(_iteration_step, t_adouble, _t_num,
+                               states[s], steps[s]),
+                   states[s], t_fwd);
+  }
+
+  // reverse : the weighted adjoints of the outputs back to x
+  trace_on<double>();
+  for (size_t i = 0; i < _t_num; i++) {
+    t_adouble[i] <<= t_fwd[i].getVal();
+  }
+  (*_final_step)(t_adouble, _t_num, y_adouble, _y_num);
+  for (size_t i = 0; i < _y_num; i++) {
+    y_adouble[i] >>= dummy;
+  }
+  std::vector<SingleForward> w_y(_y_num, SingleForward(1.0));
+  for (size_t i = 0; i < _dep_weight.size(); i++) {
+    w_y[i] = SingleForward(_dep_weight[i]);
+  }
+  std::vector<SingleForward> w(_t_num);
+  std::vector<SingleForward> w_next(_t_num);
+  reverse_tangent(trace_off<double>(), t_fwd, w_y, w);
+  for (size_t s = states.size(); s > 0; s--) {
+    reverse_tangent(trace_steps(_iteration_step, t_adouble, _t_num,
+                                states[s - 1], steps[s - 1]),
+                    states[s - 1], w, w_next);
+    w.swap(w_next);
+  }
+  std::vector<SingleForward> x_bar(_x_num);
+  reverse_tangent(initial_trace, x_fwd, w, x_bar);
+  for (size_t i = 0; i < _x_num; i++) {
+    gradient[i] = x_bar[i].getVal();
+    hv[i] = x_bar[i].getDer();
+  }
+  (*_tear_down)();
+  delete[] x_adouble;
+  delete[] y_adouble;
+  delete[] t_adouble;
+}
+
+std::shared_ptr<DerivativeTensor<size_t, double>>
+IterativeFuncBase::compute_fixed_point(double* x_values, size_t t_order) {
+  if (t_order != 1) {
+    warning_UnsupportedOrder("IterativeFunc fixed point", t_order);
+    return nullptr;
+  }
+  adouble* x_adouble = new adouble[_x_num];
+  adouble* y_adouble = new adouble[_y_num];
+  adouble* t_adouble = new adouble[_t_num];
+  std::vector<double> t_values(_t_num);
+  double dummy;
+
+  // run to the fixed point, no tracing
+  (*_set_up)();
+  iteration_init();
+  for (size_t i = 0; i < _x_num; i++) {
+    x_adouble[i] = x_values[i];
+  }
+  (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
+  while (!iteration_done(t_adouble, _t_num)) {
+    (*_iteration_step)(t_adouble, _t_num);
+  }
+  for (size_t i = 0; i < _t_num; i++) {
+    t_values[i] = t_adouble[i].getVal();
+  }
+
+  // three separate traces : t* -> y, t* -> G(t*) and x -> t
+  trace_on<double>();
+  for (size_t i = 0; i < _t_num; i++) {
+    t_adouble[i] <<= t_values[i];
+  }
+  (*_final_step)(t_adouble, _t_num, y_adouble, _y_num);
+  for (size_t i = 0; i < _y_num; i++) {
+    y_adouble[i] >>= dummy;
+  }
+  BaseReverseAdjoint<double> final_adjoint(trace_off<double>());
+  if (!_dep_weight.empty()) {
+    final_adjoint.set_dep_weight(_dep_weight.data(), _dep_weight.size());
+  }
+  std::shared_ptr<DerivativeTensor<size_t, double>> final_tensor =
+      final_adjoint.compute(_t_num, _y_num);
+  size_t dep_num = final_tensor->get_dep_size();
+
+  trace_on<double>();
+  for (size_t i = 0; i < _t_num; i++) {
+    t_adouble[i] <<= t_values[i];
+  }
+  (*_iteration_step)(t_adouble, _t_num);
+  for (size_t i = 0; i < _t_num; i++) {
+    t_adouble[i] >>= dummy;
+  }
+  BaseReverseAdjoint<double> step_adjoint(trace_off<double>());
+
+  trace_on<double>();
+  for (size_t i = 0; i < _x_num; i++) {
+    x_adouble[i] <<= x_values[i];
+  }
+  (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
+  for (size_t i = 0; i < _t_num; i++) {
+    t_adouble[i] >>= dummy;
+  }
+  BaseReverseAdjoint<double> initial_adjoint(trace_off<double>());
+  (*_tear_down)();
+
+  // The adjoint of the unrolled loop is (G'^T)^n F'^T y_bar. Iterating
+  // w = G'^T w at the fixed point converges to it : the components of
+  // the state vanish and the ones G keeps (parameters) accumulate.
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      std::make_shared<DerivativeTensor<size_t, double>>(dep_num, _x_num, 1);
+  std::vector<double> w(_t_num);
+  std::vector<double> w_next(_t_num);
+  std::vector<double> x_bar(_x_num);
+  _num_adjoint_iter = 0;
+  for (size_t dep = 0; dep < dep_num; dep++) {
+    tensor->put_dep_value(dep, final_tensor->get_dep_value(dep));
+    get_gradient(final_tensor, dep, w);
+    for (size_t k = 0; k < _fixed_point_max_iter; k++) {
+      step_adjoint.set_dep_weight(w.data(), _t_num);
+      get_gradient(step_adjoint.compute(_t_num, _t_num), 0, w_next);
+      double diff = 0.0;
+      for (size_t i = 0; i < _t_num; i++) {
+        diff = std::max(diff, std::fabs(w_next[i] - w[i]));
+      }
+      w.swap(w_next);
+      _num_adjoint_iter++;
+      if (diff <= _fixed_point_tol) {break;}
+    }
+    initial_adjoint.set_dep_weight(w.data(), _t_num);
+    get_gradient(initial_adjoint.compute(_x_num, _t_num), 0, x_bar);
+    size_t nnz = 0;
+    for (size_t i = 0; i < _x_num; i++) {
+      if (x_bar[i] != 0.0) {nnz++;}
+    }
+    tensor->init_single_tensor(dep, 1, nnz);
+    size_t num = 0;
+    for (size_t i = 0; i < _x_num; i++) {
+      if (x_bar[i] != 0.0) {
+        tensor->put_value(dep, 1, num++, &i, x_bar[i]);
+      }
+    }
+  }
+  delete[] x_adouble;
+  delete[] y_adouble;
+  delete[] t_adouble;
+  return tensor;
+}
+
+size_t IterativeFuncBase::reverse_segments_parallel(
+    CheckpointTrace& cp_trace, size_t cp_num,
+    BaseReverseMode<double>* reverse_mode) {
+  // the segments are read off cp_trace latest first, and up to
+  // _num_threads of them are retraced while the oldest request is swept
+  std::deque<std::unique_ptr<RetraceJob>> jobs;
+  void (*iteration_step)(adouble*, size_t) = _iteration_step;
+  size_t t_num = _t_num;
+  while (cp_num > 1 || !jobs.empty()) {
+    while (cp_num > 1 && jobs.size() < _num_threads) {
+      std::unique_ptr<RetraceJob> job(new RetraceJob(t_num));
+      cp_num = cp_trace.get_checkpoint(job->t.data(), t_num,
+                                       job->runtime_env);
+      job->iter_num = cp_trace.get_iteration_num();
+      RetraceJob* p = job.get();
+      job->worker = std::thread([p, iteration_step, t_num]() {
+        trace_on_runtime_env<double>(p->runtime_env);
+        for (size_t i = 0; i < p->iter_num; i++) {
+          (*iteration_step)(p->t.data(), t_num);
+        }
+        p->trace = trace_off<double>();
+      });
+      jobs.push_back(std::move(job));
+    }
+    jobs.front()->worker.join();
+    reverse_mode->reset_trace_no_clear(jobs.front()->trace);
+    jobs.pop_front();
+    reverse_mode->compute_iterative();
+  }
+  return cp_num;
+}
+
+std::shared_ptr<DerivativeTensor<size_t, double>>
+IterativeFuncBase::compute_binomial(double* x_values,
+                                    BaseReverseMode<double>& reverse_mode,
+                                    size_t max_checkpoints) {
+  adouble* x_adouble = new adouble[_x_num];
+  adouble* y_adouble = new adouble[_y_num];
+  adouble* t_adouble = new adouble[_t_num];
+  _checkpoints.clear();
+  _num_recomputed_steps = 0;
+  _peak_checkpoints = 0;
+
+  (*_set_up)();
+  iteration_init();
+  std::shared_ptr<RuntimeEnv> runtime_env = std::make_shared<RuntimeEnv>();
+  runtime_env->init();
+  RuntimeEnv initial_env = *runtime_env;
+  runtime_env_on(runtime_env);
+  for (size_t i = 0; i < _x_num; i++) {
+    x_adouble[i] <<= x_values[i];
+  }
+  (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
+  runtime_env_off();
+
+  // With a known number of iterations, the checkpoints of the first
+  // descent of the optimal schedule are taken during this sweep.
+  // Otherwise every stride-th state is kept, and when the budget is full
+  // every other one is dropped and the stride doubles.
+  size_t num_iter = 0;
+  bool is_fixed = get_fixed_num_iter(num_iter);
+  std::vector<size_t> plan;
+  if (is_fixed) {
+    size_t iter = 0;
+    size_t free = max_checkpoints - 1;
+    while (num_iter - iter > 1 && free > 0) {
+      iter += binomial_split(num_iter - iter, free + 1);
+      plan.push_back(iter);
+      free--;
+    }
+  }
+  size_t next_plan = 0;
+  size_t stride = 1;
+  size_t iter = 0;
+  push_checkpoint(0, t_adouble, runtime_env);
+  while (!iteration_done(t_adouble, _t_num)) {
+    if (is_fixed) {
+      if (next_plan < plan.size() && plan[next_plan] == iter) {
+        push_checkpoint(iter, t_adouble, runtime_env);
+        next_plan++;
+      }
+    } else if (iter > 0 && iter % stride == 0) {
+      while (_checkpoints.size() >= max_checkpoints && iter % stride == 0) {
+        size_t kept = 0;
+        for (size_t i = 0; i < _checkpoints.size(); i++) {
+          if (_checkpoints[i].iter % (2 * stride) == 0) {
+            std::swap(_checkpoints[kept++], _checkpoints[i]);
+          }
+        }
+        _checkpoints.resize(kept);
+        stride *= 2;
+      }
+      if (iter % stride == 0) {
+        push_checkpoint(iter, t_adouble, runtime_env);
+      }
+    }
+    runtime_env_on(runtime_env);
+    (*_iteration_step)(t_adouble, _t_num);
+    runtime_env_off();
+    iter++;
+  }
+  num_iter = iter;
+
+  // the final step is traced from the current state
+  trace_on_runtime_env<double>(runtime_env);
+  (*_final_step)(t_adouble, _t_num, y_adouble, _y_num);
+  double dummy_y;
+  for (size_t i = 0; i < _y_num; i++) {
+    y_adouble[i] >>= dummy_y;
+  }
+  std::shared_ptr<TrivialTrace<double>> trace = trace_off<double>();
+  reverse_mode.reset_trace(trace);
+  reverse_mode.compute_iterative();
+  // the intervals between the stored checkpoints, last one first
+  size_t end = num_iter;
+  while (!_checkpoints.empty()) {
+    size_t pos = _checkpoints.size() - 1;
+    reverse_range(pos, end, max_checkpoints - _checkpoints.size(),
+                  t_adouble, runtime_env, &reverse_mode);
+    end = _checkpoints[pos].iter;
+    _checkpoints.pop_back();
+  }
+  // the initial step
+  runtime_env = std::make_shared<RuntimeEnv>(initial_env);
+  trace_on_runtime_env<double>(runtime_env);
+  for (size_t i = 0; i < _x_num; i++) {
+    x_adouble[i] <<= x_values[i];
+  }
+  (*_initial_step)(x_adouble, _x_num, t_adouble, _t_num);
+  trace = trace_off<double>();
+  reverse_mode.reset_trace_no_clear(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      reverse_mode.compute(_x_num, 0);
+  (*_tear_down)();
+  delete[] x_adouble;
+  delete[] y_adouble;
+  delete[] t_adouble;
+  return tensor;
+}
+
+void IterativeFuncBase::push_checkpoint(
+    size_t iter, adouble* t, const std::shared_ptr<RuntimeEnv>& runtime_env) {
+  _checkpoints.emplace_back();
+  Checkpoint& cp = _checkpoints.back();
+  cp.iter = iter;
+  cp.values.resize(_t_num);
+  cp.locs.resize(_t_num);
+  for (size_t i = 0; i < _t_num; i++) {
+    cp.values[i] = t[i].getVal();
+    cp.locs[i] = t[i].getLoc();
+  }
+  cp.runtime_env = *runtime_env;
+  _peak_checkpoints = std::max(_peak_checkpoints, _checkpoints.size());
+}
+
+void IterativeFuncBase::restore_checkpoint(
+    const Checkpoint& cp, adouble* t,
+    std::shared_ptr<RuntimeEnv>& runtime_env) {
+  // In place construction, nothing goes on a trace
+  for (size_t i = 0; i < _t_num; i++) {
+    new(&t[i]) adouble(cp.values[i], cp.locs[i]);
+  }
+  runtime_env = std::make_shared<RuntimeEnv>(cp.runtime_env);
+}
+
+void IterativeFuncBase::advance(adouble* t,
+                                std::shared_ptr<RuntimeEnv>& runtime_env,
+                                size_t num) {
+  runtime_env_on(runtime_env);
+  for (size_t i = 0; i < num; i++) {
+    (*_iteration_step)(t, _t_num);
+  }
+  runtime_env_off();
+  _num_recomputed_steps += num;
+}
+
+void IterativeFuncBase::reverse_range(
+    size_t pos, size_t end, size_t free, adouble* t,
+    std::shared_ptr<RuntimeEnv>& runtime_env,
+    BaseReverseMode<double>* reverse_mode) {
+  size_t start = _checkpoints[pos].iter;
+  if (end - start > 1 && free > 0) {
+    size_t mid = start + binomial_split(end - start, free + 1);
+    restore_checkpoint(_checkpoints[pos], t, runtime_env);
+    advance(t, runtime_env, mid - start);
+    push_checkpoint(mid, t, runtime_env);
+    reverse_range(pos + 1, end, free - 1, t, runtime_env, reverse_mode);
+    _checkpoints.pop_back();
+    reverse_range(pos, mid, free, t, runtime_env, reverse_mode);
+    return;
+  }
+  // one step, or no checkpoint left : every step from the start
+  for (size_t i = end; i > start; i--) {
+    restore_checkpoint(_checkpoints[pos], t, runtime_env);
+    advance(t, runtime_env, i - 1 - start);
+    trace_on_runtime_env<double>(runtime_env);
+    (*_iteration_step)(t, _t_num);
+    std::shared_ptr<TrivialTrace<double>> trace = trace_off<double>();
+    reverse_mode->reset_trace_no_clear(trace);
+    reverse_mode->compute_iterative();
+  }
+}
+
 } // namespace ReverseAD
@@ -28,4 +28,9 @@ bool IterativeFuncFixed::iteration_done(adouble* t_values, size_t t_num) {
   return (_curr_iter++) >= _max_num_iter;
 }
 
+bool IterativeFuncFixed::get_fixed_num_iter(size_t& num_iter) const {
+  num_iter = _max_num_iter;
+  return true;
+}
+
 } // namespace ReverseAD
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <memory>
 
 #include "reversead/common/reversead_core.hpp"
@@ -8,9 +9,9 @@
 
 namespace ReverseAD {
   
-  void* global_trace = nullptr;
-  std::shared_ptr<RuntimeEnv> runtime_env = nullptr;
-  int _disk_tape_id = 0;
+  thread_local void* global_trace = nullptr;
+  thread_local std::shared_ptr<RuntimeEnv> runtime_env = nullptr;
+  std::atomic<int> _disk_tape_id(0);
   
 
   locint get_next_loc() {
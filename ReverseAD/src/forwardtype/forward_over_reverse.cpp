@@ -0,0 +1,177 @@
+#include <vector>
+
+#include "reversead/forwardtype/forward_over_reverse.hpp"
+#include "reversead/algorithm/base_reverse_third.hpp"
+#include "reversead/algorithm/base_reverse_generic.hpp"
+
+namespace ReverseAD {
+
+namespace {
+
+std::shared_ptr<TrivialTrace<SingleForward>> single_forward_replay(
+    std::shared_ptr<TrivialTrace<double>> trace,
+    size_t ind_num,
+    double* ind_init_value,
+    double* adjoint_init_value) {
+  std::vector<SingleForward> x;
+  x.reserve(ind_num);
+  for (size_t i = 0; i < ind_num; i++) {
+    x.push_back(SingleForward(ind_init_value[i], adjoint_init_value[i]));
+  }
+  return BaseFunctionReplay::replay_forward<double, SingleForward>(
+      trace, x.data(), ind_num);
+}
+
+} // namespace
+
+void forward_over_reverse(std::shared_ptr<TrivialTrace<double>> trace,
+                          size_t ind_num,
+                          size_t dep_num,
+                          double* ind_init_value,
+                          double* adjoint_init_value,
+                          double** hessian_vector) {
+  std::shared_ptr<TrivialTrace<SingleForward>> new_trace =
+      single_forward_replay(trace, ind_num, ind_init_value,
+                            adjoint_init_value);
+  if (!new_trace) {
+    return;
+  }
+  BaseReverseAdjoint<SingleForward> adjoint(new_trace);
+  std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor =
+      adjoint.compute(ind_num, dep_num);
+  size_t size;
+  size_t** tind;
+  SingleForward* values;
+  for (size_t d = 0; d < dep_num; d++) {
+    for (size_t i = 0; i < ind_num; i++) {
+      hessian_vector[d][i] = 0.0;
+    }
+    tensor->get_internal_coordinate_list(d, 1, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      hessian_vector[d][tind[l][0]] = values[l].getDer();
+    }
+  }
+}
+
+void forward_over_second(std::shared_ptr<TrivialTrace<double>> trace,
+                         size_t ind_num,
+                         size_t dep_num,
+                         double* ind_init_value,
+                         double* adjoint_init_value,
+                         double*** third_vector) {
+  std::shared_ptr<TrivialTrace<SingleForward>> new_trace =
+      single_forward_replay(trace, ind_num, ind_init_value,
+                            adjoint_init_value);
+  if (!new_trace) {
+    return;
+  }
+  BaseReverseHessian<SingleForward> hessian(new_trace);
+  std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor =
+      hessian.compute(ind_num, dep_num);
+  size_t size;
+  size_t** tind;
+  SingleForward* values;
+  for (size_t d = 0; d < dep_num; d++) {
+    for (size_t i = 0; i < ind_num; i++) {
+      for (size_t j = 0; j < ind_num; j++) {
+        third_vector[d][i][j] = 0.0;
+      }
+    }
+    tensor->get_internal_coordinate_list(d, 2, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      third_vector[d][tind[l][0]][tind[l][1]] = values[l].getDer();
+      third_vector[d][tind[l][1]][tind[l][0]] = values[l].getDer();
+    }
+  }
+}
+
+void forward_over_third(std::shared_ptr<TrivialTrace<double>> trace,
+                        size_t ind_num,
+                        size_t dep_num,
+                        double* ind_init_value,
+                        double* adjoint_init_value,
+                        double**** fourth_vector) {
+  std::shared_ptr<TrivialTrace<SingleForward>> new_trace =
+      single_forward_replay(trace, ind_num, ind_init_value,
+                            adjoint_init_value);
+  if (!new_trace) {
+    return;
+  }
+  BaseReverseThird<SingleForward> third(new_trace);
+  std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor =
+      third.compute(ind_num, dep_num);
+  size_t size;
+  size_t** tind;
+  SingleForward* values;
+  for (size_t d = 0; d < dep_num; d++) {
+    for (size_t i = 0; i < ind_num; i++) {
+      for (size_t j = 0; j < ind_num; j++) {
+        for (size_t k = 0; k < ind_num; k++) {
+          fourth_vector[d][i][j][k] = 0.0;
+        }
+      }
+    }
+    tensor->get_internal_coordinate_list(d, 3, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      size_t i = tind[l][0];
+      size_t j = tind[l][1];
+      size_t k = tind[l][2];
+      double w = values[l].getDer();
+      fourth_vector[d][i][j][k] = w;
+      fourth_vector[d][i][k][j] = w;
+      fourth_vector[d][j][i][k] = w;
+      fourth_vector[d][j][k][i] = w;
+      fourth_vector[d][k][i][j] = w;
+      fourth_vector[d][k][j][i] = w;
+    }
+  }
+}
+
+std::shared_ptr<DerivativeTensor<size_t, double>> directional_reverse(
+    std::shared_ptr<TrivialTrace<double>> trace,
+    size_t t_order,
+    size_t ind_num,
+    size_t dep_num,
+    double* ind_init_value,
+    double* adjoint_init_value) {
+  std::shared_ptr<TrivialTrace<SingleForward>> new_trace =
+      single_forward_replay(trace, ind_num, ind_init_value,
+                            adjoint_init_value);
+  if (!new_trace) {
+    return nullptr;
+  }
+  BaseReverseGeneric<SingleForward> generic(new_trace, t_order);
+  return strip_derivative(generic.compute(ind_num, dep_num),
+                          t_order, ind_num, dep_num);
+}
+
+std::shared_ptr<DerivativeTensor<size_t, double>> strip_derivative(
+    const std::shared_ptr<DerivativeTensor<size_t, SingleForward>> tensor,
+    size_t t_order, size_t ind_size, size_t dep_size) {
+  std::shared_ptr<DerivativeTensor<size_t, double>> ret =
+      std::make_shared<DerivativeTensor<size_t, double>>(
+          dep_size, ind_size, t_order);
+  size_t size;
+  size_t** tind;
+  SingleForward* values;
+  for (size_t d = 0; d < dep_size; d++) {
+    ret->put_dep_value(d, tensor->get_dep_value(d).getDer());
+    for (size_t order = 1; order <= t_order; order++) {
+      tensor->get_internal_coordinate_list(d, order, &size, &tind, &values);
+      size_t nnz = 0;
+      for (size_t l = 0; l < size; l++) {
+        if (values[l].getDer() != 0.0) {nnz++;}
+      }
+      ret->init_single_tensor(d, order, nnz);
+      nnz = 0;
+      for (size_t l = 0; l < size; l++) {
+        if (values[l].getDer() != 0.0) {
+          ret->put_value(d, order, nnz++, tind[l], values[l].getDer());
+        }
+      }
+    }
+  }
+  return ret;
+}
+
+} // namespace ReverseAD
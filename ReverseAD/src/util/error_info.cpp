@@ -10,6 +10,62 @@ void warning_NumberInconsistent(const char* const info, int input_num, int trace
             << " Will proceed with the trace." << std::endl;
 }
 
+void warning_CompressionConflict(size_t row, size_t col) {
+  std::cerr << "Hessian entry (" << row << ", " << col << ") can not be "
+            << "recovered from the compressed Hessian (invalid coloring)."
+            << std::endl;
+}
+
+void warning_UnsupportedOrder(const char* const name, size_t order) {
+  std::cerr << name << " does not support derivative order " << order
+            << "." << std::endl;
+}
+
+void warning_PlanInconsistent(size_t sac_count) {
+  std::cerr << "The trace does not match the execution plan (at operation "
+            << sac_count << "). Consider reset_plan()!" << std::endl;
+}
+
+void warning_RegionNotFound(size_t region) {
+  std::cerr << "Checkpoint region (" << region << ") is not found on the "
+            << "trace, it is skipped." << std::endl;
+}
+
+void warning_ExtFuncNotFound(size_t id) {
+  std::cerr << "External function (" << id << ") is not found on the "
+            << "trace." << std::endl;
+}
+
+void warning_ExtFuncUnsupported(const char* const name) {
+  std::cerr << name << " does not support external functions, "
+            << "they are skipped." << std::endl;
+}
+
+void warning_ExtFuncNoHessian() {
+  std::cerr << "External function without a hessian callback, its second "
+            << "order part is skipped." << std::endl;
+}
+
+void warning_ExtFuncReplay() {
+  std::cerr << "A trace with external functions can only be replayed in its "
+            << "own base type, no trace is returned." << std::endl;
+}
+
+void warning_ExtFuncRefused(const char* const name) {
+  std::cerr << name << " can not handle external functions, nothing is "
+            << "computed." << std::endl;
+}
+
+void warning_LayoutInconsistent() {
+  std::cerr << "The derivative layout was built for a different sparsity "
+            << "structure, nothing is exported." << std::endl;
+}
+
+void warning_NotInPattern(size_t row, size_t col) {
+  std::cerr << "Derivative entry (" << row << ", " << col << ") is not in "
+            << "the sparsity pattern, it is dropped." << std::endl;
+}
+
 void warning_UnrecognizedOpcode(int opcode) {
   std::cerr << "Unrecogized opcode (" << opcode << ") on trace (corrupted?)."
             << std::endl;
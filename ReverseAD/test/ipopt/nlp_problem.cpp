@@ -134,90 +134,30 @@ template<class T> bool  NlpProblem::eval_constraints(Index n, const T *x, Index
 
 bool NlpProblem::eval_f(Index n, const Number* x, bool new_x, Number& obj_value)
 {
-  eval_obj(n,x,obj_value);
-
-  return true;
+  return driver->eval_f(x, obj_value);
 }
 
 bool NlpProblem::eval_grad_f(Index n, const Number* x, bool new_x, Number* grad_f)
 {
-
-//  gradient(tag_f,n,x,grad_f);
- 
-  for (int i=0; i<n; i++) {
-    tmp_x[i] = x[i];
-#ifdef SHOW_DEBUG_INFO
-    std::cout << "x["<<i<<"] = " << x[i] << std::endl;
-#endif
-  }
-  TrivialTrace<double>* new_trace =
-    BaseFunctionReplay::replay_ind<double>(trace_f, tmp_x, n);
-  BaseReverseAdjoint<double> adjoint(new_trace);
-  adjoint.compute(n, 1);
-  adjoint.retrieve_adjoint(&grad_f_val);
-  for(int i=0; i<n; i++) {
-    grad_f[i] = grad_f_val[0][i];
-#ifdef SHOW_DEBUG_INFO
-    std::cout << "G["<<i<<"] = "<< grad_f[i] << std::endl;
-#endif
-  }
-  delete[] grad_f_val[0];
-  delete[] grad_f_val;
-  return true;
+  return driver->eval_grad_f(x, grad_f);
 }
 
 bool NlpProblem::eval_g(Index n, const Number* x, bool new_x, Index m, Number* g)
 {
-
-  eval_constraints(n,x,m,g);
-
-  return true;
+  return driver->eval_g(x, g);
 }
 
 bool NlpProblem::eval_jac_g(Index n, const Number* x, bool new_x,
                        Index m, Index nele_jac, Index* iRow, Index *jCol,
                        Number* values)
 {
-
   if (values == NULL) {
     // return the structure of the jacobian
-
-    for(Index idx=0; idx<nnz_jac; idx++)
-      {
-	iRow[idx] = rind_g[idx];
-	jCol[idx] = cind_g[idx];
-#ifdef SHOW_DEBUG_INFO
-        std::cout << "A["<<rind_g[idx]<<","<<cind_g[idx]<<"]" << std::endl;
-#endif
-      }
-  }
-  else {
-    // return the values of the jacobian of the constraints
-    delete[] rind_g;
-    delete[] cind_g;
-    delete[] jacval;
-    for(int i=0; i<n; i++) {
-      tmp_x[i] = x[i];
-#ifdef SHOW_DEBUG_INFO
-      std::cout << "x["<<i<<"] = "<<x[i] << std::endl;
-#endif
-    }
-    TrivialTrace<double>* new_trace = 
-      BaseFunctionReplay::replay_ind<double>(trace_g, tmp_x, n);
-    BaseReverseAdjoint<Number> adjoint(new_trace);
-    adjoint.compute(n, m);
-    adjoint.retrieve_adjoint_sparse_format(&nnz_jac, &rind_g, &cind_g, &jacval); 
-    for(Index idx=0; idx<nnz_jac; idx++)
-      {
-	values[idx] = jacval[idx];
-#ifdef SHOW_DEBUG_INFO
-        std::cout << "A["<<rind_g[idx]<<","<<cind_g[idx]<<"] = " << jacval[idx] << std::endl;
-#endif
-      }
+    driver->get_jac_structure(iRow, jCol);
+    return true;
   }
-
-  return true;
-
+  // return the values of the jacobian of the constraints
+  return driver->eval_jac_g(x, values);
 }
 
 bool NlpProblem::eval_h(Index n, const Number* x, bool new_x,
@@ -225,78 +165,15 @@ bool NlpProblem::eval_h(Index n, const Number* x, bool new_x,
                    bool new_lambda, Index nele_hess, Index* iRow,
                    Index* jCol, Number* values)
 {
-
   if (values == NULL) {
     // return the structure. This is a symmetric matrix, fill the lower left
     // triangle only.
-
-/*
-    for(Index idx=0; idx<nnz_L[0]; idx++)
-      {
-	iRow[idx] = cind_L[0][idx];
-	jCol[idx] = rind_L[0][idx];
-      }
-*/
-    Index idx = 0;
-    for(Index i = 0; i<n; i++) {
-      for (Index j=0; j<=i; j++) {
-        iRow[idx] = i;
-        jCol[idx] = j;
-        idx++;
-      }
-    }
+    driver->get_hess_structure(iRow, jCol);
+    return true;
   }
-  else {
-    // return the values. This is a symmetric matrix, fill the lower left
-    // triangle only
-
-    delete[] nnz_L;
-    delete[] cind_L[0];
-    delete[] cind_L;
-    delete[] rind_L[0];
-    delete[] rind_L;
-    delete[] hessval[0];
-    delete[] hessval;
-
-#ifdef SHOW_DEBUG_INFO
-    std::cout << "obj_factor = " << obj_factor << std::endl;
-#endif
-    obj_lam[0] = obj_factor;
-    for(Index idx = 0; idx<m ; idx++) {
-      obj_lam[1+idx] = lambda[idx];
-#ifdef SHOW_DEBUG_INFO
-      std::cout << "lambda["<<idx<<"] = " << lambda[idx] << std::endl; 
-#endif
-    }
-    for(Index idx = 0; idx<n; idx++) {
-      tmp_x[idx] = x[idx];
-#ifdef SHOW_DEBUG_INFO
-      std::cout << "x["<<idx<<"] = "<<tmp_x[idx]<< std::endl;
-#endif
-    }
-
-    TrivialTrace<double>* new_trace = 
-      BaseFunctionReplay::replay<double>(trace_L, 
-        tmp_x, n, obj_lam, m+1);
-    BaseReverseHessian<double> hessian(new_trace);
-    hessian.compute(n, 1);
-    hessian.retrieve_hessian_sparse_format(&nnz_L, &cind_L, &rind_L, &hessval);
-
-    Index l = 0;
-    for(Index i = 0; i < (n*(n+1))/2; i++) {
-      values[i] = 0;
-    }
-    for(Index i = 0; i <nnz_L[0] ; i++)
-      {
-          l = (cind_L[0][i]*cind_L[0][i]+1)/2 + rind_L[0][i];
-          values[l] = hessval[0][i];
-#ifdef SHOW_DEBUG_INFO
-        std::cout << "H["<<cind_L[0][i]<<","<<rind_L[0][i]<<"] = " << hessval[0][i] << std::endl;
-#endif
-      }
-  }
-  return true;
-
+  // return the values. This is a symmetric matrix, fill the lower left
+  // triangle only
+  return driver->eval_h(x, obj_factor, lambda, values);
 }
 
 void NlpProblem::finalize_solution(SolverReturn status,
@@ -313,22 +190,7 @@ void NlpProblem::finalize_solution(SolverReturn status,
   printf("\n\nObjective value\n");
   printf("f(x*) = %e\n", obj_value);
 
-// memory deallocation of ADOL-C variables
-
-  delete[] obj_lam;
-
-  delete[] rind_g;
-  delete[] cind_g;
-  delete[] jacval;
-
-  delete[] nnz_L;
-  delete[] cind_L[0];
-  delete[] cind_L;
-  delete[] rind_L[0];
-  delete[] rind_L;
-  delete[] hessval[0];
-  delete[] hessval;
-
+  driver.reset();
 }
 
 
@@ -343,94 +205,31 @@ void NlpProblem::generate_tapes(Index n, Index m, Index& nnz_jac_g, Index& nnz_h
 
   adouble *xa   = new adouble[n];
   adouble *g    = new adouble[m];
-  double *lam   = new double[m];
-  double sig;
   adouble obj_value;
   
   double dummy;
 
-  int i,j,k,l,ii;
-  tmp_x = new double[n];
-  obj_lam   = new double[m+1];
-
   get_starting_point(n, 1, xp, 0, zl, zu, m, 0, lamp);
 
+  // one trace, the dependents are f, g[0], ..., g[m-1]
   trace_on<double>();
     
     for(Index idx=0;idx<n;idx++)
       xa[idx] <<= xp[idx];
 
     eval_obj(n,xa,obj_value);
-
-    obj_value >>= dummy;
-
-  trace_f = trace_off<double>();
-  
-  trace_on<double>();
-    
-    for(Index idx=0;idx<n;idx++)
-      xa[idx] <<= xp[idx];
-
     eval_constraints(n,xa,m,g);
 
-
+    obj_value >>= dummy;
     for(Index idx=0;idx<m;idx++)
       g[idx] >>= dummy;
 
-  trace_g = trace_off<double>();
+  std::shared_ptr<TrivialTrace<double>> trace = trace_off<double>();
 
-  trace_on<double>();
-    
-    for(Index idx=0;idx<n;idx++)
-      xa[idx] <<= xp[idx];
-    for(Index idx=0;idx<m;idx++)
-      lam[idx] = 1.0;
-    sig = 1.0;
-
-    eval_obj(n,xa,obj_value);
-
-    obj_value = obj_value * adouble::markParam(sig);
-    eval_constraints(n,xa,m,g);
- 
-    for(Index idx=0;idx<m;idx++)
-      obj_value = obj_value + g[idx]*adouble::markParam(lam[idx]);
-
-    obj_value >>= dummy;
+  driver = std::make_shared<NlpDriver<double>>(trace);
+  nnz_jac_g = driver->get_nnz_jac();
+  nnz_h_lag = driver->get_nnz_hess();
 
-  trace_L = trace_off<double>();
-
-  rind_g = NULL; 
-  cind_g = NULL;
-  rind_L = NULL;
-  cind_L = NULL;
-  jacval = NULL;
-  hessval = NULL;
-
-  BaseReverseAdjoint<double> adjoint(trace_g);
-  adjoint.compute(n, m);
-  adjoint.retrieve_adjoint_sparse_format(&nnz_jac, &rind_g, &cind_g, &jacval);
-
-  nnz_jac_g = nnz_jac;
-#ifdef SHOW_DEBUG_INFO
-  for (int i = 0; i < nnz_jac; i++) {
-    std::cout << "A[" << rind_g[i] << "," << cind_g[i] << " ] = "
-              << jacval[i] << std::endl;
-  }
-#endif  
-  BaseReverseHessian<double> hessian(trace_L);
-  hessian.compute(n, 1);
-  hessian.retrieve_hessian_sparse_format(&nnz_L, &rind_L, &cind_L, &hessval);
-
-#ifdef SHOW_DEBUG_INFO
-  for (int i = 0; i < nnz_L[0]; i++) {
-    std::cout << "H[" << rind_L[0][i] << "," << cind_L[0][i] << " ] = "
-              << hessval[0][i] << std::endl;
-  }
-#endif
-
-  nnz_h_lag = (n*(n+1)) / 2;
-  
-  delete[] lam;
   delete[] g;
   delete[] xa;
   delete[] zu;
@@ -1,6 +1,8 @@
 #ifndef REVERSEAD_IPOPT_NLP_H_
 #define REVERSEAD_IPOPT_NLP_H_
 
+#include <memory>
+
 #include <IpTNLP.hpp>
 #include "reversead/reversead.hpp"
 
@@ -109,26 +111,8 @@ private:
 
   //@{
 
-  double *obj_lam;
-  double *tmp_x;
-
-  double** grad_f_val;
-
-  //** variables for sparsity exploitation
-  int nnz_jac;
-  locint *rind_g;        /* row indices    */
-  locint *cind_g;        /* column indices */
-  double *jacval;              /* values         */
-
-  int* nnz_L;
-  locint **rind_L;        /* row indices    */
-  locint **cind_L;        /* column indices */
-  double **hessval;             /* values */
-
-  
-  TrivialTrace<double>* trace_f;
-  TrivialTrace<double>* trace_g;
-  TrivialTrace<double>* trace_L;
+  // the derivatives of the trace of (f, g), structure computed once
+  std::shared_ptr<NlpDriver<double>> driver;
   //@}
 
 };
@@ -0,0 +1,70 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BatchReplay;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::DerivativeTensor;
+
+#define N 4
+#define M 2
+#define P 37
+double myEps = 1e-10;
+
+// test_util.cpp
+std::shared_ptr<TrivialTrace<double>> fixture_trace(
+    const double* x, double vp, double* y);
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+// every point is checked against tracing the function at that point
+int main() {
+  double x[P][N];
+  for (size_t p = 0; p < P; p++) {
+    x[p][0] = 1.0 + 0.1 * p;
+    x[p][1] = sin(0.3 * p);
+    x[p][2] = 2.0 + cos(0.7 * p);
+    x[p][3] = 1.5 + 0.05 * p;
+  }
+  double y[P][M], ty[P][M];
+  std::shared_ptr<TrivialTrace<double>> expected[P];
+  for (size_t p = 0; p < P; p++) {
+    expected[p] = fixture_trace(x[p], 1.5, ty[p]);
+  }
+  BatchReplay<double> batch(expected[0]);
+  for (size_t threads = 1; threads <= 3; threads += 2) {
+    batch.set_num_threads(threads);
+    batch.evaluate(&x[0][0], N, &y[0][0], M, P);
+    for (size_t p = 0; p < P; p++) {
+      for (size_t i = 0; i < M; i++) {
+        if (fabs(ty[p][i] - y[p][i]) > myEps) {
+          std::cout << "BatchReplay evaluate error at point " << p
+                    << " with " << threads << " threads" << std::endl;
+          exit(-1);
+        }
+      }
+    }
+  }
+  batch.set_num_threads(2);
+  std::vector<std::shared_ptr<TrivialTrace<double>>> traces =
+      batch.replay(&x[0][0], N, &y[0][0], M, P);
+  for (size_t p = 0; p < P; p += 6) {
+    for (size_t i = 0; i < M; i++) {
+      if (fabs(ty[p][i] - y[p][i]) > myEps) {
+        std::cout << "BatchReplay replay error at point " << p << std::endl;
+        exit(-1);
+      }
+    }
+    BaseReverseHessian<double> hessian(expected[p]);
+    BaseReverseHessian<double> replayed(traces[p]);
+    check_same(hessian.compute(N, M), replayed.compute(N, M), M, 2,
+               "BatchReplay");
+  }
+  std::cout << "BatchReplay OK!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::BaseSparsityPattern;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::SparsityPattern;
+
+double myEps = 1e-10;
+
+bool use_region = false;
+
+// test_util.cpp
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+void inner(adouble* x, size_t x_num, adouble* y, size_t y_num) {
+  y[0] = sin(x[0] * x[1]) + exp(x[1]);
+  y[1] = x[0] * x[0] * x[1];
+}
+
+// a region with a nested region and some local temporaries
+void outer(adouble* x, size_t x_num, adouble* y, size_t y_num) {
+  adouble t[2];
+  if (use_region) {
+    ReverseAD::checkpoint_region(x, 2, t, 2, inner);
+  } else {
+    inner(x, 2, t, 2);
+  }
+  adouble s = x[2];
+  for (size_t k = 0; k < 4; k++) {
+    s = sin(s) * t[0] + t[1] / (1.0 + s * s);
+  }
+  y[0] = s * x[2] + log(t[1] + x[2] * x[2]);
+  y[1] = t[0] * t[0] * x[2];
+}
+
+std::shared_ptr<TrivialTrace<double>> record(const double* xval) {
+  const double scale = 0.5;
+  adouble x[3];
+  adouble y[2];
+  adouble w[1];
+  adouble z0, z1;
+  double vz;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < 3; i++) {
+    x[i] <<= xval[i];
+  }
+  auto scaled = [scale](adouble* x, size_t, adouble* w, size_t) {
+    w[0] = scale * x[0] * x[1] * x[2];
+  };
+  if (use_region) {
+    ReverseAD::checkpoint_region(x, 3, y, 2, outer);
+    ReverseAD::checkpoint_region(x, 3, w, 1, scaled);
+  } else {
+    outer(x, 3, y, 2);
+    scaled(x, 3, w, 1);
+  }
+  z0 = y[0] * y[1] + x[0] + w[0];
+  z1 = exp(y[1] * 0.1) * w[0];
+  z0 >>= vz;
+  z1 >>= vz;
+  return ReverseAD::trace_off<double>();
+}
+
+int main() {
+  double xval[3] = {0.7, 1.3, 0.4};
+  double xnew[3] = {1.1, 0.6, 0.9};
+  use_region = false;
+  std::shared_ptr<TrivialTrace<double>> plain = record(xval);
+  use_region = true;
+  std::shared_ptr<TrivialTrace<double>> region = record(xval);
+
+  BaseReverseThird<double> plain_third(plain);
+  BaseReverseThird<double> region_third(region);
+  check_same(plain_third.compute(3, 2), region_third.compute(3, 2), 2, 3,
+             "checkpoint_region");
+
+  // again, the regions are traced for every sweep
+  BaseReverseHessian<double> plain_hessian(plain);
+  BaseReverseHessian<double> region_hessian(region);
+  check_same(plain_hessian.compute(3, 2), region_hessian.compute(3, 2), 2, 2,
+             "checkpoint_region");
+
+  // the compiled trace inlines the regions, at a new point
+  check_same(plain_hessian.compute(xnew, 3, 2),
+             region_hessian.compute(xnew, 3, 2), 2, 2,
+             "checkpoint_region");
+
+  // a replayed trace records the regions at the new point
+  double dep1[2], dep2[2];
+  BaseReverseThird<double> plain_replay(
+      BaseFunctionReplay::replay_ind(plain, dep1, 2, xnew, 3));
+  BaseReverseThird<double> region_replay(
+      BaseFunctionReplay::replay_ind(region, dep2, 2, xnew, 3));
+  check_same(plain_replay.compute(3, 2), region_replay.compute(3, 2), 2, 3,
+             "checkpoint_region");
+  for (size_t i = 0; i < 2; i++) {
+    if (fabs(dep1[i] - dep2[i]) > myEps) {
+      std::cout << "checkpoint_region replay error!" << std::endl;
+      exit(-1);
+    }
+  }
+
+  // and in another type, forward over reverse
+  double dir[3] = {0.3, -1.0, 0.5};
+  double hv1[2][3], hv2[2][3];
+  double* phv1[2] = {hv1[0], hv1[1]};
+  double* phv2[2] = {hv2[0], hv2[1]};
+  ReverseAD::forward_over_reverse(plain, 3, 2, xnew, dir, phv1);
+  ReverseAD::forward_over_reverse(region, 3, 2, xnew, dir, phv2);
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      if (fabs(hv1[i][j] - hv2[i][j]) > myEps * (1.0 + fabs(hv1[i][j]))) {
+        std::cout << "checkpoint_region forward over reverse error!"
+                  << std::endl;
+        exit(-1);
+      }
+    }
+  }
+
+  BaseSparsityPattern<double> plain_pattern(plain);
+  BaseSparsityPattern<double> region_pattern(region);
+  std::shared_ptr<SparsityPattern> p1 = plain_pattern.hessian_pattern(3, 2);
+  std::shared_ptr<SparsityPattern> p2 = region_pattern.hessian_pattern(3, 2);
+  if (p1->get_nnz() != p2->get_nnz()) {
+    std::cout << "checkpoint_region pattern error!" << std::endl;
+    exit(-1);
+  }
+  for (size_t i = 0; i < p1->get_row_size(); i++) {
+    if (p1->get_row(i) != p2->get_row(i)) {
+      std::cout << "checkpoint_region pattern error!" << std::endl;
+      exit(-1);
+    }
+  }
+  std::cout << "checkpoint_region OK!" << std::endl;
+  return 0;
+}
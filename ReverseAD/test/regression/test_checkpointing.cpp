@@ -1,13 +1,18 @@
+#include <cmath>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <vector>
 
 #include "reversead/reversead.hpp"
 
 using ReverseAD::adouble;
 using ReverseAD::BaseReverseThird;
 using ReverseAD::BaseReverseGeneric;
+using ReverseAD::BaseReverseTensor;
 using ReverseAD::TrivialTrace;
 using ReverseAD::DerivativeTensor;
+using ReverseAD::IterativeFuncBase;
 using ReverseAD::IterativeFuncCond;
 using ReverseAD::IterativeFuncFixed;
 
@@ -70,6 +75,66 @@ void check_answer(std::shared_ptr<DerivativeTensor<size_t, double>> tensor1,
   }
 }
 
+// compares by index, up to order, with the values of tensor2 scaled
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> tensor1,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor2,
+                size_t order, double scale) {
+  for (size_t k = 1; k <= order; k++) {
+    std::map<std::vector<size_t>, double> entries;
+    size_t size = 0;
+    size_t** tind = nullptr;
+    double* values = nullptr;
+    tensor1->get_internal_coordinate_list(0, k, &size, &tind, &values);
+    for (size_t i = 0; i < size; i++) {
+      entries[std::vector<size_t>(tind[i], tind[i] + k)] = values[i];
+    }
+    tensor2->get_internal_coordinate_list(0, k, &size, &tind, &values);
+    if (size != entries.size()) {
+      check_fail();
+    }
+    for (size_t i = 0; i < size; i++) {
+      std::vector<size_t> index(tind[i], tind[i] + k);
+      if (entries.find(index) == entries.end() ||
+          fabs(entries[index] - scale * values[i]) >
+              myEps * (1.0 + fabs(entries[index]))) {
+        check_fail();
+      }
+    }
+  }
+}
+
+// hessian_vector() against the gradient and Hessian in tensor, scaled
+void check_hessian_vector(IterativeFuncBase* func, double* x,
+                          std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                          double scale) {
+  double v[2] = {0.7, -1.3};
+  double gradient[2], hv[2];
+  double expected_gradient[2] = {0.0, 0.0};
+  double expected_hv[2] = {0.0, 0.0};
+  size_t size = 0;
+  size_t** tind = nullptr;
+  double* values = nullptr;
+  tensor->get_internal_coordinate_list(0, 1, &size, &tind, &values);
+  for (size_t i = 0; i < size; i++) {
+    expected_gradient[tind[i][0]] = scale * values[i];
+  }
+  tensor->get_internal_coordinate_list(0, 2, &size, &tind, &values);
+  for (size_t i = 0; i < size; i++) {
+    expected_hv[tind[i][0]] += scale * values[i] * v[tind[i][1]];
+    if (tind[i][0] != tind[i][1]) {
+      expected_hv[tind[i][1]] += scale * values[i] * v[tind[i][0]];
+    }
+  }
+  func->hessian_vector(x, 2, v, gradient, hv);
+  for (size_t i = 0; i < 2; i++) {
+    if (fabs(gradient[i] - expected_gradient[i]) >
+            myEps * (1.0 + fabs(expected_gradient[i])) ||
+        fabs(hv[i] - expected_hv[i]) > myEps * (1.0 + fabs(expected_hv[i]))) {
+      check_fail();
+    }
+  }
+}
+
 void dummy_func() {
   // a dummy_func used as empty set_up and tear_down
 }
@@ -96,6 +161,118 @@ void final_step(T* t, size_t t_num, T* y, size_t y_num) {
   y[0] = t[1] * t[0];
 }
 
+// A longer contraction, t[2] counts the iterations
+#define LONG_ITER 50
+template <typename T>
+void long_initial_step(T* x, size_t x_num, T* t, size_t t_num) {
+  t[0] = x[0];
+  t[1] = x[1];
+  t[2] = 0.0;
+}
+template <typename T>
+void long_iteration_step(T* t, size_t t_num) {
+  t[0] = 0.5 * sin(t[0] + t[1]) + 0.1 * t[1];
+  t[1] = 0.5 * cos(t[0] * t[1]) - 0.2 * t[0];
+  t[2] = t[2] + 1.0;
+}
+template <typename T>
+bool long_condition(const T* const t, size_t t_num) {
+  return t[2] < LONG_ITER;
+}
+template <typename T>
+void long_final_step(T* t, size_t t_num, T* y, size_t y_num) {
+  y[0] = t[0] * t[0] * t[1] + exp(t[1]);
+}
+
+void check_binomial(double* x) {
+  adouble xad[2];
+  adouble tad[3];
+  adouble yad;
+  double y;
+  ReverseAD::trace_on<double>();
+  xad[0] <<= x[0];
+  xad[1] <<= x[1];
+  long_initial_step<adouble>(xad, 2, tad, 3);
+  while (long_condition<adouble>(tad, 3)) {
+    long_iteration_step<adouble>(tad, 3);
+  }
+  long_final_step<adouble>(tad, 3, &yad, 1);
+  yad >>= y;
+  std::shared_ptr<TrivialTrace<double>> trace = ReverseAD::trace_off<double>();
+  BaseReverseThird<double> third(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> r_tensor =
+      third.compute(2, 1);
+
+  IterativeFuncCond iter_func_cond(
+      2, 3, 1, &dummy_func, &dummy_func,
+      &(long_initial_step<adouble>), &(long_iteration_step<adouble>),
+      &(long_final_step<adouble>), &(long_condition<adouble>));
+  IterativeFuncFixed iter_func_fixed(
+      2, 3, 1, &dummy_func, &dummy_func,
+      &(long_initial_step<adouble>), &(long_iteration_step<adouble>),
+      &(long_final_step<adouble>), LONG_ITER);
+  // other engines, and a weighted output
+  BaseReverseGeneric<double> generic(trace, 4);
+  std::shared_ptr<DerivativeTensor<size_t, double>> r4_tensor =
+      generic.compute(2, 1);
+  check_same(r4_tensor, iter_func_cond.compute(x, 2, 4), 4, 1.0);
+  BaseReverseTensor<double> tensor_mode(nullptr, 3);
+  check_same(r_tensor, iter_func_fixed.compute(x, 2, tensor_mode), 3, 1.0);
+  double weight = 2.5;
+  iter_func_fixed.set_dep_weight(&weight, 1);
+  check_same(r_tensor, iter_func_fixed.compute(x, 2, 2), 2, 1.0 / weight);
+  check_hessian_vector(&iter_func_fixed, x, r_tensor, weight);
+  iter_func_fixed.clear_dep_weight();
+  check_hessian_vector(&iter_func_cond, x, r_tensor, 1.0);
+
+  IterativeFuncBase* funcs[2] = {&iter_func_cond, &iter_func_fixed};
+  for (IterativeFuncBase* func : funcs) {
+    std::shared_ptr<DerivativeTensor<size_t, double>> g_tensor =
+        func->compute(x, 2, 3);
+    check_answer(r_tensor, g_tensor);
+    // one segment per iteration, retraced on worker threads
+    func->set_min_op_per_cp(1);
+    check_hessian_vector(func, x, r_tensor, 1.0);
+    func->set_num_threads(3);
+    check_answer(r_tensor, func->compute(x, 2, 3));
+    // all checkpoints on file, then a few of them in memory
+    func->set_checkpoint_memory(1);
+    check_answer(r_tensor, func->compute(x, 2, 3));
+    if (func->get_num_spilled_checkpoints() != LONG_ITER + 2) {
+      check_fail();
+    }
+    func->set_checkpoint_memory(400);
+    check_answer(r_tensor, func->compute(x, 2, 3));
+    func->set_num_threads(1);
+    check_answer(r_tensor, func->compute(x, 2, 3));
+    func->set_checkpoint_memory(0);
+    size_t max_checkpoints[4] = {1, 2, 5, 64};
+    // the optimal number of forward recomputations, less the steps
+    // advanced while storing the first checkpoints in the forward sweep
+    size_t fixed_recomputed[4] = {1225, 244, 75, 0};
+    for (size_t i = 0; i < 4; i++) {
+      size_t max_cp = max_checkpoints[i];
+      func->set_max_checkpoints(max_cp);
+      std::shared_ptr<DerivativeTensor<size_t, double>> b_tensor =
+          func->compute(x, 2, 3);
+      check_answer(r_tensor, b_tensor);
+      if (func->get_peak_checkpoints() > max_cp) {
+        check_fail();
+      }
+      if (func == &iter_func_fixed &&
+          func->get_num_recomputed_steps() != fixed_recomputed[i]) {
+        check_fail();
+      }
+    }
+    func->set_max_checkpoints(0);
+    func->set_max_checkpoint_bytes(1);
+    check_answer(r_tensor, func->compute(x, 2, 3));
+    if (func->get_peak_checkpoints() != 1) {
+      check_fail();
+    }
+  }
+}
+
 int main() {
   double x[2] = {2, 1};
   double y;
@@ -152,6 +329,8 @@ int main() {
   std::shared_ptr<DerivativeTensor<size_t, double>> f_tensor = 
       iter_func_fixed.compute(x, 2, 3);
   check_answer(i_tensor, f_tensor);
+  double long_x[2] = {0.3, 0.7};
+  check_binomial(long_x);
   std::cout << "IterativeFunc test OK!" << std::endl;
   return 0;
 } 
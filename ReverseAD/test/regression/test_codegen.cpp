@@ -0,0 +1,76 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::CodeGenerator;
+
+#define N 4
+#define M 3
+
+std::shared_ptr<TrivialTrace<double>> foo(double* x) {
+  adouble ax[N];
+  adouble ay[M];
+  double y[M];
+  ReverseAD::trace_on<double>();
+  adouble p = adouble::markParam(0.5);
+  for (size_t i = 0; i < N; i++) {
+    ax[i] <<= x[i];
+  }
+  // self assignments are traced with r == x
+  ax[1] = ax[1];
+  adouble t = ax[0] * ax[0] + sin(ax[1]) - cos(ax[2]) / ax[3];
+  ay[0] = t * ax[2] / ax[3] + pow(ax[2], ax[3]) + pow(ax[0], 3.0) * p;
+  ay[1] = exp(ax[1]) * sqrt(ax[2]) - log(ax[3]) + 3.0 / ax[0];
+  ay[1] += atan(t) * erf(ax[1]) + pow(2.0, ax[0]);
+  ay[1] -= fabs(ax[0] - ax[2]) * asin(ax[1] / 4.0);
+  ay[2] = 2.0 - acos(ax[3] / 4.0) * t;
+  ay[2] *= ax[1] * ax[1];
+  ay[2] /= ax[0] + 1.0;
+  ay[2] = ay[2];
+  for (size_t i = 0; i < M; i++) {
+    ay[i] >>= y[i];
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+// Generates the code and the harness, builds them with the system compiler
+// and runs the harness.
+int main() {
+  double x[N] = {1.0, 0.5, 2.0, 1.5};
+  std::shared_ptr<TrivialTrace<double>> trace = foo(x);
+  CodeGenerator generator(trace, "foo");
+  {
+    std::ofstream source("test_codegen_foo.cpp");
+    generator.generate(source);
+    std::ofstream harness("test_codegen_harness.cpp");
+    generator.generate_harness(harness, "test_codegen_foo.cpp");
+  }
+  if (std::system("g++ --version > /dev/null 2>&1") != 0) {
+    std::cout << "CodeGenerator: no g++ found, generated code not checked"
+              << std::endl;
+    std::cout << "CodeGenerator OK!" << std::endl;
+    return 0;
+  }
+  int ret = std::system("g++ -O3 -march=native -o test_codegen_harness "
+                        "test_codegen_harness.cpp");
+  if (ret != 0) {
+    std::cout << "CodeGenerator output does not compile!" << std::endl;
+    exit(-1);
+  }
+  ret = std::system("./test_codegen_harness");
+  std::remove("test_codegen_foo.cpp");
+  std::remove("test_codegen_harness.cpp");
+  std::remove("test_codegen_harness");
+  if (ret != 0) {
+    std::cout << "CodeGenerator results error!" << std::endl;
+    exit(-1);
+  }
+  std::cout << "CodeGenerator OK!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseCompressedDerivative;
+using ReverseAD::DerivativeTensor;
+
+#define N 8
+#define M 2
+#define myEps 1e-10
+
+// banded chain plus an arrowhead on x[0]
+std::shared_ptr<TrivialTrace<double>> foo(double* x) {
+  adouble ax[N];
+  adouble ay[M];
+  double y[M];
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < N; i++) {
+    ax[i] <<= x[i];
+  }
+  ay[0] = 0;
+  for (size_t i = 0; i + 1 < N; i++) {
+    ay[0] += ax[i] * ax[i + 1] + sin(ax[i]);
+  }
+  ay[1] = 0;
+  for (size_t i = 1; i < N; i++) {
+    ay[1] += exp(ax[0]) * ax[i];
+  }
+  for (size_t i = 0; i < M; i++) {
+    ay[i] >>= y[i];
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+void to_dense(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+              size_t dep, size_t order, std::vector<double>& dense) {
+  size_t size = 0;
+  size_t** tind = nullptr;
+  double* values = nullptr;
+  dense.assign(N * N, 0.0);
+  tensor->get_internal_coordinate_list(dep, order, &size, &tind, &values);
+  for (size_t l = 0; l < size; l++) {
+    if (order == 1) {
+      dense[tind[l][0]] = values[l];
+    } else {
+      dense[tind[l][0] * N + tind[l][1]] = values[l];
+    }
+  }
+}
+
+void check_tensor(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                  std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                  size_t order, const char* const name) {
+  std::vector<double> a;
+  std::vector<double> b;
+  for (size_t i = 0; i < M; i++) {
+    if (fabs(expected->get_dep_value(i) - tensor->get_dep_value(i)) > myEps) {
+      std::cout << name << " dependent value error!" << std::endl;
+      exit(-1);
+    }
+    for (size_t k = 1; k <= order; k++) {
+      to_dense(expected, i, k, a);
+      to_dense(tensor, i, k, b);
+      for (size_t l = 0; l < N * N; l++) {
+        if (fabs(a[l] - b[l]) > myEps) {
+          std::cout << name << " error at dep " << i << " order " << k
+                    << std::endl;
+          exit(-1);
+        }
+      }
+    }
+  }
+  std::cout << name << " OK!" << std::endl;
+}
+
+int main() {
+  double x[N] = {0.5, 1.0, 1.5, 2.0, 2.5, 3.0, 3.5, 4.0};
+  std::shared_ptr<TrivialTrace<double>> trace = foo(x);
+  BaseReverseAdjoint<double> adjoint(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> jac =
+      adjoint.compute(N, M);
+  BaseReverseHessian<double> hessian(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> hess =
+      hessian.compute(N, M);
+
+  BaseCompressedDerivative<2> compressed(trace);
+  check_tensor(jac, compressed.compute_jacobian(x, N, M), 1,
+               "Compressed Jacobian");
+  check_tensor(hess, compressed.compute_hessian(x, N, M), 2,
+               "Compressed Hessian");
+  // the arrowhead needs N colors for the Jacobian, banded Hessian plus
+  // arrowhead can be star colored with far fewer
+  if (compressed.get_hessian_colors() >= N) {
+    std::cout << "Star coloring uses too many colors : "
+              << compressed.get_hessian_colors() << std::endl;
+    exit(-1);
+  }
+
+  // same colorings at a different point
+  double z[N] = {-1.0, 0.3, 0.2, -0.7, 1.1, 0.9, -0.4, 0.6};
+  std::shared_ptr<TrivialTrace<double>> new_trace =
+      ReverseAD::BaseFunctionReplay::replay_ind<double>(trace, z, N);
+  BaseReverseHessian<double> new_hessian(new_trace);
+  check_tensor(new_hessian.compute(N, M), compressed.compute_hessian(z, N, M),
+               2, "Compressed Hessian reuse");
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::locint;
+using ReverseAD::TrivialAdjoint;
+using ReverseAD::TrivialHessian;
+using ReverseAD::TrivialThird;
+using ReverseAD::CompactThird;
+
+#define myEps 1e-10
+
+typedef std::map<std::vector<locint>, double> Entries;
+
+template <typename Third>
+Entries to_map(const Third& third) {
+  Entries ret;
+  typename Third::enumerator t_enum = third.get_enumerator();
+  locint x, y, z;
+  double w;
+  while (t_enum.has_next()) {
+    t_enum.get_next(x, y, z, w);
+    if (w != 0.0) {ret[{x, y, z}] = w;}
+  }
+  return ret;
+}
+
+Entries to_map(const TrivialHessian<locint, double>& hessian) {
+  Entries ret;
+  TrivialHessian<locint, double>::enumerator h_enum =
+      hessian.get_enumerator();
+  locint x, y;
+  double w;
+  while (h_enum.has_next()) {
+    h_enum.get_next(x, y, w);
+    if (w != 0.0) {ret[{x, y}] = w;}
+  }
+  return ret;
+}
+
+void check_same(const Entries& a, const Entries& b, const char* name) {
+  bool same = (a.size() == b.size());
+  for (auto iter = a.begin(); same && iter != a.end(); ++iter) {
+    auto found = b.find(iter->first);
+    same = (found != b.end() && fabs(found->second - iter->second) < myEps);
+  }
+  if (!same) {
+    std::cout << "CompactThird " << name << " error!" << std::endl;
+    exit(-1);
+  }
+}
+
+// random updates and slices, checked against TrivialThird
+int main() {
+  TrivialThird<locint, double> expected;
+  CompactThird<locint, double> third;
+  srand(12345);
+  for (locint r = 60; r > 0; r--) {
+    for (size_t k = 0; k < 400; k++) {
+      locint x = rand() % r + 1;
+      locint y = rand() % r + 1;
+      locint z = rand() % r + 1;
+      double w = (rand() % 1000) / 100.0 - 5.0;
+      expected.increase(x, y, z, w);
+      third.increase(z, x, y, w);
+    }
+    if (r % 5 == 0) {
+      check_same(to_map(expected), to_map(third), "increase");
+    }
+    check_same(to_map(expected.get_and_erase(r)),
+               to_map(third.get_and_erase(r)), "get_and_erase");
+  }
+  check_same(to_map(expected), to_map(third), "remaining");
+
+  for (size_t k = 0; k < 1000; k++) {
+    third.increase(rand() % 50 + 1, rand() % 50 + 1, rand() % 50 + 1, 1.0);
+  }
+  std::vector<char> buf(third.byte_size());
+  third.write_to_byte(&buf[0]);
+  CompactThird<locint, double> copy(&buf[0]);
+  check_same(to_map(third), to_map(copy), "serialization");
+  // the same bytes as TrivialThird, both written in increasing (x, y, z)
+  TrivialThird<locint, double> trivial;
+  CompactThird<locint, double> compact;
+  for (size_t k = 0; k < 1000; k++) {
+    locint x = rand() % 50 + 1;
+    locint y = rand() % 50 + 1;
+    locint z = rand() % 50 + 1;
+    trivial.increase(x, y, z, 1.0);
+    compact.increase(x, y, z, 1.0);
+  }
+  std::vector<char> trivial_buf(trivial.byte_size());
+  std::vector<char> compact_buf(compact.byte_size());
+  trivial.write_to_byte(&trivial_buf[0]);
+  compact.write_to_byte(&compact_buf[0]);
+  if (trivial_buf != compact_buf) {
+    std::cout << "CompactThird byte layout error!" << std::endl;
+    exit(-1);
+  }
+  third.clear();
+  if (third.get_size() != 0 || third.get_enumerator().has_next()) {
+    std::cout << "CompactThird clear error!" << std::endl;
+    exit(-1);
+  }
+  std::cout << "CompactThird OK!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::CompiledTrace;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::DerivativeTensor;
+
+#define N 4
+#define M 3
+#define myEps 1e-10
+
+std::shared_ptr<TrivialTrace<double>> foo(double* x) {
+  adouble ax[N];
+  adouble ay[M];
+  double y[M];
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < N; i++) {
+    ax[i] <<= x[i];
+  }
+  adouble t = ax[0] * ax[0] + sin(ax[1]) - cos(ax[2]) / ax[3];
+  ay[0] = t * ax[2] / ax[3] + pow(ax[2], ax[3]) + pow(ax[0], 3.0);
+  ay[1] = exp(ax[1]) * sqrt(ax[2]) - log(ax[3]) + 3.0 / ax[0];
+  ay[1] += atan(t) * erf(ax[1]) + pow(2.0, ax[0]);
+  ay[1] -= fabs(ax[0] - ax[2]) * asin(ax[1] / 4.0);
+  ay[2] = 2.0 - acos(ax[3] / 4.0) * t;
+  ay[2] *= ax[1];
+  ay[2] /= ax[0] + 1.0;
+  for (size_t i = 0; i < M; i++) {
+    ay[i] >>= y[i];
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+int main() {
+  double x[3][N] = {{1.0, 0.5, 2.0, 1.5},
+                    {0.5, 1.0, 3.0, 2.5},
+                    {-1.5, 2.0, 0.7, 1.1}};
+  std::shared_ptr<TrivialTrace<double>> trace = foo(x[0]);
+  CompiledTrace<double> compiled(trace);
+  if (compiled.get_num_ind() != N || compiled.get_num_dep() != M) {
+    std::cout << "CompiledTrace number of ind/dep error!" << std::endl;
+    exit(-1);
+  }
+  // slots keep the order of locations
+  for (const auto& ins : compiled.get_instructions()) {
+    if (ins.r != 0 && (ins.x >= ins.r || ins.y >= ins.r)) {
+      std::cout << "CompiledTrace slot order error!" << std::endl;
+      exit(-1);
+    }
+  }
+  double y[M], cy[M];
+  double w[M] = {1.0, -2.0, 0.5};
+  double g[N];
+  for (size_t p = 0; p < 3; p++) {
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        BaseFunctionReplay::replay_ind<double>(trace, y, M, x[p], N);
+    compiled.evaluate(x[p], cy);
+    for (size_t i = 0; i < M; i++) {
+      if (fabs(y[i] - cy[i]) > myEps) {
+        std::cout << "CompiledTrace evaluate error!" << std::endl;
+        exit(-1);
+      }
+    }
+    compiled.forward(x[p], cy);
+    BaseReverseAdjoint<double> adjoint(new_trace);
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+        adjoint.compute(N, M);
+    double expected[N] = {0.0};
+    for (size_t i = 0; i < M; i++) {
+      if (fabs(y[i] - cy[i]) > myEps) {
+        std::cout << "CompiledTrace forward error!" << std::endl;
+        exit(-1);
+      }
+      size_t size;
+      size_t** tind;
+      double* values;
+      tensor->get_internal_coordinate_list(i, 1, &size, &tind, &values);
+      for (size_t l = 0; l < size; l++) {
+        expected[tind[l][0]] += w[i] * values[l];
+      }
+    }
+    // the partials are reused by both sweeps
+    for (size_t k = 0; k < 2; k++) {
+      compiled.reverse(w, g);
+      for (size_t i = 0; i < N; i++) {
+        if (fabs(expected[i] - g[i]) > myEps) {
+          std::cout << "CompiledTrace reverse error at " << i << std::endl;
+          exit(-1);
+        }
+      }
+    }
+  }
+  std::cout << "CompiledTrace OK!" << std::endl;
+  return 0;
+}
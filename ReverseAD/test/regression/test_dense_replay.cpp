@@ -0,0 +1,110 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::CompiledTrace;
+using ReverseAD::DenseReplay;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::DerivativeTensor;
+
+#define N 4
+#define M 2
+double myEps = 1e-10;
+
+// test_util.cpp
+std::shared_ptr<TrivialTrace<double>> fixture_trace(
+    const double* x, double vp, double* y);
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+void check_value(const double* expected, const double* y, const char* name) {
+  for (size_t i = 0; i < M; i++) {
+    if (fabs(expected[i] - y[i]) > myEps) {
+      std::cout << name << " dependent value error!" << std::endl;
+      exit(-1);
+    }
+  }
+}
+
+// replays are checked against tracing the function at the same point
+int main() {
+  double x[3][N] = {{1.0, 0.5, 2.0, 1.5},
+                    {0.5, 1.0, 3.0, 2.5},
+                    {-1.5, 2.0, 0.7, 1.1}};
+  double vp[3] = {1.5, 0.5, 2.5};
+  double y[M], ty[M];
+  std::shared_ptr<TrivialTrace<double>> trace = fixture_trace(x[0], vp[0], y);
+  DenseReplay<double> dense(trace);
+  std::shared_ptr<CompiledTrace<double>> compiled;
+  const double* buffer = nullptr;
+  for (size_t i = 0; i < 3; i++) {
+    std::shared_ptr<TrivialTrace<double>> expected = fixture_trace(x[i], vp[0], ty);
+    BaseReverseThird<double> third(expected);
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+        third.compute(N, M);
+
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        dense.replay_ind(y, M, x[i], N);
+    check_value(ty, y, "DenseReplay");
+    BaseReverseThird<double> replayed(new_trace);
+    check_same(tensor, replayed.compute(N, M), M, 3, "DenseReplay");
+
+    new_trace = BaseFunctionReplay::replay_ind<double>(trace, y, M, x[i], N);
+    check_value(ty, y, "BaseFunctionReplay");
+    // decoded (and the value buffer allocated) by the first replay only
+    if (i == 0) {
+      compiled = trace->get_compiled();
+      buffer = trace->get_replay_value().data();
+    }
+    if (!compiled || trace->get_compiled() != compiled) {
+      std::cout << "BaseFunctionReplay decoded the trace again!" << std::endl;
+      exit(-1);
+    }
+    if (buffer == nullptr || trace->get_replay_value().data() != buffer) {
+      std::cout << "BaseFunctionReplay allocated a new buffer!" << std::endl;
+      exit(-1);
+    }
+    BaseReverseThird<double> replayed_ind(new_trace);
+    check_same(tensor, replayed_ind.compute(N, M), M, 3,
+               "BaseFunctionReplay");
+
+    // new parameter
+    expected = fixture_trace(x[i], vp[i], ty);
+    BaseReverseThird<double> third_param(expected);
+    tensor = third_param.compute(N, M);
+    new_trace = dense.replay(y, M, x[i], N, &vp[i], 1, true, true, true);
+    check_value(ty, y, "DenseReplay(param)");
+    BaseReverseThird<double> replayed_param(new_trace);
+    check_same(tensor, replayed_param.compute(N, M), M, 3,
+               "DenseReplay(param)");
+  }
+  // replays of one trace from several threads take turns
+  double ty_all[3][M];
+  double y_all[3][M];
+  for (size_t i = 0; i < 3; i++) {
+    fixture_trace(x[i], vp[0], ty_all[i]);
+  }
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < 3; i++) {
+    workers.emplace_back([&, i]() {
+      for (size_t k = 0; k < 20; k++) {
+        BaseFunctionReplay::replay_ind<double>(trace, y_all[i], M, x[i], N);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (size_t i = 0; i < 3; i++) {
+    check_value(ty_all[i], y_all[i], "BaseFunctionReplay(threads)");
+  }
+  std::cout << "DenseReplay OK!" << std::endl;
+  return 0;
+}
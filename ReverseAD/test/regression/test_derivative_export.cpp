@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::DerivativeLayout;
+using ReverseAD::DerivativeTensor;
+
+#define myEps 1e-10
+
+typedef std::map<std::vector<size_t>, double> Entries;
+
+void report(const char* const what) {
+  std::cout << "DerivativeTensor export error : " << what << std::endl;
+  exit(-1);
+}
+
+// (dep, sorted tuple) -> value
+Entries to_map(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+               size_t order) {
+  Entries ret;
+  size_t size;
+  size_t** tind;
+  double* values;
+  for (size_t dep = 0; dep < tensor->get_dep_size(); dep++) {
+    tensor->get_internal_coordinate_list(dep, order, &size, &tind, &values);
+    for (size_t i = 0; i < size; i++) {
+      std::vector<size_t> key(tind[i], tind[i] + order);
+      std::sort(key.begin(), key.end(), std::greater<size_t>());
+      key.insert(key.begin(), dep);
+      ret[key] = values[i];
+    }
+  }
+  return ret;
+}
+
+void check_value(double expected, double computed) {
+  if (fabs(expected - computed) > myEps * (1.0 + fabs(expected))) {
+    report("value");
+  }
+}
+
+// the values written through a layout (built now or by an earlier tensor)
+// are those of a plain export
+void check_layout(const std::vector<double>& values,
+                  const std::vector<double>& layout_values) {
+  if (values != layout_values) {
+    report("layout values");
+  }
+}
+
+void check_jacobian(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                    DerivativeLayout<size_t>* csr_layout,
+                    DerivativeLayout<size_t>* csc_layout) {
+  Entries expected = to_map(tensor, 1);
+  size_t m = tensor->get_dep_size();
+  size_t n = tensor->get_ind_size();
+  size_t nnz = tensor->get_nnz(1);
+  if (nnz != expected.size()) {
+    report("nnz");
+  }
+  std::vector<size_t> row_ptr(m + 1);
+  std::vector<size_t> col_ind(nnz);
+  std::vector<double> values(nnz);
+  std::vector<double> layout_values(nnz);
+  if (!tensor->get_jacobian_csr(row_ptr.data(), col_ind.data(),
+                                values.data()) ||
+      !tensor->get_jacobian_csr(nullptr, nullptr, layout_values.data(),
+                                csr_layout)) {
+    report("csr");
+  }
+  check_layout(values, layout_values);
+  auto iter = expected.begin();
+  for (size_t i = 0; i < m; i++) {
+    for (size_t k = row_ptr[i]; k < row_ptr[i + 1]; k++, ++iter) {
+      if (iter->first[0] != i || iter->first[1] != col_ind[k]) {
+        report("csr structure");
+      }
+      check_value(iter->second, values[k]);
+    }
+  }
+  if (row_ptr[m] != nnz) {
+    report("csr size");
+  }
+
+  std::vector<size_t> col_ptr(n + 1);
+  std::vector<size_t> row_ind(nnz);
+  if (!tensor->get_jacobian_csc(col_ptr.data(), row_ind.data(),
+                                values.data()) ||
+      !tensor->get_jacobian_csc(nullptr, nullptr, layout_values.data(),
+                                csc_layout)) {
+    report("csc");
+  }
+  check_layout(values, layout_values);
+  for (size_t j = 0; j < n; j++) {
+    for (size_t k = col_ptr[j]; k < col_ptr[j + 1]; k++) {
+      if ((k > col_ptr[j] && row_ind[k - 1] >= row_ind[k])) {
+        report("csc order");
+      }
+      auto found = expected.find({row_ind[k], j});
+      if (found == expected.end()) {
+        report("csc structure");
+      }
+      check_value(found->second, values[k]);
+    }
+  }
+  if (col_ptr[n] != nnz) {
+    report("csc size");
+  }
+}
+
+void check_sorted(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                  size_t order,
+                  std::vector<DerivativeLayout<size_t>>& layouts) {
+  Entries expected = to_map(tensor, order);
+  for (size_t dep = 0; dep < tensor->get_dep_size(); dep++) {
+    size_t size;
+    size_t** tind;
+    double* vals;
+    tensor->get_internal_coordinate_list(dep, order, &size, &tind, &vals);
+    std::vector<size_t> rind(size);
+    std::vector<size_t> cind(size);
+    std::vector<size_t> coords(size * order);
+    std::vector<double> values(size);
+    std::vector<double> layout_values(size);
+    bool ret;
+    if (order == 2) {
+      ret = tensor->get_hessian_coo(dep, rind.data(), cind.data(),
+                                    values.data()) &&
+            tensor->get_hessian_coo(dep, nullptr, nullptr,
+                                    layout_values.data(), &layouts[dep]);
+      for (size_t i = 0; i < size; i++) {
+        coords[i * 2] = rind[i];
+        coords[i * 2 + 1] = cind[i];
+      }
+    } else {
+      ret = tensor->get_sorted_coordinate_list(dep, order, coords.data(),
+                                               values.data()) &&
+            tensor->get_sorted_coordinate_list(dep, order, nullptr,
+                                               layout_values.data(),
+                                               &layouts[dep]);
+    }
+    if (!ret) {
+      report("coordinates");
+    }
+    check_layout(values, layout_values);
+    auto iter = expected.lower_bound({dep});
+    for (size_t i = 0; i < size; i++, ++iter) {
+      std::vector<size_t> key(&coords[i * order], &coords[(i + 1) * order]);
+      key.insert(key.begin(), dep);
+      if (iter == expected.end() || iter->first != key) {
+        report("coordinate structure");
+      }
+      check_value(iter->second, values[i]);
+    }
+  }
+}
+
+std::shared_ptr<TrivialTrace<double>> record(const double* xval) {
+  adouble x[4];
+  adouble y[3];
+  double vy;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < 4; i++) {
+    x[i] <<= xval[i];
+  }
+  y[0] = x[3] * sin(x[0] * x[1]);
+  y[1] = exp(x[2]) * x[0] + x[3] * x[3] * x[3];
+  y[2] = x[1] * x[1] / (1.0 + x[2] * x[2]);
+  for (size_t j = 0; j < 3; j++) {
+    y[j] >>= vy;
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+int main() {
+  double xval[4] = {0.7, 1.3, 0.4, 0.9};
+  double xnew[4] = {1.1, -0.6, 0.9, 0.3};
+  std::shared_ptr<TrivialTrace<double>> trace = record(xval);
+
+  BaseReverseThird<double> third(trace);
+  std::vector<DerivativeLayout<size_t>> third_layouts(3);
+  check_sorted(third.compute(4, 3), 3, third_layouts);
+
+  BaseReverseHessian<double> hessian(trace);
+  DerivativeLayout<size_t> csr_layout;
+  DerivativeLayout<size_t> csc_layout;
+  std::vector<DerivativeLayout<size_t>> hess_layouts(3);
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      hessian.compute(4, 3);
+  check_jacobian(tensor, &csr_layout, &csc_layout);
+  check_sorted(tensor, 2, hess_layouts);
+
+  // a new point, only the values are written through the layouts
+  std::shared_ptr<DerivativeTensor<size_t, double>> other =
+      hessian.compute(xnew, 4, 3);
+  check_jacobian(other, &csr_layout, &csc_layout);
+  check_sorted(other, 2, hess_layouts);
+
+  std::vector<double> values(other->get_nnz(1));
+  // a layout of another structure is refused
+  if (other->get_jacobian_csr(nullptr, nullptr, values.data(),
+                              &hess_layouts[0])) {
+    report("inconsistent layout accepted");
+  }
+  std::cout << "DerivativeTensor export OK!" << std::endl;
+  return 0;
+}
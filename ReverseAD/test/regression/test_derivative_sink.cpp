@@ -0,0 +1,165 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::BaseReverseTensor;
+using ReverseAD::DerivativeSink;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::FunctionSink;
+
+double myEps = 1e-10;
+
+typedef std::map<std::vector<size_t>, double> SparseTensor;
+
+// test_util.cpp
+SparseTensor to_map(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                    size_t dep, size_t order);
+bool same_entries(const SparseTensor& expected, const SparseTensor& computed);
+
+void report(const char* const what) {
+  std::cout << "DerivativeSink error : " << what << std::endl;
+  exit(-1);
+}
+
+class MapSink : public DerivativeSink<double> {
+ public:
+  void begin(size_t dep_size, size_t ind_size, size_t order) override {
+    if (begun) {
+      report("begin twice");
+    }
+    begun = true;
+    this->dep_size = dep_size;
+    this->order = order;
+    dep_values.assign(dep_size, 0.0);
+    entries.assign(dep_size, SparseTensor());
+  }
+  void put_dep_value(size_t dep, const double& value) override {
+    dep_values[dep] = value;
+  }
+  void put_value(size_t dep, size_t order, const size_t* ind,
+                 const double& value) override {
+    if (!begun || ended || dep >= dep_size || order > this->order) {
+      report("entry out of place");
+    }
+    std::vector<size_t> key(ind, ind + order);
+    if (!entries[dep].insert(std::make_pair(key, value)).second) {
+      report("entry twice");
+    }
+  }
+  void end() override {
+    ended = true;
+  }
+
+  bool begun = false;
+  bool ended = false;
+  size_t dep_size = 0;
+  size_t order = 0;
+  std::vector<double> dep_values;
+  // one map per dependent
+  std::vector<SparseTensor> entries;
+};
+
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t order, const MapSink& sink) {
+  if (!sink.ended || sink.order != order ||
+      sink.dep_size != tensor->get_dep_size()) {
+    report("begin/end");
+  }
+  for (size_t dep = 0; dep < sink.dep_size; dep++) {
+    if (fabs(sink.dep_values[dep] - tensor->get_dep_value(dep)) > myEps) {
+      report("dependent value");
+    }
+    SparseTensor expected = to_map(tensor, dep, order);
+    if (expected.size() != sink.entries[dep].size()) {
+      report("size");
+    }
+    if (!same_entries(expected, sink.entries[dep])) {
+      report("entry");
+    }
+  }
+}
+
+// the sink of a fresh compute() against the tensor of another one
+template <typename Engine, typename... Args>
+void check_engine(std::shared_ptr<TrivialTrace<double>> trace,
+                  size_t order, const double* xnew, Args... args) {
+  Engine tensor_engine(trace, args...);
+  Engine sink_engine(trace, args...);
+  MapSink sink;
+  sink_engine.compute(4, 3, sink);
+  check_same(tensor_engine.compute(4, 3), order, sink);
+  if (xnew != nullptr) {
+    MapSink new_sink;
+    sink_engine.compute(xnew, 4, 3, new_sink);
+    check_same(tensor_engine.compute(xnew, 4, 3), order, new_sink);
+  }
+}
+
+std::shared_ptr<TrivialTrace<double>> record(const double* xval) {
+  adouble x[4];
+  adouble y[3];
+  double vy;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < 4; i++) {
+    x[i] <<= xval[i];
+  }
+  y[0] = x[3] * sin(x[0] * x[1]) + x[2] * x[2] * x[2];
+  y[1] = exp(x[2]) * x[0] + x[3] * x[3] * x[1];
+  y[2] = x[1] * x[1] / (1.0 + x[2] * x[0]);
+  for (size_t j = 0; j < 3; j++) {
+    y[j] >>= vy;
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+int main() {
+  double xval[4] = {0.7, 1.3, 0.4, 0.9};
+  double xnew[4] = {1.1, -0.6, 0.9, 0.3};
+  std::shared_ptr<TrivialTrace<double>> trace = record(xval);
+
+  check_engine<BaseReverseAdjoint<double>>(trace, 1, xnew);
+  check_engine<BaseReverseHessian<double>>(trace, 2, xnew);
+  check_engine<BaseReverseThird<double>>(trace, 3, nullptr);
+  // through get_tensor()
+  check_engine<BaseReverseTensor<double>>(trace, 3, nullptr, 3);
+
+  // a weighted sum only has one dependent
+  double weight[3] = {0.5, -1.0, 2.0};
+  BaseReverseHessian<double> weighted(trace);
+  weighted.set_dep_weight(weight, 3);
+  MapSink sink;
+  weighted.compute(4, 3, sink);
+  check_same(weighted.compute(4, 3), 2, sink);
+
+  // the callback sink, summing the Hessian of the first dependent
+  double sum = 0.0;
+  FunctionSink<double> callback([&sum](size_t dep, size_t order,
+                                       const size_t* ind, const double& w) {
+    if (dep == 0 && order == 2) {
+      sum += w;
+    }
+  });
+  BaseReverseHessian<double> hessian(trace);
+  hessian.compute(4, 3, callback);
+  double expected = 0.0;
+  for (const auto& kv : to_map(hessian.compute(4, 3), 0, 2)) {
+    if (kv.first.size() == 2) {
+      expected += kv.second;
+    }
+  }
+  if (fabs(sum - expected) > myEps * (1.0 + fabs(expected))) {
+    report("callback");
+  }
+  std::cout << "DerivativeSink OK!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseSparsityPattern;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BatchReplay;
+using ReverseAD::CompiledTrace;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::ExternalFunction;
+using ReverseAD::SingleForward;
+using ReverseAD::SparsityPattern;
+
+double myEps = 1e-10;
+
+// test_util.cpp
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+// y0 = x0 * x1 * x2, y1 = sin(x0) + x1 * x1
+void primal(const double* x, size_t, double* y, size_t) {
+  y[0] = x[0] * x[1] * x[2];
+  y[1] = sin(x[0]) + x[1] * x[1];
+}
+
+void adjoint(const double* x, size_t, const double* w, size_t,
+             double* x_adj) {
+  x_adj[0] = w[0] * x[1] * x[2] + w[1] * cos(x[0]);
+  x_adj[1] = w[0] * x[0] * x[2] + w[1] * 2.0 * x[1];
+  x_adj[2] = w[0] * x[0] * x[1];
+}
+
+void hessian(const double* x, size_t, const double* w, size_t,
+             double* h) {
+  h[0] = -w[1] * sin(x[0]);
+  h[1] = h[3] = w[0] * x[2];
+  h[2] = h[6] = w[0] * x[1];
+  h[4] = w[1] * 2.0;
+  h[5] = h[7] = w[0] * x[0];
+  h[8] = 0.0;
+}
+
+void plain_func(adouble* x, adouble* y) {
+  y[0] = x[0] * x[1] * x[2];
+  y[1] = sin(x[0]) + x[1] * x[1];
+}
+
+std::shared_ptr<TrivialTrace<double>> record(const double* xval,
+                                             bool external) {
+  std::shared_ptr<ExternalFunction<double>> func =
+      std::make_shared<ExternalFunction<double>>(3, 2, primal, adjoint,
+                                                 hessian);
+  adouble x[3];
+  adouble u[3];
+  adouble y[2];
+  adouble v[2];
+  adouble z0, z1;
+  double vz;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < 3; i++) {
+    x[i] <<= xval[i];
+  }
+  for (size_t i = 0; i < 3; i++) {
+    u[i] = exp(0.1 * x[i]) * x[(i + 1) % 3];
+  }
+  if (external) {
+    ReverseAD::call_external(func, u, y);
+  } else {
+    plain_func(u, y);
+  }
+  // the same function again, its outputs are used nonlinearly
+  u[2] = y[0] * y[1];
+  if (external) {
+    ReverseAD::call_external(func, u, v);
+  } else {
+    plain_func(u, v);
+  }
+  z0 = y[0] * y[1] + u[0] + v[0] * v[1];
+  z1 = v[0] * v[0] * x[2] + y[1];
+  z0 >>= vz;
+  z1 >>= vz;
+  return ReverseAD::trace_off<double>();
+}
+
+int main() {
+  double xval[3] = {0.7, 1.3, 0.4};
+  std::shared_ptr<TrivialTrace<double>> plain = record(xval, false);
+  std::shared_ptr<TrivialTrace<double>> ext = record(xval, true);
+
+  BaseReverseAdjoint<double> plain_adjoint(plain);
+  BaseReverseAdjoint<double> ext_adjoint(ext);
+  std::shared_ptr<DerivativeTensor<size_t, double>> expected =
+      plain_adjoint.compute(3, 2);
+  check_same(expected, ext_adjoint.compute(3, 2), 2, 1,
+             "ExternalFunction");
+  for (size_t num_threads = 1; num_threads <= 2; num_threads++) {
+    BaseReverseAdjoint<double> preacc(ext);
+    preacc.enable_parallel_preacc(num_threads, 2);
+    check_same(expected, preacc.compute(3, 2), 2, 1,
+             "ExternalFunction");
+  }
+
+  BaseReverseHessian<double> plain_hessian(plain);
+  BaseReverseHessian<double> ext_hessian(ext);
+  check_same(plain_hessian.compute(3, 2), ext_hessian.compute(3, 2), 2, 2,
+             "ExternalFunction");
+
+  // the external function is a dense block, a superset of the pattern
+  BaseSparsityPattern<double> plain_pattern(plain);
+  BaseSparsityPattern<double> ext_pattern(ext);
+  std::shared_ptr<SparsityPattern> p1 = plain_pattern.hessian_pattern(3, 2);
+  std::shared_ptr<SparsityPattern> p2 = ext_pattern.hessian_pattern(3, 2);
+  for (size_t i = 0; i < p1->get_row_size(); i++) {
+    for (const size_t& j : p1->get_row(i)) {
+      bool found = false;
+      for (const size_t& k : p2->get_row(i)) {
+        found = found || (j == k);
+      }
+      if (!found) {
+        std::cout << "ExternalFunction pattern error!" << std::endl;
+        exit(-1);
+      }
+    }
+  }
+  // at a new point : replayed, compiled and batched
+  double xnew[3] = {1.1, -0.6, 0.9};
+  expected = plain_adjoint.compute(xnew, 3, 2);
+  BaseReverseAdjoint<double> replay_adjoint(
+      BaseFunctionReplay::replay_ind(ext, xnew, 3));
+  check_same(expected, replay_adjoint.compute(3, 2), 2, 1,
+             "ExternalFunction");
+  check_same(expected, ext_adjoint.compute(xnew, 3, 2), 2, 1,
+             "ExternalFunction");
+  check_same(plain_hessian.compute(xnew, 3, 2),
+             ext_hessian.compute(xnew, 3, 2), 2, 2,
+             "ExternalFunction");
+
+  CompiledTrace<double> plain_compiled(plain);
+  CompiledTrace<double> ext_compiled(ext);
+  double y1[2], y2[2], w[2] = {0.5, -2.0}, g1[3], g2[3];
+  plain_compiled.forward(xnew, y1);
+  ext_compiled.forward(xnew, y2);
+  plain_compiled.reverse(w, g1);
+  ext_compiled.reverse(w, g2);
+  for (size_t i = 0; i < 3; i++) {
+    if (fabs(g1[i] - g2[i]) > myEps * (1.0 + fabs(g1[i])) ||
+        (i < 2 && fabs(y1[i] - y2[i]) > myEps * (1.0 + fabs(y1[i])))) {
+      std::cout << "ExternalFunction compiled error!" << std::endl;
+      exit(-1);
+    }
+  }
+
+  double xs[9] = {0.7, 1.3, 0.4, 1.1, -0.6, 0.9, 0.2, 0.5, -1.0};
+  double ys1[6], ys2[6];
+  BatchReplay<double>(plain).evaluate(xs, 3, ys1, 2, 3);
+  BatchReplay<double>(ext).evaluate(xs, 3, ys2, 2, 3);
+  for (size_t i = 0; i < 6; i++) {
+    if (fabs(ys1[i] - ys2[i]) > myEps * (1.0 + fabs(ys1[i]))) {
+      std::cout << "ExternalFunction batch error!" << std::endl;
+      exit(-1);
+    }
+  }
+
+  // a function of double can not be replayed in another type
+  SingleForward xf[3];
+  if (BaseFunctionReplay::replay_forward<double, SingleForward>(ext, xf, 3)) {
+    std::cout << "ExternalFunction replay not refused!" << std::endl;
+    exit(-1);
+  }
+  std::cout << "ExternalFunction OK!" << std::endl;
+  return 0;
+}
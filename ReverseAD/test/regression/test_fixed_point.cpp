@@ -0,0 +1,103 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::DerivativeTensor;
+using ReverseAD::IterativeFuncCond;
+
+#define myEps 1e-9
+
+void dummy_func() {}
+
+// t = (z0, z1, p0, p1, residual), the parameters p are kept by the step
+template <typename T>
+void initial_step(T* x, size_t x_num, T* t, size_t t_num) {
+  t[0] = 0.0;
+  t[1] = 0.0;
+  t[2] = x[0];
+  t[3] = x[1];
+  t[4] = 1.0;
+}
+
+template <typename T>
+void iteration_step(T* t, size_t t_num) {
+  T z0 = 0.3 * cos(t[0] + t[1]) + 0.5 * t[2];
+  T z1 = 0.25 * sin(t[0] * t[3]) + 0.2 * t[1];
+  t[4] = fabs(z0 - t[0]) + fabs(z1 - t[1]);
+  t[0] = z0;
+  t[1] = z1;
+}
+
+template <typename T>
+bool while_condition(const T* const t, size_t t_num) {
+  return t[4] > 1e-15;
+}
+
+template <typename T>
+void final_step(T* t, size_t t_num, T* y, size_t y_num) {
+  y[0] = t[0] * t[1] + t[3];
+  y[1] = exp(t[0]);
+}
+
+void check_fail(const char* what) {
+  std::cout << "Fixed point test fail : " << what << std::endl;
+  exit(-1);
+}
+
+std::vector<double> gradient(
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+    size_t dep, size_t x_num) {
+  std::vector<double> ret(x_num, 0.0);
+  size_t size = 0;
+  size_t** tind = nullptr;
+  double* values = nullptr;
+  tensor->get_internal_coordinate_list(dep, 1, &size, &tind, &values);
+  for (size_t i = 0; i < size; i++) {
+    ret[tind[i][0]] = values[i];
+  }
+  return ret;
+}
+
+int main() {
+  double x[2] = {0.4, 0.9};
+  IterativeFuncCond iter_func(
+      2, 5, 2, &dummy_func, &dummy_func,
+      &(initial_step<adouble>), &(iteration_step<adouble>),
+      &(final_step<adouble>), &(while_condition<adouble>));
+  // the adjoint of every iteration as reference
+  std::shared_ptr<DerivativeTensor<size_t, double>> expected =
+      iter_func.compute(x, 2, 1);
+
+  iter_func.enable_fixed_point(1e-14, 1000);
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      iter_func.compute(x, 2, 1);
+  if (iter_func.get_num_adjoint_iter() == 0) {
+    check_fail("no adjoint iteration");
+  }
+  for (size_t dep = 0; dep < 2; dep++) {
+    if (fabs(tensor->get_dep_value(dep) - expected->get_dep_value(dep))
+        > myEps) {
+      check_fail("value");
+    }
+    std::vector<double> g1 = gradient(expected, dep, 2);
+    std::vector<double> g2 = gradient(tensor, dep, 2);
+    for (size_t i = 0; i < 2; i++) {
+      if (fabs(g1[i] - g2[i]) > myEps) {
+        std::cout << g1[i] << " != " << g2[i] << std::endl;
+        check_fail("gradient");
+      }
+    }
+  }
+  // only first order
+  if (iter_func.compute(x, 2, 2) != nullptr) {
+    check_fail("second order");
+  }
+  iter_func.disable_fixed_point();
+  std::cout << "Fixed point OK!" << std::endl;
+  return 0;
+}
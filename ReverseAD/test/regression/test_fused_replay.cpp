@@ -0,0 +1,74 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BaseReverseMode;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::BaseReverseGeneric;
+using ReverseAD::BaseReverseTensor;
+using ReverseAD::BaseHessianPlan;
+using ReverseAD::DerivativeTensor;
+
+#define N 4
+#define M 2
+double myEps = 1e-10;
+
+// test_util.cpp
+std::shared_ptr<TrivialTrace<double>> fixture_trace(
+    const double* x, double vp, double* y);
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+// compute(x, ...) on the original trace against compute() on a replayed one
+void check_fused(BaseReverseMode<double>& replayed,
+                 BaseReverseMode<double>& fused,
+                 double* x, size_t order, const char* name) {
+  check_same(replayed.compute(N, M), fused.compute(x, N, M), M, order, name);
+}
+
+int main() {
+  double x[3][N] = {{1.0, 0.5, 2.0, 1.5},
+                    {0.5, 1.0, 3.0, 2.5},
+                    {-1.5, 2.0, 0.7, 1.1}};
+  double lambda[M] = {1.0, -2.0};
+  double vy[M];
+  std::shared_ptr<TrivialTrace<double>> trace = fixture_trace(x[0], 1.5, vy);
+  BaseReverseAdjoint<double> adjoint(trace);
+  BaseReverseHessian<double> hessian(trace);
+  BaseReverseThird<double> third(trace);
+  BaseReverseGeneric<double> generic(trace, 3);
+  BaseReverseTensor<double> tensor(trace, 3);
+  BaseReverseHessian<double> weighted(trace);
+  weighted.set_dep_weight(lambda, M);
+  BaseHessianPlan<double> plan(trace);
+  for (size_t i = 0; i < 3; i++) {
+    double y[M];
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        BaseFunctionReplay::replay_ind<double>(trace, y, M, x[i], N);
+    BaseReverseAdjoint<double> r_adjoint(new_trace);
+    check_fused(r_adjoint, adjoint, x[i], 1, "BaseReverseAdjoint");
+    BaseReverseHessian<double> r_hessian(new_trace);
+    check_fused(r_hessian, hessian, x[i], 2, "BaseReverseHessian");
+    BaseReverseThird<double> r_third(new_trace);
+    check_fused(r_third, third, x[i], 3, "BaseReverseThird");
+    BaseReverseGeneric<double> r_generic(new_trace, 3);
+    check_fused(r_generic, generic, x[i], 3, "BaseReverseGeneric");
+    BaseReverseTensor<double> r_tensor(new_trace, 3);
+    check_fused(r_tensor, tensor, x[i], 3, "BaseReverseTensor");
+    BaseReverseHessian<double> r_weighted(new_trace);
+    r_weighted.set_dep_weight(lambda, M);
+    check_same(r_weighted.compute(N, M), weighted.compute(x[i], N, M), 1, 2,
+               "BaseReverseHessian(weighted)");
+    check_fused(r_hessian, plan, x[i], 2, "BaseHessianPlan");
+  }
+  std::cout << "Fused replay OK!" << std::endl;
+  return 0;
+}
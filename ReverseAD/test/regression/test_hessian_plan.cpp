@@ -0,0 +1,112 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseFunctionReplay;
+using ReverseAD::BaseReverseMode;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseHessianPlan;
+using ReverseAD::DerivativeTensor;
+
+#define N 4
+#define M 2
+double myEps = 1e-10;
+
+// test_util.cpp
+std::shared_ptr<TrivialTrace<double>> fixture_trace(
+    const double* x, double vp, double* y);
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+// a long chain, the slots of the plan are recycled along it
+void check_chain() {
+  const size_t n = 3;
+  const size_t length = 200;
+  double x[n] = {0.3, 0.5, 0.7};
+  double vy;
+  adouble ax[n];
+  adouble ay;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    ax[i] <<= x[i];
+  }
+  ay = ax[0];
+  for (size_t k = 0; k < length; k++) {
+    ay = sin(ay) * ax[1] + ax[2] * ay * 0.1;
+  }
+  ay >>= vy;
+  std::shared_ptr<TrivialTrace<double>> trace = ReverseAD::trace_off<double>();
+  BaseHessianPlan<double> plan(trace);
+  for (size_t i = 0; i < 3; i++) {
+    x[i] += 0.1;
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        BaseFunctionReplay::replay_ind<double>(trace, &vy, 1, x, n);
+    BaseReverseHessian<double> hessian(new_trace);
+    plan.reset_trace(new_trace);
+    check_same(hessian.compute(n, 1), plan.compute(n, 1), 1, 2,
+               "BaseHessianPlan(chain)");
+  }
+  if (plan.get_num_slots() > 50 || plan.get_plan_size() < length) {
+    std::cout << "BaseHessianPlan slots are not recycled : "
+              << plan.get_num_slots() << " slots" << std::endl;
+    exit(-1);
+  }
+}
+
+int main() {
+  // x[1] = 0 : sin''(x[1]) is zero at the point the plan is built
+  double x[4][N] = {{1.0, 0.0, 2.0, 1.5},
+                    {0.5, 1.0, 3.0, 2.5},
+                    {-1.5, 2.0, 0.7, 1.1},
+                    {2.0, -0.3, 1.2, 0.9}};
+  double vy[M];
+  std::shared_ptr<TrivialTrace<double>> trace = fixture_trace(x[0], 1.5, vy);
+  BaseHessianPlan<double> plan(trace);
+  BaseHessianPlan<double> adjoint_plan(trace, 1);
+  BaseHessianPlan<double> weighted_plan(trace);
+  double lambda[2][M] = {{1.0, -2.0}, {0.5, 3.0}};
+  // a tensor still held is not filled again by the next compute()
+  std::shared_ptr<DerivativeTensor<size_t, double>> held;
+  std::shared_ptr<DerivativeTensor<size_t, double>> held_expected;
+  for (size_t i = 0; i < 4; i++) {
+    double y[M];
+    std::shared_ptr<TrivialTrace<double>> new_trace =
+        BaseFunctionReplay::replay_ind<double>(trace, y, M, x[i], N);
+    BaseReverseHessian<double> hessian(new_trace);
+    BaseReverseAdjoint<double> adjoint(new_trace);
+    plan.reset_trace(new_trace);
+    adjoint_plan.reset_trace(new_trace);
+    std::shared_ptr<DerivativeTensor<size_t, double>> expected =
+        hessian.compute(N, M);
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+        plan.compute(N, M);
+    check_same(expected, tensor, M, 2, "BaseHessianPlan");
+    if (i == 1) {
+      held = tensor;
+      held_expected = expected;
+    }
+    check_same(adjoint.compute(N, M), adjoint_plan.compute(N, M), M, 1,
+               "BaseHessianPlan(order 1)");
+
+    BaseReverseHessian<double> weighted(new_trace);
+    weighted.set_dep_weight(lambda[i % 2], M);
+    weighted_plan.reset_trace(new_trace);
+    weighted_plan.set_dep_weight(lambda[i % 2], M);
+    check_same(weighted.compute(N, M), weighted_plan.compute(N, M), 1, 2,
+               "BaseHessianPlan(weighted)");
+  }
+  check_same(held_expected, held, M, 2, "BaseHessianPlan(held)");
+  check_chain();
+  if (!plan.is_built() || plan.get_plan_size() == 0) {
+    std::cout << "BaseHessianPlan was not built!" << std::endl;
+    exit(-1);
+  }
+  std::cout << "BaseHessianPlan OK!" << std::endl;
+  return 0;
+}
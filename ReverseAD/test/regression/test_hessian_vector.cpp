@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::BaseReverseGeneric;
+using ReverseAD::DerivativeTensor;
+
+#define N 4
+#define M 2
+#define K 3
+#define myEps 1e-8
+
+std::shared_ptr<TrivialTrace<double>> foo(double* x) {
+  adouble ax[N];
+  adouble ay[M];
+  double y[M];
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < N; i++) {
+    ax[i] <<= x[i];
+  }
+  ay[0] = ax[0] * ax[1] * ax[2] + sin(ax[3]) * exp(ax[0]);
+  ay[1] = pow(ax[1], 3.0) / ax[2] + log(ax[3]) * ax[0] * ax[0];
+  for (size_t i = 0; i < M; i++) {
+    ay[i] >>= y[i];
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+// dense symmetric tensor of order `order` (order <= 3) of one dependent
+void to_dense(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+              size_t dep, size_t order, std::vector<double>& dense) {
+  size_t size = 0;
+  size_t** tind = nullptr;
+  double* values = nullptr;
+  size_t total = 1;
+  for (size_t i = 0; i < order; i++) {total *= N;}
+  dense.assign(total, 0.0);
+  tensor->get_internal_coordinate_list(dep, order, &size, &tind, &values);
+  for (size_t l = 0; l < size; l++) {
+    size_t p[3];
+    std::copy(tind[l], tind[l] + order, p);
+    std::sort(p, p + order);
+    do {
+      size_t index = 0;
+      for (size_t r = 0; r < order; r++) {
+        index = index * N + p[r];
+      }
+      dense[index] = values[l];
+    } while (std::next_permutation(p, p + order));
+  }
+}
+
+// contracts the last index of a dense tensor with v
+void contract(const std::vector<double>& dense, const double* v,
+              std::vector<double>& result) {
+  result.assign(dense.size() / N, 0.0);
+  for (size_t i = 0; i < result.size(); i++) {
+    for (size_t j = 0; j < N; j++) {
+      result[i] += dense[i * N + j] * v[j];
+    }
+  }
+}
+
+void check(double a, double b, const char* const name) {
+  if (fabs(a - b) > myEps) {
+    std::cout << name << " error : " << a << " vs " << b << std::endl;
+    exit(-1);
+  }
+}
+
+int main() {
+  double x[N] = {1.0, 2.0, 3.0, 4.0};
+  double v[K][N] = {{1.0, 0.0, 0.0, 0.0},
+                    {0.5, -1.0, 2.0, 0.25},
+                    {-1.0, 3.0, 0.0, 1.5}};
+  std::shared_ptr<TrivialTrace<double>> trace = foo(x);
+  BaseReverseHessian<double> hessian(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> h_tensor =
+      hessian.compute(N, M);
+  BaseReverseThird<double> third(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> t_tensor =
+      third.compute(N, M);
+
+  double** hv = new double*[M];
+  double*** tv = new double**[M];
+  double*** hv_k = new double**[M];
+  double**** tv_k = new double***[M];
+  for (size_t d = 0; d < M; d++) {
+    hv[d] = new double[N];
+    tv[d] = new double*[N];
+    hv_k[d] = new double*[N];
+    tv_k[d] = new double**[N];
+    for (size_t i = 0; i < N; i++) {
+      tv[d][i] = new double[N];
+      hv_k[d][i] = new double[K];
+      tv_k[d][i] = new double*[N];
+      for (size_t j = 0; j < N; j++) {
+        tv_k[d][i][j] = new double[K];
+      }
+    }
+  }
+  double* directions[N];
+  double direction_data[N][K];
+  for (size_t i = 0; i < N; i++) {
+    for (size_t k = 0; k < K; k++) {
+      direction_data[i][k] = v[k][i];
+    }
+    directions[i] = direction_data[i];
+  }
+  ReverseAD::forward_over_reverse<K>(trace, N, M, x, directions, hv_k);
+  ReverseAD::forward_over_second<K>(trace, N, M, x, directions, tv_k);
+
+  std::vector<double> dense;
+  std::vector<double> expected;
+  for (size_t k = 0; k < K; k++) {
+    ReverseAD::forward_over_reverse(trace, N, M, x, v[k], hv);
+    ReverseAD::forward_over_second(trace, N, M, x, v[k], tv);
+    std::shared_ptr<DerivativeTensor<size_t, double>> d_tensor =
+        ReverseAD::directional_reverse(trace, 2, N, M, x, v[k]);
+    for (size_t d = 0; d < M; d++) {
+      to_dense(h_tensor, d, 2, dense);
+      contract(dense, v[k], expected);
+      for (size_t i = 0; i < N; i++) {
+        check(hv[d][i], expected[i], "forward_over_reverse");
+        check(hv_k[d][i][k], expected[i], "forward_over_reverse<K>");
+      }
+      to_dense(d_tensor, d, 1, dense);
+      for (size_t i = 0; i < N; i++) {
+        check(dense[i], expected[i], "directional_reverse");
+      }
+      to_dense(t_tensor, d, 3, dense);
+      contract(dense, v[k], expected);
+      for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < N; j++) {
+          check(tv[d][i][j], expected[i * N + j], "forward_over_second");
+          check(tv_k[d][i][j][k], expected[i * N + j],
+                "forward_over_second<K>");
+        }
+      }
+      to_dense(d_tensor, d, 2, dense);
+      for (size_t i = 0; i < N * N; i++) {
+        check(dense[i], expected[i], "directional_reverse");
+      }
+    }
+  }
+  std::cout << "Hessian vector products OK!" << std::endl;
+
+  // fourth order against the generic tensor
+  BaseReverseGeneric<double> generic(trace, 4);
+  std::shared_ptr<DerivativeTensor<size_t, double>> g_tensor =
+      generic.compute(N, M);
+  double**** fv = new double***[M];
+  for (size_t d = 0; d < M; d++) {
+    fv[d] = new double**[N];
+    for (size_t i = 0; i < N; i++) {
+      fv[d][i] = new double*[N];
+      for (size_t j = 0; j < N; j++) {
+        fv[d][i][j] = new double[N];
+      }
+    }
+  }
+  ReverseAD::forward_over_third(trace, N, M, x, v[1], fv);
+  for (size_t d = 0; d < M; d++) {
+    std::vector<double> fourth(N * N * N * N, 0.0);
+    size_t size = 0;
+    size_t** tind = nullptr;
+    double* values = nullptr;
+    g_tensor->get_internal_coordinate_list(d, 4, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      size_t p[4] = {tind[l][0], tind[l][1], tind[l][2], tind[l][3]};
+      std::sort(p, p + 4);
+      do {
+        fourth[((p[0] * N + p[1]) * N + p[2]) * N + p[3]] = values[l];
+      } while (std::next_permutation(p, p + 4));
+    }
+    contract(fourth, v[1], expected);
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
+        for (size_t k = 0; k < N; k++) {
+          check(fv[d][i][j][k], expected[(i * N + j) * N + k],
+                "forward_over_third");
+        }
+      }
+    }
+  }
+  std::cout << "Forward over third OK!" << std::endl;
+
+  for (size_t d = 0; d < M; d++) {
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
+        delete[] tv_k[d][i][j];
+        delete[] fv[d][i][j];
+      }
+      delete[] tv[d][i];
+      delete[] hv_k[d][i];
+      delete[] tv_k[d][i];
+      delete[] fv[d][i];
+    }
+    delete[] hv[d];
+    delete[] tv[d];
+    delete[] hv_k[d];
+    delete[] tv_k[d];
+    delete[] fv[d];
+  }
+  delete[] hv;
+  delete[] tv;
+  delete[] hv_k;
+  delete[] tv_k;
+  delete[] fv;
+  return 0;
+}
@@ -0,0 +1,185 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::NlpDriver;
+
+#define myEps 1e-10
+#define N 5
+#define M 2
+
+void report(const char* const what) {
+  std::cout << "NlpDriver error : " << what << std::endl;
+  exit(-1);
+}
+
+void check_value(double expected, double computed) {
+  if (fabs(expected - computed) > myEps * (1.0 + fabs(expected))) {
+    report("value");
+  }
+}
+
+// hs071 with an extra variable that only enters g[1]
+template <typename T>
+void eval_nlp(const T* x, T& f, T* g) {
+  f = x[0] * x[3] * (x[0] + x[1] + x[2]) + x[2];
+  g[0] = x[0] * x[1] * x[2] * x[3];
+  g[1] = x[0] * x[0] + x[1] * x[1] + x[2] * x[2] + x[3] * x[3] + 3.0 * x[4];
+}
+
+// dense derivatives by hand
+void grad_f(const double* x, double* grad) {
+  grad[0] = x[3] * (2.0 * x[0] + x[1] + x[2]);
+  grad[1] = x[0] * x[3];
+  grad[2] = x[0] * x[3] + 1.0;
+  grad[3] = x[0] * (x[0] + x[1] + x[2]);
+  grad[4] = 0.0;
+}
+
+void jac_g(const double* x, double jac[M][N]) {
+  jac[0][0] = x[1] * x[2] * x[3];
+  jac[0][1] = x[0] * x[2] * x[3];
+  jac[0][2] = x[0] * x[1] * x[3];
+  jac[0][3] = x[0] * x[1] * x[2];
+  jac[0][4] = 0.0;
+  for (size_t i = 0; i < 4; i++) {
+    jac[1][i] = 2.0 * x[i];
+  }
+  jac[1][4] = 3.0;
+}
+
+void hess_l(const double* x, double sigma, const double* lambda,
+            double h[N][N]) {
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      h[i][j] = 0.0;
+    }
+  }
+  h[0][0] = sigma * 2.0 * x[3] + lambda[1] * 2.0;
+  h[1][0] = sigma * x[3] + lambda[0] * x[2] * x[3];
+  h[2][0] = sigma * x[3] + lambda[0] * x[1] * x[3];
+  h[3][0] = sigma * (2.0 * x[0] + x[1] + x[2]) + lambda[0] * x[1] * x[2];
+  h[1][1] = lambda[1] * 2.0;
+  h[2][1] = lambda[0] * x[0] * x[3];
+  h[3][1] = sigma * x[0] + lambda[0] * x[0] * x[2];
+  h[2][2] = lambda[1] * 2.0;
+  h[3][2] = sigma * x[0] + lambda[0] * x[0] * x[1];
+  h[3][3] = lambda[1] * 2.0;
+}
+
+std::shared_ptr<TrivialTrace<double>> record(const double* xval) {
+  adouble x[N];
+  adouble f;
+  adouble g[M];
+  double dummy;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < N; i++) {
+    x[i] <<= xval[i];
+  }
+  eval_nlp(x, f, g);
+  f >>= dummy;
+  for (size_t i = 0; i < M; i++) {
+    g[i] >>= dummy;
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+// the calls of an IPOPT iteration at x, values against the dense ones
+void check_point(NlpDriver<double>& driver, const double* x, double sigma,
+                 const double* lambda, bool jac_first,
+                 const std::vector<int>& jrow, const std::vector<int>& jcol,
+                 const std::vector<int>& hrow, const std::vector<int>& hcol) {
+  double f, g[M], grad[N];
+  double ef, eg[M], egrad[N], ejac[M][N], eh[N][N];
+  eval_nlp(x, ef, eg);
+  grad_f(x, egrad);
+  jac_g(x, ejac);
+  hess_l(x, sigma, lambda, eh);
+
+  std::vector<double> jval(driver.get_nnz_jac());
+  std::vector<double> hval(driver.get_nnz_hess());
+  if (!driver.eval_f(x, f) || !driver.eval_g(x, g)) {
+    report("eval");
+  }
+  // the gradient and the Jacobian share one sweep, either comes first
+  bool ok = (jac_first ?
+      driver.eval_jac_g(x, jval.data()) && driver.eval_grad_f(x, grad) :
+      driver.eval_grad_f(x, grad) && driver.eval_jac_g(x, jval.data()));
+  if (!ok || !driver.eval_h(x, sigma, lambda, hval.data())) {
+    report("derivative");
+  }
+
+  check_value(ef, f);
+  for (size_t i = 0; i < M; i++) {
+    check_value(eg[i], g[i]);
+  }
+  for (size_t i = 0; i < N; i++) {
+    check_value(egrad[i], grad[i]);
+  }
+  // every nonzero is in the structure, the structure only holds them
+  double jsum = 0.0, ejsum = 0.0;
+  for (size_t k = 0; k < jval.size(); k++) {
+    check_value(ejac[jrow[k]][jcol[k]], jval[k]);
+    jsum += fabs(jval[k]);
+  }
+  for (size_t i = 0; i < M; i++) {
+    for (size_t j = 0; j < N; j++) {
+      ejsum += fabs(ejac[i][j]);
+    }
+  }
+  check_value(ejsum, jsum);
+  double hsum = 0.0, ehsum = 0.0;
+  for (size_t k = 0; k < hval.size(); k++) {
+    if (hcol[k] > hrow[k]) {
+      report("upper triangle");
+    }
+    check_value(eh[hrow[k]][hcol[k]], hval[k]);
+    hsum += fabs(hval[k]);
+  }
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j <= i; j++) {
+      ehsum += fabs(eh[i][j]);
+    }
+  }
+  check_value(ehsum, hsum);
+}
+
+int main() {
+  double x0[N] = {1.0, 5.0, 5.0, 1.0, 0.5};
+  std::shared_ptr<TrivialTrace<double>> trace = record(x0);
+
+  // get_nlp_info
+  NlpDriver<double> driver(trace);
+  if (driver.get_n() != N || driver.get_m() != M) {
+    report("size");
+  }
+  // x[4] only enters g[1], linearly
+  if (driver.get_nnz_jac() != 9 || driver.get_nnz_hess() != 10) {
+    report("structure size");
+  }
+  std::vector<int> jrow(driver.get_nnz_jac());
+  std::vector<int> jcol(driver.get_nnz_jac());
+  std::vector<int> hrow(driver.get_nnz_hess());
+  std::vector<int> hcol(driver.get_nnz_hess());
+  driver.get_jac_structure(jrow.data(), jcol.data());
+  driver.get_hess_structure(hrow.data(), hcol.data());
+
+  double lambda[M] = {0.3, -1.2};
+  check_point(driver, x0, 1.0, lambda, false, jrow, jcol, hrow, hcol);
+  double x1[N] = {1.3, 4.1, 3.7, 1.9, -2.0};
+  check_point(driver, x1, 0.5, lambda, true, jrow, jcol, hrow, hcol);
+  // some derivatives vanish here, the structure stays the same
+  double x2[N] = {0.0, 2.0, 0.0, 1.5, 1.0};
+  double lambda2[M] = {0.0, 2.5};
+  check_point(driver, x2, 2.0, lambda2, false, jrow, jcol, hrow, hcol);
+  check_point(driver, x1, 0.5, lambda2, false, jrow, jcol, hrow, hcol);
+
+  std::cout << "NlpDriver OK!" << std::endl;
+  return 0;
+}
@@ -10,6 +10,53 @@ extern double myEps;
 
 void check_value(size_t, std::shared_ptr<DerivativeTensor<size_t, double>>, double, bool&);
 
+// test_util.cpp
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name);
+
+// 5 inputs, 2 outputs and 43 statements
+std::shared_ptr<TrivialTrace<double>> chain_trace() {
+  const size_t n = 5;
+  adouble x[n];
+  adouble y[2];
+  double vy;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    x[i] <<= 0.3 + 0.1 * i;
+  }
+  adouble s = 1.0;
+  for (size_t k = 0; k < 40; k++) {
+    adouble t = x[k % n] * sin(x[(k + 1) % n]) +
+                s / (1.0 + x[(k + 2) % n] * x[(k + 2) % n]);
+    s += t * x[(k + 3) % n];
+  }
+  y[0] = s;
+  y[1] = s * x[0] + exp(x[4]);
+  y[0] >>= vy;
+  y[1] >>= vy;
+  return ReverseAD::trace_off<double>();
+}
+
+// the parallel preaccumulation against the serial one, every block size
+// here but 1 leaves a partial block, and the workers are kept across calls
+template <typename Engine>
+void check_parallel(std::shared_ptr<TrivialTrace<double>> trace,
+                    size_t order, const char* name) {
+  Engine serial(trace);
+  serial.enable_preacc();
+  std::shared_ptr<DerivativeTensor<size_t, double>> expected =
+      serial.compute(5, 2);
+  const size_t threads[3] = {3, 4, 2};
+  const size_t block_size[3] = {7, 1, 1024};
+  for (size_t i = 0; i < 3; i++) {
+    Engine parallel(trace);
+    parallel.enable_parallel_preacc(threads[i], block_size[i]);
+    check_same(expected, parallel.compute(5, 2), 2, order, name);
+    check_same(expected, parallel.compute(5, 2), 2, order, name);
+  }
+}
+
 void check_answer(std::shared_ptr<TrivialTrace<double>> trace,
                   double vx,
                   double vp,
@@ -30,6 +77,12 @@ void check_answer(std::shared_ptr<TrivialTrace<double>> trace,
   check_value(2, tensor, 6*vx*vp, done);
   check_value(3, tensor, 6*vp, done);
 
+  ReverseAD::BaseReverseThird<double> parallel_third(new_trace);
+  parallel_third.enable_parallel_preacc(4, 2);
+  tensor = parallel_third.compute(1, 1);
+  check_value(1, tensor, 3*vx*vx*vp, done);
+  check_value(2, tensor, 6*vx*vp, done);
+  check_value(3, tensor, 6*vp, done);
 }
 int run_function() {
   bool done = false;
@@ -111,5 +164,11 @@ int run_function() {
     }
     testCase++;
   }
+  std::shared_ptr<TrivialTrace<double>> trace = chain_trace();
+  check_parallel<ReverseAD::BaseReverseAdjoint<double>>(
+      trace, 1, "BaseReverseAdjoint(parallel preacc)");
+  check_parallel<ReverseAD::BaseReverseHessian<double>>(
+      trace, 2, "BaseReverseHessian(parallel preacc)");
+  std::cout << "test parallel preacc ok." << std::endl;
   return 0;
 }
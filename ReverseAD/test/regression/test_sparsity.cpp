@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <memory>
+#include <iostream>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseSparsityPattern;
+using ReverseAD::SparsityPattern;
+using ReverseAD::DerivativeTensor;
+
+#define N 6
+#define M 3
+
+std::shared_ptr<TrivialTrace<double>> foo(double* x) {
+  adouble ax[N];
+  adouble ay[M];
+  double y[M];
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < N; i++) {
+    ax[i] <<= x[i];
+  }
+  adouble t = ax[1] * ax[3]; // not used by any dependent
+  ay[0] = ax[0] * ax[1] + sin(ax[2]);
+  ay[1] = ax[3] / ax[4] + 2 * ax[5];
+  ay[2] = exp(ax[0]) * ax[5];
+  for (size_t i = 0; i < M; i++) {
+    ay[i] >>= y[i];
+  }
+  return ReverseAD::trace_off<double>();
+}
+
+bool check_pattern(std::shared_ptr<SparsityPattern> pattern,
+                   std::vector<std::vector<size_t>>& expected) {
+  if (pattern->get_row_size() != expected.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (pattern->get_row(i) != expected[i]) {
+      std::cout << "row " << i << " inconsistent" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool contains(std::shared_ptr<SparsityPattern> pattern, size_t i, size_t j) {
+  const std::vector<size_t>& row = pattern->get_row(i);
+  return std::find(row.begin(), row.end(), j) != row.end();
+}
+
+int main() {
+  double x[N] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+  std::shared_ptr<TrivialTrace<double>> trace = foo(x);
+
+  std::vector<std::vector<size_t>> jac = {{0, 1, 2}, {3, 4, 5}, {0, 5}};
+  std::vector<std::vector<size_t>> hess = {{0}, {0}, {2}, {}, {3, 4}, {0}};
+  for (size_t num_threads = 1; num_threads <= 3; num_threads += 2) {
+    BaseSparsityPattern<double> sparsity(trace);
+    sparsity.set_num_threads(num_threads);
+    if (!check_pattern(sparsity.jacobian_pattern(N, M), jac)) {
+      std::cout << "Jacobian pattern error!" << std::endl;
+      exit(-1);
+    }
+    if (!check_pattern(sparsity.hessian_pattern(N, M), hess)) {
+      std::cout << "Hessian pattern error!" << std::endl;
+      exit(-1);
+    }
+  }
+  std::cout << "Sparsity pattern OK!" << std::endl;
+
+  // numerical nonzeros must be covered by the pattern
+  BaseSparsityPattern<double> sparsity(trace);
+  std::shared_ptr<SparsityPattern> h_pattern = sparsity.hessian_pattern(N, M);
+  std::shared_ptr<SparsityPattern> j_pattern = sparsity.jacobian_pattern(N, M);
+  BaseReverseHessian<double> hessian(trace);
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      hessian.compute(N, M);
+  for (size_t dep = 0; dep < M; dep++) {
+    size_t size;
+    size_t** tind;
+    double* values;
+    tensor->get_internal_coordinate_list(dep, 1, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      if (!contains(j_pattern, dep, tind[l][0])) {
+        std::cout << "Jacobian pattern misses an entry!" << std::endl;
+        exit(-1);
+      }
+    }
+    tensor->get_internal_coordinate_list(dep, 2, &size, &tind, &values);
+    for (size_t l = 0; l < size; l++) {
+      if (!contains(h_pattern, tind[l][0], tind[l][1])) {
+        std::cout << "Hessian pattern misses an entry!" << std::endl;
+        exit(-1);
+      }
+    }
+  }
+  std::cout << "Sparsity pattern covers BaseReverseHessian OK!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseGeneric;
+using ReverseAD::BaseTaylorTensor;
+using ReverseAD::DerivativeTensor;
+
+#define myEps 1e-8
+#define ORDER 4
+
+typedef std::map<std::vector<size_t>, double> Entries;
+
+Entries to_map(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+               size_t dep, size_t order) {
+  Entries ret;
+  size_t size;
+  size_t** tind;
+  double* values;
+  for (size_t k = 1; k <= order; k++) {
+    tensor->get_internal_coordinate_list(dep, k, &size, &tind, &values);
+    for (size_t i = 0; i < size; i++) {
+      ret[std::vector<size_t>(tind[i], tind[i] + k)] = values[i];
+    }
+  }
+  return ret;
+}
+
+// BaseReverseGeneric only reports the nonzeros, the Taylor tensor is dense
+void check_same(const Entries& generic, const Entries& taylor) {
+  for (const auto& kv : generic) {
+    if (taylor.find(kv.first) == taylor.end()) {
+      std::cout << "BaseTaylorTensor missing index!" << std::endl;
+      exit(-1);
+    }
+  }
+  for (const auto& kv : taylor) {
+    auto found = generic.find(kv.first);
+    double expected = (found == generic.end() ? 0.0 : found->second);
+    if (fabs(expected - kv.second) > myEps * (1.0 + fabs(expected))) {
+      std::cout << "BaseTaylorTensor error : " << kv.second
+                << " != " << expected << std::endl;
+      exit(-1);
+    }
+  }
+}
+
+// at the highest order, against BaseReverseGeneric
+void check_max_order() {
+  const size_t n = 3;
+  const size_t order = REVERSEAD_MAX_GENERIC_ORDER;
+  adouble x[n];
+  adouble y;
+  double vy;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    x[i] <<= 0.4 + 0.2 * i;
+  }
+  y = sin(x[0] * x[1]) * exp(x[2]) + x[0] / (x[1] + x[2])
+      + sqrt(x[0] + x[2]) * log(x[1]);
+  y >>= vy;
+  std::shared_ptr<TrivialTrace<double>> trace =
+      ReverseAD::trace_off<double>();
+
+  BaseReverseGeneric<double> generic(trace, order);
+  BaseTaylorTensor<double> taylor(trace, order);
+  check_same(to_map(generic.compute(n, 1), 0, order),
+             to_map(taylor.compute(n, 1), 0, order));
+}
+
+int main() {
+  const size_t n = 4;
+  adouble x[n];
+  adouble y1, y2;
+  double vy1, vy2;
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < n; i++) {
+    x[i] <<= 0.3 + 0.1 * i;
+  }
+  y1 = sin(x[0] * x[1]) + exp(x[2]) / (x[3] + 1.0)
+       + log(x[1] + x[2]) * sqrt(x[0]) + pow(x[3], 2.5) + pow(x[0], x[1]);
+  y2 = atan(x[0]) * cos(x[3]) + asin(x[1]) - acos(x[2] * 0.5)
+       + erf(x[0] * x[3]) + 2.0 / x[1] + pow(2.0, x[2])
+       + fabs(x[3] - 1.0) * x[0] * x[1] * x[2];
+  y1 >>= vy1;
+  y2 >>= vy2;
+  std::shared_ptr<TrivialTrace<double>> trace =
+      ReverseAD::trace_off<double>();
+
+  BaseReverseGeneric<double> generic(trace, ORDER);
+  std::shared_ptr<DerivativeTensor<size_t, double>> expected =
+      generic.compute(n, 2);
+  for (size_t num_threads = 1; num_threads <= 3; num_threads += 2) {
+    BaseTaylorTensor<double> taylor(trace, ORDER);
+    taylor.set_num_threads(num_threads);
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+        taylor.compute(n, 2);
+    if (fabs(tensor->get_dep_value(0) - vy1) > myEps ||
+        fabs(tensor->get_dep_value(1) - vy2) > myEps) {
+      std::cout << "BaseTaylorTensor value error!" << std::endl;
+      exit(-1);
+    }
+    for (size_t dep = 0; dep < 2; dep++) {
+      check_same(to_map(expected, dep, ORDER), to_map(tensor, dep, ORDER));
+    }
+  }
+  check_max_order();
+  std::cout << "BaseTaylorTensor OK!" << std::endl;
+  return 0;
+}
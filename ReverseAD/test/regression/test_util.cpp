@@ -1,4 +1,18 @@
+#include <cmath>
 #include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::DerivativeTensor;
+
+extern double myEps;
+
+typedef std::map<std::vector<size_t>, double> SparseTensor;
 
 void symmetric_third_vector(
     size_t n, size_t t_size, size_t** t_ind, double* t_value,
@@ -44,3 +58,74 @@ void symmetric_matrix_vector(
     }
   }
 }
+
+// y0 = t*x2/x3 + x2^x3 - acos(x1/4), t = x0*x0 + sin(x1)*p
+// y1 = exp(x1)*sqrt(x2) - log(x3) + 3/x0 + t*t + erf(x1)*|x0| - x3^p
+std::shared_ptr<TrivialTrace<double>> fixture_trace(
+    const double* x, double vp, double* y) {
+  adouble ax[4];
+  adouble ay[2];
+  ReverseAD::trace_on<double>();
+  adouble p = adouble::markParam(vp);
+  for (size_t i = 0; i < 4; i++) {
+    ax[i] <<= x[i];
+  }
+  adouble t = ax[0] * ax[0] + sin(ax[1]) * p;
+  ay[0] = t * ax[2] / ax[3] + pow(ax[2], ax[3]) - acos(ax[1] / 4.0);
+  ay[0] >>= y[0];
+  ay[1] = exp(ax[1]) * sqrt(ax[2]) - log(ax[3]) + 3.0 / ax[0];
+  ay[1] += t * t + erf(ax[1]) * fabs(ax[0]) - pow(ax[3], p);
+  ay[1] >>= y[1];
+  return ReverseAD::trace_off<double>();
+}
+
+// the entries of orders 1 to order of one dependent
+SparseTensor to_map(std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                    size_t dep, size_t order) {
+  SparseTensor ret;
+  size_t size = 0;
+  size_t** tind = nullptr;
+  double* values = nullptr;
+  for (size_t k = 1; k <= order; k++) {
+    tensor->get_internal_coordinate_list(dep, k, &size, &tind, &values);
+    for (size_t i = 0; i < size; i++) {
+      ret[std::vector<size_t>(tind[i], tind[i] + k)] = values[i];
+    }
+  }
+  return ret;
+}
+
+// an explicit zero is the same as a missing entry
+bool same_entries(const SparseTensor& expected, const SparseTensor& computed) {
+  for (const auto& kv : expected) {
+    auto found = computed.find(kv.first);
+    double v = (found == computed.end() ? 0.0 : found->second);
+    if (fabs(v - kv.second) > myEps * (1.0 + fabs(kv.second))) {
+      return false;
+    }
+  }
+  for (const auto& kv : computed) {
+    if (fabs(kv.second) > myEps && expected.find(kv.first) == expected.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void check_same(std::shared_ptr<DerivativeTensor<size_t, double>> expected,
+                std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+                size_t dep_num, size_t order, const char* name) {
+  for (size_t dep = 0; dep < dep_num; dep++) {
+    if (fabs(expected->get_dep_value(dep) - tensor->get_dep_value(dep))
+            > myEps) {
+      std::cout << name << " dependent value error at dep " << dep
+                << std::endl;
+      exit(-1);
+    }
+    if (!same_entries(to_map(expected, dep, order),
+                      to_map(tensor, dep, order))) {
+      std::cout << name << " derivative error at dep " << dep << std::endl;
+      exit(-1);
+    }
+  }
+}
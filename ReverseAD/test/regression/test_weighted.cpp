@@ -0,0 +1,138 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "reversead/reversead.hpp"
+
+using ReverseAD::adouble;
+using ReverseAD::TrivialTrace;
+using ReverseAD::BaseReverseMode;
+using ReverseAD::BaseReverseAdjoint;
+using ReverseAD::BaseReverseHessian;
+using ReverseAD::BaseReverseThird;
+using ReverseAD::BaseReverseGeneric;
+using ReverseAD::BaseReverseTensor;
+using ReverseAD::DerivativeTensor;
+
+#define N 3
+#define M 3
+#define myEps 1e-10
+
+std::shared_ptr<TrivialTrace<double>> foo(double* x) {
+  adouble ax[N];
+  adouble ay[M];
+  double y[M];
+  ReverseAD::trace_on<double>();
+  for (size_t i = 0; i < N; i++) {
+    ax[i] <<= x[i];
+  }
+  ay[0] = ax[0] * ax[0] * ax[1] + exp(ax[2]);
+  ay[0] >>= y[0];
+  // uses a dependent as an intermediate
+  ay[1] = ay[0] * sin(ax[1]) + ax[2] / ax[0];
+  ay[1] >>= y[1];
+  ay[2] = pow(ax[1], 3.0) * log(ax[2]);
+  ay[2] >>= y[2];
+  return ReverseAD::trace_off<double>();
+}
+
+typedef std::map<std::vector<size_t>, double> SparseTensor;
+
+// sum over dependents of weight * tensor entries, for every order
+std::vector<SparseTensor> combine(
+    std::shared_ptr<DerivativeTensor<size_t, double>> tensor,
+    size_t order, const double* weight, size_t dep_num, double& value) {
+  std::vector<SparseTensor> ret(order);
+  value = 0.0;
+  for (size_t d = 0; d < dep_num; d++) {
+    value += weight[d] * tensor->get_dep_value(d);
+    for (size_t k = 1; k <= order; k++) {
+      size_t size = 0;
+      size_t** tind = nullptr;
+      double* values = nullptr;
+      tensor->get_internal_coordinate_list(d, k, &size, &tind, &values);
+      for (size_t l = 0; l < size; l++) {
+        ret[k - 1][std::vector<size_t>(tind[l], tind[l] + k)] +=
+            weight[d] * values[l];
+      }
+    }
+  }
+  return ret;
+}
+
+void check_weighted(BaseReverseMode<double>& plain,
+                    BaseReverseMode<double>& weighted,
+                    size_t order, const double* weight, const char* name) {
+  std::shared_ptr<DerivativeTensor<size_t, double>> tensor =
+      plain.compute(N, M);
+  double v1, v2;
+  std::vector<SparseTensor> expected = combine(tensor, order, weight, M, v1);
+  weighted.set_dep_weight(weight, M);
+  tensor = weighted.compute(N, M);
+  if (tensor->get_dep_size() != 1) {
+    std::cout << name << " weighted tensor should have one dependent"
+              << std::endl;
+    exit(-1);
+  }
+  double one = 1.0;
+  std::vector<SparseTensor> result = combine(tensor, order, &one, 1, v2);
+  if (fabs(v1 - v2) > myEps) {
+    std::cout << name << " weighted value error!" << std::endl;
+    exit(-1);
+  }
+  for (size_t k = 0; k < order; k++) {
+    for (auto& kv : expected[k]) {
+      if (fabs(kv.second - result[k][kv.first]) > myEps) {
+        std::cout << name << " weighted order " << k + 1 << " error!"
+                  << std::endl;
+        exit(-1);
+      }
+    }
+    for (auto& kv : result[k]) {
+      if (fabs(kv.second - expected[k][kv.first]) > myEps) {
+        std::cout << name << " weighted order " << k + 1 << " error!"
+                  << std::endl;
+        exit(-1);
+      }
+    }
+  }
+  std::cout << name << " weighted OK!" << std::endl;
+}
+
+int main() {
+  double x[N] = {1.5, 0.7, 2.0};
+  double lambda[M] = {1.0, -2.5, 0.5};
+  double mu[M] = {0.0, 3.0, -1.0};
+  std::shared_ptr<TrivialTrace<double>> trace = foo(x);
+  {
+    BaseReverseAdjoint<double> plain(trace);
+    BaseReverseAdjoint<double> weighted(trace);
+    check_weighted(plain, weighted, 1, lambda, "BaseReverseAdjoint");
+  }
+  {
+    BaseReverseHessian<double> plain(trace);
+    BaseReverseHessian<double> weighted(trace);
+    check_weighted(plain, weighted, 2, lambda, "BaseReverseHessian");
+    // new weights without retracing
+    check_weighted(plain, weighted, 2, mu, "BaseReverseHessian");
+    weighted.enable_preacc();
+    check_weighted(plain, weighted, 2, lambda, "BaseReverseHessian(preacc)");
+  }
+  {
+    BaseReverseThird<double> plain(trace);
+    BaseReverseThird<double> weighted(trace);
+    check_weighted(plain, weighted, 3, lambda, "BaseReverseThird");
+  }
+  {
+    BaseReverseGeneric<double> plain(trace, 3);
+    BaseReverseGeneric<double> weighted(trace, 3);
+    check_weighted(plain, weighted, 3, lambda, "BaseReverseGeneric");
+  }
+  {
+    BaseReverseTensor<double> plain(trace, 3);
+    BaseReverseTensor<double> weighted(trace, 3);
+    check_weighted(plain, weighted, 3, mu, "BaseReverseTensor");
+  }
+  return 0;
+}